@@ -0,0 +1,312 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+// Micro-benchmarks of the hot paths of cthyb: the trace, the determinants, the global moves and the measures.
+//
+// For each model (those of benchmark/, in C++) and inverse temperature, a short run of the solver records its final
+// configuration, which is then loaded in a fresh qmc_data: the benchmarks run on that configuration, with a fixed seed.
+// Each benchmark reports ns/op, and GFLOP/s for the trace when cthyb is compiled with Performance_counters.
+//
+// Usage: cthyb_bench [model ...]     models: anderson, kanamori, kanamori_3, kanamori_5 (default: all)
+
+#include <triqs_cthyb/solver_core.hpp>
+#include <triqs_cthyb/qmc_data.hpp>
+#include <triqs_cthyb/moves/global.hpp>
+#include <triqs_cthyb/measures/G_tau.hpp>
+#include <triqs_cthyb/measures/G_l.hpp>
+#include <triqs_cthyb/measures/G_iw_nfft.hpp>
+#include <triqs_cthyb/measures/O_tau_ins.hpp>
+#include <triqs_cthyb/measures/density_matrix.hpp>
+#ifdef CTHYB_G2_NFFT
+#include <triqs_cthyb/measures/G2_iw_nfft.hpp>
+#include <triqs_cthyb/measures/G2_tau.hpp>
+#endif
+
+#include <triqs/gfs.hpp>
+#include <triqs/mpi/base.hpp>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace triqs_cthyb;
+using namespace triqs::gfs;
+using triqs::operators::c;
+using triqs::operators::c_dag;
+using triqs::operators::n;
+
+// ------------------------------------------------------------------------------------------------
+// Models
+
+struct model_t {
+  std::string name;
+  gf_struct_t gf_struct;
+  many_body_op_t h_int;
+  double mu, V, epsilon;                     // chemical potential, and the symmetric bath levels V^2 / (iw -+ epsilon)
+  indices_map_t spin_flip;                   // for move_global
+  many_body_op_t O1, O2;                     // for the O_tau measure
+};
+
+// Kanamori interaction on n_orb orbitals, one block per spin and orbital (as test/c++/kanamori.cpp)
+model_t kanamori(int n_orb, std::string name) {
+  double U = 2.0, J = 0.2;
+  auto bl  = [](std::string s, int o) { return s + "-" + std::to_string(o); };
+  auto N   = [&](std::string s, int o) { return n(bl(s, o), 0); };
+  auto C   = [&](std::string s, int o) { return c(bl(s, o), 0); };
+  auto Cd  = [&](std::string s, int o) { return c_dag(bl(s, o), 0); };
+
+  model_t m{name, {}, {}, U / 2 + (n_orb - 1) * (1.5 * U - 5 * J) / 2, 1.0, 2.3, {}, {}, {}};
+  for (int o = 0; o < n_orb; ++o) m.gf_struct.push_back({bl("down", o), {0}});
+  for (int o = 0; o < n_orb; ++o) m.gf_struct.push_back({bl("up", o), {0}});
+  for (int o = 0; o < n_orb; ++o) m.h_int += U * N("up", o) * N("down", o);
+  for (int o1 = 0; o1 < n_orb; ++o1)
+    for (int o2 = 0; o2 < n_orb; ++o2) {
+      if (o1 == o2) continue;
+      m.h_int += (U - 2 * J) * N("up", o1) * N("down", o2);
+      if (o2 < o1) m.h_int += (U - 3 * J) * (N("up", o1) * N("up", o2) + N("down", o1) * N("down", o2));
+      m.h_int += -J * Cd("up", o1) * Cd("down", o1) * C("up", o2) * C("down", o2);
+      m.h_int += -J * Cd("up", o1) * Cd("down", o2) * C("up", o2) * C("down", o1);
+    }
+  for (int o = 0; o < n_orb; ++o) {
+    m.spin_flip[{bl("up", o), "0"}]   = {bl("down", o), "0"};
+    m.spin_flip[{bl("down", o), "0"}] = {bl("up", o), "0"};
+    m.O1 += N("up", o) - N("down", o);
+  }
+  m.O2 = m.O1;
+  return m;
+}
+
+// One correlated site (as benchmark/anderson)
+model_t anderson() {
+  double U = 2.0;
+  model_t m{"anderson", {{"up", {0}}, {"dn", {0}}}, U * n("up", 0) * n("dn", 0), U / 2, 1.0, 2.3, {}, {}, {}};
+  m.spin_flip[{"up", "0"}] = {"dn", "0"};
+  m.spin_flip[{"dn", "0"}] = {"up", "0"};
+  m.O1                     = n("up", 0) - n("dn", 0);
+  m.O2                     = m.O1;
+  return m;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Timing
+
+using bench_clock = std::chrono::steady_clock;
+
+// Runs f until at least min_time seconds have passed, after a warmup. Returns the seconds per call.
+double time_per_call(std::function<void()> const &f, double min_time = 0.2) {
+  for (int i = 0; i < 10; ++i) f();
+  long n_calls = 0;
+  auto start   = bench_clock::now();
+  double t     = 0;
+  for (long n = 16; t < min_time; n *= 2) {
+    for (long i = 0; i < n; ++i) f();
+    n_calls += n;
+    t = std::chrono::duration<double>(bench_clock::now() - start).count();
+  }
+  return t / n_calls;
+}
+
+void report(std::string const &bench, model_t const &m, double beta, int order, double seconds, double flops_per_call = -1) {
+  std::printf("%-32s %-12s beta=%-6g order=%-5d %12.1f ns/op", bench.c_str(), m.name.c_str(), beta, order, seconds * 1e9);
+  if (flops_per_call >= 0) std::printf("  %8.3f GFLOP/s", flops_per_call / seconds * 1e-9);
+  std::printf("\n");
+}
+
+// ------------------------------------------------------------------------------------------------
+
+void run_benchmarks(model_t const &m, double beta) {
+
+  int n_iw = 200, n_tau = 2001;
+  solver_core solver({beta, m.gf_struct, n_iw, n_tau, 50});
+
+  triqs::clef::placeholder<0> om_;
+  auto g0_iw = gf<imfreq>{{beta, Fermion, n_iw}, {1, 1}};
+  g0_iw(om_) << om_ + m.mu - (m.V * m.V / 2 / (om_ - m.epsilon) + m.V * m.V / 2 / (om_ + m.epsilon));
+  for (int b = 0; b < int(m.gf_struct.size()); ++b) solver.G0_iw()[b] = triqs::gfs::inverse(g0_iw);
+
+  // A short run, to record a configuration of the typical order
+  auto p               = solve_parameters_t(m.h_int, 2000);
+  p.n_warmup_cycles    = 2000;
+  p.length_cycle       = 50;
+  p.random_seed        = 1234;
+  p.partition_method   = "autopartition";
+  p.use_norm_as_weight = true;
+  p.measure_density_matrix = true;
+  p.verbosity              = 0;
+  p.configuration_file     = "cthyb_bench_" + m.name;
+  solver.solve(p);
+
+  configuration_record_t record;
+  {
+    triqs::h5::file f(p.configuration_file + "." + std::to_string(triqs::mpi::communicator().rank()) + ".h5", H5F_ACC_RDONLY);
+    h5_read(triqs::h5::group(f), "configuration", record);
+  }
+
+  // A fresh Markov chain state on the recorded configuration
+  auto const &h_diag = solver.h_loc_diagonalization();
+  auto fops          = h_diag.get_fops();
+  std::map<std::pair<int, int>, int> linindex;
+  std::vector<int> n_inner;
+  for (int b = 0; b < int(m.gf_struct.size()); ++b) {
+    auto const &[name, indices] = m.gf_struct[b];
+    for (int i = 0; i < int(indices.size()); ++i) linindex[{b, i}] = fops[{name, indices[i]}];
+    n_inner.push_back(indices.size());
+  }
+  qmc_data data(beta, p, h_diag, linindex, solver.Delta_tau(), n_inner, nullptr);
+  if (!data.load_configuration(record, p)) std::cerr << m.name << ": the recorded configuration could not be loaded, using the empty one" << std::endl;
+  int order = data.config.size() / 2;
+
+  triqs::mc_tools::random_generator rng("", 4321);
+  auto random_op = [&](int b, bool dagger) {
+    int inner = rng(n_inner[b]);
+    return op_desc{b, inner, dagger, linindex[{b, inner}]};
+  };
+  int n_blocks = m.gf_struct.size();
+
+  // flops of the trace per call of f, if they are counted
+  auto trace_flops = [&](std::function<void()> const &f) -> double {
+    if (!performance_counters_enabled) return -1;
+    auto before = data.imp_trace.get_counters();
+    for (int i = 0; i < 100; ++i) f();
+    return (data.imp_trace.get_counters().flops - before.flops) / 100;
+  };
+
+  // -------- impurity_trace --------
+
+  {
+    auto f = [&] {
+      int b = rng(n_blocks);
+      try {
+        data.imp_trace.try_insert(data.tau_seg.get_random_pt(rng), random_op(b, true));
+        data.imp_trace.try_insert(data.tau_seg.get_random_pt(rng), random_op(b, false));
+        data.imp_trace.compute();
+      } catch (rbt_insert_error const &) {}
+      data.imp_trace.cancel_insert();
+    };
+    double fl = trace_flops(f);
+    report("trace try_insert+compute", m, beta, order, time_per_call(f), fl);
+  }
+
+  if (order > 0) {
+    auto f = [&] {
+      int b = rng(n_blocks);
+      int k = data.dets[b].size();
+      if (k == 0) return;
+      data.imp_trace.try_delete(rng(k), b, false);
+      data.imp_trace.try_delete(rng(k), b, true);
+      data.imp_trace.compute();
+      data.imp_trace.cancel_delete();
+    };
+    double fl = trace_flops(f);
+    report("trace try_delete+compute", m, beta, order, time_per_call(f), fl);
+  }
+
+  {
+    move_global mv("spin flip", m.spin_flip, data, rng);
+    auto f = [&] {
+      mv.attempt();
+      mv.reject();
+    };
+    report("move_global attempt+reject", m, beta, order, time_per_call(f));
+  }
+
+  // -------- det_manip through delta_block_adaptor --------
+
+  {
+    auto f = [&] {
+      int b   = rng(n_blocks);
+      auto &d = data.dets[b];
+      d.try_insert(rng(d.size() + 1), rng(d.size() + 1), {data.tau_seg.get_random_pt(rng), rng(n_inner[b])},
+                   {data.tau_seg.get_random_pt(rng), rng(n_inner[b])});
+      d.reject_last_try();
+    };
+    report("det try_insert", m, beta, order, time_per_call(f));
+  }
+
+  if (order > 0) {
+    auto f = [&] {
+      int b   = rng(n_blocks);
+      auto &d = data.dets[b];
+      if (d.size() == 0) return;
+      d.try_remove(rng(d.size()), rng(d.size()));
+      d.reject_last_try();
+    };
+    report("det try_remove", m, beta, order, time_per_call(f));
+  }
+
+  // -------- measures --------
+
+  auto bench_measure = [&](std::string const &name, auto &&measure) {
+    report("accumulate " + name, m, beta, order, time_per_call([&] { measure.accumulate(1.0); }));
+  };
+
+  {
+    std::optional<G_tau_G_target_t> G_tau;
+    bench_measure("G_tau", measure_G_tau{G_tau, data, n_tau, m.gf_struct});
+  }
+  {
+    std::optional<G_l_t> G_l;
+    bench_measure("G_l", measure_G_l{G_l, data, 50, m.gf_struct});
+  }
+  {
+    std::optional<G_iw_t> G_iw;
+    bench_measure("G_iw_nfft", measure_G_iw_nfft{G_iw, data, n_iw, m.gf_struct});
+  }
+  {
+    std::optional<gf<imtime, scalar_valued>> O_tau;
+    bench_measure("O_tau_ins", measure_O_tau_ins{O_tau, data, 101, m.O1, m.O2, 10, true, rng});
+  }
+  {
+    std::vector<matrix_t> dm;
+    bench_measure("density_matrix", measure_density_matrix{data, dm});
+  }
+#ifdef CTHYB_G2_NFFT
+  {
+    auto p2                           = p;
+    p2.measure_G2_n_fermionic         = 10;
+    p2.measure_G2_n_bosonic           = 5;
+    p2.measure_G2_n_tau               = 20;
+    G2_measures_t G2_measures(solver.Delta_tau(), m.gf_struct, p2);
+    std::optional<G2_iw_t> G2_iw;
+    bench_measure("G2_iw_nfft", measure_G2_iw_nfft<G2_channel::AllFermionic>{G2_iw, data, G2_measures});
+    std::optional<G2_tau_t> G2_tau;
+    bench_measure("G2_tau", measure_G2_tau{G2_tau, data, G2_measures});
+  }
+#endif
+}
+
+// ------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+  triqs::mpi::environment env(argc, argv);
+
+  std::vector<model_t> all = {anderson(), kanamori(2, "kanamori"), kanamori(3, "kanamori_3"), kanamori(5, "kanamori_5")};
+  std::vector<model_t> models;
+  for (int i = 1; i < argc; ++i)
+    for (auto const &m : all)
+      if (m.name == argv[i]) models.push_back(m);
+  if (argc == 1) models = all;
+
+  for (auto const &m : models)
+    for (double beta : {10.0, 40.0}) run_benchmarks(m, beta);
+}
@@ -0,0 +1,370 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+// Replay of a trajectory saved by a build of cthyb with SAVE_CONFIGS, for performance regression tracking.
+//
+// The file (configs.h5) holds the problem (parameters, h_diag, Delta_tau) and the configurations c_0, c_1, ... visited by a solve.
+// The transitions between successive configurations are replayed, without any random number, through impurity_trace and the dets,
+// as the moves do: insertion and removal of one or two pairs, shift of an operator, global replacement of operators.
+// A transition of another kind restarts the replay from the configuration (not timed). A configuration which cannot be loaded is
+// skipped (counted in n_skipped), and the replay restarts from the next one. Every check_interval transitions, the state
+// is compared with the one rebuilt from scratch. The result is written to stdout as JSON: run it with two builds to compare them.
+//
+// Usage: cthyb_replay [configs.h5] [--check-interval n] [--tolerance t] [--repeat n]
+
+#include <triqs_cthyb/qmc_data.hpp>
+#include <triqs_cthyb/parameters.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace triqs_cthyb;
+using namespace triqs::gfs;
+using oplist_t = configuration::flat_oplist_t;
+
+// ------------------------------------------------------------------------------------------------
+
+struct problem_t {
+  constr_parameters_t constr_parameters;
+  solve_parameters_t params;
+  atom_diag h_diag;
+  block_gf<imtime> Delta_tau;
+  std::map<std::pair<int, int>, int> linindex;
+  std::vector<int> n_inner;
+  std::vector<configuration_record_t> records;
+};
+
+problem_t read_problem(std::string const &file_name) {
+  problem_t pb;
+  triqs::h5::file f(file_name, H5F_ACC_RDONLY);
+  triqs::h5::group g(f);
+  h5_read(g, "constr_parameters", pb.constr_parameters);
+  h5_read(g, "solve_parameters", pb.params);
+  h5_read(g, "h_diag", pb.h_diag);
+  h5_read(g, "Delta_tau", pb.Delta_tau);
+  for (int id = 0; g.has_key("c_" + std::to_string(id)); ++id) {
+    pb.records.emplace_back();
+    h5_read(g, "c_" + std::to_string(id), pb.records.back());
+  }
+
+  // as in solver_core
+  auto fops = pb.h_diag.get_fops();
+  int b     = 0;
+  for (auto const &bl : pb.constr_parameters.gf_struct) {
+    int i = 0;
+    for (auto const &a : bl.second) pb.linindex[{b, i++}] = fops[{bl.first, a}];
+    pb.n_inner.push_back(bl.second.size());
+    ++b;
+  }
+  return pb;
+}
+
+// The data in the configuration r, or nullptr if it cannot be loaded. A configuration whose weight is not positive is loaded
+// all the same: load_configuration refuses it as the start of a Markov chain, but the trajectory may visit it (with a sign).
+std::unique_ptr<qmc_data> make_data(problem_t const &pb, configuration_record_t const &r) {
+  auto data = std::make_unique<qmc_data>(pb.constr_parameters.beta, pb.params, pb.h_diag, pb.linindex, pb.Delta_tau, pb.n_inner, nullptr);
+  if (!data->load_configuration(r, pb.params) && (int(data->config.size()) != r.size())) return nullptr;
+  return data;
+}
+
+// ------------------------------------------------------------------------------------------------
+// Transitions
+
+// The operators removed, added and replaced (same time, other operator) from old_ops to new_ops, both in decreasing time order
+struct diff_t {
+  oplist_t removed, added;
+  configuration::oplist_t replaced;
+};
+
+diff_t make_diff(oplist_t const &old_ops, oplist_t const &new_ops) {
+  diff_t d;
+  auto same = [](op_desc const &x, op_desc const &y) { return x.block_index == y.block_index && x.inner_index == y.inner_index && x.dagger == y.dagger; };
+  auto o = old_ops.begin(), n = new_ops.begin();
+  while (o != old_ops.end() || n != new_ops.end()) {
+    if (n == new_ops.end() || (o != old_ops.end() && o->first > n->first))
+      d.removed.push_back(*o++);
+    else if (o == old_ops.end() || n->first > o->first)
+      d.added.push_back(*n++);
+    else {
+      if (!same(o->second, n->second)) d.replaced.emplace(n->first, n->second);
+      ++o, ++n;
+    }
+  }
+  return d;
+}
+
+// Rank of the operator at tau among the operators of ops with its block and dagger (its position in the det)
+int rank_in(oplist_t const &ops, time_pt const &tau, op_desc const &op) {
+  int r = 0;
+  for (auto const &[t, o] : ops) {
+    if (!(t > tau)) break;
+    r += (o.block_index == op.block_index && o.dagger == op.dagger);
+  }
+  return r;
+}
+
+// Arguments of the det of block b, for the operators of ops
+void det_args(oplist_t const &ops, int b, std::vector<std::pair<time_pt, int>> &x, std::vector<std::pair<time_pt, int>> &y) {
+  x.clear();
+  y.clear();
+  for (auto const &[tau, op] : ops)
+    if (op.block_index == b) (op.dagger ? x : y).emplace_back(tau, op.inner_index);
+}
+
+// Inserted or removed operators of a det: the c^dagger and the c, with their positions
+struct det_change_t {
+  std::vector<std::pair<int, std::pair<time_pt, int>>> x, y;
+};
+
+std::map<int, det_change_t> det_changes(oplist_t const &ops, oplist_t const &ref) {
+  std::map<int, det_change_t> r;
+  for (auto const &[tau, op] : ops) {
+    auto &c = r[op.block_index];
+    (op.dagger ? c.x : c.y).push_back({rank_in(ref, tau, op), {tau, op.inner_index}});
+  }
+  return r;
+}
+
+// Replays the transition of data to new_ops as the corresponding move, if there is one. Returns its kind, or "" if there is none,
+// in which case data is left unchanged, or "rejected" if the configuration did not change.
+std::string replay(qmc_data &data, oplist_t const &new_ops, diff_t const &d) {
+  auto &tr = data.imp_trace;
+  oplist_t old_ops(data.config.begin(), data.config.end());
+  std::vector<int> changed_blocks;
+  std::string kind;
+  std::pair<h_scalar_t, h_scalar_t> weights; // atomic weight and reweighting of new_ops
+
+  if (d.removed.empty() && d.added.empty() && d.replaced.empty()) return "rejected";
+
+  if (d.removed.empty() && d.added.empty()) { // global move
+    kind = "global";
+    tr.try_replace(d.replaced);
+    std::vector<std::pair<time_pt, int>> x, y;
+    for (auto const &[tau, op] : d.replaced) {
+      auto old_op = std::find_if(old_ops.begin(), old_ops.end(), [&tau = tau](auto const &o) { return o.first == tau; });
+      changed_blocks.push_back(op.block_index);
+      changed_blocks.push_back(old_op->second.block_index);
+    }
+    std::sort(changed_blocks.begin(), changed_blocks.end());
+    changed_blocks.erase(std::unique(changed_blocks.begin(), changed_blocks.end()), changed_blocks.end());
+    for (int b : changed_blocks) {
+      det_args(new_ops, b, x, y);
+      data.dets[b].try_refill(x, y);
+    }
+    weights = tr.compute();
+    tr.confirm_replace();
+    for (auto const &[tau, op] : d.replaced) data.config.replace(tau, op);
+
+  } else if (d.replaced.empty() && (d.removed.empty() || d.added.empty())) { // insertion or removal of pairs
+    bool insert      = d.removed.empty();
+    auto const &ops  = (insert ? d.added : d.removed);
+    auto changes     = det_changes(ops, insert ? new_ops : old_ops); // the positions in the final det for insertions
+    for (auto const &[b, c] : changes)
+      if ((c.x.size() != c.y.size()) || (c.x.size() > 2)) return "";
+    if (ops.size() != 2 && ops.size() != 4) return "";
+    kind = std::string(ops.size() == 2 ? "" : "double ") + (insert ? "insert" : "remove");
+
+    if (insert) {
+      try {
+        for (auto const &[tau, op] : ops) tr.try_insert(tau, op);
+      } catch (rbt_insert_error const &) {
+        tr.cancel_insert();
+        return "";
+      }
+    } else
+      for (auto const &[tau, op] : ops) tr.try_delete(rank_in(old_ops, tau, op), op.block_index, op.dagger);
+
+    for (auto const &[b, c] : changes) {
+      auto &det = data.dets[b];
+      changed_blocks.push_back(b);
+      if (insert && c.x.size() == 1)
+        det.try_insert(c.x[0].first, c.y[0].first, c.x[0].second, c.y[0].second);
+      else if (insert)
+        det.try_insert2(c.x[0].first, c.x[1].first, c.y[0].first, c.y[1].first, c.x[0].second, c.x[1].second, c.y[0].second, c.y[1].second);
+      else if (c.x.size() == 1)
+        det.try_remove(c.x[0].first, c.y[0].first);
+      else
+        det.try_remove2(c.x[0].first, c.x[1].first, c.y[0].first, c.y[1].first);
+    }
+    weights = tr.compute();
+    if (insert) {
+      tr.confirm_insert();
+      for (auto const &[tau, op] : ops) data.config.insert(tau, op);
+    } else {
+      tr.confirm_delete();
+      for (auto const &[tau, op] : ops) data.config.erase(tau);
+    }
+
+  } else if (d.replaced.empty() && d.removed.size() == 1 && d.added.size() == 1) { // shift
+    auto const &[tau_old, op_old] = d.removed[0];
+    auto const &[tau_new, op_new] = d.added[0];
+    if (op_old.block_index != op_new.block_index || op_old.dagger != op_new.dagger) return "";
+    kind  = "shift";
+    int b = op_old.block_index;
+    try {
+      tr.try_shift(rank_in(old_ops, tau_old, op_old), b, op_old.dagger, tau_new, op_new);
+    } catch (rbt_insert_error const &) {
+      tr.cancel_shift();
+      return "";
+    }
+    // The shift move changes a row or a column, and rolls the det when the operator goes through beta:
+    // the det is refilled here, which keeps the order of the operators without replaying the roll.
+    std::vector<std::pair<time_pt, int>> x, y;
+    det_args(new_ops, b, x, y);
+    data.dets[b].try_refill(x, y);
+    changed_blocks.push_back(b);
+    weights = tr.compute();
+    tr.confirm_shift();
+    data.config.erase(tau_old);
+    data.config.insert(tau_new, op_new);
+
+  } else
+    return "";
+
+  for (int b : changed_blocks) data.dets[b].complete_operation();
+  std::tie(data.atomic_weight, data.atomic_reweighting) = weights;
+  data.update_sign();
+  return kind;
+}
+
+double rel_diff(mc_weight_t a, mc_weight_t b) {
+  double s = std::max(std::abs(a), std::abs(b));
+  return (s == 0 ? 0 : std::abs(a - b) / s);
+}
+
+// ------------------------------------------------------------------------------------------------
+
+int main(int argc, char **argv) {
+  triqs::mpi::environment env(argc, argv);
+
+  std::string file_name = "configs.h5";
+  int check_interval = 100, n_repeat = 1;
+  double tolerance = 1e-8;
+  for (int i = 1; i < argc; ++i) {
+    std::string a = argv[i];
+    if (a == "--check-interval" && i + 1 < argc)
+      check_interval = std::max(1, std::atoi(argv[++i]));
+    else if (a == "--tolerance" && i + 1 < argc)
+      tolerance = std::atof(argv[++i]);
+    else if (a == "--repeat" && i + 1 < argc)
+      n_repeat = std::max(1, std::atoi(argv[++i]));
+    else
+      file_name = a;
+  }
+
+  auto pb = read_problem(file_name);
+  if (pb.records.empty()) {
+    std::cerr << file_name << ": no saved configuration" << std::endl;
+    return 1;
+  }
+
+  // The configurations, on the grid of time_pt
+  std::vector<oplist_t> configs(pb.records.size());
+  {
+    auto data = make_data(pb, {pb.constr_parameters.beta, {}, {}, {}, {}});
+    for (int k = 0; k < int(configs.size()); ++k)
+      if (!data->ops_from_record(pb.records[k], configs[k])) {
+        std::cerr << file_name << ": the configuration c_" << k << " does not fit the problem" << std::endl;
+        return 1;
+      }
+  }
+
+  using clock = std::chrono::steady_clock;
+  struct kind_stats_t {
+    long n       = 0;
+    double time = 0;
+  };
+  std::map<std::string, kind_stats_t> stats;
+  long n_restarts = 0, n_skipped = 0, n_checks = 0;
+  double max_diff_trace = 0, max_diff_det = 0, checksum = 0;
+
+  for (int repeat = 0; repeat < n_repeat; ++repeat) {
+    auto data = make_data(pb, pb.records[0]);
+    if (!data && (repeat == 0)) ++n_skipped;
+    for (int k = 1; k < int(configs.size()); ++k) {
+      if (!data) { // restart from the configuration k
+        data = make_data(pb, pb.records[k]);
+        if (!data && (repeat == 0)) ++n_skipped;
+        continue;
+      }
+      auto d     = make_diff(oplist_t(data->config.begin(), data->config.end()), configs[k]);
+      auto start = clock::now();
+      auto kind  = replay(*data, configs[k], d);
+      auto time  = std::chrono::duration<double>(clock::now() - start).count();
+      if (kind.empty()) {
+        data = make_data(pb, pb.records[k]);
+        if (repeat == 0) ++n_restarts;
+        if (!data) {
+          if (repeat == 0) ++n_skipped;
+          continue;
+        }
+      } else {
+        stats[kind].n++;
+        stats[kind].time += time;
+      }
+      if (repeat > 0) continue;
+
+      mc_weight_t w = data->current_sign * data->atomic_weight;
+      for (auto const &det : data->dets) w *= det.determinant();
+      checksum += std::log(std::abs(w));
+
+      // Comparison with the state rebuilt from scratch
+      if ((k % check_interval == 0) || (k + 1 == int(configs.size()))) {
+        auto ref = make_data(pb, pb.records[k]);
+        if (!ref) continue;
+        ++n_checks;
+        max_diff_trace = std::max(max_diff_trace, rel_diff(data->atomic_weight, ref->atomic_weight));
+        for (int b = 0; b < int(data->dets.size()); ++b)
+          max_diff_det = std::max(max_diff_det, rel_diff(data->dets[b].determinant(), ref->dets[b].determinant()));
+      }
+    }
+  }
+
+  long n_moves = 0;
+  double time  = 0;
+  for (auto const &[kind, s] : stats)
+    if (kind != "rejected") {
+      n_moves += s.n;
+      time += s.time;
+    }
+  bool passed = (max_diff_trace <= tolerance) && (max_diff_det <= tolerance);
+
+  std::printf("{\n  \"file\": \"%s\",\n  \"n_configurations\": %d,\n  \"n_restarts\": %ld,\n  \"n_skipped\": %ld,\n", file_name.c_str(),
+              int(configs.size()), n_restarts, n_skipped);
+  std::printf("  \"moves\": {\n");
+  int i = 0;
+  for (auto const &[kind, s] : stats)
+    std::printf("    \"%s\": {\"n\": %ld, \"time\": %.6g, \"moves_per_sec\": %.6g}%s\n", kind.c_str(), s.n, s.time, (s.time > 0 ? s.n / s.time : 0),
+                (++i < int(stats.size()) ? "," : ""));
+  std::printf("  },\n  \"moves_per_sec\": %.6g,\n", (time > 0 ? n_moves / time : 0));
+  std::printf("  \"checks\": {\"n\": %ld, \"max_rel_diff_trace\": %.3g, \"max_rel_diff_det\": %.3g, \"tolerance\": %.3g, \"passed\": %s},\n", n_checks,
+              max_diff_trace, max_diff_det, tolerance, (passed ? "true" : "false"));
+  std::printf("  \"log_weight_checksum\": %.12g\n}\n", checksum);
+  return passed ? 0 : 2;
+}
@@ -0,0 +1,78 @@
+#!/bin/env pytriqs
+
+# Scaling of the threaded walkers (n_walkers) with the number of cores, on one process,
+# for the placements of the walkers (walker_placement). Run on a single process, e.g.
+#   OMP_NUM_THREADS=1 pytriqs kanamori_walkers.py
+# The cycles per second go to kanamori_walkers.dat (a line per number of walkers, a column per placement).
+
+import pytriqs.utility.mpi as mpi
+from pytriqs.operators import n, Operator
+from pytriqs.operators.util.op_struct import set_operator_structure, get_mkind
+from pytriqs.operators.util.hamiltonians import h_int_kanamori
+from triqs_cthyb import SolverCore
+from pytriqs.gf import GfImFreq, iOmega_n, inverse
+import multiprocessing
+import numpy as np
+import time
+
+# Input parameters, as kanamori.py
+beta = 10.0
+num_orbitals = 2
+mu = 1.0
+U = 2.0
+J = 0.2
+V = 1.0
+epsilon = 2.3
+
+spin_names = ("up","dn")
+orb_names = range(num_orbitals)
+
+placements = ("none", "cores", "numa")
+n_cores = multiprocessing.cpu_count()
+n_walkers_list = sorted(set([1, 2] + range(4, n_cores + 1, 4) + [n_cores]))
+n_cycles = 100000  # per walker
+
+gf_struct = set_operator_structure(spin_names,orb_names,False)
+mkind = get_mkind(False,None)
+
+H = h_int_kanamori(spin_names,orb_names,
+                   np.array([[0,U-3*J],[U-3*J,0]]),
+                   np.array([[U,U-2*J],[U-2*J,U]]),
+                   J,False)
+
+QN = [sum([n(*mkind("up",o)) for o in orb_names],Operator()),
+      sum([n(*mkind("dn",o)) for o in orb_names],Operator())]
+for o in orb_names:
+    dn = n(*mkind("up",o)) - n(*mkind("dn",o))
+    QN.append(dn*dn)
+
+S = SolverCore(beta=beta, gf_struct=gf_struct, n_tau=10001, n_iw=1025)
+
+delta_w = GfImFreq(indices = [0], beta=beta, n_points=1025)
+delta_w << (V**2) * inverse(iOmega_n - epsilon) + (V**2) * inverse(iOmega_n + epsilon)
+S.G0_iw << inverse(iOmega_n + mu - delta_w)
+
+p = {}
+p["max_time"] = -1
+p["random_name"] = ""
+p["random_seed"] = 123 * mpi.rank + 567
+p["length_cycle"] = 50
+p["n_warmup_cycles"] = 5000
+p["n_cycles"] = n_cycles
+p["partition_method"] = "quantum_numbers"
+p["quantum_numbers"] = QN
+p["verbosity"] = 0
+
+rates = {}
+for n_walkers in n_walkers_list:
+    for placement in placements:
+        t = time.time()
+        S.solve(h_int=H, n_walkers=n_walkers, walker_placement=placement, **p)
+        rates[n_walkers, placement] = n_walkers * n_cycles / (time.time() - t)
+        mpi.report("%3i walkers, %5s: %10.1f cycles/s" % (n_walkers, placement, rates[n_walkers, placement]))
+
+if mpi.is_master_node():
+    with open("kanamori_walkers.dat", "w") as f:
+        f.write("# n_walkers " + " ".join(placements) + " (cycles per second, warmup included)\n")
+        for n_walkers in n_walkers_list:
+            f.write("%i " % n_walkers + " ".join("%.1f" % rates[n_walkers, pl] for pl in placements) + "\n")
@@ -0,0 +1,289 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <complex>
+#include <map>
+#include <string>
+#include <vector>
+#include <fftw3.h>
+#include <triqs/gfs.hpp>
+
+namespace triqs {
+  namespace experimental {
+
+    // One component of the frequency mesh of nfft_batch_t
+    struct nfft_mesh_dim_t {
+      double beta;
+      bool fermion;
+      long first_index; // Matsubara index of the first frequency
+      long size;
+    };
+
+    inline nfft_mesh_dim_t make_nfft_mesh_dim(triqs::gfs::gf_mesh<triqs::gfs::imfreq> const &m) {
+      return {m.domain().beta, m.domain().statistic == triqs::gfs::Fermion, long(m.first_index()), long(m.size())};
+    }
+
+    // Process-wide pool of the FFTW plans and scratch grids of nfft_batch_t, by shape
+    //
+    // All batches of the same shape (oversampled grid and number of functions) execute one plan, on their own grid
+    // (fftw_execute_dft) or on the scratch grid of the shape. The grids are allocated with fftw_malloc, thus with
+    // the alignment of the array the plan is made for. Plans and scratch grids live as long as the process.
+    // Planning is not thread-safe: the batches must be constructed from one thread.
+    class nfft_plan_pool {
+
+      public:
+      static nfft_plan_pool &instance() {
+        static nfft_plan_pool pool;
+        return pool;
+      }
+
+      // Planner of the new plans: "estimate", "measure" or "patient"
+      void set_planner(std::string const &name) {
+        if (name == "estimate")
+          flags = FFTW_ESTIMATE;
+        else if (name == "measure")
+          flags = FFTW_MEASURE;
+        else if (name == "patient")
+          flags = FFTW_PATIENT;
+        else
+          TRIQS_RUNTIME_ERROR << "nfft_plan_pool: unknown FFTW planner " << name << " (expected estimate, measure or patient)";
+      }
+
+      // Read the wisdom of the file, if it exists. Returns false if the file could not be read.
+      static bool import_wisdom(std::string const &filename) { return fftw_import_wisdom_from_filename(filename.c_str()); }
+
+      // Write the wisdom gathered so far (the imported one included) to the file
+      static void export_wisdom(std::string const &filename) {
+        if (!fftw_export_wisdom_to_filename(filename.c_str())) TRIQS_RUNTIME_ERROR << "nfft_plan_pool: cannot write FFTW wisdom to " << filename;
+      }
+
+      // In-place backward FFT of n_functions interleaved grids of sizes n
+      template <int Rank> fftw_plan plan(std::array<int, Rank> const &n, long n_functions) {
+        auto &p = plans[key(n.data(), Rank, n_functions)];
+        if (!p) {
+          long size = n_functions;
+          for (int r = 0; r < Rank; ++r) size *= n[r];
+          // MEASURE and PATIENT overwrite the array they plan for: plan on a temporary grid
+          auto g = reinterpret_cast<fftw_complex *>(fftw_malloc(sizeof(fftw_complex) * size));
+          p      = fftw_plan_many_dft(Rank, n.data(), n_functions, g, nullptr, n_functions, 1, g, nullptr, n_functions, 1, FFTW_BACKWARD, flags);
+          fftw_free(g);
+        }
+        return p;
+      }
+
+      // Zeroed scratch grid of the shape, shared by all batches of that shape which ask for it
+      template <int Rank> std::complex<double> *scratch(std::array<int, Rank> const &n, long n_functions) {
+        auto &g = scratches[key(n.data(), Rank, n_functions)];
+        if (!g) {
+          long size = n_functions;
+          for (int r = 0; r < Rank; ++r) size *= n[r];
+          g = reinterpret_cast<std::complex<double> *>(fftw_malloc(sizeof(fftw_complex) * size));
+          std::fill(g, g + size, 0);
+        }
+        return g;
+      }
+
+      nfft_plan_pool(nfft_plan_pool const &) = delete;
+      nfft_plan_pool &operator=(nfft_plan_pool const &) = delete;
+
+      ~nfft_plan_pool() {
+        for (auto &x : plans) fftw_destroy_plan(x.second);
+        for (auto &x : scratches) fftw_free(x.second);
+      }
+
+      private:
+      nfft_plan_pool() = default;
+
+      static std::vector<long> key(int const *n, int rank, long n_functions) {
+        std::vector<long> k(n, n + rank);
+        k.push_back(n_functions);
+        return k;
+      }
+
+      unsigned flags = FFTW_ESTIMATE;
+      std::map<std::vector<long>, fftw_plan> plans;
+      std::map<std::vector<long>, std::complex<double> *> scratches;
+    };
+
+    // Adjoint NFFT of many functions at once, onto a common Matsubara frequency mesh
+    //
+    //   F_c(n_1, ..., n_R) += sum_j f_{c,j} exp(i (w_{n_1} tau_{1,j} + ... + w_{n_R} tau_{R,j}))
+    //
+    // A point is spread onto the oversampled grids of its functions when it is pushed, with a Kaiser-Bessel window
+    // of half-width m: the window is evaluated once per point, whatever the number of functions pushed with it.
+    // The spreading being linear, the grids accumulate until flush(), which transforms the grids of all functions
+    // with one batched FFT, deconvolves the window and adds the result to the output. Oversampling factor 2.
+    // The grids are interleaved (the function is the fastest index), so that the values pushed at one point for
+    // consecutive functions are spread with contiguous, vectorizable loops.
+    // The FFTW plan comes from nfft_plan_pool. With shared_grid, the grids are the scratch grid of the pool for the
+    // shape: this is for batches flushed after each series of push_back, which never interleave with another
+    // batch of the same shape.
+    template <int Rank> class nfft_batch_t {
+
+      public:
+      using mesh_dim_t = nfft_mesh_dim_t;
+
+      // The output of function c at the frequency (d_1, ..., d_R) (data indices) is out[(d_1 * size_2 + d_2 ...) * n_functions + c],
+      // or out[(d_1 * size_2 + d_2 ...) * n_functions + out_offsets[c]] when out_offsets is given.
+      nfft_batch_t(std::array<mesh_dim_t, Rank> const &dims, long n_functions, std::complex<double> *out, std::vector<long> out_offsets = {},
+                   int m = 6, bool shared_grid = false)
+         : dims(dims), n_functions(n_functions), out(out), out_offsets(std::move(out_offsets)), m(m), owns_grid(!shared_grid) {
+
+        if (m < 1 || 2 * m + 1 > max_width) TRIQS_RUNTIME_ERROR << "nfft_batch_t: the half-width of the window must be in [1, 16]";
+
+        n_grid = 1;
+        for (int r = 0; r < Rank; ++r) {
+          // bandwidth covering the Matsubara indices of the mesh, in [-N/2, N/2)
+          long N   = 2 * std::max(-dims[r].first_index, dims[r].first_index + dims[r].size);
+          n[r]     = 2 * N;
+          b[r]     = M_PI * (2 - 1 / 2.0);
+          n_grid *= n[r];
+          deconv[r].resize(dims[r].size);
+          for (long d = 0; d < dims[r].size; ++d) {
+            double k     = double(d + dims[r].first_index);
+            double y     = 2 * M_PI * k / n[r];
+            deconv[r][d] = 1 / std::cyl_bessel_i(0.0, m * std::sqrt(b[r] * b[r] - y * y));
+          }
+        }
+
+        auto &pool = nfft_plan_pool::instance();
+        plan       = pool.plan<Rank>(n, n_functions);
+        if (owns_grid) {
+          grid = reinterpret_cast<std::complex<double> *>(fftw_malloc(sizeof(fftw_complex) * n_grid * n_functions));
+          std::fill(grid, grid + n_grid * n_functions, 0);
+        } else
+          grid = pool.scratch<Rank>(n, n_functions);
+      }
+
+      ~nfft_batch_t() {
+        if (grid && owns_grid) fftw_free(grid);
+      }
+
+      // Owns its grids, unless shared
+      nfft_batch_t(nfft_batch_t const &) = delete;
+      nfft_batch_t &operator=(nfft_batch_t const &) = delete;
+      nfft_batch_t(nfft_batch_t &&x) noexcept { *this = std::move(x); }
+      nfft_batch_t &operator=(nfft_batch_t &&x) noexcept {
+        std::swap(dims, x.dims);
+        std::swap(n_functions, x.n_functions);
+        std::swap(out, x.out);
+        std::swap(out_offsets, x.out_offsets);
+        std::swap(m, x.m);
+        std::swap(n, x.n);
+        std::swap(b, x.b);
+        std::swap(n_grid, x.n_grid);
+        std::swap(deconv, x.deconv);
+        std::swap(grid, x.grid);
+        std::swap(plan, x.plan);
+        std::swap(owns_grid, x.owns_grid);
+        return *this;
+      }
+
+      // Add the values f[i * stride] of the functions c0 + i * stride, i = 0 ... n_f - 1, at the times tau
+      void push_back(std::array<double, Rank> const &tau, long c0, long stride, std::complex<double> const *f, long n_f) {
+
+        // Window on the grid points l0[r] ... l0[r] + 2m in each dimension, and the phase of the fermionic dimensions
+        std::array<std::array<double, max_width>, Rank> w;
+        std::array<long, Rank> l0;
+        double phase = 0;
+        for (int r = 0; r < Rank; ++r) {
+          double x = tau[r] / dims[r].beta; // the grid is periodic: no need to fold x into [0, 1)
+          if (dims[r].fermion) phase += M_PI * x;
+          double nx = n[r] * x;
+          l0[r]     = long(std::ceil(nx - m));
+          for (int l = 0; l <= 2 * m; ++l) w[r][l] = window(r, nx - double(l0[r] + l));
+          l0[r] = ((l0[r] % n[r]) + n[r]) % n[r];
+        }
+        auto ph = std::polar(1.0, phase);
+
+        // Spread the functions onto the grid points of the window
+        auto spread = [&](long point, std::complex<double> a) {
+          std::complex<double> *g = grid + point * n_functions + c0;
+          for (long i = 0; i < n_f; ++i) g[i * stride] += a * f[i * stride];
+        };
+        if constexpr (Rank == 1) {
+          for (int l = 0; l <= 2 * m; ++l) spread((l0[0] + l) % n[0], ph * w[0][l]);
+        } else {
+          static_assert(Rank == 2, "nfft_batch_t: only Rank 1 and 2 are implemented");
+          for (int l1 = 0; l1 <= 2 * m; ++l1)
+            for (int l2 = 0; l2 <= 2 * m; ++l2) spread(((l0[0] + l1) % n[0]) * n[1] + (l0[1] + l2) % n[1], ph * (w[0][l1] * w[1][l2]));
+        }
+      }
+
+      // Add the value f of function c at the times tau
+      void push_back(std::array<double, Rank> const &tau, long c, std::complex<double> f) { push_back(tau, c, 1, &f, 1); }
+
+      // Transform the grids, add the results to the output and reset the grids
+      void flush() {
+        fftw_execute_dft(plan, reinterpret_cast<fftw_complex *>(grid), reinterpret_cast<fftw_complex *>(grid));
+        auto grid_index = [this](int r, long d) {
+          long k = d + dims[r].first_index;
+          return ((k % n[r]) + n[r]) % n[r];
+        };
+        auto add = [this](std::complex<double> *o, long point, double f) {
+          std::complex<double> const *g = grid + point * n_functions;
+          if (out_offsets.empty())
+            for (long c = 0; c < n_functions; ++c) o[c] += g[c] * f;
+          else
+            for (long c = 0; c < n_functions; ++c) o[out_offsets[c]] += g[c] * f;
+        };
+        if constexpr (Rank == 1) {
+          for (long d = 0; d < dims[0].size; ++d) add(out + d * n_functions, grid_index(0, d), deconv[0][d]);
+        } else {
+          for (long d1 = 0; d1 < dims[0].size; ++d1)
+            for (long d2 = 0; d2 < dims[1].size; ++d2)
+              add(out + (d1 * dims[1].size + d2) * n_functions, grid_index(0, d1) * n[1] + grid_index(1, d2), deconv[0][d1] * deconv[1][d2]);
+        }
+        std::fill(grid, grid + n_grid * n_functions, 0);
+      }
+
+      private:
+      static constexpr int max_width = 2 * 16 + 1;
+
+      // Kaiser-Bessel window at the distance u from a grid point, in units of the grid spacing (|u| <= m)
+      double window(int r, double u) const {
+        double s = double(m) * m - u * u;
+        if (s <= 0) return 0;
+        s = std::sqrt(s);
+        return std::sinh(b[r] * s) / (M_PI * s);
+      }
+
+      std::array<mesh_dim_t, Rank> dims;
+      long n_functions = 0;
+      std::complex<double> *out = nullptr;
+      std::vector<long> out_offsets;
+      int m = 6;
+
+      std::array<int, Rank> n;                    // sizes of the oversampled grid
+      std::array<double, Rank> b;                 // shape parameter of the window
+      long n_grid = 0;                            // number of points of the grid (of one function)
+      std::array<std::vector<double>, Rank> deconv; // inverse of the Fourier coefficients of the window, by frequency
+      std::complex<double> *grid = nullptr;       // the grids of all functions, interleaved: grid[point * n_functions + c]
+      fftw_plan plan             = nullptr;       // owned by nfft_plan_pool
+      bool owns_grid             = true;
+    };
+
+  } // namespace experimental
+} // namespace triqs
@@ -23,8 +23,10 @@
 #include <triqs/utility/first_include.hpp>
 #include <triqs/utility/exceptions.hpp>
 #include <limits>
+#include <functional>
 #include <iostream>
 #include <stack>
+#include <utility>
 #include <vector>
 #include "./rbt_iterators.hpp"
 
@@ -34,7 +36,9 @@ namespace triqs {
     struct rbt_insert_error {};
 
     // Key: must be a regular type, ie. with comparison operators
-    // Value: semi-regular type, wth a reset method void reset (T&&...)
+    // Value: semi-regular type, wth a reset method void reset (T&&...).
+    //        Optionally, a method void update_subtree(Value const *left, Value const *right), called whenever the subtree
+    //        of a node changes (children are nullptr if absent), to maintain aggregates of the subtree, like N.
     // Compare: compare operator for the Keys
     template <typename Key, typename Value, typename Compare = std::less<Key>> class rb_tree {
 
@@ -89,6 +93,15 @@ namespace triqs {
  *************************************************************************/
       private:
       node root; // root of the BST
+      std::function<void(node)> release_hook; // takes the nodes removed from the tree, if set
+
+      // a node removed from the tree
+      void free_node(node n) {
+        if (release_hook)
+          release_hook(n);
+        else
+          delete n;
+      }
 
       template <typename Fnt> void apply_recursive(Fnt const &f, node n) const {
         if (n->left) apply_recursive(f, n->left);
@@ -120,6 +133,17 @@ namespace triqs {
         return x->N;
       }
 
+      // recompute N and the aggregates of Value from the children of h
+      void update_subtree(node h) {
+        h->N = size(h->left) + size(h->right) + 1;
+        update_value_subtree(h, 0);
+      }
+      template <typename V = Value>
+      auto update_value_subtree(node h, int) -> decltype(std::declval<V &>().update_subtree(nullptr, nullptr), void()) {
+        h->update_subtree(h->left, h->right);
+      }
+      void update_value_subtree(node, long) {}
+
       void rec_free(node n) {
         if (n == nullptr) return;
         rec_free(n->left);
@@ -166,6 +190,10 @@ namespace triqs {
         if (n.root) root = new node_t(*n.root);
       }
 
+      /// Nodes removed from the tree are handed to f, which takes ownership, instead of being deleted.
+      /// Together with insert_node, it lets the user recycle the nodes.
+      void set_release_hook(std::function<void(node)> f) { release_hook = std::move(f); }
+
       /// Number of nodes in the tree
       int size() const { return size(root); }
       /// Is the tree empty?
@@ -332,20 +360,38 @@ namespace triqs {
       // insert the key-value pair; overwrite the old value with the new value
       // if the key is already present
       void insert(Key const &key, Value const &val) {
-        root        = insert(root, key, val);
+        root        = insert(root, key, [&]() { return new node_t(key, val, RED, 1); });
         root->color = BLACK;
         check();
       }
 
+      // insert a detached node, allocated with new (e.g. one given to the release hook), at its key.
+      // The tree takes ownership of it, except if the key is already present (rbt_insert_error).
+      void insert_node(node n) {
+        n->left        = nullptr;
+        n->right       = nullptr;
+        n->color       = RED;
+        n->N           = 1;
+        n->modified    = true;
+        n->delete_flag = false;
+        root           = insert(root, n->key, [n]() { return n; });
+        root->color    = BLACK;
+        check();
+      }
+
       private:
-      // insert the key-value pair in the subtree rooted at h
-      node insert(node h, Key const &key, Value const &val) {
-        if (h == nullptr) return new node_t(key, val, true, 1);
+      // insert the node made by make_node at key in the subtree rooted at h
+      template <typename MakeNode> node insert(node h, Key const &key, MakeNode const &make_node) {
+        if (h == nullptr) {
+          node n = make_node();
+          update_subtree(n);
+          return n;
+        }
 
         if (compare(key, h->key))
-          h->left = insert(h->left, key, val);
+          h->left = insert(h->left, key, make_node);
         else if (compare(h->key, key))
-          h->right = insert(h->right, key, val);
+          h->right = insert(h->right, key, make_node);
         else
           throw rbt_insert_error{};
 
@@ -353,7 +399,7 @@ namespace triqs {
         if (is_red(h->right) && !is_red(h->left)) h     = rotateLeft(h);
         if (is_red(h->left) && is_red(h->left->left)) h = rotateRight(h);
         if (is_red(h->left) && is_red(h->right)) flipColors(h);
-        h->N = size(h->left) + size(h->right) + 1;
+        update_subtree(h);
 
         h->modified = true;
         return h;
@@ -366,7 +412,7 @@ namespace triqs {
       // delete the key-value pair with the minimum key rooted at h
       node deleteMin(node h) {
         if (h->left == nullptr) {
-          delete h;
+          free_node(h);
           return nullptr;
         }
         if (!is_red(h->left) && !is_red(h->left->left)) h = moveRedLeft(h);
@@ -379,7 +425,7 @@ namespace triqs {
         if (is_red(h->left)) h = rotateRight(h);
         if (h->right == nullptr) {
           // std::cout << " deleting " << h->key << std::endl;
-          delete h;
+          free_node(h);
           return nullptr;
         }
         if (!is_red(h->right) && !is_red(h->right->left)) h = moveRedRight(h);
@@ -430,7 +476,7 @@ namespace triqs {
 
           if (is_red(h->left)) h = rotateRight(h);
           if (key == h->key && (h->right == nullptr)) {
-            delete h;
+            free_node(h);
             return nullptr;
           }
           if (!is_red(h->right) && !is_red(h->right->left)) h = moveRedRight(h);
@@ -460,8 +506,8 @@ namespace triqs {
         x->right        = h;
         x->color        = x->right->color;
         x->right->color = RED;
-        x->N            = h->N;
-        h->N            = size(h->left) + size(h->right) + 1;
+        update_subtree(h);
+        update_subtree(x);
         h->modified     = true;
         x->modified     = true;
         return x;
@@ -475,8 +521,8 @@ namespace triqs {
         x->left        = h;
         x->color       = x->left->color;
         x->left->color = RED;
-        x->N           = h->N;
-        h->N           = size(h->left) + size(h->right) + 1;
+        update_subtree(h);
+        update_subtree(x);
         h->modified    = true;
         x->modified    = true;
         return x;
@@ -524,7 +570,7 @@ namespace triqs {
         if (is_red(h->left) && is_red(h->left->left)) h = rotateRight(h);
         if (is_red(h->left) && is_red(h->right)) flipColors(h);
 
-        h->N        = size(h->left) + size(h->right) + 1;
+        update_subtree(h);
         h->modified = true;
         return h;
       }
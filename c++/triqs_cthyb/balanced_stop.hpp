@@ -0,0 +1,94 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include <triqs/mpi/base.hpp>
+#include <algorithm>
+#include <functional>
+#include <memory>
+
+namespace triqs_cthyb {
+
+  /// Stop criterion of the balanced accumulation, to be called once per cycle (as the stop callback of mc_generic).
+  // All the processes stop together, once they have done n_target cycles in total, or once one of them has run out of time.
+  // The counts of cycles are summed by non-blocking all-reduces, which overlap with the next cycles.
+  // A reduction is only started once the previous one has completed: as all the processes see the same sums,
+  // they all stop after the same reduction.
+  class balanced_stop_callback {
+
+    struct state_t {
+      MPI_Comm comm;
+      long n_target;
+      int check_interval;
+      std::function<bool()> time_out;
+      long n_done = 0, n_done_at_last_report = 0;
+      long local[2] = {0, 0}, global[2] = {0, 0}; // cycles done, number of processes out of time
+      MPI_Request request = MPI_REQUEST_NULL;
+      bool pending = false, stopped = false, target_reached = false;
+    };
+    std::shared_ptr<state_t> st;
+
+    public:
+    balanced_stop_callback(triqs::mpi::communicator const &comm, long n_target, int check_interval, std::function<bool()> time_out)
+       : st(std::make_shared<state_t>()) {
+      st->comm           = comm.get();
+      st->n_target       = n_target;
+      st->check_interval = std::max(check_interval, 1);
+      st->time_out       = std::move(time_out);
+    }
+
+    bool operator()() {
+      auto &s = *st;
+      if (s.stopped) return true;
+      ++s.n_done;
+
+      // The result of the last report
+      if (s.pending) {
+        int done = 0;
+        MPI_Test(&s.request, &done, MPI_STATUS_IGNORE);
+        if (done) {
+          s.pending = false;
+          if ((s.global[1] > 0) || (s.global[0] >= s.n_target)) {
+            s.target_reached = (s.global[1] == 0);
+            s.stopped        = true;
+            return true;
+          }
+        }
+      }
+
+      // Report the progress
+      if (!s.pending && (s.n_done - s.n_done_at_last_report >= s.check_interval)) {
+        s.local[0]              = s.n_done;
+        s.local[1]              = (s.time_out() ? 1 : 0);
+        s.n_done_at_last_report = s.n_done;
+        MPI_Iallreduce(s.local, s.global, 2, MPI_LONG, MPI_SUM, s.comm, &s.request);
+        s.pending = true;
+      }
+      return false;
+    }
+
+    /// Has the run stopped because the processes did the target number of cycles (rather than for lack of time)?
+    bool target_reached() const { return st->target_reached; }
+
+    /// Number of cycles done by this process
+    long n_cycles_done() const { return st->n_done; }
+  };
+
+} // namespace triqs_cthyb
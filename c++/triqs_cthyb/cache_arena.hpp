@@ -0,0 +1,209 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include "./config.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace triqs_cthyb {
+
+  /********************************************
+   A pool of fixed-size, aligned slots.
+   ********************************************/
+  // Slots are carved out of large chunks. When the pool runs dry, a new chunk
+  // as large as all previous ones together is added (i.e. the capacity doubles).
+  // Chunks are only released with the pool: a slot never moves once handed out.
+  class slab_pool {
+
+    static constexpr std::size_t chunk_alignment = 64; // cache line
+    static constexpr std::size_t min_chunk_bytes = 4096;
+
+    struct chunk_deleter {
+      void operator()(char *p) const { ::operator delete(p, std::align_val_t{chunk_alignment}); }
+    };
+
+    std::size_t slot_size; // in bytes
+    std::size_t capacity = 0;
+    std::vector<std::unique_ptr<char, chunk_deleter>> chunks;
+    std::vector<char *> free_slots;
+
+    void grow() {
+      std::size_t n = std::max({capacity, (min_chunk_bytes + slot_size - 1) / slot_size, std::size_t{1}});
+      chunks.emplace_back(static_cast<char *>(::operator new(n * slot_size, std::align_val_t{chunk_alignment})));
+      capacity += n;
+      free_slots.reserve(capacity); // release() never allocates
+      char *p = chunks.back().get();
+      for (std::size_t i = n; i-- > 0;) free_slots.push_back(p + i * slot_size); // acquire() returns slots in address order
+    }
+
+    public:
+    // slot_bytes is rounded up to a multiple of the alignment (a power of 2, at most 64)
+    slab_pool(std::size_t slot_bytes, std::size_t alignment = chunk_alignment)
+       : slot_size(std::max(alignment, (slot_bytes + alignment - 1) / alignment * alignment)) {}
+
+    slab_pool(slab_pool const &) = delete;
+    slab_pool(slab_pool &&)      = default;
+    slab_pool &operator=(slab_pool const &) = delete;
+    slab_pool &operator=(slab_pool &&) = default;
+
+    char *acquire() {
+      if (free_slots.empty()) grow();
+      char *p = free_slots.back();
+      free_slots.pop_back();
+      return p;
+    }
+
+    void release(char *p) { free_slots.push_back(p); }
+
+    std::size_t get_slot_size() const { return slot_size; }
+    std::size_t n_slots_in_use() const { return capacity - free_slots.size(); }
+    std::size_t size_in_bytes() const { return capacity * slot_size; }
+  };
+
+  /********************************************
+   Storage for the cache of the impurity_trace nodes
+   ********************************************/
+  // All per-block arrays of a node (block table, norms, ... ) live in one header slot,
+  // together with the counts of operators in the subtree of the node.
+  // The partial product matrices are stored in pools of size classes: class k holds
+  // matrices of at most 2^k elements, so that matrices of the same dimension are
+  // contiguous in memory, and a matrix slot can be reused when the block table changes.
+  class cache_arena {
+
+    int n_blocks, n_op_counts;
+    slab_pool headers;
+    std::vector<slab_pool> matrix_pools; // indexed by size class
+
+    static int size_class(std::size_t n_elements) {
+      int k = 0;
+      while ((std::size_t{1} << k) < n_elements) ++k;
+      return k;
+    }
+
+    slab_pool &matrix_pool(int k) {
+      while (int(matrix_pools.size()) <= k) {
+        std::size_t bytes = (std::size_t{1} << matrix_pools.size()) * sizeof(h_scalar_t);
+        matrix_pools.emplace_back(bytes, std::min(bytes, std::size_t{64}));
+      }
+      return matrix_pools[k];
+    }
+
+    // Layout of a header slot, in this order (decreasing alignment)
+    std::size_t lnorms_offset() const { return n_blocks * sizeof(h_scalar_t *); }
+    std::size_t energy_lnorms_offset() const { return lnorms_offset() + n_blocks * sizeof(double); }
+    std::size_t block_table_offset() const { return energy_lnorms_offset() + n_blocks * sizeof(double); }
+    std::size_t op_counts_offset() const { return block_table_offset() + n_blocks * sizeof(int); }
+    std::size_t size_class_offset() const { return op_counts_offset() + n_op_counts * sizeof(int); }
+    std::size_t valid_offset() const { return size_class_offset() + n_blocks * sizeof(signed char); }
+    std::size_t single_offset() const { return valid_offset() + n_blocks * sizeof(bool); }
+    std::size_t header_bytes() const { return single_offset() + n_blocks * sizeof(bool); }
+
+    // the number of elements of h_scalar_t which hold n elements of h_single_t
+    static std::size_t single_to_scalar(std::size_t n) { return (n * sizeof(h_single_t) + sizeof(h_scalar_t) - 1) / sizeof(h_scalar_t); }
+
+    public:
+    /// The per-block arrays of the cache of one node
+    struct header_t {
+      h_scalar_t **matrices           = nullptr; // partial product of operator/time evolution matrices, row-major (nullptr: not allocated)
+      double *matrix_lnorms           = nullptr; // -ln(norm(matrix))
+      double *energy_lnorms           = nullptr; // -ln of the bound of the matrix from the eigenvalues alone
+      int *block_table                = nullptr; // number of blocks limited to 2^15
+      int *op_counts                  = nullptr; // number of operators of each kind in the subtree
+      signed char *matrix_size_class  = nullptr; // size class of the storage of matrices[b]
+      bool *matrix_norm_valid         = nullptr; // is the norm of the matrix still valid?
+      bool *matrix_is_single          = nullptr; // is matrices[b] stored in single precision (as h_single_t)?
+    };
+
+    cache_arena(int n_blocks, int n_op_counts = 0) : n_blocks(n_blocks), n_op_counts(n_op_counts), headers(header_bytes()) {}
+
+    cache_arena(cache_arena const &) = delete;
+    cache_arena &operator=(cache_arena const &) = delete;
+
+    // A new header, with all matrices unallocated, norms, block table and counts set to 0, and all norms invalid.
+    header_t acquire_header() {
+      char *p = headers.acquire();
+      std::memset(p, 0, header_bytes());
+      return {reinterpret_cast<h_scalar_t **>(p), reinterpret_cast<double *>(p + lnorms_offset()),
+              reinterpret_cast<double *>(p + energy_lnorms_offset()), reinterpret_cast<int *>(p + block_table_offset()), reinterpret_cast<int *>(p + op_counts_offset()),
+              reinterpret_cast<signed char *>(p + size_class_offset()), reinterpret_cast<bool *>(p + valid_offset()),
+              reinterpret_cast<bool *>(p + single_offset())};
+    }
+
+    // Give back the header and all the matrices it holds
+    void release_header(header_t &h) {
+      if (h.matrices == nullptr) return;
+      for (int b = 0; b < n_blocks; ++b)
+        if (h.matrices[b]) matrix_pool(h.matrix_size_class[b]).release(reinterpret_cast<char *>(h.matrices[b]));
+      headers.release(reinterpret_cast<char *>(h.matrices));
+      h = header_t{};
+    }
+
+    // Storage for a matrix of n_elements for block b, in single precision, with the same rules as matrix_storage.
+    // It takes half of the memory of matrix_storage.
+    h_single_t *single_matrix_storage(header_t &h, int b, std::size_t n_elements) {
+      auto p                = reinterpret_cast<h_single_t *>(matrix_storage(h, b, single_to_scalar(n_elements)));
+      h.matrix_is_single[b] = true;
+      return p;
+    }
+
+    // Storage for a matrix of n_elements for block b, allocated if absent or too small. Content is unspecified.
+    h_scalar_t *matrix_storage(header_t &h, int b, std::size_t n_elements) {
+      h.matrix_is_single[b] = false;
+      int k = size_class(n_elements);
+      if (h.matrices[b]) {
+        if (h.matrix_size_class[b] >= k) return h.matrices[b];
+        matrix_pool(h.matrix_size_class[b]).release(reinterpret_cast<char *>(h.matrices[b]));
+      }
+      h.matrices[b]          = reinterpret_cast<h_scalar_t *>(matrix_pool(k).acquire());
+      h.matrix_size_class[b] = k;
+      return h.matrices[b];
+    }
+
+    // Copy the norms, block table, counts and valid flags, and the content of the valid matrices
+    void copy_header(header_t const &from, header_t &to) {
+      std::memcpy(to.matrix_lnorms, from.matrix_lnorms, n_blocks * sizeof(double));
+      std::memcpy(to.energy_lnorms, from.energy_lnorms, n_blocks * sizeof(double));
+      std::memcpy(to.block_table, from.block_table, n_blocks * sizeof(int));
+      std::memcpy(to.op_counts, from.op_counts, n_op_counts * sizeof(int));
+      std::memcpy(to.matrix_norm_valid, from.matrix_norm_valid, n_blocks * sizeof(bool));
+      for (int b = 0; b < n_blocks; ++b) {
+        if (!from.matrix_norm_valid[b]) continue;
+        std::size_t n = std::size_t{1} << from.matrix_size_class[b];
+        std::memcpy(matrix_storage(to, b, n), from.matrices[b], n * sizeof(h_scalar_t));
+        to.matrix_is_single[b] = from.matrix_is_single[b];
+      }
+    }
+
+    int get_n_op_counts() const { return n_op_counts; }
+
+    /// Total memory reserved by the arena
+    std::size_t size_in_bytes() const {
+      std::size_t r = headers.size_in_bytes();
+      for (auto const &p : matrix_pools) r += p.size_in_bytes();
+      return r;
+    }
+  };
+
+} // namespace triqs_cthyb
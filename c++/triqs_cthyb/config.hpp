@@ -62,6 +62,7 @@ using h_scalar_t = double; // type of scalar for H_loc: double or complex.
 static constexpr bool is_h_scalar_complex = false;
 #endif
 
+using h_single_t = std14::conditional_t<is_h_scalar_complex, std::complex<float>, float>; // h_scalar_t in single precision, for the cache of the trace
 using mc_weight_t = decltype(h_scalar_t{} * det_scalar_t{}); // complex iif either is complex
 using many_body_op_t = triqs::operators::many_body_operator_generic<h_scalar_t>; // Operator with real or complex value
 using matrix_t = matrix<h_scalar_t>;
@@ -24,8 +24,11 @@
 #include <triqs/utility/time_pt.hpp>
 #include <triqs/atom_diag/atom_diag.hpp>
 #include <triqs/atom_diag/functions.hpp>
+#include <triqs/mpi/base.hpp>
 
+#include <algorithm>
 #include <map>
+#include <vector>
 
 namespace triqs_cthyb {
 
@@ -51,15 +54,58 @@ namespace triqs_cthyb {
     }
   };
 
+  // The operators of a configuration in plain form, in decreasing time order, e.g. to start a later run from it (warm start)
+  struct configuration_record_t {
+    double beta = 0;
+    std::vector<double> tau;
+    std::vector<int> block, inner, dagger;
+
+    int size() const { return tau.size(); }
+
+    friend void h5_write(triqs::h5::group g, std::string const &name, configuration_record_t const &r) {
+      auto gr = g.create_group(name);
+      h5_write(gr, "beta", r.beta);
+      h5_write(gr, "tau", r.tau);
+      h5_write(gr, "block", r.block);
+      h5_write(gr, "inner", r.inner);
+      h5_write(gr, "dagger", r.dagger);
+    }
+
+    friend void h5_read(triqs::h5::group g, std::string const &name, configuration_record_t &r) {
+      auto gr = g.open_group(name);
+      h5_read(gr, "beta", r.beta);
+      h5_read(gr, "tau", r.tau);
+      h5_read(gr, "block", r.block);
+      h5_read(gr, "inner", r.inner);
+      h5_read(gr, "dagger", r.dagger);
+    }
+  };
+
+  struct configuration;
+  inline configuration_record_t make_configuration_record(configuration const &c);
+
   // The configuration of the Monte Carlo
   struct configuration {
 
     // a map associating an operator to an imaginary time
     using oplist_t = std::map<time_pt, op_desc, std::greater<time_pt>>;
 
+    // The operators of the configuration, in decreasing time order, in a flat vector:
+    // insertion and removal move the tail, but do not allocate once the capacity is reached,
+    // the kth operator is accessed in O(1) and an operator is found in O(log N).
+    using op_t          = std::pair<time_pt, op_desc>;
+    using flat_oplist_t = std::vector<op_t>;
+
 #ifdef SAVE_CONFIGS
-    configuration(double beta) : beta_(beta), id(0), configs_hfile("configs.h5", exists("configs.h5") ? H5F_ACC_RDWR : H5F_ACC_TRUNC) {
-      if (NUM_CONFIGS_TO_SAVE > 0) h5_write(configs_hfile, "c_0", *this);
+    // The visited configurations are saved as configuration_record_t, in groups c_0, c_1, ... (one per call of finalize),
+    // next to the problem written by solver_core::solve, for the replay of the trajectory by benchmark/cpp/cthyb_replay
+    static std::string configs_file_name() {
+      triqs::mpi::communicator world;
+      return (world.size() == 1 ? "configs.h5" : "configs." + std::to_string(world.rank()) + ".h5");
+    }
+    configuration(double beta)
+       : beta_(beta), id(0), configs_hfile(configs_file_name(), exists(configs_file_name()) ? H5F_ACC_RDWR : H5F_ACC_TRUNC) {
+      if (NUM_CONFIGS_TO_SAVE > 0) h5_write(configs_hfile, "c_0", make_configuration_record(*this));
     }
     ~configuration() { configs_hfile.close(); }
 #else
@@ -69,15 +115,31 @@ namespace triqs_cthyb {
     double beta() const { return beta_; }
     int size() const { return oplist.size(); }
 
-    void insert(time_pt tau, op_desc op) { oplist.insert({tau, op}); }
-    void replace(time_pt tau, op_desc op) { oplist[tau] = op; }
-    void erase(time_pt const &t) { oplist.erase(t); }
+    // like std::map: no effect if there is already an operator at tau
+    void insert(time_pt tau, op_desc op) {
+      auto it = lower_bound(tau);
+      if ((it == oplist.end()) || (it->first != tau)) oplist.insert(it, {tau, op});
+    }
+    void replace(time_pt tau, op_desc op) {
+      auto it = lower_bound(tau);
+      if ((it != oplist.end()) && (it->first == tau))
+        it->second = op;
+      else
+        oplist.insert(it, {tau, op});
+    }
+    void erase(time_pt const &t) {
+      auto it = lower_bound(t);
+      if ((it != oplist.end()) && (it->first == t)) oplist.erase(it);
+    }
     void clear() { oplist.clear(); }
 
-    oplist_t::iterator begin() { return oplist.begin(); }
-    oplist_t::iterator end() { return oplist.end(); }
-    oplist_t::const_iterator begin() const { return oplist.begin(); }
-    oplist_t::const_iterator end() const { return oplist.end(); }
+    // the kth operator, in decreasing time order
+    op_t const &operator[](int k) const { return oplist[k]; }
+
+    flat_oplist_t::iterator begin() { return oplist.begin(); }
+    flat_oplist_t::iterator end() { return oplist.end(); }
+    flat_oplist_t::const_iterator begin() const { return oplist.begin(); }
+    flat_oplist_t::const_iterator end() const { return oplist.end(); }
 
     friend std::ostream &operator<<(std::ostream &out, configuration const &c) {
       for (auto const &op : c) out << "tau = " << op.first << " : " << op.second << std::endl;
@@ -100,18 +162,35 @@ namespace triqs_cthyb {
     void finalize() {
       id++;
 #ifdef SAVE_CONFIGS
-      if (id < NUM_CONFIGS_TO_SAVE) h5_write(configs_hfile, "c_" + std::to_string(id), *this);
+      if (id < NUM_CONFIGS_TO_SAVE) h5_write(configs_hfile, "c_" + std::to_string(id), make_configuration_record(*this));
 #endif
     }
 
     private:
     long id; // configuration id, for debug purposes
     double beta_;
-    oplist_t oplist;
+    flat_oplist_t oplist;
+
+    // first operator at a time <= tau
+    flat_oplist_t::iterator lower_bound(time_pt const &tau) {
+      return std::lower_bound(oplist.begin(), oplist.end(), tau, [](op_t const &x, time_pt const &t) { return x.first > t; });
+    }
 
 #ifdef SAVE_CONFIGS
     // HDF5 file to save configurations
     triqs::h5::file configs_hfile;
 #endif
   };
+
+  inline configuration_record_t make_configuration_record(configuration const &c) {
+    configuration_record_t r;
+    r.beta = c.beta();
+    for (auto const &op : c) {
+      r.tau.push_back(double(op.first));
+      r.block.push_back(op.second.block_index);
+      r.inner.push_back(op.second.inner_index);
+      r.dagger.push_back(op.second.dagger);
+    }
+    return r;
+  }
 }
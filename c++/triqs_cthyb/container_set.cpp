@@ -23,6 +23,44 @@
 
 namespace triqs_cthyb {
 
+  namespace {
+
+    template <typename G> void combine_gf(G &a, G const &b, double wa, double wb) { a.data() = wa * a.data() + wb * b.data(); }
+
+    template <typename V, typename T> void combine_gf(block_gf<V, T> &a, block_gf<V, T> const &b, double wa, double wb) {
+      for (int i = 0; i < a.size(); ++i) combine_gf(a[i], b[i], wa, wb);
+    }
+
+    template <typename V, typename T> void combine_gf(block2_gf<V, T> &a, block2_gf<V, T> const &b, double wa, double wb) {
+      for (int i = 0; i < a.size1(); ++i)
+        for (int j = 0; j < a.size2(); ++j) combine_gf(a(i, j), b(i, j), wa, wb);
+    }
+
+    template <typename G> void combine_gf(std::optional<G> &a, std::optional<G> const &b, double wa, double wb) {
+      if (a && b) combine_gf(*a, *b, wa, wb);
+    }
+
+  } // namespace
+
+  void combine(container_set_t &c, container_set_t const &other, double wc, double wo) {
+
+    combine_gf(c.G_tau, other.G_tau, wc, wo);
+    combine_gf(c.G_tau_accum, other.G_tau_accum, wc, wo);
+    combine_gf(c.G_l, other.G_l, wc, wo);
+    combine_gf(c.G_iw_nfft, other.G_iw_nfft, wc, wo);
+    combine_gf(c.O_tau, other.O_tau, wc, wo);
+
+    combine_gf(c.G2_tau, other.G2_tau, wc, wo);
+    combine_gf(c.G2_iw, other.G2_iw, wc, wo);
+    combine_gf(c.G2_iw_nfft, other.G2_iw_nfft, wc, wo);
+    combine_gf(c.G2_iw_pp, other.G2_iw_pp, wc, wo);
+    combine_gf(c.G2_iw_pp_nfft, other.G2_iw_pp_nfft, wc, wo);
+    combine_gf(c.G2_iw_ph, other.G2_iw_ph, wc, wo);
+    combine_gf(c.G2_iw_ph_nfft, other.G2_iw_ph_nfft, wc, wo);
+    combine_gf(c.G2_iwll_pp, other.G2_iwll_pp, wc, wo);
+    combine_gf(c.G2_iwll_ph, other.G2_iwll_ph, wc, wo);
+  }
+
   /// Function that writes all containers to hdf5 file
   void h5_write(triqs::h5::group h5group, std::string subgroup_name, container_set_t const &c) {
 
@@ -31,6 +69,7 @@ namespace triqs_cthyb {
     h5_write(grp, "G_tau", c.G_tau);
     h5_write(grp, "G_tau_accum", c.G_tau_accum);
     h5_write(grp, "G_l", c.G_l);
+    h5_write(grp, "G_iw_nfft", c.G_iw_nfft);
     h5_write(grp, "O_tau", c.O_tau);
 
     h5_write(grp, "G2_tau", c.G2_tau);
@@ -52,6 +91,7 @@ namespace triqs_cthyb {
     h5_read(grp, "G_tau", c.G_tau);
     h5_read(grp, "G_tau_accum", c.G_tau_accum);
     h5_read(grp, "G_l", c.G_l);
+    if( grp.has_key("G_iw_nfft") ) h5_read(grp, "G_iw_nfft", c.G_iw_nfft);
     if( grp.has_key("O_tau") ) h5_read(grp, "O_tau", c.O_tau);
 
     h5_read(grp, "G2_tau", c.G2_tau);
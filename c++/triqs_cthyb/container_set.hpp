@@ -41,6 +41,9 @@ namespace triqs_cthyb {
     /// Single-particle Green's function :math:`G_l` in Legendre polynomial representation.
     std::optional<G_l_t> G_l;
 
+    /// Single-particle Green's function :math:`G(i\omega_n)` in Matsubara frequencies, measured with NFFT.
+    std::optional<G_iw_t> G_iw_nfft;
+
     /// General operator Green's function :math:`O(\tau)` in imaginary time.
     std::optional<gf<imtime, scalar_valued>> O_tau;
 
@@ -73,6 +76,9 @@ namespace triqs_cthyb {
     /// Two-particle Green's function :math:`G^{(2)}(i\omega,l,l')` in the ph-channel (one bosonic matsubara and two legendre)
     std::optional<G2_iwll_t> G2_iwll_ph;
 
+    /// c <- wc * c + wo * other, for each container present in both (results of independent Markov chains)
+    friend void combine(container_set_t &c, container_set_t const &other, double wc, double wo);
+
     /// Function that writes all containers to hdf5 file
     friend void h5_write(triqs::h5::group h5group, std::string subgroup_name, container_set_t const &c);
 
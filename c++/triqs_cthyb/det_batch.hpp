@@ -0,0 +1,78 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include "./types.hpp"
+#include <vector>
+
+namespace triqs_cthyb {
+
+  /// The entries of the inverse matrices M of all the dets, gathered in one pass over the dets (qmc_data::det_batch).
+  // The measures read their entries from the batch, as arrays, in place of a foreach over the dets in each measure.
+  // The entry k is the element M(y, x) of the det of its block, by position of x, then of y, in the det; the entries of the
+  // block b are k = start[b], ..., start[b + 1] - 1.
+  struct det_batch_t {
+    long config_id = -1;                // id of the configuration of the batch (-1: not filled)
+    std::vector<long> start;            // size n_blocks + 1
+    std::vector<op_t> x, y;             // the c^dagger (time, inner index) and the c of the entry
+    std::vector<int> x_pos, y_pos;      // their positions in the det (decreasing time order)
+    std::vector<double> t_x, t_y, dtau; // double(x.first), double(y.first), and double(y.first - x.first), in [0, beta)
+    std::vector<det_scalar_t> M;        // the element of the inverse matrix
+    std::vector<det_scalar_t> M_signed; // idem, times -1 if y is at a smaller time than x (beta-antiperiodicity)
+
+    int n_blocks() const { return int(start.size()) - 1; }
+    long size(int b) const { return start[b + 1] - start[b]; }
+
+    void clear() {
+      start.assign(1, 0);
+      for (auto *v : {&x, &y}) v->clear();
+      for (auto *v : {&x_pos, &y_pos}) v->clear();
+      for (auto *v : {&t_x, &t_y, &dtau}) v->clear();
+      for (auto *v : {&M, &M_signed}) v->clear();
+    }
+
+    void push_back(op_t const &x_, int x_pos_, op_t const &y_, int y_pos_, det_scalar_t M_) {
+      x.push_back(x_);
+      y.push_back(y_);
+      x_pos.push_back(x_pos_);
+      y_pos.push_back(y_pos_);
+      t_x.push_back(double(x_.first));
+      t_y.push_back(double(y_.first));
+      dtau.push_back(double(y_.first - x_.first));
+      M.push_back(M_);
+      M_signed.push_back(y_.first >= x_.first ? M_ : -M_);
+    }
+
+    // closes the current block
+    void end_block() { start.push_back(long(M.size())); }
+
+    // All the entries of det, as a new block. They are taken in the order of the positions of the operators in the det
+    // (as foreach, whose element for get_x(i) and get_y(j) is inverse_matrix(j, i)), which are thus known without a search.
+    template <typename Det> void push_back_block(Det const &det) {
+      int n = det.size();
+      for (int i = 0; i < n; ++i) {
+        auto const &x_ = det.get_x(i);
+        for (int j = 0; j < n; ++j) push_back(x_, i, det.get_y(j), j, det.inverse_matrix(j, i));
+      }
+      end_block();
+    }
+  };
+
+} // namespace triqs_cthyb
@@ -71,7 +71,9 @@ matrix_t impurity_trace::check_one_block_matrix_linear(node top, int b, bool pri
     if (!n->delete_flag) {
       int bp = this->get_op_block_map(n, b);
       if (bp == -1) TRIQS_RUNTIME_ERROR << " Nasty error ";
-      M = get_op_block_matrix(n, b) * M;
+      matrix_t M2(get_block_dim(bp), second_dim(M));
+      kernels::csr_gemm(M2.data_start(), get_op_block_csr(n, b), nullptr, M.data_start(), second_dim(M));
+      M = std::move(M2);
       b = bp;
     }
     p = n;
@@ -96,4 +98,11 @@ void impurity_trace::check_cache_integrity_one_node(node n, bool print) {
       TRIQS_RUNTIME_ERROR << " FATAL ";
     }
   }
+
+  // counts of the operators in the subtree
+  for (int k = 0; k < arena.get_n_op_counts(); ++k) {
+    int check = (n->left ? n->left->cache.op_counts[k] : 0) + (n->right ? n->right->cache.op_counts[k] : 0) +
+       (op_count_index(n->op.block_index, n->op.dagger) == k);
+    if (ca.op_counts[k] != check) TRIQS_RUNTIME_ERROR << " Inconsistent operator count " << k << " : cache = " << ca.op_counts[k] << " while it should be " << check;
+  }
 }
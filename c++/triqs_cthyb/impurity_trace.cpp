@@ -22,8 +22,13 @@
 #include <triqs/arrays.hpp>
 #include <triqs/arrays/blas_lapack/dot.hpp>
 #include <algorithm>
+#include <exception>
 #include <limits>
+#include <tuple>
 #include <triqs/arrays/linalg/eigenelements.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 //#define CHECK_ALL
 #ifdef CHECK_ALL
@@ -34,40 +39,107 @@
 
 double double_max = std::numeric_limits<double>::max(); // easier to read
 
-template <typename T>
-// require( is_real_or_complex<T>) FIXME?
-double frobenius_norm2(triqs::arrays::matrix<T> const &a) {
-  double r = 0;
-  for (int i = 0; i < first_dim(a); ++i)
-    for (int j = 0; j < second_dim(a); ++j) {
-      auto ab = std::abs(a(i, j));
-      r += ab * ab;
-    }
-  return std::sqrt(r);
-}
-
 // -----------------------------------------------
 
 namespace triqs_cthyb {
 
   // -------- Constructor --------
-  impurity_trace::impurity_trace(double beta, atom_diag const &h_diag_, histo_map_t *hist_map, bool use_norm_as_weight, bool measure_density_matrix, bool performance_analysis)
+  impurity_trace::impurity_trace(double beta, atom_diag const &h_diag_, histo_map_t *hist_map, bool use_norm_as_weight, bool measure_density_matrix, bool performance_analysis,
+                                 double energy_cutoff)
      : beta(beta),
        h_diag(&h_diag_),
        histo(performance_analysis ? new histograms_t(h_diag_.n_subspaces(), *hist_map) : nullptr),
-       atomic_z(partition_function(*h_diag, beta)),
-       atomic_norm(0),
        atomic_rho(n_blocks),
        density_matrix(n_blocks),
        use_norm_as_weight(use_norm_as_weight),
        measure_density_matrix(measure_density_matrix) {
 
-    // init density_matrix block + bool
-    for (int bl = 0; bl < n_blocks; ++bl) density_matrix[bl] = bool_and_matrix{false, matrix_t(get_block_dim(bl), get_block_dim(bl))};
+    // recycle the nodes removed from the tree
+    tree.set_release_hook([this](node n) { spare_nodes.emplace_back(n); });
+
+    // eigenstates kept in the trace. The eigenvalues are sorted in each block.
+    double e_0 = double_max;
+    for (int bl = 0; bl < n_blocks; ++bl) e_0 = std::min(e_0, h_diag->get_eigenvalue(bl, 0));
+    for (int bl = 0; bl < n_blocks; ++bl) {
+      int dim = h_diag->get_subspace_dim(bl), n_kept = dim;
+      if (energy_cutoff > 0)
+        for (n_kept = 0; (n_kept < dim) && (beta * (h_diag->get_eigenvalue(bl, n_kept) - e_0) <= energy_cutoff); ++n_kept)
+          ;
+      block_dims.push_back(n_kept);
+      is_truncated = is_truncated || (n_kept < dim);
+    }
+
+    for (int bl = 0; bl < n_blocks; ++bl) block_gemm.push_back(kernels::select_gemm<h_scalar_t>(get_block_dim(bl)));
+    init_blocks();
+  }
+
+  // The data which depends on the kept eigenstates (block_dims): the operator blocks, the eigenvalues and the atomic weights
+  void impurity_trace::init_blocks() {
+    c_csr.clear();
+    cdag_csr.clear();
+    c_lnorms.clear();
+    cdag_lnorms.clear();
+    c_truncated.clear();
+    cdag_truncated.clear();
+    shifted_eigenvals.clear();
+    shifted_eigenvals_start.clear();
+    atomic_z    = partition_function(*h_diag, beta);
+    atomic_norm = 0;
+
+    // sparse (and truncated) copies of the blocks of c and c^dagger
+    for (int op = 0; op < n_orbitals; ++op) {
+      c_csr.emplace_back(n_blocks);
+      cdag_csr.emplace_back(n_blocks);
+      c_lnorms.emplace_back(n_blocks, 0.0);
+      cdag_lnorms.emplace_back(n_blocks, 0.0);
+      if (is_truncated) {
+        c_truncated.emplace_back(n_blocks);
+        cdag_truncated.emplace_back(n_blocks);
+      }
+      for (int b = 0; b < n_blocks; ++b) {
+        add_op_block(h_diag->c_matrix(op, b), b, h_diag->c_connection(op, b), c_csr[op][b], (is_truncated ? &c_truncated[op][b] : nullptr),
+                     c_lnorms[op][b]);
+        add_op_block(h_diag->cdag_matrix(op, b), b, h_diag->cdag_connection(op, b), cdag_csr[op][b],
+                     (is_truncated ? &cdag_truncated[op][b] : nullptr), cdag_lnorms[op][b]);
+      }
+    }
+
+    scalar_blocks = std::all_of(block_dims.begin(), block_dims.end(), [](int d) { return d <= 1; });
+
+    // eigenvalues shifted by the minimum of their block, each block aligned for the exponentials
+    constexpr int per_line = kernels::aligned_allocator<double>::alignment / sizeof(double);
+    for (int bl = 0; bl < n_blocks; ++bl) {
+      shifted_eigenvals_start.push_back(shifted_eigenvals.size());
+      for (int i = 0; i < get_block_dim(bl); ++i) shifted_eigenvals.push_back(get_block_eigenval(bl, i) - get_block_emin(bl));
+      while (shifted_eigenvals.size() % per_line) shifted_eigenvals.push_back(0);
+    }
+
+    // init density_matrix block + bool. Full dimension: the discarded states stay at 0.
+    for (int bl = 0; bl < n_blocks; ++bl) {
+      int dim                  = h_diag->get_subspace_dim(bl);
+      density_matrix[bl]       = bool_and_matrix{false, matrix_t(dim, dim)};
+      density_matrix[bl].mat() = 0;
+    }
 
     // prepare atomic_rho and atomic_norm
-    if (use_norm_as_weight) {
-      auto rho = atomic_density_matrix(h_diag_, beta);
+    if (is_truncated) { // in the truncated basis, where rho is diagonal
+      atomic_z = 0;
+      for (int bl = 0; bl < n_blocks; ++bl)
+        for (int u = 0; u < get_block_dim(bl); ++u) atomic_z += std::exp(-beta * get_block_eigenval(bl, u));
+      if (use_norm_as_weight) {
+        for (int bl = 0; bl < n_blocks; ++bl) {
+          atomic_rho[bl]          = density_matrix[bl];
+          atomic_rho[bl].is_valid = true;
+          for (int u = 0; u < get_block_dim(bl); ++u) {
+            atomic_rho[bl].mat(u, u) = std::exp(-beta * get_block_eigenval(bl, u));
+            auto xx                 = atomic_rho[bl].mat(u, u) / atomic_z;
+            atomic_norm += xx * xx;
+          }
+        }
+        atomic_norm = std::sqrt(atomic_norm);
+      }
+    } else if (use_norm_as_weight) {
+      auto rho = atomic_density_matrix(*h_diag, beta);
       for (int bl = 0; bl < n_blocks; ++bl) {
         atomic_rho[bl] = bool_and_matrix{true, rho[bl] * atomic_z};
         for (int u = 0; u < get_block_dim(bl); ++u) {
@@ -77,6 +149,55 @@ namespace triqs_cthyb {
       }
       atomic_norm = std::sqrt(atomic_norm);
     }
+
+    // the auxiliary operators already attached
+    aux_csr.clear();
+    aux_lnorms.clear();
+    aux_truncated.clear();
+    for (auto const &aux : aux_operators) add_aux_op_blocks(aux);
+  }
+
+  impurity_trace::impurity_trace(double beta, atom_diag const &h_diag_, histo_map_t *hist_map, solve_parameters_t const &p)
+     : impurity_trace(beta, h_diag_, hist_map, p.use_norm_as_weight, p.measure_density_matrix, p.performance_analysis, p.trace_energy_cutoff) {
+    n_parallel_blocks    = p.trace_parallel_blocks;
+    single_precision_tol = p.trace_single_precision_tol;
+    single_min_block_dim = std::max(p.trace_single_min_block_dim, 2);
+    if (is_truncated && (p.verbosity >= 2)) {
+      int n_kept = 0, n_blocks_kept = 0;
+      for (int d : block_dims) {
+        n_kept += d;
+        n_blocks_kept += (d > 0);
+      }
+      std::cout << "Energy cutoff of the trace: keeping " << n_kept << " of " << n_eigstates << " atomic states, in " << n_blocks_kept << " of "
+                << n_blocks << " subspaces." << std::endl;
+    }
+#ifndef _OPENMP
+    if ((n_parallel_blocks > 1) && (p.verbosity >= 2))
+      std::cerr << "WARNING: trace_parallel_blocks is ignored, cthyb was compiled without OpenMP (-DUse_OpenMP=ON)" << std::endl;
+#endif
+  }
+
+  // NB : like all operator blocks used in compute_matrix, m is C ordered
+  impurity_trace::op_block_csr_t impurity_trace::make_csr(matrix<h_scalar_t> const &m) {
+    return {m.data_start(), int(first_dim(m)), int(second_dim(m))};
+  }
+
+  void impurity_trace::add_op_block(matrix<h_scalar_t> const &m, int b, int b_to, op_block_csr_t &csr, matrix<h_scalar_t> *truncated,
+                                    double &lnorm) {
+    if (b_to == -1) return;
+    auto set_lnorm = [&lnorm](matrix<h_scalar_t> const &x) {
+      double norm = kernels::sharp_spectral_norm_bound(x.data_start(), int(first_dim(x)), int(second_dim(x)));
+      lnorm       = (norm > 0 ? -std::log(norm) : double_max);
+    };
+    if (!truncated) {
+      csr = make_csr(m);
+      set_lnorm(m);
+      return;
+    }
+    if ((get_block_dim(b) == 0) || (get_block_dim(b_to) == 0)) return; // structural zero in the truncated basis
+    *truncated = m(arrays::range(0, get_block_dim(b_to)), arrays::range(0, get_block_dim(b)));
+    csr        = make_csr(*truncated);
+    set_lnorm(*truncated);
   }
 
   //====== Recursive operations ======
@@ -112,116 +233,448 @@ namespace triqs_cthyb {
 
     return (n->left ? compute_block_table(n->left, b2) : b2);
   }
+  // The states (block bs[i], from the initial block b_start[i]) through the subtree at n. The structural zeros are removed,
+  // so that the work goes down with the number of blocks still alive.
+  int impurity_trace::propagate_block_table(node n, int *bs, int *b_start, int n_states) const {
+    auto compact = [&](auto const &image) {
+      int k = 0;
+      for (int i = 0; i < n_states; ++i) {
+        int b = image(bs[i]);
+        if (b < 0) continue;
+        bs[k]        = b;
+        b_start[k++] = b_start[i];
+      }
+      return k;
+    };
+    if (!n->modified) {
+      int const *table = n->cache.block_table;
+      return compact([table](int b) { return table[b]; });
+    }
+    if (n->right) n_states = propagate_block_table(n->right, bs, b_start, n_states);
+    if (n_states == 0) return 0;
+    if (!n->delete_flag) n_states = compact([this, n](int b) { return get_op_block_map(n, b); });
+    if (n_states == 0) return 0;
+    if (n->left) n_states = propagate_block_table(n->left, bs, b_start, n_states);
+    return n_states;
+  }
+
+  bool impurity_trace::is_structurally_nonzero() {
+    if (tree_size == 0) return true;
+    structural_blocks.clear();
+    structural_starts.clear();
+    for (int b = 0; b < n_blocks; ++b)
+      if (get_block_dim(b) > 0) {
+        structural_blocks.push_back(b);
+        structural_starts.push_back(b);
+      }
+    int n_states = propagate_block_table(tree.get_root(), structural_blocks.data(), structural_starts.data(), structural_blocks.size());
+    for (int i = 0; i < n_states; ++i)
+      if (structural_blocks[i] == structural_starts[i]) return true;
+    return false;
+  }
+
   // -------- Computation of the block table and bounds -------------
 
-  // for subtree at node n, return (B', bound)
-  // precondition: b !=-1, n != null
-  // returns -1 for structural and/or threshold cancellation
-  std::pair<int, double> impurity_trace::compute_block_table_and_bound(node n, int b, double lnorm_threshold, bool use_threshold) {
+  // The states going through an unmodified subtree: its cache
+  void impurity_trace::propagate_through_cache(node n, int *bs, double *ls, int n_states) const {
+    int const *table     = n->cache.block_table;
+    double const *lnorms = n->cache.matrix_lnorms;
+    for (int i = 0; i < n_states; ++i) {
+      int b = bs[i];
+      if (b < 0) continue;
+      ls[i] += lnorms[b];
+      bs[i] = table[b];
+    }
+  }
 
-    if (b < 0) TRIQS_RUNTIME_ERROR << " b < 0";
-    if (!n->modified) return {n->cache.block_table[b], n->cache.matrix_lnorms[b]};
+  // The recursion of the bound, for all states at each node: exp(-dtau_r H) between the right subtree and the operator,
+  // exp(-dtau_l H) between the operator and the left subtree, bounded by exp(-dtau Emin) in the current block, and the operator,
+  // bounded by the spectral norm of its block. All these are bounds of spectral norms, hence of the product.
+  void impurity_trace::propagate_block_table_and_bound(node n, int *bs, double *ls, int n_states, bool children_cached) {
 
-    double lnorm = 0;
+    if (!n->modified) {
+      propagate_through_cache(n, bs, ls, n_states);
+      return;
+    }
+    auto walk = [&](node c) {
+      if (children_cached)
+        propagate_through_cache(c, bs, ls, n_states);
+      else
+        propagate_block_table_and_bound(c, bs, ls, n_states);
+    };
 
-    int b1 = b;
     if (n->right) {
-      std::tie(b1, lnorm) = compute_block_table_and_bound(n->right, b, lnorm_threshold, use_threshold);
+      walk(n->right);
+      double dtau_r = n->cache.dtau_r;
+      for (int i = 0; i < n_states; ++i)
+        if (bs[i] >= 0) ls[i] += dtau_r * get_block_emin(bs[i]);
+    }
+    if (!n->delete_flag)
+      for (int i = 0; i < n_states; ++i)
+        if (bs[i] >= 0) {
+          ls[i] += get_op_block_lnorm(n->op, bs[i]);
+          bs[i] = get_op_block_map(n, bs[i]);
+        }
+    if (n->left) {
+      double dtau_l = n->cache.dtau_l;
+      for (int i = 0; i < n_states; ++i)
+        if (bs[i] >= 0) ls[i] += dtau_l * get_block_emin(bs[i]);
+      walk(n->left);
+    }
+  }
+
+  // -------- Computation of the bound from the eigenvalues alone -------------
+
+  // Unlike matrix_lnorms, which are improved by the norms of the matrices computed in the cache,
+  // the energy bound only depends on the configuration: e^{-sum_k dtau_k Emin(b_k)} along the blocks b_k visited.
+  // precondition: the block table of n is not -1 for b, and the caches of the children are up to date
+  double impurity_trace::energy_lnorm_from_children(node n, int b) {
+    int b1    = (n->right ? n->right->cache.block_table[b] : b);
+    double el = (n->right ? n->right->cache.energy_lnorms[b] + n->cache.dtau_r * get_block_emin(b1) : 0);
+    int b2    = get_op_block_map(n, b1);
+    if (n->left) el += n->cache.dtau_l * get_block_emin(b2) + n->left->cache.energy_lnorms[b2];
+    return el;
+  }
+
+  // for subtree at node n, return (B', energy lnorm), with the same recursion as propagate_block_table_and_bound
+  std::pair<int, double> impurity_trace::compute_energy_bound_impl(node n, int b) {
+
+    if (!n->modified) return {n->cache.block_table[b], n->cache.energy_lnorms[b]};
+
+    int b1    = b;
+    double el = 0;
+    if (n->right) {
+      std::tie(b1, el) = compute_energy_bound_impl(n->right, b);
       if (b1 < 0) return {b1, 0};
-      lnorm += n->cache.dtau_r * get_block_emin(b1);
+      el += n->cache.dtau_r * get_block_emin(b1);
     }
-    if (use_threshold && (lnorm > lnorm_threshold)) return {-1, 0};
 
     int b2 = (n->delete_flag ? b1 : get_op_block_map(n, b1));
     if (b2 < 0) return {b2, 0};
 
     int b3 = b2;
     if (n->left) {
-      lnorm += n->cache.dtau_l * get_block_emin(b2);
-      if (use_threshold && (lnorm > lnorm_threshold)) return {-1, 0};
-      double lnorm3;
-      std::tie(b3, lnorm3) = compute_block_table_and_bound(n->left, b2, lnorm_threshold, use_threshold);
+      double el3;
+      std::tie(b3, el3) = compute_energy_bound_impl(n->left, b2);
       if (b3 < 0) return {b3, 0};
-      lnorm += lnorm3;
+      el += n->cache.dtau_l * get_block_emin(b2) + el3;
     }
+    return {b3, el};
+  }
+
+  double impurity_trace::compute_energy_bound() {
 
-    if (use_threshold && (lnorm > lnorm_threshold)) return {-1, 0};
+    double e_0 = double_max, r = 0;
+    for (int b = 0; b < n_blocks; ++b)
+      if (get_block_dim(b) > 0) e_0 = std::min(e_0, get_block_emin(b));
 
-    if (std::isinf(lnorm)) {
-      lnorm = double_max;
-      if (lnorm < 0) TRIQS_RUNTIME_ERROR << "Negative lnorm in compute_block_table_and_bound!";
+    if (tree_size == 0) {
+      for (int b = 0; b < n_blocks; ++b)
+        if (get_block_dim(b) > 0) r += std::sqrt(get_block_dim(b)) * std::exp(-beta * (get_block_emin(b) - e_0));
+      return r;
     }
 
-    return {b3, lnorm};
+    auto root   = tree.get_root();
+    double dtau = beta - tree.min_key() + double(tree.max_key()); // the tree is in REVERSE order
+    update_dtau(root);
+    for (int b = 0; b < n_blocks; ++b) {
+      if (get_block_dim(b) == 0) continue;
+      auto bel = compute_energy_bound_impl(root, b);
+      if (bel.first == b) r += std::sqrt(get_block_dim(b)) * std::exp(-(bel.second + dtau * get_block_emin(b) - beta * e_0));
+    }
+    return r;
   }
 
   // -------- Computation of the matrix ------------------------------
 
+  namespace {
+    // v viewed as a buffer of at least n elements
+    template <typename T> T *resized(std::vector<T> &v, int n) {
+      if (v.size() < std::size_t(n)) v.resize(n);
+      return v.data();
+    }
+  } // namespace
+
+  matrix_t impurity_trace::matrix_ref_t::to_matrix() const {
+    matrix_t M(n_rows, n_cols);
+    for (int i = 0; i < n_rows; ++i)
+      for (int j = 0; j < n_cols; ++j) M(i, j) = (*this)(i, j);
+    return M;
+  }
+
+  int impurity_trace::thread_id() {
+#ifdef _OPENMP
+    return omp_get_thread_num();
+#else
+    return 0;
+#endif
+  }
+
+  // exp(-dtau * E_i) = exp(-dtau * E_min) * exp(-dtau * (E_i - E_min)): one scalar exponential, and a vectorized loop
+  double const *impurity_trace::get_exp_factors(std::vector<double> &buf, int b, double dtau) {
+    int dim   = get_block_dim(b);
+    double *e = resized(buf, dim);
+    kernels::exp_neg_scaled(e, shifted_eigenvals.data() + shifted_eigenvals_start[b], dtau, std::exp(-dtau * get_block_emin(b)), dim);
+    return e;
+  }
+
   // returns {block that b connects to at this node, matrix for this block on node n (if not structurally zero, i.e. if B' != -1)}
-  std::pair<int, matrix_t> impurity_trace::compute_matrix(node n, int b) {
+  // The products are computed in place: in the cache of n when updating it, in the trial products otherwise.
+  std::pair<int, impurity_trace::matrix_ref_t> impurity_trace::compute_matrix(node n, int b, int depth) {
 
     if (b == -1) return {-1, {}};
     if (n == nullptr) return {b, {}};
-    if (!n->modified && n->cache.matrix_norm_valid[b]) return {n->cache.block_table[b], n->cache.matrices[b]};
+    if (!n->modified && n->cache.matrix_norm_valid[b]) return {n->cache.block_table[b], get_cached_matrix(n, b, get_workspace(depth).cached)};
     bool updating = (!n->modified && !n->cache.matrix_norm_valid[b]);
 
-    double dtau_l = 0, dtau_r = 0;
-    auto _ = arrays::range();
-
-    auto r = compute_matrix(n->right, b);
+    auto r = compute_matrix(n->right, b, depth + 1);
     int b1 = r.first; // exit block of right subtree
     if (b1 == -1) return {-1, {}};
 
     int b2 = (n->delete_flag ? b1 : get_op_block_map(n, b1)); // relevant block on current node
     if (b2 == -1) return {-1, {}};
 
-    matrix_t M = (!n->delete_flag ? get_op_block_matrix(n, b1) : make_unit_matrix<h_scalar_t>(get_block_dim(b1)));
-
-    if (n->right) { // M <- M * exp * r[b]
-      dtau_r   = double(n->key - tree.min_key(n->right));
-      auto dim = second_dim(M);                                                               // same as get_block_dim(b2);
-      for (int i = 0; i < dim; ++i) M(_, i) *= std::exp(-dtau_r * get_block_eigenval(b1, i)); // Create time-evolution matrix e^-H(t'-t)
-      if ((first_dim(r.second) == 1) && (second_dim(r.second) == 1))
-        M *= r.second(0, 0);
-      else
-        M = M * r.second; // FIXME could try to optimise lapack call?
+    auto &ws = get_workspace(depth);
+    int dim = get_block_dim(b), dim1 = get_block_dim(b1), dim2 = get_block_dim(b2);
+
+    // destination of the final product, with n_rows rows. When updating, n_rows is the dimension of block_table[b].
+    // In single precision, the product goes to the workspace, and is stored in the cache at the end.
+    trial_product_t *trial = nullptr; // where the product goes when n is modified, i.e. in a trial tree
+    bool single            = false;
+    auto get_dest = [&](int n_rows) {
+      if (!updating) {
+        trial = &trial_products[thread_id()].next();
+        trial->t_min = tree.min_key(n);
+        trial->t_max = tree.max_key(n);
+        trial->b     = b;
+        return resized(trial->data, n_rows * dim);
+      }
+      if ((single = store_in_single(n, b, n_rows))) return resized(ws.cached, n_rows * dim);
+      h_scalar_t *p;
+#pragma omp critical(cthyb_cache_arena)
+      p = arena.matrix_storage(n->cache, b, n_rows * dim);
+      return p;
+    };
+    h_scalar_t *dest = nullptr;
+
+    // T <- Op * exp(-dtau_r H) * R, of size dim2 x dim. T.data == nullptr stands for the identity (deleted node, no right subtree).
+    matrix_ref_t T;
+    if (n->right) {
+      double const *e = get_exp_factors(ws.exp_factors, b1, double(n->key - tree.min_key(n->right))); // time-evolution e^-H(t'-t)
+      h_scalar_t *t   = (n->left ? resized(ws.scratch2, dim2 * dim) : (dest = get_dest(dim2)));
+      if (n->delete_flag)
+        kernels::scale_rows(t, r.second.data, e, dim1, dim);
+      else if (get_op_block_csr(n, b1).prefer_sparse) {
+        kernels::csr_gemm(t, get_op_block_csr(n, b1), e, r.second.data, dim);
+        count_product(double(get_op_block_csr(n, b1).vals.size()) * dim);
+      } else {
+        auto const &op = get_op_block_matrix(n, b1);
+        h_scalar_t *a  = resized(ws.scratch1, dim2 * dim1);
+        kernels::scale_cols(a, op.data_start(), e, dim2, dim1);
+        block_gemm[b](t, a, r.second.data, dim2, dim1, dim);
+        count_product(double(dim2) * dim1 * dim);
+      }
+      T = {t, dim2, dim};
+    } else if (!n->delete_flag) {
+      auto const &op = get_op_block_matrix(n, b1);
+      T              = {op.data_start(), dim2, dim};
     }
+    bool T_is_op = (!n->right && !n->delete_flag); // T is the bare operator matrix
 
     int b3 = b2;
-    if (n->left) { // M <- l[b] * exp * M
-      auto l = compute_matrix(n->left, b2);
+    if (n->left) { // M <- L * exp(-dtau_l H) * T
+      auto l = compute_matrix(n->left, b2, depth + 1);
       b3     = l.first;
       if (b3 == -1) return {-1, {}};
-      dtau_l   = double(tree.max_key(n->left) - n->key);
-      auto dim = first_dim(M); // same as get_block_dim(b1);
-      for (int i = 0; i < dim; ++i) M(i, _) *= std::exp(-dtau_l * get_block_eigenval(b2, i));
-      if ((first_dim(l.second) == 1) && (second_dim(l.second) == 1))
-        M *= l.second(0, 0);
-      else
-        M = l.second * M;
+      int dim3        = get_block_dim(b3);
+      double const *e = get_exp_factors(ws.exp_factors, b2, double(tree.max_key(n->left) - n->key));
+      dest            = get_dest(dim3);
+      if (T.data == nullptr)
+        kernels::scale_cols(dest, l.second.data, e, dim3, dim2);
+      else if (T_is_op && get_op_block_csr(n, b1).prefer_sparse) {
+        kernels::gemm_csr(dest, l.second.data, e, get_op_block_csr(n, b1), dim3);
+        count_product(double(get_op_block_csr(n, b1).vals.size()) * dim3);
+      } else {
+        h_scalar_t *s = resized(ws.scratch2, dim2 * dim); // T may already be there
+        kernels::scale_rows(s, T.data, e, dim2, dim);
+        block_gemm[b](dest, l.second.data, s, dim3, dim2, dim);
+        count_product(double(dim3) * dim2 * dim);
+      }
+    } else if (dest == nullptr) { // a leaf: the operator matrix itself, or the identity
+      if (T.data == nullptr) {
+        dest = get_dest(dim);
+        kernels::set_identity(dest, dim);
+      } else if (updating) {
+        dest = get_dest(dim2);
+        std::copy(T.data, T.data + dim2 * dim, dest);
+      } else
+        return {b2, T}; // no copy needed
     }
 
+    int n_rows = get_block_dim(b3);
+    if (trial) trial->b_out = b3;
     if (updating) {
-      n->cache.matrices[b]          = M;
+      if (single) store_cached_matrix(n, b, dest, n_rows);
       n->cache.matrix_norm_valid[b] = true;
+      update_cached_lnorm(n, b, dest, n_rows, dim);
+    }
 
-      // improve the norm if calculating the full_trace
-      if (use_norm_of_matrices_in_cache) { // seems slower
-        auto norm = frobenius_norm(M);
-        if (std::abs(norm - frobenius_norm2(M)) > 1.e-12) TRIQS_RUNTIME_ERROR << " FROB PB" << M;
-        //if (norm < frobenius_norm2(M))  TRIQS_RUNTIME_ERROR << " FROB PB";
-        //if (norm < frobenius_norm2(M)) std::cout  <<norm <<" vs "<< frobenius_norm2(M)<<std::endl;// TRIQS_RUNTIME_ERROR << " FROB PB";
-        n->cache.matrix_lnorms[b] = -std::log(norm);
-        if (!isfinite(-std::log(norm))) { n->cache.matrix_lnorms[b] = double_max; }
-      }
+    return {b3, {dest, n_rows, dim}};
+  }
+
+  // The same products as compute_matrix, when all blocks have dimension 1 (e.g. density-density interactions):
+  // numbers instead of matrices, without workspaces nor kernel calls. The operations are done in the same order.
+  std::pair<int, h_scalar_t> impurity_trace::compute_scalar(node n, int b) {
+
+    if (b == -1) return {-1, 0};
+    if (!n->modified && n->cache.matrix_norm_valid[b]) return {n->cache.block_table[b], n->cache.matrices[b][0]};
+    bool updating = (!n->modified && !n->cache.matrix_norm_valid[b]);
+
+    int b1 = b;
+    h_scalar_t r = 1;
+    if (n->right) {
+      std::tie(b1, r) = compute_scalar(n->right, b);
+      if (b1 == -1) return {-1, 0};
     }
 
-    return {b3, std::move(M)};
+    int b2 = (n->delete_flag ? b1 : get_op_block_map(n, b1));
+    if (b2 == -1) return {-1, 0};
+
+    // the element of the operator, 0 if the element is 0 (no entry in the sparse matrix)
+    auto op_element = [&]() -> h_scalar_t const * {
+      auto const &op = get_op_block_csr(n, b1);
+      return (op.vals.empty() ? nullptr : op.vals.data());
+    };
+
+    // T <- Op * exp(-dtau_r H) * R. has_T = false stands for the identity (deleted node, no right subtree).
+    h_scalar_t T = 0;
+    bool has_T   = true;
+    if (n->right) {
+      double e = std::exp(-double(n->key - tree.min_key(n->right)) * get_block_emin(b1));
+      if (n->delete_flag)
+        T = r * e;
+      else if (auto a = op_element())
+        T = (*a * e) * r;
+    } else if (!n->delete_flag) {
+      auto a = op_element();
+      T      = (a ? *a : 0);
+    } else
+      has_T = false;
+
+    int b3       = b2;
+    h_scalar_t x = T;
+    if (n->left) { // M <- L * exp(-dtau_l H) * T
+      h_scalar_t l;
+      std::tie(b3, l) = compute_scalar(n->left, b2);
+      if (b3 == -1) return {-1, 0};
+      double e = std::exp(-double(tree.max_key(n->left) - n->key) * get_block_emin(b2));
+      if (!has_T)
+        x = l * e;
+      else if (!n->right && !n->delete_flag) {
+        auto a = op_element();
+        x      = (a ? (l * e) * *a : 0);
+      } else
+        x = l * (T * e);
+    } else if (!has_T)
+      x = 1;
+    else if (!n->right && !updating)
+      return {b2, x}; // a leaf, as compute_matrix: no trial product
+
+    if (updating) {
+#pragma omp critical(cthyb_cache_arena)
+      *arena.matrix_storage(n->cache, b, 1) = x;
+      n->cache.matrix_norm_valid[b] = true;
+      update_cached_lnorm(n, b, &x, 1, 1);
+    } else {
+      auto &trial = trial_products[thread_id()].next();
+      trial.t_min = tree.min_key(n);
+      trial.t_max = tree.max_key(n);
+      trial.b     = b;
+      trial.b_out = b3;
+      trial.data.assign(1, x);
+    }
+    return {b3, x};
+  }
+
+  // improve the norm if calculating the full_trace
+  // The bound of the spectral norm of the matrix, min(Frobenius, sqrt(|M|_1 |M|_inf)), replaces the bound from its subtrees if sharper
+  void impurity_trace::update_cached_lnorm(node n, int b, h_scalar_t const *m, int n_rows, int n_cols) {
+    if (!use_norm_of_matrices_in_cache) return; // seems slower
+    auto norm    = kernels::spectral_norm_bound(m, n_rows, n_cols);
+    double lnorm = (isfinite(-std::log(norm)) ? -std::log(norm) : double_max);
+    n->cache.matrix_lnorms[b] = std::max(n->cache.matrix_lnorms[b], lnorm);
+  }
+
+  // ------- Single precision in the cache -----------------------
+
+  bool impurity_trace::store_in_single(node n, int b, int n_rows) const {
+    // the bounds of the other blocks of n are updated by the other threads with trace_parallel_blocks: no single precision
+    if ((single_precision_tol <= 0) || (n_parallel_blocks > 1) || (n == tree.get_root())) return false;
+    if ((get_block_dim(b) < single_min_block_dim) || (n_rows < single_min_block_dim)) return false;
+    // the rounding error of the matrix, relative to the largest bound of the blocks of the node
+    double lnorm_min = double_max;
+    for (int bl = 0; bl < n_blocks; ++bl)
+      if (n->cache.block_table[bl] != -1) lnorm_min = std::min(lnorm_min, n->cache.matrix_lnorms[bl]);
+    constexpr double eps_single = std::numeric_limits<float>::epsilon();
+    return eps_single * std::exp(lnorm_min - n->cache.matrix_lnorms[b]) <= single_precision_tol;
+  }
+
+  void impurity_trace::store_cached_matrix(node n, int b, h_scalar_t const *m, int n_rows) {
+    int n_elements = n_rows * get_block_dim(b);
+    if (store_in_single(n, b, n_rows)) {
+      h_single_t *p;
+#pragma omp critical(cthyb_cache_arena)
+      p = arena.single_matrix_storage(n->cache, b, n_elements);
+      std::copy(m, m + n_elements, p);
+      if constexpr (performance_counters_enabled) ++counters[thread_id()].n_single_stores;
+    } else {
+      h_scalar_t *p;
+#pragma omp critical(cthyb_cache_arena)
+      p = arena.matrix_storage(n->cache, b, n_elements);
+      std::copy(m, m + n_elements, p);
+    }
+  }
+
+  int impurity_trace::n_single_matrices() {
+    int r = 0;
+    foreach (tree, [&](node n) {
+      for (int b = 0; b < n_blocks; ++b) r += (n->cache.matrix_norm_valid[b] && n->cache.matrix_is_single[b]);
+    });
+    return r;
+  }
+
+  // ------- Products of the trial tree -----------------------
+
+  namespace {
+    auto trial_product_key(time_pt const &t_min, time_pt const &t_max, int b) { return std::make_tuple(t_min, t_max, b); }
+  } // namespace
+
+  void impurity_trace::sort_trial_products() {
+    trial_products_sorted.clear();
+    for (auto const &t : trial_products)
+      for (int i = 0; i < t.n_used; ++i) trial_products_sorted.push_back(&t.items[i]);
+    std::sort(trial_products_sorted.begin(), trial_products_sorted.end(), [](trial_product_t const *x, trial_product_t const *y) {
+      return trial_product_key(x->t_min, x->t_max, x->b) < trial_product_key(y->t_min, y->t_max, y->b);
+    });
+  }
+
+  impurity_trace::trial_product_t const *impurity_trace::find_trial_product(time_pt const &t_min, time_pt const &t_max, int b) const {
+    auto key = trial_product_key(t_min, t_max, b);
+    auto it  = std::lower_bound(trial_products_sorted.begin(), trial_products_sorted.end(), key,
+                               [](trial_product_t const *x, auto const &k) { return trial_product_key(x->t_min, x->t_max, x->b) < k; });
+    if ((it == trial_products_sorted.end()) || (trial_product_key((*it)->t_min, (*it)->t_max, (*it)->b) != key)) return nullptr;
+    return *it;
   }
 
   // ------- Update the cache -----------------------
 
-  void impurity_trace::update_cache() { update_cache_impl(tree.get_root()); }
+  // The matrices computed in the last compute() are reused, the others are invalidated.
+  void impurity_trace::update_cache() {
+    ++tree_id;
+    sort_trial_products();
+    update_cache_impl(tree.get_root());
+    clear_trial_products();
+  }
 
   // --------------------------------
 
@@ -233,11 +686,30 @@ namespace triqs_cthyb {
     update_cache_impl(n->right);
     n->cache.dtau_r = (n->right ? double(n->key - tree.min_key(n->right)) : 0);
     n->cache.dtau_l = (n->left ? double(tree.max_key(n->left) - n->key) : 0);
+    bool has_trial_products = !trial_products_sorted.empty();
+    time_pt t_min = (has_trial_products ? tree.min_key(n) : time_pt{}), t_max = (has_trial_products ? tree.max_key(n) : time_pt{});
+    // all blocks in one pass, from the caches of the children (updated above)
+    int *bt    = n->cache.block_table;
+    double *ml = n->cache.matrix_lnorms;
     for (int b = 0; b < n_blocks; ++b) {
-      auto r                        = compute_block_table_and_bound(n, b, double_max, false);
-      n->cache.block_table[b]       = r.first;
-      n->cache.matrix_lnorms[b]     = r.second;
+      bt[b] = b;
+      ml[b] = 0;
+    }
+    propagate_block_table_and_bound(n, bt, ml, n_blocks, true);
+    for (int b = 0; b < n_blocks; ++b) {
+      if (bt[b] == -1)
+        ml[b] = 0;
+      else if (std::isinf(ml[b]))
+        ml[b] = double_max;
       n->cache.matrix_norm_valid[b] = false;
+      if (bt[b] != -1) n->cache.energy_lnorms[b] = energy_lnorm_from_children(n, b);
+      if (!has_trial_products || (bt[b] == -1)) continue;
+      // same span as a subtree of the trial tree: the product is already known
+      auto p = find_trial_product(t_min, t_max, b);
+      if (!p || (p->b_out != bt[b])) continue;
+      store_cached_matrix(n, b, p->data.data(), get_block_dim(bt[b]));
+      n->cache.matrix_norm_valid[b] = true;
+      update_cached_lnorm(n, b, p->data.data(), get_block_dim(bt[b]), get_block_dim(b));
     }
     // This is not necessary here as all modified nodes are "cleared"
     //  by tree::clear_modified in the try/cancel/confirm set
@@ -253,10 +725,67 @@ namespace triqs_cthyb {
     n->cache.dtau_l = (n->left ? double(tree.max_key(n->left) - n->key) : 0);
   }
 
+  //-------- Contribution of one block to the trace ------------------------------------------
+
+  impurity_trace::block_trace_t impurity_trace::compute_block_trace(int block_index, double dtau_beta, double dtau_0) {
+
+    auto root = tree.get_root();
+    block_trace_t r;
+    if constexpr (performance_counters_enabled) ++counters[thread_id()].n_blocks;
+
+    // computes the matrices, recursively along the modified path in the tree
+    std::pair<int, matrix_ref_t> b_mat; // {block that b connects to, matrix for this block}
+    h_scalar_t b_scalar;
+    if (scalar_blocks) {
+      std::tie(b_mat.first, b_scalar) = compute_scalar(root, block_index);
+      b_mat.second                    = {&b_scalar, 1, 1};
+    } else
+      b_mat = compute_matrix(root, block_index);
+    if (b_mat.first == -1) TRIQS_RUNTIME_ERROR << " Internal error : B = -1 after compute matrix : " << block_index;
+
+#ifdef CHECK_AGAINST_LINEAR_COMPUTATION
+    auto b_mat2 = check_one_block_matrix_linear(root, block_index, false);
+    if (max_element(abs(b_mat.second.to_matrix() - b_mat2)) > 1.e-10) TRIQS_RUNTIME_ERROR << " Matrix failed against linear computation";
+#endif
+
+    // trace(mat * exp(- H * (beta - tmax)) * exp (- H * tmin)) to handle the piece outside of the first-last operators.
+    // exp(-H * (dtau_beta + dtau_0)) = exp(-H * dtau_beta) * exp(-H * dtau_0): the same factors as for the density matrix
+    auto dim       = get_block_dim(block_index);
+    auto &ws       = get_workspace(0);
+    auto e_beta    = get_exp_factors(ws.exp_factors, block_index, dtau_beta);
+    auto e_0       = get_exp_factors(ws.exp_factors_0, block_index, dtau_0);
+    for (int u = 0; u < dim; ++u) {
+      auto x = b_mat.second(u, u) * (e_beta[u] * e_0[u]);
+      r.trace += x;
+      r.trace_abs += std::abs(x);
+    }
+
+    if (use_norm_as_weight) { // else we are not allowed to compute this matrix, may make no sense
+      // recompute the density matrix. Its validity flag is set by the caller, if the block is kept.
+      auto &mat = density_matrix[block_index].mat;
+      for (int u = 0; u < dim; ++u) {
+        for (int v = 0; v < dim; ++v) {
+          mat(u, v) = b_mat.second(u, v) * (e_beta[u] * e_0[v]);
+          double xx = std::abs(mat(u, v));
+          r.norm_sq += xx * xx;
+        }
+      }
+      // internal check
+      if (std::abs(r.trace) - 1.0000001 * std::sqrt(r.norm_sq) * get_block_dim(block_index) > 1.e-15)
+        TRIQS_RUNTIME_ERROR << "|trace| > dim * norm" << r.trace << " " << std::sqrt(r.norm_sq) << "  " << r.trace_abs;
+      if (std::abs(r.trace - trace(mat)) > 1.e-15) TRIQS_RUNTIME_ERROR << "Internal error : trace and density mismatch";
+    }
+    return r;
+  }
+
   //-------- Compute the full trace ------------------------------------------
   // Returns MC atomic weight and reweighting = trace/(atomic weight)
   std::pair<h_scalar_t, h_scalar_t> impurity_trace::compute(double p_yee, double u_yee) {
 
+    timeline::span timeline_span("impurity_trace::compute", &timeline_n_calls);
+    clear_trial_products(); // only those of this call can be moved into the cache
+    if constexpr (performance_counters_enabled) ++counters[0].n_compute;
+
     double epsilon         = 1.e-15; // Machine precision
     auto log_epsilon0      = -std::log(1.e-15);
     double lnorm_threshold = double_max - 100;
@@ -264,6 +793,12 @@ namespace triqs_cthyb {
 
     // simplifies later code
     if (tree_size == 0) {
+      if (record_block_weights) { // the atomic weights of the blocks
+        std::vector<std::pair<double, int>> lnorm_b;
+        for (int b = 0; b < n_blocks; ++b)
+          if (get_block_dim(b) > 0) lnorm_b.emplace_back(beta * get_block_emin(b), b);
+        record_block_weights_impl(lnorm_b);
+      }
       if (use_norm_as_weight) {
         density_matrix = atomic_rho;
         return {atomic_norm, atomic_z / atomic_norm};
@@ -288,22 +823,36 @@ namespace triqs_cthyb {
 
     update_dtau(root); // recompute the dtau for modified nodes
 
-    for (int b = 0; b < n_blocks; ++b) {
-      auto block_lnorm_pair = compute_block_table_and_bound(root, b, lnorm_threshold);
+    // The block tables and bounds of all the blocks, in one walk of the modified path.
+    // The blocks go in the order of the last sorted bounds, which the sort below then hardly changes.
+    if (block_order.empty())
+      for (int b = 0; b < n_blocks; ++b) block_order.push_back(b);
+    bound_blocks.clear();
+    for (int b : block_order)
+      if (get_block_dim(b) > 0) bound_blocks.push_back(b); // the others are discarded by the energy cutoff
+    int n_states = bound_blocks.size();
+    bound_lnorms.assign(n_states, 0);
+    propagate_block_table_and_bound(root, bound_blocks.data(), bound_lnorms.data(), n_states);
+
+    int i_state = 0;
+    for (int b : block_order) {
+      if (get_block_dim(b) == 0) continue;
+      int b_out    = bound_blocks[i_state];
+      double bound = bound_lnorms[i_state++];
+      if (std::isinf(bound)) bound = double_max;
 
       // Check that the final block is the same as the initial block or -1, indicating structural cancellation
       // This guarantees that the density matrix is blockwise diagonal (otherwise the code will have thrown an error).
       if (measure_density_matrix) {
-        if ((block_lnorm_pair.first != b) && (block_lnorm_pair.first != -1))
-          std::cerr << "WARNING: The product of atomic operators has a matrix element in the off-diagonal block (" << b << ","
-                    << block_lnorm_pair.first << ")\n"
+        if ((b_out != b) && (b_out != -1))
+          std::cerr << "WARNING: The product of atomic operators has a matrix element in the off-diagonal block (" << b << "," << b_out << ")\n"
                     << "You will not be able to use this density matrix to calculate expectations values of operators that do not "
                        "commute with the local Hamiltonian!"
                     << std::endl;
       }
 
-      if (block_lnorm_pair.first == b) { // final structural check B ---> returns to B.
-        double lnorm    = block_lnorm_pair.second + dtau * get_block_emin(b);
+      if (b_out == b) { // final structural check B ---> returns to B.
+        double lnorm    = bound + dtau * get_block_emin(b);
         lnorm_threshold = std::min(lnorm_threshold, lnorm + log_epsilon0);
         init_to_sort_lnorm_b.emplace_back(lnorm, b);
       }
@@ -317,8 +866,30 @@ namespace triqs_cthyb {
 
     if (to_sort_lnorm_b.size() == 0) return {0.0, 1}; // structural 0
 
-    // Now sort the blocks non structurally 0 according to the bound
-    std::sort(to_sort_lnorm_b.begin(), to_sort_lnorm_b.end());
+    // Now sort the blocks non structurally 0 according to the bound.
+    // They come in the order of the last call: an insertion sort takes O(n + inversions), std::sort if there are too many.
+    {
+      long n_moves = 0, max_moves = 4 * long(to_sort_lnorm_b.size()) + 16;
+      for (size_t i = 1; (i < to_sort_lnorm_b.size()) && (n_moves <= max_moves); ++i)
+        for (size_t j = i; (j > 0) && (to_sort_lnorm_b[j] < to_sort_lnorm_b[j - 1]) && (n_moves <= max_moves); --j, ++n_moves)
+          std::swap(to_sort_lnorm_b[j], to_sort_lnorm_b[j - 1]);
+      if (n_moves > max_moves) std::sort(to_sort_lnorm_b.begin(), to_sort_lnorm_b.end());
+    }
+    // the sorted blocks first, then the others in their previous order
+    {
+      auto &order = bound_blocks; // no longer needed
+      order.clear();
+      block_is_sorted.assign(n_blocks, 0);
+      for (auto const &lb : to_sort_lnorm_b) {
+        order.push_back(lb.second);
+        block_is_sorted[lb.second] = 1;
+      }
+      for (int b : block_order)
+        if (!block_is_sorted[b]) order.push_back(b);
+      block_order.swap(order);
+    }
+
+    if (record_block_weights) record_block_weights_impl(to_sort_lnorm_b);
 
     // Prepare to loop over all blocks (in sorted order).
     // According to estimator, truncate as epsilon.
@@ -344,6 +915,33 @@ namespace triqs_cthyb {
       for (int bl = n_bl - 1; bl >= 0; --bl) bound_cumul[bl] = bound_cumul[bl + 1] + std::exp(-to_sort_lnorm_b[bl].first);
     }
 
+    // Speculative evaluation of the leading blocks in parallel. The truncation and the Yee criterion
+    // are applied afterwards in the serial loop below, which gives the same result as a serial run.
+    int n_spec = (n_parallel_blocks > 1 ? std::min(n_parallel_blocks, n_bl) : 0);
+    auto spec_traces = std::vector<block_trace_t>(n_spec);
+    if (n_spec > 0) {
+      if ((p_yee >= 0.0) && (std::abs(p_yee) * bound_cumul[0] < u_yee)) { // Yee rejection before any block, as below
+        if constexpr (performance_counters_enabled) ++counters[0].n_yee_exits;
+        return {0, 1};
+      }
+#ifdef _OPENMP
+      if (int(workspaces.size()) < omp_get_max_threads()) workspaces.resize(omp_get_max_threads());
+      if (int(counters.size()) < omp_get_max_threads()) counters.resize(omp_get_max_threads());
+      if (int(trial_products.size()) < omp_get_max_threads()) trial_products.resize(omp_get_max_threads());
+#endif
+      std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic)
+      for (int bl = 0; bl < n_spec; ++bl) {
+        try {
+          spec_traces[bl] = compute_block_trace(to_sort_lnorm_b[bl].second, dtau_beta, dtau_0);
+        } catch (...) {
+#pragma omp critical(cthyb_trace_error)
+          error = std::current_exception();
+        }
+      }
+      if (error) std::rethrow_exception(error);
+    }
+
     int bl;
     for (bl = 0; bl < n_bl; ++bl) { // sum over all blocks
 
@@ -356,50 +954,22 @@ namespace triqs_cthyb {
       if (p_yee >= 0.0) {
         auto current_weight = (use_norm_as_weight ? std::sqrt(norm_trace_sq) : full_trace);
         auto pmax           = std::abs(p_yee) * (std::abs(current_weight) + bound_cumul[bl]);
-        if (pmax < u_yee) return {0, 1}; // pmax < u, we can reject
-      }
-
-      // computes the matrices, recursively along the modified path in the tree
-      auto b_mat = compute_matrix(root, block_index); // b_mat = {block that b connects to, matrix for this block}
-      if (b_mat.first == -1) TRIQS_RUNTIME_ERROR << " Internal error : B = -1 after compute matrix : " << block_index;
-
-#ifdef CHECK_AGAINST_LINEAR_COMPUTATION
-      auto b_mat2 = check_one_block_matrix_linear(root, block_index, false);
-      if (max_element(abs(b_mat.second - b_mat2)) > 1.e-10) TRIQS_RUNTIME_ERROR << " Matrix failed against linear computation";
-#endif
-
-      // trace(mat * exp(- H * (beta - tmax)) * exp (- H * tmin)) to handle the piece outside of the first-last operators.
-      h_scalar_t trace_partial = 0;
-      auto dim                 = get_block_dim(block_index);
-      for (int u = 0; u < dim; ++u) {
-        auto x = b_mat.second(u, u) * std::exp(-dtau * get_block_eigenval(block_index, u));
-        trace_partial += x;
-        trace_abs += std::abs(x);
-      }
-
-      if (use_norm_as_weight) { // else we are not allowed to compute this matrix, may make no sense
-        // recompute the density matrix
-        density_matrix[block_index].is_valid = true;
-        double norm_trace_sq_partial         = 0;
-        auto &mat                            = density_matrix[block_index].mat;
-        for (int u = 0; u < dim; ++u) {
-          for (int v = 0; v < dim; ++v) {
-            mat(u, v) = b_mat.second(u, v) * std::exp(-dtau_beta * get_block_eigenval(block_index, u) - dtau_0 * get_block_eigenval(block_index, v));
-            double xx = std::abs(mat(u, v));
-            norm_trace_sq_partial += xx * xx;
-          }
+        if (pmax < u_yee) { // pmax < u, we can reject
+          if constexpr (performance_counters_enabled) ++counters[0].n_yee_exits;
+          return {0, 1};
         }
-        norm_trace_sq += norm_trace_sq_partial;
-        // internal check
-        if (std::abs(trace_partial) - 1.0000001 * std::sqrt(norm_trace_sq_partial) * get_block_dim(block_index) > 1.e-15)
-          TRIQS_RUNTIME_ERROR << "|trace| > dim * norm" << trace_partial << " " << std::sqrt(norm_trace_sq_partial) << "  " << trace_abs;
-        if (std::abs(trace_partial - trace(mat)) > 1.e-15) TRIQS_RUNTIME_ERROR << "Internal error : trace and density mismatch";
       }
 
+      auto bt                  = (bl < n_spec ? spec_traces[bl] : compute_block_trace(block_index, dtau_beta, dtau_0));
+      h_scalar_t trace_partial = bt.trace;
+      trace_abs += bt.trace_abs;
+      norm_trace_sq += bt.norm_sq;
+      if (use_norm_as_weight) density_matrix[block_index].is_valid = true;
+
 #ifdef CHECK_MATRIX_BOUNDED_BY_BOUND
-      if (std::abs(trace_partial) > 1.000001 * dim * std::exp(-to_sort_lnorm_b[bl].first))
+      if (std::abs(trace_partial) > 1.000001 * get_block_dim(block_index) * std::exp(-to_sort_lnorm_b[bl].first))
         TRIQS_RUNTIME_ERROR << "Matrix not bounded by the bound ! test is " << std::abs(trace_partial) << " < "
-                            << dim * std::exp(-to_sort_lnorm_b[bl].first);
+                            << get_block_dim(block_index) * std::exp(-to_sort_lnorm_b[bl].first);
 #endif
 
       full_trace += trace_partial; // sum for all blocks
@@ -441,6 +1011,143 @@ namespace triqs_cthyb {
     return {norm_trace, rw};
   }
 
+  // -------- Pruning of the subspaces --------
+
+  // The relative bounds of the blocks at the root, from the -ln of their bounds (without the dimension)
+  void impurity_trace::record_block_weights_impl(std::vector<std::pair<double, int>> const &lnorm_b) {
+    if (block_max_weights.empty()) block_max_weights.assign(n_blocks, 0);
+    if (lnorm_b.empty()) return;
+    double lnorm_min = double_max;
+    for (auto const &lb : lnorm_b) lnorm_min = std::min(lnorm_min, lb.first);
+    // as bound_cumul in compute, relative to the largest bound
+    auto bound = [&](std::pair<double, int> const &lb) {
+      return std::exp(lnorm_min - lb.first) * (use_norm_as_weight ? 1.0 : std::sqrt(get_block_dim(lb.second)));
+    };
+    double total = 0;
+    for (auto const &lb : lnorm_b) total += bound(lb);
+    for (auto const &lb : lnorm_b) block_max_weights[lb.second] = std::max(block_max_weights[lb.second], bound(lb) / total);
+  }
+
+  double impurity_trace::prune_blocks(double tolerance) {
+    if (block_max_weights.empty()) return 0;
+    int b_max        = std::max_element(block_max_weights.begin(), block_max_weights.end()) - block_max_weights.begin();
+    double discarded = 0;
+    int n_pruned     = 0;
+    for (int b = 0; b < n_blocks; ++b)
+      if ((get_block_dim(b) > 0) && (b != b_max) && (block_max_weights[b] < tolerance)) {
+        block_dims[b] = 0;
+        discarded += block_max_weights[b];
+        ++n_pruned;
+      }
+    block_max_weights.clear();
+    if (n_pruned == 0) return 0;
+
+    is_truncated = true;
+    init_blocks();
+    block_order.clear();
+    set_modified(tree.get_root());
+    update_cache();
+    tree.clear_modified();
+    return discarded;
+  }
+
+  //-------- Traces with a pair of auxiliary operators ----------------------
+  // With the times u_k = tau_k - tau1 of the operators O_k of the configuration, sorted in (0, beta), u_0 = 0 and u_{n+1} = beta,
+  // and op2 = Y in the segment (u_s, u_{s+1}):
+  //   trace = Tr[S_s e^{-(u_{s+1} - dtau) H} Y e^{-(dtau - u_s) H} A_s]
+  // with the prefix A_s = O_s e^{-(u_s - u_{s-1}) H} ... O_1 e^{-u_1 H} op1 and the suffix S_s = e^{-(beta - u_n) H} O_n ... O_{s+1}.
+  void impurity_trace::compute_aux_pair_traces(op_desc const &op1, op_desc const &op2, time_pt const &tau1, std::vector<double> const &dtaus,
+                                               std::vector<h_scalar_t> &traces) {
+
+    traces.assign(dtaus.size(), 0);
+
+    // The operators of the configuration, by increasing time from tau1 on
+    std::vector<node> ops;
+    bool on_operator = false;
+    foreach_reverse(tree, [&](node n) {
+      if (n->delete_flag) return;
+      if (n->key == tau1) on_operator = true;
+      ops.push_back(n);
+    });
+    if (on_operator) return; // as for an insertion in the tree
+    std::rotate(ops.begin(), std::find_if(ops.begin(), ops.end(), [&tau1](node n) { return n->key > tau1; }), ops.end());
+
+    int n_ops = ops.size();
+    std::vector<double> u(n_ops + 2);
+    u[0]         = 0;
+    u[n_ops + 1] = beta;
+    for (int k = 1; k <= n_ops; ++k) u[k] = double(ops[k - 1]->key - tau1);
+
+    std::vector<double> e1, e2;
+
+    // The suffixes S_s, for all blocks b at their right, and the block at their left (-1 for a structural zero)
+    std::vector<std::vector<h_scalar_t>> suffix((n_ops + 1) * n_blocks);
+    std::vector<int> suffix_end((n_ops + 1) * n_blocks, -1);
+    auto sfx = [this](int s, int b) { return s * n_blocks + b; };
+    for (int b = 0; b < n_blocks; ++b) {
+      int dim = get_block_dim(b);
+      if (dim == 0) continue;
+      kernels::set_identity(resized(suffix[sfx(n_ops, b)], dim * dim), dim);
+      suffix_end[sfx(n_ops, b)] = b;
+    }
+    for (int s = n_ops; s > 0; --s) { // S_{s-1} = S_s e^{-(u_{s+1} - u_s) H} O_s
+      for (int b = 0; b < n_blocks; ++b) {
+        int bp = get_op_block_map(ops[s - 1], b);
+        if ((bp == -1) || (suffix_end[sfx(s, bp)] == -1)) continue;
+        int b_end = suffix_end[sfx(s, bp)];
+        auto e    = get_exp_factors(e1, bp, u[s + 1] - u[s]);
+        kernels::gemm_csr(resized(suffix[sfx(s - 1, b)], get_block_dim(b_end) * get_block_dim(b)), suffix[sfx(s, bp)].data(), e,
+                          get_op_block_csr(ops[s - 1], b), get_block_dim(b_end));
+        suffix_end[sfx(s - 1, b)] = b_end;
+      }
+    }
+
+    // Sweep over the segments with the prefixes A_s, block by block
+    std::vector<h_scalar_t> prefix, prefix_next, K;
+    for (int b = 0; b < n_blocks; ++b) {
+      int dim = get_block_dim(b);
+      if (dim == 0) continue;
+      int a = get_op_block_map(op1, b); // the block at the left of A_s
+      if (a == -1) continue;
+      auto const &x = get_op_block_csr(op1, b);
+      std::vector<h_scalar_t> id(dim * dim);
+      kernels::set_identity(id.data(), dim);
+      kernels::csr_gemm(resized(prefix, get_block_dim(a) * dim), x, nullptr, id.data(), dim);
+
+      int j = 0; // the first dtau of the segment
+      for (int s = 0; s <= n_ops; ++s) {
+        int j_end = j;
+        while ((j_end < int(dtaus.size())) && ((s == n_ops) || (dtaus[j_end] < u[s + 1]))) ++j_end;
+
+        int c = get_op_block_map(op2, a);
+        if ((j_end > j) && (c != -1) && (suffix_end[sfx(s, c)] == b)) {
+          // K = A_s S_s, then trace = sum_{k, i} e^{-(u_{s+1} - dtau) E_k} Y_{ki} e^{-(dtau - u_s) E_i} K_{ik}
+          int dim_a = get_block_dim(a), dim_c = get_block_dim(c);
+          kernels::gemm(resized(K, dim_a * dim_c), prefix.data(), suffix[sfx(s, c)].data(), dim_a, dim, dim_c);
+          auto const &y = get_op_block_csr(op2, a);
+          for (int jj = j; jj < j_end; ++jj) {
+            auto d1      = get_exp_factors(e1, c, u[s + 1] - dtaus[jj]);
+            auto d2      = get_exp_factors(e2, a, dtaus[jj] - u[s]);
+            h_scalar_t r = 0;
+            for (int k = 0; k < y.n_rows; ++k)
+              for (int p = y.row_start[k]; p < y.row_start[k + 1]; ++p) r += d1[k] * y.vals[p] * d2[y.cols[p]] * K[y.cols[p] * dim_c + k];
+            traces[jj] += r;
+          }
+        }
+        j = j_end;
+
+        if (s == n_ops) break;
+        // A_{s+1} = O_{s+1} e^{-(u_{s+1} - u_s) H} A_s
+        int a_next = get_op_block_map(ops[s], a);
+        if (a_next == -1) break;
+        auto e = get_exp_factors(e1, a, u[s + 1] - u[s]);
+        kernels::csr_gemm(resized(prefix_next, get_block_dim(a_next) * dim), get_op_block_csr(ops[s], a), e, prefix.data(), dim);
+        std::swap(prefix, prefix_next);
+        a = a_next;
+      }
+    }
+  }
+
   /// Stream insertion
   std::ostream &operator<<(std::ostream &out, impurity_trace const & imp_trace) {
     out << "Impurity trace: size = " << imp_trace.tree_size << "\n";
@@ -21,9 +21,16 @@
 #pragma once
 #include "./configuration.hpp"
 #include "./parameters.hpp"
+#include "./cache_arena.hpp"
+#include "./trace_kernels.hpp"
+#include "./performance_counters.hpp"
+#include "./timeline.hpp"
 #include "triqs/utility/rbt.hpp"
 #include <triqs/statistics/histograms.hpp>
 #include <triqs/atom_diag/atom_diag.hpp>
+#include <algorithm>
+#include <deque>
+#include <iterator>
 
 //#define PRINT_CONF_DEBUG
 
@@ -43,11 +50,17 @@ namespace triqs_cthyb {
     double beta;
     bool use_norm_as_weight;
     bool measure_density_matrix;
+    int n_parallel_blocks = 0; // number of leading blocks computed in parallel in compute()
 
     public:
     // construct from the config, the diagonalization of h_loc, and parameters
+    // If energy_cutoff > 0, only the eigenstates with beta * (E - E_0) <= energy_cutoff enter the trace.
     impurity_trace(double beta, atom_diag const &h_diag, histo_map_t *hist_map,
-		   bool use_norm_as_weight=false, bool measure_density_matrix=false, bool performance_analysis=false);
+		   bool use_norm_as_weight=false, bool measure_density_matrix=false, bool performance_analysis=false,
+		   double energy_cutoff=-1);
+
+    // construct from the diagonalization of h_loc and the solve parameters
+    impurity_trace(double beta, atom_diag const &h_diag, histo_map_t *hist_map, solve_parameters_t const &p);
 
     ~impurity_trace() {
       cancel_insert_impl(); // in case of an exception, we need to remove any trial nodes before cleaning the tree!
@@ -55,6 +68,42 @@ namespace triqs_cthyb {
 
     std::pair<h_scalar_t, h_scalar_t> compute(double p_yee = -1, double u_yee = 0);
 
+    // A bound of the trace from the eigenvalues alone, relative to e^{-beta E_0}, for the current (trial) tree.
+    // It only depends on the configuration, not on the state of the cache. No matrix is computed.
+    double compute_energy_bound();
+
+    // Is the trace of the current (trial) tree structurally non-zero, i.e. does a block go back to itself through all the operators?
+    // Only the block tables, of all blocks at once: no matrix, no bound. The moves call it before any work on the determinants.
+    bool is_structurally_nonzero();
+
+    // Pruning of the subspaces. With record_block_weights, compute() records the largest relative bound of each block at the root
+    // (its share of the bound of the trace), over the calls. prune_blocks then drops the blocks whose largest relative bound stayed
+    // below tolerance, as the energy cutoff drops states: they are structural zeros afterwards, and are skipped by all the loops.
+    // The block with the largest relative bound is always kept. The cache of the current tree is rebuilt.
+    // Returns the sum of the largest relative bounds of the dropped blocks, an estimate of the relative error on the trace.
+    bool record_block_weights = false;
+    double prune_blocks(double tolerance);
+
+    // The number of blocks in the trace (not emptied by the energy cutoff or the pruning)
+    int n_blocks_kept() const { return std::count_if(block_dims.begin(), block_dims.end(), [](int d) { return d > 0; }); }
+
+    // The number of the matrices of the cache of the current tree stored in single precision (trace_single_precision_tol)
+    int n_single_matrices();
+
+    // The counters of compute() since the construction, summed over the threads
+    trace_counters_t get_counters() const {
+      trace_counters_t r;
+      for (auto const &c : counters) r += c;
+      return r;
+    }
+
+    // The traces with the auxiliary operators op1 at tau1 and op2 at tau1 + dtau (modulo beta), for the sorted dtau in [0, beta],
+    // in traces. op2 is after op1 for dtau = 0, and before it for dtau = beta. The traces are 0 if tau1 is the time of an operator.
+    // The trace is cyclic: from tau1 on, the partial products of the configuration at all the operator boundaries are computed once,
+    // then each dtau only costs a contraction with the matrix of op2, instead of an insertion in the tree.
+    void compute_aux_pair_traces(op_desc const &op1, op_desc const &op2, time_pt const &tau1, std::vector<double> const &dtaus,
+                                 std::vector<h_scalar_t> &traces);
+
     // ------- Configuration and h_loc data ----------------
 
     const configuration *config;                                  // config object does exist longer (temporally) than this object.
@@ -75,45 +124,130 @@ namespace triqs_cthyb {
     double atomic_z;                                // atomic partition function
     double atomic_norm;                             // Frobenius norm of atomic_rho
 
+    // density_matrix of the accepted configuration, for the tree_id at which it was computed (-1: not computed yet)
+    arrays::vector<bool_and_matrix> accepted_density_matrix;
+    long accepted_density_matrix_id = -1;
+    long tree_id                    = 0; // incremented by each confirmed change of the tree
+
     public:
+    // The density matrix of the last compute(), which may be that of a rejected move
     arrays::vector<bool_and_matrix> const &get_density_matrix() const { return density_matrix; }
 
+    // The density matrix of the current (accepted) configuration, without any Yee threshold.
+    // Only recomputed on the first call after a change of configuration.
+    arrays::vector<bool_and_matrix> const &get_accepted_density_matrix() {
+      if (accepted_density_matrix_id != tree_id) {
+        compute();
+        accepted_density_matrix    = density_matrix;
+        accepted_density_matrix_id = tree_id;
+      }
+      return accepted_density_matrix;
+    }
+
     // ------------------ Cache data ----------------
 
     private:
     // The data stored for each node in tree
-    struct cache_t {
-      double dtau_l = 0, dtau_r = 0;                    // difference in tau of this node and left and right sub-trees
-      std::vector<int> block_table;                     // number of blocks limited to 2^15
-      std::vector<arrays::matrix<h_scalar_t>> matrices; // partial product of operator/time evolution matrices
-      std::vector<double> matrix_lnorms;                // -ln(norm(matrix))
-      std::vector<bool> matrix_norm_valid;              // is the norm of the matrix still valid?
-      cache_t(int n_blocks) : block_table(n_blocks), matrix_lnorms(n_blocks), matrices(n_blocks), matrix_norm_valid(n_blocks) {}
+    // The per-block arrays (block_table, matrices, matrix_lnorms, energy_lnorms, matrix_norm_valid) live in the arena.
+    struct cache_t : cache_arena::header_t {
+      double dtau_l = 0, dtau_r = 0; // difference in tau of this node and left and right sub-trees
+      cache_arena *arena;
+      cache_t(cache_arena &arena) : cache_arena::header_t(arena.acquire_header()), arena(&arena) {}
+      cache_t(cache_t const &x) : cache_arena::header_t(x.arena->acquire_header()), dtau_l(x.dtau_l), dtau_r(x.dtau_r), arena(x.arena) {
+        arena->copy_header(x, *this);
+      }
+      cache_t &operator=(cache_t const &x) {
+        dtau_l = x.dtau_l;
+        dtau_r = x.dtau_r;
+        arena->copy_header(x, *this);
+        return *this;
+      }
+      ~cache_t() { arena->release_header(*this); }
     };
 
+    // index of the operators with block_index and dagger in cache.op_counts
+    static int op_count_index(int block_index, bool dagger) { return 2 * block_index + dagger; }
+
     struct node_data_t {
       op_desc op;
       cache_t cache;
-      node_data_t(op_desc op, int n_blocks) : op(op), cache(n_blocks) {}
+      node_data_t(op_desc op, cache_arena &arena) : op(op), cache(arena) {}
       void reset(op_desc op_new) { op = op_new; }
+
+      // called by the tree when the subtree changes: counts of the operators by (block_index, dagger) in the subtree
+      void update_subtree(node_data_t const *l, node_data_t const *r) {
+        int n = cache.arena->get_n_op_counts();
+        for (int k = 0; k < n; ++k) cache.op_counts[k] = (l ? l->cache.op_counts[k] : 0) + (r ? r->cache.op_counts[k] : 0);
+        ++cache.op_counts[op_count_index(op.block_index, op.dagger)];
+      }
     };
 
+    // A binary tree minimizes the work of an update: with k children per node, recomputing a node after the change
+    // of one child takes k-1 products, i.e. (k-1) log_k(N) >= log_2(N) products along the modified path.
+    // Wider nodes only pay off with prefix products of the children, which is again a binary tree.
     using rb_tree_t = rb_tree<time_pt, node_data_t, std::greater<time_pt>>;
     using node      = rb_tree_t::node;
 
+    // Storage of the caches of all nodes. Must outlive the tree, the pools of trial nodes and the spare nodes.
+    // The block_index of the operators is smaller than n_orbitals.
+    cache_arena arena = {n_blocks, 2 * n_orbitals};
+
 #ifdef EXT_DEBUG
     public:
 #endif
     rb_tree_t tree; // the red black tree and its nodes
 
+    private:
+    // Nodes removed from the tree, with their cache, handed over by the release hook of the tree.
+    // They are recycled by insert_in_tree, so that accepted moves do not allocate.
+    std::vector<std::unique_ptr<rb_tree_t::node_t>> spare_nodes;
+
+    // red black insertion of op at tau, on a spare node if there is one
+    void insert_in_tree(time_pt const &tau, op_desc const &op) {
+      if (spare_nodes.empty()) {
+        tree.insert(tau, {op, arena});
+        return;
+      }
+      node n = spare_nodes.back().release();
+      spare_nodes.pop_back();
+      n->reset(tau, op);
+      try {
+        tree.insert_node(n);
+      } catch (rbt_insert_error const &) {
+        spare_nodes.emplace_back(n);
+        throw;
+      }
+    }
+
+#ifdef EXT_DEBUG
+    public:
+#endif
     std::vector<atom_diag::op_block_mat_t> aux_operators;
     
     // ---------------- Cache machinery ----------------
     void update_cache();
 
     private:
-    // The dimension of block b
-    int get_block_dim(int b) const { return h_diag->get_subspace_dim(b); }
+    // Number of eigenstates of each block kept in the trace: the lowest ones, all of them unless truncated.
+    // The density matrices keep the full dimension of the blocks, with zeros for the discarded states.
+    std::vector<int> block_dims;
+    bool is_truncated = false;
+    void init_blocks(); // the data which depends on block_dims
+
+    // the largest relative bound of each block at the root, with record_block_weights
+    std::vector<double> block_max_weights;
+    void record_block_weights_impl(std::vector<std::pair<double, int>> const &lnorm_b);
+
+    // the cache of the whole tree is rebuilt by the next update_cache
+    void set_modified(node n) {
+      if (n == nullptr) return;
+      n->modified = true;
+      set_modified(n->left);
+      set_modified(n->right);
+    }
+
+    // The dimension of block b in the trace
+    int get_block_dim(int b) const { return block_dims[b]; }
 
     // the i-th eigenvalue of the block b
     double get_block_eigenval(int b, int i) const { return h_diag->get_eigenvalue(b, i); }
@@ -121,18 +255,33 @@ namespace triqs_cthyb {
     // the minimal eigenvalue of the block b
     double get_block_emin(int b) const { return get_block_eigenval(b, 0); }
 
-    // node, block -> image of the block by n->op (the operator)
-    int get_op_block_map(node n, int b) const {
-      if( n->op.linear_index >= 0 )
-	return (n->op.dagger ? h_diag->cdag_connection(n->op.linear_index, b) : h_diag->c_connection(n->op.linear_index, b));
+    // E_i - E_min of all blocks, contiguous. Block b starts at shifted_eigenvals_start[b], on a cache line boundary.
+    std::vector<double, kernels::aligned_allocator<double>> shifted_eigenvals;
+    std::vector<int> shifted_eigenvals_start;
+
+    // node, block -> image of the block by n->op (the operator). Blocks emptied by the truncation are structural zeros.
+    int get_op_block_map(node n, int b) const { return get_op_block_map(n->op, b); }
+    int get_op_block_map(op_desc const &op, int b) const {
+      int r;
+      if( op.linear_index >= 0 )
+	r = (op.dagger ? h_diag->cdag_connection(op.linear_index, b) : h_diag->c_connection(op.linear_index, b));
       else {
-	int aux_idx = -n->op.linear_index - 1;
-	return aux_operators[aux_idx].connection(b);
+	int aux_idx = -op.linear_index - 1;
+	r = aux_operators[aux_idx].connection(b);
       }
+      if (is_truncated && ((r == -1) || (block_dims[b] == 0) || (block_dims[r] == 0))) return -1;
+      return r;
     }
 
+    // Operator blocks restricted to the kept eigenstates, only if is_truncated: [linear_index][block], and for the auxiliary operators
+    std::vector<std::vector<matrix<h_scalar_t>>> c_truncated, cdag_truncated, aux_truncated;
+
     // the matrix of n->op, from block b to its image
     matrix<h_scalar_t> const &get_op_block_matrix(node n, int b) const {
+      if (is_truncated) {
+        if (n->op.linear_index >= 0) return (n->op.dagger ? cdag_truncated[n->op.linear_index][b] : c_truncated[n->op.linear_index][b]);
+        return aux_truncated[-n->op.linear_index - 1][b];
+      }
       if( n->op.linear_index >= 0 )
 	return (n->op.dagger ? h_diag->cdag_matrix(n->op.linear_index, b) : h_diag->c_matrix(n->op.linear_index, b));
       else {
@@ -141,34 +290,197 @@ namespace triqs_cthyb {
       }
     }
 
+    // -ln of the bounds of the spectral norms of the operator blocks, from block b to its image: [linear_index][block], and for
+    // the auxiliary operators. They enter the bounds of the trace, so that an operator with small elements sharpens them.
+    std::vector<std::vector<double>> c_lnorms, cdag_lnorms, aux_lnorms;
+    double get_op_block_lnorm(op_desc const &op, int b) const {
+      if (op.linear_index >= 0) return (op.dagger ? cdag_lnorms[op.linear_index][b] : c_lnorms[op.linear_index][b]);
+      return aux_lnorms[-op.linear_index - 1][b];
+    }
+
+    // Sparse copies of the operator blocks, built once: [linear_index][block], and for the auxiliary operators
+    using op_block_csr_t = kernels::csr_matrix<h_scalar_t>;
+    std::vector<std::vector<op_block_csr_t>> c_csr, cdag_csr, aux_csr;
+    static op_block_csr_t make_csr(matrix<h_scalar_t> const &m);
+
+    // Sparse (and truncated if needed) copies of the block of an operator, from block b to b_to (-1: structural zero)
+    // with lnorm, -ln of a bound of its spectral norm
+    void add_op_block(matrix<h_scalar_t> const &m, int b, int b_to, op_block_csr_t &csr, matrix<h_scalar_t> *truncated, double &lnorm);
+
+    // the sparse matrix of n->op, from block b to its image
+    op_block_csr_t const &get_op_block_csr(node n, int b) const { return get_op_block_csr(n->op, b); }
+    op_block_csr_t const &get_op_block_csr(op_desc const &op, int b) const {
+      if (op.linear_index >= 0) return (op.dagger ? cdag_csr[op.linear_index][b] : c_csr[op.linear_index][b]);
+      return aux_csr[-op.linear_index - 1][b];
+    }
+
     // recursive function for tree traversal
     int compute_block_table(node n, int b);
-    std::pair<int, double> compute_block_table_and_bound(node n, int b, double bound_threshold, bool use_threshold = true);
-    std::pair<int, matrix_t> compute_matrix(node n, int b);
+
+    // The block tables and bounds of all blocks together, in one walk of the modified path (structure of arrays):
+    // state i enters subtree n in block bs[i] with log-bound ls[i], and leaves it in bs[i] (-1: structural zero) with ls[i] added to.
+    // With children_cached, the caches of the children of n are up to date, whether they are flagged as modified or not.
+    void propagate_block_table_and_bound(node n, int *bs, double *ls, int n_states, bool children_cached = false);
+    void propagate_through_cache(node n, int *bs, double *ls, int n_states) const;
+    // The same for the blocks only, dropping the structural zeros: returns the number of states left
+    int propagate_block_table(node n, int *bs, int *b_start, int n_states) const;
+    std::vector<int> structural_blocks, structural_starts; // states of the walk in is_structurally_nonzero()
+    std::vector<int> bound_blocks;      // states of the walk in compute()
+    std::vector<double> bound_lnorms;   // idem
+    std::vector<int> block_order;       // all blocks, those of the last sorted bounds first: a warm start for the sort in compute()
+    std::vector<char> block_is_sorted;  // idem
+
+    // the bound of the trace from the eigenvalues alone, cf compute_energy_bound
+    std::pair<int, double> compute_energy_bound_impl(node n, int b);
+    double energy_lnorm_from_children(node n, int b);
+
+    // A view of a row-major matrix: in the cache, an operator block, or the workspace
+    struct matrix_ref_t {
+      h_scalar_t const *data = nullptr;
+      int n_rows = 0, n_cols = 0;
+      h_scalar_t operator()(int i, int j) const { return data[i * n_cols + j]; }
+      matrix_t to_matrix() const;
+    };
+
+    // Buffers used by compute_matrix at a given depth in the tree.
+    // They only grow, so after a few calls compute_matrix no longer allocates.
+    struct workspace_t {
+      std::vector<h_scalar_t> scratch1, scratch2;
+      std::vector<h_scalar_t> cached; // a matrix of the cache in double precision, read from or to be stored in single precision
+      std::vector<double> exp_factors, exp_factors_0; // the latter only for the final trace
+    };
+    // by thread, then by depth. A deque never moves its elements when growing.
+    std::vector<std::deque<workspace_t>> workspaces = std::vector<std::deque<workspace_t>>(1);
+
+    workspace_t &get_workspace(int depth) {
+      auto &ws = workspaces[thread_id()];
+      while (int(ws.size()) <= depth) ws.emplace_back();
+      return ws[depth];
+    }
+
+    // OpenMP thread number, 0 when compiled without OpenMP
+    static int thread_id();
+
+    long timeline_n_calls = 0; // calls of compute(), for the sampling of the timeline
+
+    // Counters of compute(), by thread, only recorded with performance_counters_enabled
+    std::vector<trace_counters_t> counters = std::vector<trace_counters_t>(1);
+
+    // a product of n_fma multiply-adds in the trace
+    void count_product(double n_fma) {
+      if constexpr (performance_counters_enabled) {
+        auto &c = counters[thread_id()];
+        ++c.n_gemm;
+        c.flops += n_fma * (triqs::is_complex<h_scalar_t>::value ? 8 : 2);
+      }
+    }
+
+    // The products computed for the modified nodes by the last compute(), by thread.
+    // The product of a subtree only depends on the operators in its time span, not on the shape of the tree:
+    // when the move is confirmed, they are moved into the cache of the nodes of the balanced tree with the same span.
+    struct trial_product_t {
+      time_pt t_min, t_max;         // span of the subtree: tree.min_key(n), tree.max_key(n)
+      int b = -1, b_out = -1;       // block, and its image by the product
+      std::vector<h_scalar_t> data; // row-major, dim(b_out) x dim(b)
+    };
+    struct trial_products_t {
+      std::deque<trial_product_t> items; // the first n_used are valid. A deque never moves its elements when growing.
+      int n_used = 0;
+      trial_product_t &next() {
+        if (int(items.size()) <= n_used) items.emplace_back();
+        return items[n_used++];
+      }
+    };
+    std::vector<trial_products_t> trial_products = std::vector<trial_products_t>(1);
+    std::vector<trial_product_t const *> trial_products_sorted; // all valid products, sorted by (t_min, t_max, b)
+
+    void clear_trial_products() {
+      for (auto &t : trial_products) t.n_used = 0;
+      trial_products_sorted.clear();
+    }
+    void sort_trial_products();
+    trial_product_t const *find_trial_product(time_pt const &t_min, time_pt const &t_max, int b) const;
+
+    // -ln(norm) of the matrix m of block b in the cache, if use_norm_of_matrices_in_cache
+    void update_cached_lnorm(node n, int b, h_scalar_t const *m, int n_rows, int n_cols);
+
+    // exp(-dtau * E_i) for the eigenvalues E_i of block b, in buf
+    double const *get_exp_factors(std::vector<double> &buf, int b, double dtau);
+
+    // the matrix of block b in the cache of node n, converted into buf if it is stored in single precision
+    matrix_ref_t get_cached_matrix(node n, int b, std::vector<h_scalar_t> &buf) const {
+      int n_rows = get_block_dim(n->cache.block_table[b]), n_cols = get_block_dim(b);
+      if (!n->cache.matrix_is_single[b]) return {n->cache.matrices[b], n_rows, n_cols};
+      auto const *p = reinterpret_cast<h_single_t const *>(n->cache.matrices[b]);
+      if (int(buf.size()) < n_rows * n_cols) buf.resize(n_rows * n_cols);
+      std::copy(p, p + n_rows * n_cols, buf.begin());
+      return {buf.data(), n_rows, n_cols};
+    }
+
+    // Single precision in the cache (trace_single_precision_tol > 0). The matrices of the blocks of dimension >= single_min_block_dim
+    // are stored in single precision if the bound of their rounding error, relative to the largest bound of the blocks of the node
+    // (from matrix_lnorms), is below single_precision_tol. The dominant blocks, those near the truncation of the trace among them,
+    // stay in double precision, as the root, for the trace and the density matrix. The products are always computed in double precision.
+    // Not with n_parallel_blocks > 1: the choice would depend on the order in which the threads update the bounds of the node.
+    double single_precision_tol = 0;
+    int single_min_block_dim    = 16;
+    bool store_in_single(node n, int b, int n_rows) const;
+
+    // Stores the n_rows x dim(b) matrix m as the matrix of block b in the cache of node n, in single precision if store_in_single
+    void store_cached_matrix(node n, int b, h_scalar_t const *m, int n_rows);
+
+    // The products in compute_matrix for block b have dim(b) columns: a kernel of that fixed size for small blocks.
+    // The large blocks stay on the host BLAS: on a GPU, the products only pay off if the cached matrices and the trial
+    // products live on the device, otherwise each product copies its operands there and its result back.
+    std::vector<kernels::gemm_kernel_t<h_scalar_t>> block_gemm;
+
+    // The returned matrix lives in the cache, an operator block, or the workspace at this depth:
+    // it is only valid until the next call to compute_matrix at the same depth.
+    std::pair<int, matrix_ref_t> compute_matrix(node n, int b, int depth = 0);
+
+    // All blocks have dimension 1 (or 0): compute_scalar replaces compute_matrix
+    bool scalar_blocks = false;
+    std::pair<int, h_scalar_t> compute_scalar(node n, int b);
+
+    // Contribution of one block to the trace
+    struct block_trace_t {
+      h_scalar_t trace = 0;  // trace of the block
+      double trace_abs = 0;  // sum of the moduli of the diagonal terms
+      double norm_sq   = 0;  // squared Frobenius norm of the density matrix (use_norm_as_weight only)
+    };
+
+    // Computes the matrix of block_index at the root, its trace, and its density matrix if use_norm_as_weight.
+    // Only touches data of this block: calls for different blocks can run concurrently.
+    block_trace_t compute_block_trace(int block_index, double dtau_beta, double dtau_0);
 
     void update_cache_impl(node n);
     void update_dtau(node n);
 
     bool use_norm_of_matrices_in_cache = true; // When a matrix is computed in cache, its spectral radius replaces the norm estimate
 
-    // integrity check
+#ifdef EXT_DEBUG
+    public:
+#endif
+    // integrity check (check_cache_integrity only runs with CHECK_CACHE, one call in ten)
     void check_cache_integrity(bool print = false);
     void check_cache_integrity_one_node(node n, bool print);
+
+    private:
     int check_one_block_table_linear(node n, int b, bool print);       // compare block table to that of a linear method (ie. no tree)
     matrix_t check_one_block_matrix_linear(node n, int b, bool print); // compare matrix to that of a linear method (ie. no tree)
 
     // Pool of detached nodes
     class nodes_storage {
 
-      const int n_blocks;
+      cache_arena *arena;
       std::vector<node> nodes;
       int i;
 
       // make a new detached black node
-      node make_new_node() { return new rb_tree_t::node_t(time_pt{}, node_data_t{{}, n_blocks}, false, 1); }
+      node make_new_node() { return new rb_tree_t::node_t(time_pt{}, node_data_t{{}, *arena}, false, 1); }
 
       public:
-      inline nodes_storage(int n_blocks, int size = 0) : n_blocks(n_blocks), i(-1) {
+      inline nodes_storage(cache_arena &arena, int size = 0) : arena(&arena), i(-1) {
         for (int j = 0; j < size; ++j) nodes.push_back(make_new_node());
       }
       inline ~nodes_storage() {
@@ -187,8 +499,10 @@ namespace triqs_cthyb {
         i      = -1;
         return i_;
       }
+      // Exchange n with the next stored node, adding one if needed
       inline node swap_next(node n) {
-        std::swap(n, nodes[++i]);
+        if (++i == int(nodes.size())) nodes.push_back(make_new_node());
+        std::swap(n, nodes[i]);
         return n;
       }
       inline node swap_prev(node n) {
@@ -204,9 +518,23 @@ namespace triqs_cthyb {
     // attach auxiliary operators
     op_desc attach_aux_operator(many_body_op_t const &op) {
       aux_operators.push_back(h_diag->get_op_mat(op));
+      add_aux_op_blocks(aux_operators.back());
       op_desc operator_desc{0, 0, true, -static_cast<int>(aux_operators.size())};
       return std::move(operator_desc);
     }
+
+    private:
+    // the sparse (and truncated) blocks of the auxiliary operator aux, appended to those of the others
+    void add_aux_op_blocks(atom_diag::op_block_mat_t const &aux) {
+      aux_csr.emplace_back(n_blocks);
+      aux_lnorms.emplace_back(n_blocks, 0.0);
+      if (is_truncated) aux_truncated.emplace_back(n_blocks);
+      for (int b = 0; b < n_blocks; ++b)
+        add_op_block(aux.block_mat[b], b, aux.connection(b), aux_csr.back()[b], (is_truncated ? &aux_truncated.back()[b] : nullptr),
+                     aux_lnorms.back()[b]);
+    }
+
+    public:
     
     /*************************************************************************
      *  Ordinary binary search tree (BST) insertion of the trial nodes
@@ -217,10 +545,11 @@ namespace triqs_cthyb {
     int tree_size = 0; // size of the tree +/- the added/deleted node
 
     // a pool of trial nodes, ready to be glued in the tree. Max 4 to allow for double insertions
-    nodes_storage trial_nodes = {n_blocks, 4};
+    nodes_storage trial_nodes = {arena, 4};
 
     // for each inserted node, need to know {parent_of_node,child_is_left}
     std::vector<std::pair<node, bool>> inserted_nodes = {{nullptr, false}, {nullptr, false}, {nullptr, false}, {nullptr, false}};
+    bool first_trial_is_root = false; // the first trial node went into an empty tree (inserted_nodes[0] is also empty when its insertion failed)
 
     node try_insert_impl(node h, node n) { // implementation
       if (h == nullptr) return n;
@@ -241,7 +570,8 @@ namespace triqs_cthyb {
         auto &r = inserted_nodes[i];
         if (r.first != nullptr) (r.second ? r.first->left : r.first->right)= nullptr;
       }
-      if (tree_size <= trial_nodes.index() + 1) tree.get_root() = nullptr;
+      // the first trial node was inserted in an empty tree: it is the root
+      if ((trial_nodes.index() >= 0) && first_trial_is_root) tree.get_root() = nullptr;
     }
 
     /*************************************************************************
@@ -255,6 +585,7 @@ namespace triqs_cthyb {
       auto &root                          = tree.get_root();
       node n                              = trial_nodes.take_next(); // get the next available node
       inserted_nodes[trial_nodes.index()] = {nullptr, false};
+      if (trial_nodes.index() == 0) first_trial_is_root = (root == nullptr);
       n->reset(tau, op);               // change the time and op of the node
       root = try_insert_impl(root, n); // insert it using a regular BST, no red black
       tree_size++;
@@ -263,6 +594,7 @@ namespace triqs_cthyb {
     // Remove all trial nodes from the tree
     void cancel_insert() {
       cancel_insert_impl();
+      clear_trial_products();
       trial_nodes.reset_index();
       tree_size = tree.size();
       tree.clear_modified();
@@ -276,7 +608,7 @@ namespace triqs_cthyb {
       int imax = trial_nodes.reset_index();
       for (int i = 0; i <= imax; ++i) {
         node n = trial_nodes.take_next();
-        tree.insert(n->key, {n->op, n_blocks});
+        insert_in_tree(n->key, n->op);
       }
       trial_nodes.reset_index();
       update_cache();
@@ -292,16 +624,64 @@ namespace triqs_cthyb {
     std::vector<node> removed_nodes;
     std::vector<time_pt> removed_keys;
 
+    // the nth operator with dagger and block_index, in the order of the tree, with the counts of the subtrees.
+    // The trial nodes are not counted: when some are glued in the tree, traverse it instead.
+    node find_nth_op(int n, int block_index, bool dagger) const {
+      auto match = [&](node no) { return no->op.dagger == dagger && no->op.block_index == block_index; };
+      if (!trial_nodes.is_index_reset()) {
+        int i = 0;
+        return find_if(tree, [&](node no) {
+          if (match(no)) ++i;
+          return i == n + 1;
+        });
+      }
+      int k  = op_count_index(block_index, dagger);
+      node x = tree.get_root();
+      while (x) {
+        int n_left = (x->left ? x->left->cache.op_counts[k] : 0);
+        if (n < n_left) {
+          x = x->left;
+          continue;
+        }
+        n -= n_left;
+        if (match(x) && (n-- == 0)) return x;
+        x = x->right;
+      }
+      return nullptr;
+    }
+
     public:
+    // Ranks from the counts of the subtrees, in O(log N). No trial node must be glued in the tree.
+    // Number of operators with block_index and dagger at times larger than tau
+    int count_ops_later(time_pt const &tau, int block_index, bool dagger) const {
+      int k = op_count_index(block_index, dagger), r = 0;
+      for (node x = tree.get_root(); x;) {
+        if (x->key > tau) {
+          r += (x->left ? x->left->cache.op_counts[k] : 0) + (op_count_index(x->op.block_index, x->op.dagger) == k);
+          x = x->right;
+        } else
+          x = x->left;
+      }
+      return r;
+    }
+
+    // Number of operators with block_index and dagger at times smaller than tau
+    int count_ops_earlier(time_pt const &tau, int block_index, bool dagger) const {
+      int k = op_count_index(block_index, dagger), r = 0;
+      for (node x = tree.get_root(); x;) {
+        if (x->key < tau) {
+          r += (x->right ? x->right->cache.op_counts[k] : 0) + (op_count_index(x->op.block_index, x->op.dagger) == k);
+          x = x->left;
+        } else
+          x = x->right;
+      }
+      return r;
+    }
+
     // Find and mark as deleted the nth operator with fixed dagger and block_index
     // n=0 : first operator, n=1, second, etc...
     time_pt try_delete(int n, int block_index, bool dagger) noexcept {
-      // traverse the tree, looking for the nth operator of the correct dagger, block_index
-      int i  = 0;
-      node x = find_if(tree, [&](node no) {
-        if (no->op.dagger == dagger && no->op.block_index == block_index) ++i;
-        return i == n + 1;
-      });
+      node x = find_nth_op(n, block_index, dagger);
       removed_nodes.push_back(x);             // store the node
       removed_keys.push_back(x->key);         // store the key
       tree.set_modified_from_root_to(x->key); // mark all nodes on path from node to root as modified
@@ -312,6 +692,7 @@ namespace triqs_cthyb {
 
     // Clean all the delete flags
     void cancel_delete() {
+      clear_trial_products();
       for (auto &n : removed_nodes) n->delete_flag = false;
       removed_nodes.clear();
       removed_keys.clear();
@@ -332,13 +713,61 @@ namespace triqs_cthyb {
     }
 
     /*************************************************************************
-     * Node shift (=insertion+deletion)
+     * Node shift (in place, or insertion+deletion)
      *************************************************************************/
 
-    // No try_shift implemented. Use combination of try_insert and try_delete instead.
+    private:
+    // The node shifted in place by try_shift, with its original time and operator (nullptr: none)
+    node shifted_node = nullptr;
+    time_pt shifted_key;
+    op_desc shifted_op;
+
+    // Is there a node at a time between t_old (excluded) and t_new (included)?
+    // Later times are on the left: the range is (t_old, t_new] for a shift to a later time, [t_new, t_old) otherwise.
+    bool any_node_in_shift_range(time_pt const &t_old, time_pt const &t_new) const {
+      bool later = (t_new > t_old);
+      for (node x = tree.get_root(); x;) {
+        if (later ? (x->key > t_new) : (x->key >= t_old))
+          x = x->right; // past the latest end of the range
+        else if (later ? (x->key <= t_old) : (x->key < t_new))
+          x = x->left; // before the earliest end of the range
+        else
+          return true;
+      }
+      return false;
+    }
+
+    public:
+    // Shift the nth operator with block_index and dagger to tau, and change it to op (of the same block and dagger).
+    // If no other operator lies between the old and new times, the node keeps its place in the tree:
+    // only its time and operator change, and only the path from the root to it is recomputed.
+    // Otherwise, it is a try_delete followed by a try_insert. Returns the original time.
+    time_pt try_shift(int n, int block_index, bool dagger, time_pt const &tau, op_desc const &op) {
+      node x = find_nth_op(n, block_index, dagger);
+      if (any_node_in_shift_range(x->key, tau)) {
+        auto tau_old = try_delete(n, block_index, dagger);
+        try_insert(tau, op);
+        return tau_old;
+      }
+      shifted_node = x;
+      shifted_key  = x->key;
+      shifted_op   = x->op;
+      tree.set_modified_from_root_to(x->key);
+      x->key = tau;
+      x->op  = op;
+      return shifted_key;
+    }
 
     // Cancel the shift
     void cancel_shift() {
+      clear_trial_products();
+
+      // Node shifted in place
+      if (shifted_node) {
+        shifted_node->key = shifted_key;
+        shifted_node->op  = shifted_op;
+        shifted_node      = nullptr;
+      }
 
       // Inserted nodes
       cancel_insert_impl();
@@ -357,6 +786,9 @@ namespace triqs_cthyb {
     // Confirm the shift of the node, with red black balance
     void confirm_shift() {
 
+      // Node shifted in place: the tree is unchanged
+      shifted_node = nullptr;
+
       // Inserted nodes
       cancel_insert_impl(); //  first remove BST inserted nodes
 
@@ -364,7 +796,7 @@ namespace triqs_cthyb {
       int imax = trial_nodes.reset_index();
       for (int i = 0; i <= imax; ++i) {
         node n = trial_nodes.take_next();
-        tree.insert(n->key, {n->op, n_blocks});
+        insert_in_tree(n->key, n->op);
       }
       trial_nodes.reset_index();
 
@@ -384,68 +816,60 @@ namespace triqs_cthyb {
      * Node replacement (replace op_desc according to a substitution table)
      *************************************************************************/
     private:
-    // Store copies of the nodes to be replaced
-    nodes_storage backup_nodes = {n_blocks};
-
-    node try_replace_impl(node n, configuration::oplist_t const &updated_ops) noexcept {
-
-      node new_left = nullptr, new_right = nullptr;
-      if (n->left) new_left              = try_replace_impl(n->left, updated_ops);
-      if (n->right) new_right = try_replace_impl(n->right, updated_ops);
-
-      auto const &op     = n->op;
-      auto it            = updated_ops.find(n->key);
-      bool op_changed    = it != updated_ops.end();
-      auto const &new_op = op_changed ? it->second : op;
-      node new_node      = n;
-      if (op_changed || new_left != n->left || new_right != n->right) {
-        auto key   = n->key;
-        auto color = n->color;
-        auto N     = n->N;
-
-        new_node = backup_nodes.swap_next(n);
-        if (op_changed)
-          new_node->reset(key, new_op);
-        else
-          new_node->reset(key, op);
-        new_node->left     = new_left;
-        new_node->right    = new_right;
-        new_node->color    = color;
-        new_node->N        = N;
-        new_node->modified = true;
-      }
+    // Copy-on-write replacement: only the nodes on the paths from the root to the changed operators are replaced, by
+    // copies taken from backup_nodes. The original nodes go into backup_nodes, and still link to their original children,
+    // so the original tree is intact below replaced_root. Cancelling restores the root and gives the copies back.
+    nodes_storage backup_nodes = {arena};
+    std::vector<node> replace_log; // the copies, in the order in which the originals were stored in backup_nodes
+    node replaced_root = nullptr;
+
+    // Replace the nodes of the subtree n, with updated operators [first, last) (sorted as the tree)
+    using updated_ops_iterator = configuration::oplist_t::const_iterator;
+    node try_replace_impl(node n, updated_ops_iterator first, updated_ops_iterator last) {
+      if (n == nullptr || first == last) return n;
+
+      // operators later than n->key are in the left subtree
+      auto mid        = std::lower_bound(first, last, n->key, [](auto const &x, time_pt const &t) { return x.first > t; });
+      bool op_changed = (mid != last && mid->first == n->key);
+      node new_left   = try_replace_impl(n->left, first, mid);
+      node new_right  = try_replace_impl(n->right, (op_changed ? std::next(mid) : mid), last);
+
+      node new_node = backup_nodes.swap_next(n);
+      replace_log.push_back(new_node);
+      new_node->reset(n->key, (op_changed ? mid->second : n->op));
+      new_node->left     = new_left;
+      new_node->right    = new_right;
+      new_node->color    = n->color;
+      new_node->N        = n->N;
+      new_node->modified = true;
+      new_node->update_subtree(new_left, new_right);
       return new_node;
     }
 
-    node cancel_replace_impl(node n) {
-      node n_in_tree = n;
-      if (n_in_tree && n_in_tree->modified) n= backup_nodes.swap_prev(n);
-      if (n_in_tree->right) cancel_replace_impl(n_in_tree->right);
-      if (n_in_tree->left) cancel_replace_impl(n_in_tree->left);
-      return n;
-    }
-
     public:
     void try_replace(configuration::oplist_t const &updated_ops) {
       if (tree_size == 0) return;
 
       if (!backup_nodes.is_index_reset()) TRIQS_RUNTIME_ERROR << "impurity_trace: improper use of try_replace()";
-      backup_nodes.reserve(tree.size());
-      auto &root = tree.get_root();
-      root       = try_replace_impl(root, updated_ops);
+      auto &root    = tree.get_root();
+      replaced_root = root;
+      root          = try_replace_impl(root, updated_ops.begin(), updated_ops.end());
     }
 
     void confirm_replace() {
       backup_nodes.reset_index();
+      replace_log.clear();
       update_cache();
       tree.clear_modified();
       check_cache_integrity();
     }
 
     void cancel_replace() {
+      clear_trial_products();
       if (tree_size == 0 || backup_nodes.is_index_reset()) return;
-      auto &root = tree.get_root();
-      root       = cancel_replace_impl(root);
+      tree.get_root() = replaced_root;
+      for (auto it = replace_log.rbegin(); it != replace_log.rend(); ++it) backup_nodes.swap_prev(*it);
+      replace_log.clear();
       check_cache_integrity();
     }
 
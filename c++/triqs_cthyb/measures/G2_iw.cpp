@@ -21,6 +21,7 @@
  ******************************************************************************/
 
 #include <triqs/arrays.hpp>
+#include <triqs/arrays/blas_lapack/gemm.hpp>
 #include <triqs/utility/itertools.hpp>
 
 #include "./G2_iw.hpp"
@@ -45,30 +46,31 @@ namespace triqs_cthyb {
 
   template <G2_channel Channel> void measure_G2_iw<Channel>::accumulate(mc_weight_t s) {
 
-    if (true)
+    if (G2_measures.params.measure_G2_iw_gemm)
+      accumulate_M_gemm(s); // Scattering matrix accumulation with matrix products
+    else if (true)
       accumulate_M_opt(s); // FLOPS Optimized scattering matrix accumulation
     else {
 
       // ---------------------------------------------------------------
       // Base line scattering matrix computation in two frequencies
 
-      auto M_ww_fill = [this](det_type const &det, M_t &M_ww) {
-        const double beta = this->data.config.beta();
-        foreach (det, [&M_ww, beta](op_t const &x, op_t const &y, det_scalar_t M_xy) {
+      auto const &batch = data.det_batch();
+      auto M_ww_fill    = [&batch, beta = data.config.beta()](int bidx, M_t &M_ww) {
+        for (long k = batch.start[bidx]; k < batch.start[bidx + 1]; ++k) {
           // insert accumulation
-          double t1 = double(x.first);
-          double t2 = double(y.first);
+          double t1 = batch.t_x[k];
+          double t2 = batch.t_y[k];
           for (auto const &[w1, w2] : M_ww.mesh()) {
-            M_ww[w1, w2](x.second, y.second) += exp((beta - t1) * w1) * M_xy * std::exp(t2 * w2);
+            M_ww[w1, w2](batch.x[k].second, batch.y[k].second) += exp((beta - t1) * w1) * batch.M[k] * std::exp(t2 * w2);
           }
-        })
-          ;
+        }
       };
 
       timer_M.start();
       // Intermediate M matrices for all blocks
       M() = 0;
-      for (auto bidx : range(M.size())) { M_ww_fill(data.dets[bidx], M[bidx]); }
+      for (auto bidx : range(M.size())) { M_ww_fill(bidx, M[bidx]); }
       timer_M.stop();
 
     } // end accumulate_M
@@ -90,37 +92,38 @@ namespace triqs_cthyb {
     const double beta    = data.config.beta();
     const double pi_beta = M_PI / beta;
 
-    auto M_arr_fill = [pi_beta, beta](det_type const &det, M_arr_t &M_arr, M_mesh_t const &M_mesh) {
-      foreach (det,
-               [&M_mesh, &M_arr, pi_beta, beta](op_t const &x, op_t const &y, det_scalar_t M_xy) {
-                 double t1 = double(x.first);
-                 double t2 = double(y.first);
+    auto const &batch = data.det_batch();
+    auto M_arr_fill   = [&batch, pi_beta, beta](int bidx, M_arr_t &M_arr, M_mesh_t const &M_mesh) {
+      const auto &mesh1 = std::get<0>(M_mesh.components());
+      const auto &mesh2 = std::get<1>(M_mesh.components());
 
-                 const auto &mesh1 = std::get<0>(M_mesh.components());
-                 const auto &mesh2 = std::get<1>(M_mesh.components());
+      for (long k = batch.start[bidx]; k < batch.start[bidx + 1]; ++k) {
+        double t1  = batch.t_x[k];
+        double t2  = batch.t_y[k];
+        auto M_xy  = batch.M[k];
+        int x_orb  = batch.x[k].second, y_orb = batch.y[k].second;
 
-                 std::complex<double> dWt1(0., 2 * pi_beta * (beta - t1));
-                 std::complex<double> dWt2(0., 2 * pi_beta * t2);
+        std::complex<double> dWt1(0., 2 * pi_beta * (beta - t1));
+        std::complex<double> dWt2(0., 2 * pi_beta * t2);
 
-                 auto dexp1 = std::exp(dWt1);
-                 auto dexp2 = std::exp(dWt2);
+        auto dexp1 = std::exp(dWt1);
+        auto dexp2 = std::exp(dWt2);
 
-                 auto exp1 = std::exp(dWt1 * (mesh1.first_index() + 0.5));
+        auto exp1 = std::exp(dWt1 * (mesh1.first_index() + 0.5));
 
-                 for (auto const i1 : range(M_arr.shape()[2])) {
+        for (auto const i1 : range(M_arr.shape()[2])) {
 
-                   auto exp2      = std::exp(dWt2 * (mesh2.first_index() + 0.5));
-                   auto exp1_M_xy = exp1 * M_xy;
+          auto exp2      = std::exp(dWt2 * (mesh2.first_index() + 0.5));
+          auto exp1_M_xy = exp1 * M_xy;
 
-                   for (auto const i2 : range(M_arr.shape()[3])) {
+          for (auto const i2 : range(M_arr.shape()[3])) {
 
-                     M_arr(x.second, y.second, i1, i2) += exp1_M_xy * exp2;
-                     exp2 *= dexp2;
-                   }
-                   exp1 *= dexp1;
-                 }
-               })
-        ;
+            M_arr(x_orb, y_orb, i1, i2) += exp1_M_xy * exp2;
+            exp2 *= dexp2;
+          }
+          exp1 *= dexp1;
+        }
+      }
     };
 
     timer_M.start();
@@ -128,7 +131,7 @@ namespace triqs_cthyb {
     // Intermediate M matrices for all blocks
     for (auto bidx : range(M_block_arr.size())) {
       M_block_arr[bidx]() = 0;
-      M_arr_fill(data.dets[bidx], M_block_arr[bidx], M_mesh);
+      M_arr_fill(bidx, M_block_arr[bidx], M_mesh);
     }
 
     // Reshuffle the accumulated scattering matrix into a Green's function object
@@ -139,6 +142,92 @@ namespace triqs_cthyb {
     timer_M.stop();
   }
 
+  template <G2_channel Channel> void measure_G2_iw<Channel>::accumulate_M_gemm(mc_weight_t s) {
+
+    // ---------------------------------------------------------------
+    // Scattering matrix accumulation as a product of matrices
+    //
+    //   M_ab(w1, w2) = sum_{x in a, y in b} exp(i w1 (beta - t_x)) M_xy exp(i w2 t_y) = E1_a * M_ab * E2_b
+    //
+    // with the phase matrices E1 (w1, x) and E2 (y, w2), built with the product relations
+    // of the exponents as in accumulate_M_opt. The operators are grouped by inner index,
+    // so that the orbital blocks of E1, M and E2 are contiguous.
+
+    using matrix_t       = matrix<std::complex<double>>;
+    const double beta    = data.config.beta();
+    const double pi_beta = M_PI / beta;
+    const auto &mesh1    = std::get<0>(M_mesh.components());
+    const auto &mesh2    = std::get<1>(M_mesh.components());
+    const int nfreq1     = mesh1.size();
+    const int nfreq2     = mesh2.size();
+
+    // Positions of the operators, grouped by inner index, and the start of the group of each index
+    auto group = [](int k, int n_orb, auto const &inner) {
+      std::vector<int> pos(k), start(n_orb + 1, 0);
+      for (int i = 0; i < k; ++i) ++start[inner(i) + 1];
+      for (int a = 0; a < n_orb; ++a) start[a + 1] += start[a];
+      auto next = start;
+      for (int i = 0; i < k; ++i) pos[i] = next[inner(i)]++;
+      return std::make_pair(pos, start);
+    };
+
+    timer_M.start();
+
+    for (auto bidx : range(M.size())) {
+      auto const &det = data.dets[bidx];
+      auto M_data     = M[bidx].data();
+      M_data()        = 0;
+      const int k     = det.size();
+      if (k == 0) continue;
+      const int n_orb1 = M_data.shape()[2];
+      const int n_orb2 = M_data.shape()[3];
+
+      auto [x_pos, x_start] = group(k, n_orb1, [&det](int i) { return det.get_x(i).second; });
+      auto [y_pos, y_start] = group(k, n_orb2, [&det](int i) { return det.get_y(i).second; });
+
+      // Phase matrices
+      matrix_t E1(nfreq1, k), E2(k, nfreq2), M_xy(k, k);
+      for (int i = 0; i < k; ++i) {
+        std::complex<double> dWt1(0., 2 * pi_beta * (beta - double(det.get_x(i).first)));
+        auto dexp1 = std::exp(dWt1);
+        auto exp1  = std::exp(dWt1 * (mesh1.first_index() + 0.5));
+        for (int i1 = 0; i1 < nfreq1; ++i1) {
+          E1(i1, x_pos[i]) = exp1;
+          exp1 *= dexp1;
+        }
+        std::complex<double> dWt2(0., 2 * pi_beta * double(det.get_y(i).first));
+        auto dexp2 = std::exp(dWt2);
+        auto exp2  = std::exp(dWt2 * (mesh2.first_index() + 0.5));
+        for (int i2 = 0; i2 < nfreq2; ++i2) {
+          E2(y_pos[i], i2) = exp2;
+          exp2 *= dexp2;
+        }
+      }
+
+      // Inverse matrix, in the grouped order
+      auto const &batch = data.det_batch();
+      for (long e = batch.start[bidx]; e < batch.start[bidx + 1]; ++e) M_xy(x_pos[batch.x_pos[e]], y_pos[batch.y_pos[e]]) = batch.M[e];
+
+      // Per orbital pair: (E1_a * M_a.) restricted to the columns of b, times E2_b
+      matrix_t E1_M(nfreq1, k), M_ab(nfreq1, nfreq2);
+      for (int a = 0; a < n_orb1; ++a) {
+        auto ra = range(x_start[a], x_start[a + 1]);
+        if (ra.size() == 0) continue;
+        auto E1_M_v = E1_M();
+        blas::gemm(1.0, E1(range(), ra), M_xy(ra, range()), 0.0, E1_M_v);
+        for (int b = 0; b < n_orb2; ++b) {
+          auto rb = range(y_start[b], y_start[b + 1]);
+          if (rb.size() == 0) continue;
+          auto M_ab_v = M_ab();
+          blas::gemm(1.0, E1_M(range(), rb), E2(rb, range()), 0.0, M_ab_v);
+          M_data(range(), range(), a, b) = M_ab;
+        }
+      }
+    }
+
+    timer_M.stop();
+  }
+
   template class measure_G2_iw<G2_channel::AllFermionic>;
   template class measure_G2_iw<G2_channel::PP>;
   template class measure_G2_iw<G2_channel::PH>;
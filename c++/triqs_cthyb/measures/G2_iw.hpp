@@ -33,6 +33,7 @@ namespace triqs_cthyb {
                   G2_measures_t const &G2_measures);
     void accumulate(mc_weight_t s);
     void accumulate_M_opt(mc_weight_t s);
+    void accumulate_M_gemm(mc_weight_t s);
 
     using B = G2_iw::measure_G2_iw_base<Channel>;
     using B::collect_results;
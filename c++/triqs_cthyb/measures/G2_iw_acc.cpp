@@ -21,6 +21,9 @@
  ******************************************************************************/
 
 #include "./G2_iw_acc.hpp"
+#include "./chunked_reduce.hpp"
+
+#include <algorithm>
 
 namespace triqs_cthyb {
 
@@ -47,14 +50,21 @@ namespace triqs_cthyb {
         gf_mesh<cartesian_product<imfreq, imfreq, imfreq>> mesh_bff{mesh_b, mesh_f, mesh_f};
 
         if (Channel == G2_channel::AllFermionic)
-          G2_iw_opt = make_block2_gf(mesh_fff, G2_measures.gf_struct, order);
+          G2_iw_opt = make_block2_gf(mesh_fff, G2_measures.gf_struct, order, G2_measures.block_pairs());
         else
-          G2_iw_opt = make_block2_gf(mesh_bff, G2_measures.gf_struct, order);
+          G2_iw_opt = make_block2_gf(mesh_bff, G2_measures.gf_struct, order, G2_measures.block_pairs());
 
         G2_iw.rebind(*G2_iw_opt);
         G2_iw() = 0;
       }
 
+      // For a real hybridization and local Hamiltonian, M(-nu1, -nu2) = conj(M(nu1, nu2)) for every configuration,
+      // hence the same symmetry for each contribution to G2. Inverting a (symmetric) mesh maps the index f to size - 1 - f.
+      conj_symmetry = G2_measures.params.measure_G2_iw_conj_symmetry;
+      if (conj_symmetry && (is_h_scalar_complex || std::is_same_v<det_scalar_t, dcomplex>))
+        TRIQS_RUNTIME_ERROR << "measure_G2_iw_conj_symmetry requires a real hybridization function and local Hamiltonian";
+      if (conj_symmetry) f0_begin = std::get<0>(G2_iw(0, 0).mesh().components()).size() / 2;
+
       // Allocate temporary two-frequency matrix M
       {
         if (Channel == G2_channel::AllFermionic) { // Smaller mesh possible in AllFermionic
@@ -70,14 +80,19 @@ namespace triqs_cthyb {
         // Initialize intermediate scattering matrix
         M = block_gf{M_mesh, G2_measures.gf_struct};
       }
+
+      int n_async = G2_measures.params.measure_G2_async_threads;
+      if (n_async > 0)
+        async_G2 = std::make_unique<async_G2_accumulator<Channel>>(n_async, *G2_iw_opt, M, this->G2_measures(), order, f0_begin);
     }
 
+    // Accumulate the contribution of one configuration to G2, for the first frequencies from f0_begin on
     template <G2_channel Channel>
     void accumulate_impl_AABB(G2_iw_t::g_t::view_type G2, mc_weight_t s, M_t const &M_ij,
-                              M_t const &M_kl);
+                              M_t const &M_kl, int f0_begin);
     template <G2_channel Channel>
     void accumulate_impl_ABBA(G2_iw_t::g_t::view_type G2, mc_weight_t s, M_t const &M_ij,
-                              M_t const &M_kl);
+                              M_t const &M_kl, int f0_begin);
 
     template <G2_channel Channel> void measure_G2_iw_base<Channel>::accumulate_G2(mc_weight_t s) {
 
@@ -85,13 +100,18 @@ namespace triqs_cthyb {
       average_sign += s;
       
       timer_G2.start();
+      if (async_G2) {
+        async_G2->push(M, s);
+        timer_G2.stop();
+        return;
+      }
       for (auto &m : G2_measures()) {
         auto G2_iw_block = G2_iw(m.b1.idx, m.b2.idx);
         bool diag_block  = (m.b1.idx == m.b2.idx);
         if (order == block_order::AABB || diag_block)
-          accumulate_impl_AABB<Channel>(G2_iw_block, s, M(m.b1.idx), M(m.b2.idx));
+          accumulate_impl_AABB<Channel>(G2_iw_block, s, M(m.b1.idx), M(m.b2.idx), f0_begin);
         if (order == block_order::ABBA || diag_block)
-          accumulate_impl_ABBA<Channel>(G2_iw_block, s, M(m.b1.idx), M(m.b2.idx));
+          accumulate_impl_ABBA<Channel>(G2_iw_block, s, M(m.b1.idx), M(m.b2.idx), f0_begin);
       }
       timer_G2.stop();
     }
@@ -99,8 +119,39 @@ namespace triqs_cthyb {
     template <G2_channel Channel>
     void measure_G2_iw_base<Channel>::collect_results(triqs::mpi::communicator const &com) {
 
+      if (async_G2) {
+        async_G2->finish(G2_iw);
+        async_G2.reset();
+      }
+
       average_sign = mpi_all_reduce(average_sign, com);
-      G2_iw        = mpi_all_reduce(G2_iw, com);
+
+      auto mode        = make_reduction_mode(G2_measures.params.measure_G2_reduction);
+      auto chunk_bytes = std::size_t(G2_measures.params.mpi_reduction_chunk_mb) << 20;
+      if (!conj_symmetry)
+        mpi_reduce_block2_gf(G2_iw, com, mode, chunk_bytes);
+      else {
+        // Reduce the accumulated first frequencies only, then G2(f0, f1, f2) = conj(G2(n0 - 1 - f0, n1 - 1 - f1, n2 - 1 - f2))
+        for (auto &m : G2_measures()) {
+          auto d   = G2_iw(m.b1.idx, m.b2.idx).data();
+          auto sh  = d.shape();
+          auto acc = d(range(f0_begin, sh[0]), ellipsis());
+          if (mode == reduction_mode::all)
+            acc = mpi_all_reduce(acc, com);
+          else
+            mpi_reduce_in_chunks(acc.data_start(), acc.size(), com, mode == reduction_mode::root, chunk_bytes);
+
+          long n_orb = sh[3] * sh[4] * sh[5] * sh[6];
+          long n12   = sh[1] * sh[2];
+          dcomplex *p = d.data_start();
+          for (long f0 = 0; f0 < f0_begin; ++f0)
+            for (long f12 = 0; f12 < n12; ++f12) {
+              dcomplex *g       = p + (f0 * n12 + f12) * n_orb;
+              dcomplex const *h = p + ((sh[0] - 1 - f0) * n12 + (n12 - 1 - f12)) * n_orb;
+              for (long a = 0; a < n_orb; ++a) g[a] = std::conj(h[a]);
+            }
+        }
+      }
 
       G2_iw = G2_iw / (real(average_sign) * data.config.beta());
 
@@ -112,102 +163,244 @@ namespace triqs_cthyb {
 
     namespace {
 
-      // Index placeholders
-      clef::placeholder<0> i;
-      clef::placeholder<1> j;
-      clef::placeholder<2> k;
-      clef::placeholder<3> l;
+      // The kernels below work on the raw data of the (C-ordered) Green's functions.
+      // G2(f0, f1, f2)(i, j, k, l) += s * A(p, q) * B(r, t), where A and B are the orbital matrices of two scattering
+      // matrices at frequencies depending on (f0, f1, f2), and (p, q, r, t) is a permutation of (i, j, k, l).
+      enum class orbital_pairing { ij_kl, il_kj, ji_lk, li_jk };
+
+      // Raw access to a scattering matrix: the orbital matrix at the Matsubara indices (n1, n2)
+      struct M_raw_t {
+        dcomplex const *data;
+        int first1, first2, stride1, stride2;
+
+        M_raw_t(M_t const &M)
+           : data(M.data().data_start()),
+             first1(std::get<0>(M.mesh().components()).first_index()),
+             first2(std::get<1>(M.mesh().components()).first_index()) {
+          auto sh = M.data().shape();
+          stride2 = sh[2] * sh[3];
+          stride1 = sh[1] * stride2;
+        }
+
+        dcomplex const *operator()(long n1, long n2) const { return data + (n1 - first1) * stride1 + (n2 - first2) * stride2; }
+      };
+
+      // G(i, j, k, l) += s * A(p, q) * B(r, t), for one frequency point. The last index l runs contiguously in G.
+      template <orbital_pairing P>
+      inline void accumulate_orbitals(dcomplex *g, dcomplex s, dcomplex const *A, dcomplex const *B, int ni, int nj, int nk, int nl) {
+        for (int i = 0; i < ni; ++i)
+          for (int j = 0; j < nj; ++j)
+            for (int k = 0; k < nk; ++k, g += nl) {
+              if constexpr (P == orbital_pairing::ij_kl) {
+                dcomplex a = s * A[i * nj + j];
+                for (int l = 0; l < nl; ++l) g[l] += a * B[k * nl + l];
+              } else if constexpr (P == orbital_pairing::il_kj) {
+                dcomplex b = s * B[k * nj + j];
+                for (int l = 0; l < nl; ++l) g[l] += b * A[i * nl + l];
+              } else if constexpr (P == orbital_pairing::ji_lk) {
+                dcomplex a = s * A[j * ni + i];
+                for (int l = 0; l < nl; ++l) g[l] += a * B[l * nk + k];
+              } else {
+                dcomplex b = s * B[j * nk + k];
+                for (int l = 0; l < nl; ++l) g[l] += b * A[l * ni + i];
+              }
+            }
+      }
 
-      // Frequency placeholders
-      clef::placeholder<4> w;
-      clef::placeholder<5> n1;
-      clef::placeholder<6> n2;
-      clef::placeholder<7> n3;
+      // Loop over the frequencies of G2 from f0_begin on in the first dimension, with a_at(n0, n1, n2) and b_at(n0, n1, n2) the orbital matrices A and B at the
+      // Matsubara indices (n0, n1, n2) of the mesh point. The last frequency runs in tiles, so that the orbital matrices
+      // of M used in one tile stay in cache while the second frequency runs.
+      template <orbital_pairing P, typename FA, typename FB>
+      void accumulate_tiled(G2_iw_t::g_t::view_type G2, dcomplex s, int f0_begin, FA const &a_at, FB const &b_at) {
+        constexpr int tile = 16;
+        auto const &mesh   = G2.mesh();
+        long first0        = std::get<0>(mesh.components()).first_index();
+        long first1        = std::get<1>(mesh.components()).first_index();
+        long first2        = std::get<2>(mesh.components()).first_index();
+        auto sh            = G2.data().shape();
+        int n0 = sh[0], n1 = sh[1], n2 = sh[2], ni = sh[3], nj = sh[4], nk = sh[5], nl = sh[6];
+        long n_orb         = long(ni) * nj * nk * nl;
+        dcomplex *g_start  = G2.data().data_start();
+
+        for (int f0 = f0_begin; f0 < n0; ++f0)
+          for (int t2 = 0; t2 < n2; t2 += tile)
+            for (int f1 = 0; f1 < n1; ++f1) {
+              dcomplex *g = g_start + ((long(f0) * n1 + f1) * n2 + t2) * n_orb;
+              for (int f2 = t2; f2 < std::min(t2 + tile, n2); ++f2, g += n_orb) {
+                long w0 = f0 + first0, w1 = f1 + first1, w2 = f2 + first2;
+                accumulate_orbitals<P>(g, s, a_at(w0, w1, w2), b_at(w0, w1, w2), ni, nj, nk, nl);
+              }
+            }
+      }
 
     } // namespace
 
+    // The Matsubara indices of the sums of frequencies: nu_n + omega_m = nu_{n + m}, omega_m - nu_n = nu_{m - n - 1}
+
     // -- Particle-hole
 
     template <>
     void accumulate_impl_AABB<G2_channel::PH>(G2_iw_t::g_t::view_type G2, mc_weight_t s,
-                                              M_t const &M_ij, M_t const &M_kl) {
+                                              M_t const &M_ij, M_t const &M_kl, int f0_begin) {
 
       //G2(w, n1, n2)(i, j, k, l) << G2(w, n1, n2)(i, j, k, l) + s * M_ij(n1, n1 + w)(i, j) * M_kl(n2 + w, n2)(k, l);
 
-      for (const auto &[w, n1, n2] : G2.mesh())
-        for (const auto [i, j, k, l] : G2.target_indices())
-          G2[w, n1, n2](i, j, k, l) += s * M_ij[n1, n1 + w](i, j) * M_kl[n2 + w, n2](k, l);
+      M_raw_t A{M_ij}, B{M_kl};
+      accumulate_tiled<orbital_pairing::ij_kl>(
+         G2, s, f0_begin, [&A](long w, long n1, long) { return A(n1, n1 + w); }, [&B](long w, long, long n2) { return B(n2 + w, n2); });
     }
 
     template <>
     void accumulate_impl_ABBA<G2_channel::PH>(G2_iw_t::g_t::view_type G2, mc_weight_t s,
-                                              M_t const &M_il, M_t const &M_kj) {
+                                              M_t const &M_il, M_t const &M_kj, int f0_begin) {
 
       //G2(w, n1, n2)(i, j, k, l) << G2(w, n1, n2)(i, j, k, l) - s * M_il(n1, n2)(i, l) * M_kj(n2 + w, n1 + w)(k, j);
 
-      for (const auto &[w, n1, n2] : G2.mesh())
-        for (const auto [i, j, k, l] : G2.target_indices())
-          G2[w, n1, n2](i, j, k, l) -= s * M_il[n1, n2](i, l) * M_kj[n2 + w, n1 + w](k, j);
+      M_raw_t A{M_il}, B{M_kj};
+      accumulate_tiled<orbital_pairing::il_kj>(
+         G2, -s, f0_begin, [&A](long, long n1, long n2) { return A(n1, n2); }, [&B](long w, long n1, long n2) { return B(n2 + w, n1 + w); });
     }
 
     // -- Particle-particle
 
     template <>
     void accumulate_impl_AABB<G2_channel::PP>(G2_iw_t::g_t::view_type G2, mc_weight_t s,
-                                              M_t const &M_ij, M_t const &M_kl) {
+                                              M_t const &M_ij, M_t const &M_kl, int f0_begin) {
 
       //G2(w, n1, n2)(i, j, k, l) << G2(w, n1, n2)(i, j, k, l) + s * M_ij(n1, w - n2)(i, j) * M_kl(w - n1, n2)(k, l);
 
-      for (const auto &[w, n1, n2] : G2.mesh())
-        for (const auto [i, j, k, l] : G2.target_indices())
-          G2[w, n1, n2](i, j, k, l) += s * M_ij[n1, w - n2](i, j) * M_kl[w - n1, n2](k, l);
+      M_raw_t A{M_ij}, B{M_kl};
+      accumulate_tiled<orbital_pairing::ij_kl>(
+         G2, s, f0_begin, [&A](long w, long n1, long n2) { return A(n1, w - n2 - 1); }, [&B](long w, long n1, long n2) { return B(w - n1 - 1, n2); });
     }
 
     template <>
     void accumulate_impl_ABBA<G2_channel::PP>(G2_iw_t::g_t::view_type G2, mc_weight_t s,
-                                              M_t const &M_il, M_t const &M_kj) {
+                                              M_t const &M_il, M_t const &M_kj, int f0_begin) {
 
       //G2(w, n1, n2)(i, j, k, l) << G2(w, n1, n2)(i, j, k, l) - s * M_il(n1, n2)(i, l) * M_kj(w - n1, w - n2)(k, j);
 
-      for (const auto &[w, n1, n2] : G2.mesh())
-        for (const auto [i, j, k, l] : G2.target_indices())
-          G2[w, n1, n2](i, j, k, l) -= s * M_il[n1, n2](i, l) * M_kj[w - n1, w - n2](k, j);
+      M_raw_t A{M_il}, B{M_kj};
+      accumulate_tiled<orbital_pairing::il_kj>(
+         G2, -s, f0_begin, [&A](long, long n1, long n2) { return A(n1, n2); }, [&B](long w, long n1, long n2) { return B(w - n1 - 1, w - n2 - 1); });
     }
 
     // -- Fermionic
 
     template <>
     void accumulate_impl_AABB<G2_channel::AllFermionic>(G2_iw_t::g_t::view_type G2, mc_weight_t s,
-                                                        M_t const &M_ij, M_t const &M_kl) {
+                                                        M_t const &M_ij, M_t const &M_kl, int f0_begin) {
 
       //G2(n1, n2, n3)(i, j, k, l) << G2(n1, n2, n3)(i, j, k, l) + s * M_ij(n2, n1)(j, i) * M_kl(n1 + n3 - n2, n3)(l, k);
 
-      const auto &iw_mesh = std::get<0>(G2.mesh());
-      using mesh_point_t  = typename std::remove_reference<decltype(iw_mesh)>::type::mesh_point_t;
-
-      for (const auto &[n1, n2, n3] : G2.mesh()) {
-        mesh_point_t n4{iw_mesh, n1.index() + n3.index() - n2.index()};
-        for (const auto [i, j, k, l] : G2.target_indices())
-          G2[n1, n2, n3](i, j, k, l) += s * M_ij[n2, n1](j, i) * M_kl[n4, n3](l, k);
-      }
+      M_raw_t A{M_ij}, B{M_kl};
+      accumulate_tiled<orbital_pairing::ji_lk>(
+         G2, s, f0_begin, [&A](long n1, long n2, long) { return A(n2, n1); }, [&B](long n1, long n2, long n3) { return B(n1 + n3 - n2, n3); });
     }
 
     template <>
     void accumulate_impl_ABBA<G2_channel::AllFermionic>(G2_iw_t::g_t::view_type G2, mc_weight_t s,
-                                                        M_t const &M_il, M_t const &M_kj) {
+                                                        M_t const &M_il, M_t const &M_kj, int f0_begin) {
 
       //G2(n1, n2, n3)(i, j, k, l) << G2(n1, n2, n3)(i, j, k, l) - s * M_il(n1 + n3 - n2, n1)(l, i) * M_kj(n2, n3)(j, k);
 
-      const auto &iw_mesh = std::get<0>(G2.mesh());
-      using mesh_point_t  = typename std::remove_reference<decltype(iw_mesh)>::type::mesh_point_t;
+      M_raw_t A{M_il}, B{M_kj};
+      accumulate_tiled<orbital_pairing::li_jk>(
+         G2, -s, f0_begin, [&A](long n1, long n2, long n3) { return A(n1 + n3 - n2, n1); }, [&B](long, long n2, long n3) { return B(n2, n3); });
+    }
+
+    // -- Asynchronous accumulation
+
+    template <G2_channel Channel>
+    async_G2_accumulator<Channel>::async_G2_accumulator(int n_threads, G2_iw_t const &G2_iw, M_block_t const &M, std::vector<G2_measure_t> measures,
+                                                        block_order order, int f0_begin)
+       : measures(std::move(measures)), order(order), f0_begin(f0_begin) {
+      // Two snapshots per worker, so that the Markov chain rarely waits
+      for (int i = 0; i < 2 * n_threads; ++i) {
+        slots.push_back({M, 0});
+        free_slots.push_back(i);
+      }
+      for (int w = 0; w < n_threads; ++w) {
+        G2_workers.push_back(G2_iw);
+        G2_workers.back()() = 0;
+      }
+      for (int w = 0; w < n_threads; ++w) workers.emplace_back([this, w] { run(w); });
+    }
+
+    template <G2_channel Channel> async_G2_accumulator<Channel>::~async_G2_accumulator() { stop_workers(); }
+
+    template <G2_channel Channel> void async_G2_accumulator<Channel>::push(M_block_t const &M, mc_weight_t s) {
+      int i;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        slot_freed.wait(lock, [this] { return !free_slots.empty() || error; });
+        if (error) std::rethrow_exception(error);
+        i = free_slots.back();
+        free_slots.pop_back();
+      }
+      // The slot is not used by any worker until it is queued
+      for (int b = 0; b < M.size(); ++b) slots[i].M[b].data() = M[b].data();
+      slots[i].s = s;
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        full_slots.push_back(i);
+      }
+      slot_filled.notify_one();
+    }
+
+    template <G2_channel Channel> void async_G2_accumulator<Channel>::run(int worker) {
+      auto &G2 = G2_workers[worker];
+      while (true) {
+        int i;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          slot_filled.wait(lock, [this] { return stopping || !full_slots.empty(); });
+          if (full_slots.empty()) return;
+          i = full_slots.front();
+          full_slots.pop_front();
+        }
+        try {
+          auto const &slot = slots[i];
+          for (auto const &m : measures) {
+            bool diag_block = (m.b1.idx == m.b2.idx);
+            if (order == block_order::AABB || diag_block)
+              accumulate_impl_AABB<Channel>(G2(m.b1.idx, m.b2.idx), slot.s, slot.M[m.b1.idx], slot.M[m.b2.idx], f0_begin);
+            if (order == block_order::ABBA || diag_block)
+              accumulate_impl_ABBA<Channel>(G2(m.b1.idx, m.b2.idx), slot.s, slot.M[m.b1.idx], slot.M[m.b2.idx], f0_begin);
+          }
+        } catch (...) {
+          std::lock_guard<std::mutex> lock(mutex);
+          error = std::current_exception();
+        }
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          free_slots.push_back(i);
+        }
+        slot_freed.notify_one();
+      }
+    }
 
-      for (const auto &[n1, n2, n3] : G2.mesh()) {
-        mesh_point_t n4{iw_mesh, n1.index() + n3.index() - n2.index()};
-        for (const auto [i, j, k, l] : G2.target_indices())
-          G2[n1, n2, n3](i, j, k, l) -= s * M_il[n4, n1](l, i) * M_kj[n2, n3](j, k);
+    template <G2_channel Channel> void async_G2_accumulator<Channel>::stop_workers() {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
       }
+      slot_filled.notify_all();
+      for (auto &t : workers)
+        if (t.joinable()) t.join();
     }
 
+    template <G2_channel Channel> void async_G2_accumulator<Channel>::finish(G2_iw_t::view_type &G2_iw) {
+      stop_workers();
+      if (error) std::rethrow_exception(error);
+      for (auto &G2 : G2_workers)
+        for (auto const &m : measures) G2_iw(m.b1.idx, m.b2.idx).data() += G2(m.b1.idx, m.b2.idx).data();
+    }
+
+    template class async_G2_accumulator<G2_channel::AllFermionic>;
+    template class async_G2_accumulator<G2_channel::PP>;
+    template class async_G2_accumulator<G2_channel::PH>;
+
     template class measure_G2_iw_base<G2_channel::AllFermionic>;
     template class measure_G2_iw_base<G2_channel::PP>;
     template class measure_G2_iw_base<G2_channel::PH>;
@@ -21,6 +21,12 @@
  ******************************************************************************/
 #pragma once
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <triqs/mpi/base.hpp>
 #include <triqs/utility/timer.hpp> // DEBUG
@@ -41,6 +47,49 @@ namespace triqs_cthyb {
     using M_arr_t       = array<std::complex<double>, 4>;
     using M_block_arr_t = std::vector<M_arr_t>;
 
+    // Accumulation of G2 by worker threads, from snapshots of the scattering matrices M taken in the Markov chain.
+    // The snapshots go through a fixed set of slots: push waits while all of them are in use.
+    // Each worker accumulates into its own copy of G2, views of which are only made by that worker.
+    template <G2_channel Channel> class async_G2_accumulator {
+
+      public:
+      async_G2_accumulator(int n_threads, G2_iw_t const &G2_iw, M_block_t const &M, std::vector<G2_measure_t> measures, block_order order,
+                           int f0_begin);
+      ~async_G2_accumulator();
+
+      async_G2_accumulator(async_G2_accumulator const &) = delete;
+      async_G2_accumulator &operator=(async_G2_accumulator const &) = delete;
+
+      // Queue the contribution s * M x M of one configuration
+      void push(M_block_t const &M, mc_weight_t s);
+
+      // Wait for the queued contributions, stop the workers and add their G2 to G2_iw
+      void finish(G2_iw_t::view_type &G2_iw);
+
+      private:
+      struct slot_t {
+        M_block_t M;
+        mc_weight_t s;
+      };
+
+      void run(int worker);
+      void stop_workers();
+
+      std::vector<G2_measure_t> measures;
+      block_order order;
+      int f0_begin;
+
+      std::vector<slot_t> slots;
+      std::vector<int> free_slots;
+      std::deque<int> full_slots;
+      std::vector<G2_iw_t> G2_workers;
+      std::vector<std::thread> workers;
+      std::mutex mutex;
+      std::condition_variable slot_freed, slot_filled;
+      bool stopping = false;
+      std::exception_ptr error;
+    };
+
     // Measure the two-particle Green's function in Matsubara frequency
     template <G2_channel Channel> class measure_G2_iw_base {
 
@@ -60,6 +109,13 @@ namespace triqs_cthyb {
       M_block_t M;
       M_mesh_t M_mesh;
 
+      // With the symmetry G2(-w) = conj(G2(w)), only the first frequencies from f0_begin on are accumulated
+      bool conj_symmetry = false;
+      int f0_begin       = 0;
+
+      // Asynchronous accumulation of G2, if measure_G2_async_threads > 0
+      std::unique_ptr<async_G2_accumulator<Channel>> async_G2;
+
       triqs::utility::timer timer_M;
       triqs::utility::timer timer_G2;
     };
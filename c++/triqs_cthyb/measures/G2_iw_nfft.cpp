@@ -20,6 +20,7 @@
  ******************************************************************************/
 
 #include "./G2_iw_nfft.hpp"
+#include "../timeline.hpp"
 
 namespace triqs_cthyb {
 
@@ -31,44 +32,33 @@ namespace triqs_cthyb {
                                                   G2_measures_t const &G2_measures)
      : measure_G2_iw_base<Channel>(G2_iw_opt, data, G2_measures) {
 
-    // Initialize the nfft_buffers mirroring the matrix M
-    {
-      M_nfft.resize(M.size());
-
-      std::cout << "G2_iw_nfft NFFT buffer sizes:\n";
-      for (auto bidx : range(M.size())) {
-        std::string bname = M.block_names()[bidx];
-
-        int buf_size = 10; // default
-        if (G2_measures.params.nfft_buf_sizes.count(bname)) {
-          buf_size = G2_measures.params.nfft_buf_sizes.at(bname);
-        }
-        array<int, 2> buf_sizes{M(bidx).target_shape()};
-        buf_sizes() = buf_size;
-
-        std::cout << "block_name = " << bname << " nfft_buf_size = " << buf_size << "\n";
-
-        M_nfft(bidx) = nfft_array_t<2, 2>(M(bidx).mesh(), M(bidx).data(), buf_sizes);
-      }
+    // Initialize the nfft_buffers mirroring the matrix M.
+    // All orbital components of a block are transformed together, with one batched FFT.
+    // A block is flushed right after it is filled: blocks of the same shape share their grids and plans.
+    // With several walkers, the measures run concurrently and keep their own grids.
+    for (auto bidx : range(M.size())) {
+      auto const &[mesh1, mesh2] = M(bidx).mesh().components();
+      auto sh                    = M(bidx).target_shape();
+      M_nfft.emplace_back(std::array<nfft_mesh_dim_t, 2>{make_nfft_mesh_dim(mesh1), make_nfft_mesh_dim(mesh2)}, long(sh[0]) * sh[1],
+                          M(bidx).data().data_start(), std::vector<long>{}, 6, G2_measures.params.n_walkers == 1);
     }
   }
 
   template <G2_channel Channel> void measure_G2_iw_nfft<Channel>::accumulate(mc_weight_t s) {
 
-    auto nfft_fill = [this](det_type const &det, nfft_array_t<2, 2> &nfft_matrix) {
-      const double beta = this->data.config.beta();
-      foreach (det, [&nfft_matrix, beta](op_t const &x, op_t const &y, det_scalar_t M) {
-        nfft_matrix.push_back({beta - double(x.first), double(y.first)}, {x.second, y.second}, M);
-      })
-        ;
+    auto const &batch = data.det_batch();
+    auto nfft_fill    = [&batch, beta = data.config.beta()](int bidx, nfft_batch_t<2> &nfft_matrix, int n_orb2) {
+      for (long k = batch.start[bidx]; k < batch.start[bidx + 1]; ++k)
+        nfft_matrix.push_back({beta - batch.t_x[k], batch.t_y[k]}, batch.x[k].second * n_orb2 + batch.y[k].second, batch.M[k]);
     };
 
     timer_M.start();
     // Intermediate M matrices for all blocks
     M() = 0;
     for (auto bidx : range(M.size())) {
-      nfft_fill(data.dets[bidx], M_nfft(bidx));
-      M_nfft(bidx).flush();
+      nfft_fill(bidx, M_nfft[bidx], M(bidx).target_shape()[1]);
+      timeline::span _("G2_iw_nfft flush", &timeline_n_calls);
+      M_nfft[bidx].flush();
     }
     timer_M.stop();
 
@@ -20,7 +20,8 @@
  ******************************************************************************/
 #pragma once
 
-#include <triqs/experimental/nfft_array.hpp>
+#include <vector>
+#include <triqs/experimental/nfft_batch.hpp>
 
 #include "G2_iw_acc.hpp"
 
@@ -40,7 +41,8 @@ namespace triqs_cthyb {
     using B::collect_results;
     
     private:
-    array<nfft_array_t<2, 2>, 1> M_nfft;
+    std::vector<nfft_batch_t<2>> M_nfft;
+    long timeline_n_calls = 0; // flushes of M_nfft, for the sampling of the timeline
     using B::M, B::M_mesh, B::G2_measures, B::data, B::timer_M, B::accumulate_G2;
   };
 
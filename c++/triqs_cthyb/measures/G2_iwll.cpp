@@ -20,6 +20,8 @@
  ******************************************************************************/
 
 #include "./G2_iwll.hpp"
+#include "./chunked_reduce.hpp"
+#include "../timeline.hpp"
 
 namespace triqs_cthyb {
 
@@ -32,7 +34,6 @@ namespace triqs_cthyb {
     order             = G2_measures.params.measure_G2_block_order;
     size_t n_l        = G2_measures.params.measure_G2_n_l;
     int n_bosonic     = G2_measures.params.measure_G2_n_bosonic;
-    int nfft_buf_size = G2_measures.params.measure_G2_iwll_nfft_buf_size; 
 
     // Allocate the two-particle Green's function
     {
@@ -40,23 +41,28 @@ namespace triqs_cthyb {
       gf_mesh<legendre> mesh_l{beta, Fermion, n_l};
       gf_mesh<cartesian_product<imfreq, legendre, legendre>> mesh_wll{mesh_w, mesh_l, mesh_l};
 
-      G2_iwll_opt = make_block2_gf(mesh_wll, G2_measures.gf_struct, order);
+      G2_iwll_opt = make_block2_gf(mesh_wll, G2_measures.gf_struct, order, G2_measures.block_pairs());
       G2_iwll.rebind(*G2_iwll_opt);
       G2_iwll() = 0;
     }
 
-    // Allocate the nfft buffers
+    // Allocate the nfft buffers. All (i, j, k, l, l1, l2) are transformed together, (l1, l2) running fastest:
+    // one NFFT node per time, with the n_l^2 products of Legendre polynomials as a contiguous payload.
+    // The output of G2_iwll is ordered as (l1, l2, i, j, k, l).
     {
-      nfft_buf.resize(mini_vector<int, 2>{G2_iwll.size1(), G2_iwll.size2()});
-
       gf_mesh<imfreq> mesh_w = std::get<0>(G2_iwll(0, 0).mesh().components());
 
       for (auto const &m : G2_measures()) {
-        auto s = m.target_shape;
-        array<int, 6> buf_sizes(n_l, n_l, s[0], s[1], s[2], s[3]);
-        buf_sizes() = nfft_buf_size;
-        nfft_buf(m.b1.idx, m.b2.idx) = nfft_array_t<1, 6>{mesh_w, G2_iwll(m.b1.idx, m.b2.idx).data(), buf_sizes};
+        auto s     = m.target_shape;
+        long n_orb = s[0] * s[1] * s[2] * s[3];
+        std::vector<long> out_offsets(n_orb * n_l * n_l);
+        for (long ijkl = 0; ijkl < n_orb; ++ijkl)
+          for (long l1l2 = 0; l1l2 < long(n_l * n_l); ++l1l2) out_offsets[ijkl * n_l * n_l + l1l2] = l1l2 * n_orb + ijkl;
+        nfft_buf.emplace(std::piecewise_construct, std::forward_as_tuple(m.b1.idx, m.b2.idx),
+                         std::forward_as_tuple(std::array<nfft_mesh_dim_t, 1>{make_nfft_mesh_dim(mesh_w)}, long(out_offsets.size()),
+                                               G2_iwll(m.b1.idx, m.b2.idx).data().data_start(), std::move(out_offsets)));
       }
+      nfft_values.resize(n_l * n_l);
     }
   }
 
@@ -68,10 +74,15 @@ namespace triqs_cthyb {
     double beta = data.config.beta();
     int n_l     = std::get<1>(G2_iwll(0, 0).mesh().components()).size();
 
+    auto const &batch = data.det_batch();
+
     for (auto const &m : G2_measures()) {
 
       if (data.dets[m.b1.idx].size() == 0 || data.dets[m.b2.idx].size() == 0) continue;
 
+      auto &buf      = nfft_buf.at({m.b1.idx, m.b2.idx});
+      auto const &sh = m.target_shape;
+
       auto accumulate_impl = [&](op_t const &i, op_t const &j, op_t const &k, op_t const &l, mc_weight_t val) {
 
         tilde_p_gen p_l1_gen(beta), p_l2_gen(beta);
@@ -81,32 +92,23 @@ namespace triqs_cthyb {
           double p_l1 = p_l1_gen.next();
           for (int l2 : range(n_l)) {
             double p_l2 = p_l2_gen.next();
-            mini_vector<int, 6> vec{l1, l2, i.second, j.second, k.second, l.second};
-            nfft_buf(m.b1.idx, m.b2.idx).push_back({dtau}, vec, val * p_l1 * p_l2);
+            nfft_values[l1 * n_l + l2] = val * p_l1 * p_l2;
           }
         }
+        long ijkl = ((i.second * sh[1] + j.second) * sh[2] + k.second) * sh[3] + l.second;
+        buf.push_back({dtau}, ijkl * n_l * n_l, 1, nfft_values.data(), n_l * n_l);
       };
 
       bool diag_block = (m.b1.idx == m.b2.idx);
 
-      // Perform the accumulation looping over both determinants
-      if (order == block_order::AABB || diag_block) {
-        foreach (data.dets[m.b1.idx], [&](op_t const &i, op_t const &j, mc_weight_t M_ij) {
-          foreach (data.dets[m.b2.idx], [&](op_t const &k, op_t const &l, mc_weight_t M_kl) {
-            accumulate_impl(i, j, k, l, s * M_ij * M_kl); // Accumulate in legendre-nfft buffer
-          })
-            ;
-        })
-          ;
-      }
-      if (order == block_order::ABBA || diag_block) {
-        foreach (data.dets[m.b1.idx], [&](op_t const &i, op_t const &l, mc_weight_t M_il) {
-          foreach (data.dets[m.b2.idx], [&](op_t const &k, op_t const &j, mc_weight_t M_kj) {
-            accumulate_impl(i, j, k, l, -s * M_il * M_kj); // Accumulate in legendre-nfft buffer
-          })
-            ;
-        })
-          ;
+      // Perform the accumulation looping over the entries of both determinants
+      for (long k1 = batch.start[m.b1.idx]; k1 < batch.start[m.b1.idx + 1]; ++k1) {
+        for (long k2 = batch.start[m.b2.idx]; k2 < batch.start[m.b2.idx + 1]; ++k2) {
+          mc_weight_t M1 = batch.M[k1], M2 = batch.M[k2];
+          // Accumulate in legendre-nfft buffer
+          if (order == block_order::AABB || diag_block) accumulate_impl(batch.x[k1], batch.y[k1], batch.x[k2], batch.y[k2], s * M1 * M2);
+          if (order == block_order::ABBA || diag_block) accumulate_impl(batch.x[k1], batch.y[k2], batch.x[k2], batch.y[k1], -s * M1 * M2);
+        }
       }
     }
   }
@@ -129,9 +131,12 @@ namespace triqs_cthyb {
 
   template <G2_channel Channel> void measure_G2_iwll<Channel>::collect_results(triqs::mpi::communicator const &c) {
 
-    for (auto const &m : G2_measures()) { nfft_buf(m.b1.idx, m.b2.idx).flush(); }
+    {
+      timeline::span _("G2_iwll flush");
+      for (auto &[blocks, buf] : nfft_buf) buf.flush();
+    }
 
-    G2_iwll = mpi_all_reduce(G2_iwll, c);
+    mpi_reduce_block2_gf(G2_iwll, c, make_reduction_mode(G2_measures.params.measure_G2_reduction), std::size_t(G2_measures.params.mpi_reduction_chunk_mb) << 20);
 
     average_sign = mpi_all_reduce(average_sign, c);
 
@@ -20,10 +20,11 @@
  ******************************************************************************/
 #pragma once
 
+#include <map>
 #include <vector>
 #include <triqs/mpi/base.hpp>
 #include <triqs/statistics/histograms.hpp>
-#include <triqs/experimental/nfft_array.hpp>
+#include <triqs/experimental/nfft_batch.hpp>
 
 #include <triqs/utility/legendre.hpp>
 
@@ -59,8 +60,11 @@ namespace triqs_cthyb {
 
     mc_weight_t average_sign;
 
-    // Object that performs NFFT transform
-    array<nfft_array_t<1, 6>, 2> nfft_buf;
+    // Objects that perform the NFFT transform, for each measured pair of blocks
+    std::map<std::pair<int, int>, nfft_batch_t<1>> nfft_buf;
+
+    // Values for all (l1, l2) at one time
+    std::vector<dcomplex> nfft_values;
 
     measure_G2_iwll(std::optional<G2_iwll_t> & G2_iwll_opt, qmc_data const &data, G2_measures_t & G2_measures);
     void accumulate(mc_weight_t s);
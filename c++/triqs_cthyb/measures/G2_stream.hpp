@@ -0,0 +1,103 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include <triqs/h5.hpp>
+#include <triqs/utility/exceptions.hpp>
+#include <algorithm>
+#include <complex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace triqs_cthyb {
+
+  namespace detail {
+
+    // Writes the n0 x ... complex elements at p (C order) as the chunked dataset name of g, in slices of the first dimension
+    // of about chunk_bytes: a real dataset with a last dimension of size 2 and the attribute __complex__, as h5_write of an array.
+    inline void h5_write_chunked(triqs::h5::group g, std::string const &name, std::complex<double> const *p, std::vector<hsize_t> shape,
+                                 std::size_t chunk_bytes, int deflate) {
+      shape.push_back(2);
+      int rank          = shape.size();
+      hsize_t row_bytes = sizeof(double);
+      for (int r = 1; r < rank; ++r) row_bytes *= shape[r];
+      std::vector<hsize_t> chunk = shape, start(rank, 0);
+      // HDF5 chunks are limited to 4 GiB
+      chunk[0] = std::max<hsize_t>(1, std::min<hsize_t>(shape[0], std::min<std::size_t>(chunk_bytes, std::size_t(1) << 31) / row_bytes));
+
+      hid_t file_space = H5Screate_simple(rank, shape.data(), nullptr);
+      hid_t plist      = H5Pcreate(H5P_DATASET_CREATE);
+      H5Pset_chunk(plist, rank, chunk.data());
+      if (deflate > 0) H5Pset_deflate(plist, std::min(deflate, 9));
+      hid_t ds = H5Dcreate2(hid_t(g), name.c_str(), H5T_NATIVE_DOUBLE, file_space, H5P_DEFAULT, plist, H5P_DEFAULT);
+      H5Pclose(plist);
+      if (ds < 0) {
+        H5Sclose(file_space);
+        TRIQS_RUNTIME_ERROR << "Cannot create the dataset " << name;
+      }
+
+      for (hsize_t i0 = 0; i0 < shape[0]; i0 += chunk[0]) {
+        std::vector<hsize_t> count = shape;
+        count[0]                   = std::min(chunk[0], shape[0] - i0);
+        start[0]                   = i0;
+        hid_t mem_space            = H5Screate_simple(rank, count.data(), nullptr);
+        H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start.data(), nullptr, count.data(), nullptr);
+        herr_t err = H5Dwrite(ds, H5T_NATIVE_DOUBLE, mem_space, file_space, H5P_DEFAULT, p + i0 * (row_bytes / (2 * sizeof(double))));
+        H5Sclose(mem_space);
+        if (err < 0) {
+          H5Dclose(ds);
+          H5Sclose(file_space);
+          TRIQS_RUNTIME_ERROR << "Cannot write the dataset " << name;
+        }
+      }
+      triqs::h5::h5_write_attribute(ds, "__complex__", "1");
+      H5Dclose(ds);
+      H5Sclose(file_space);
+    }
+
+  } // namespace detail
+
+  /// Writes the blocks of a G2 container (a block2_gf), which is then released, to the group name of f, by rank 0 (only_root).
+  // Each block is a group <name>/<block1>/<block2> with the mesh, the indices and the data as a chunked (and deflated) dataset,
+  // which can be read one slice at a time. The data goes from the container to the file in chunks, without any copy.
+  template <typename G2> void stream_G2(std::optional<G2> &g2, triqs::h5::file *f, std::string const &name, std::size_t chunk_bytes, int deflate) {
+    if (!g2) return;
+    if (f) {
+      auto gr = triqs::h5::group(*f).create_group(name);
+      for (int i = 0; i < g2->size1(); ++i) {
+        auto g1 = (gr.has_key(g2->block_names()[0][i]) ? gr.open_group(g2->block_names()[0][i]) : gr.create_group(g2->block_names()[0][i]));
+        for (int j = 0; j < g2->size2(); ++j) {
+          auto const &g = (*g2)(i, j);
+          auto d        = g.data();
+          if (d.size() == 0) continue; // the blocks which are not measured
+          auto gb = g1.create_group(g2->block_names()[1][j]);
+          h5_write(gb, "mesh", g.mesh());
+          h5_write(gb, "indices", g.indices());
+          std::vector<hsize_t> shape;
+          for (auto n : d.shape()) shape.push_back(n);
+          detail::h5_write_chunked(gb, "data", d.data_start(), shape, chunk_bytes, deflate);
+        }
+      }
+    }
+    g2.reset();
+  }
+
+} // namespace triqs_cthyb
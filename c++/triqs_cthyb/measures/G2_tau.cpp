@@ -20,6 +20,13 @@
  ******************************************************************************/
 
 #include "./G2_tau.hpp"
+#include "./chunked_reduce.hpp"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace triqs_cthyb {
 
@@ -31,12 +38,13 @@ namespace triqs_cthyb {
     double beta = data.config.beta();
 
     order     = G2_measures.params.measure_G2_block_order;
+    grouped   = G2_measures.params.measure_G2_tau_grouped;
     int n_tau = G2_measures.params.measure_G2_n_tau;
 
     gf_mesh<imtime> fermi_tau_mesh{beta, Fermion, n_tau};
     gf_mesh<cartesian_product<imtime, imtime, imtime>> G2_tau_mesh{fermi_tau_mesh, fermi_tau_mesh, fermi_tau_mesh};
 
-    G2_tau_opt = make_block2_gf(G2_tau_mesh, G2_measures.gf_struct, order);
+    G2_tau_opt = make_block2_gf(G2_tau_mesh, G2_measures.gf_struct, order, G2_measures.block_pairs());
 
     G2_tau.rebind(*G2_tau_opt);
     G2_tau() = 0.0;
@@ -47,14 +55,22 @@ namespace triqs_cthyb {
     sign *= data.atomic_reweighting;
     average_sign += sign;
 
+    if (grouped) {
+      accumulate_grouped(sign);
+      return;
+    }
+
     // loop only over block-combinations that should be measured
+    auto const &batch = data.det_batch();
     for (auto &m : G2_measures()) {
 
       auto G2_tau_block = G2_tau(m.b1.idx, m.b2.idx);
       bool diag_block   = (m.b1.idx == m.b2.idx);
 
-      foreach (data.dets[m.b1.idx], [&](auto const &i, auto const &j, auto const M_ij) {
-        foreach (data.dets[m.b2.idx], [&](auto const &k, auto const &l, auto const M_kl) {
+      for (long kij = batch.start[m.b1.idx]; kij < batch.start[m.b1.idx + 1]; ++kij) {
+        for (long kkl = batch.start[m.b2.idx]; kkl < batch.start[m.b2.idx + 1]; ++kkl) {
+          auto const &i = batch.x[kij], &j = batch.y[kij], &k = batch.x[kkl], &l = batch.y[kkl];
+          auto const M_ij = batch.M[kij], M_kl = batch.M[kkl];
 
           // lambda for computing a single product term of M_ij and M_kl
           auto compute_M2_product = [&](auto const &i, auto const &j, auto const &k, auto const &l, mc_weight_t sign) {
@@ -72,18 +88,130 @@ namespace triqs_cthyb {
 
           if (order == block_order::AABB || diag_block) compute_M2_product(i, j, k, l, +sign);
           if (order == block_order::ABBA || diag_block) compute_M2_product(i, l, k, j, -sign);
+        }
+      }
+    }
+  }
 
-        })
-          ;
-      })
-        ;
+  void measure_G2_tau::accumulate_grouped(mc_weight_t sign) {
+
+    // The block pairs fill different blocks of G2_tau: they are accumulated in parallel.
+    // The views of the blocks are made beforehand, their reference counting is not thread-safe.
+    auto const &measures = G2_measures();
+    int n_measures       = measures.size();
+    std::vector<G2_tau_t::g_t::view_type> blocks;
+    for (auto const &m : measures) blocks.push_back(G2_tau(m.b1.idx, m.b2.idx));
+    data.det_batch(); // filled here, it is only read by the threads
+#ifdef _OPENMP
+    if (int(workspaces.size()) < omp_get_max_threads()) workspaces.resize(omp_get_max_threads());
+#endif
+    std::exception_ptr error;
+#pragma omp parallel for schedule(dynamic)
+    for (int n = 0; n < n_measures; ++n) {
+      try {
+#ifdef _OPENMP
+        auto &ws = workspaces[omp_get_thread_num()];
+#else
+        auto &ws = workspaces[0];
+#endif
+        accumulate_block_pair(measures[n], blocks[n], sign, ws);
+      } catch (...) {
+#pragma omp critical(cthyb_G2_tau_error)
+        error = std::current_exception();
+      }
     }
+    if (error) std::rethrow_exception(error);
+  }
+
+  void measure_G2_tau::accumulate_block_pair(G2_measure_t const &m, G2_tau_t::g_t::view_type &G2_tau_block, mc_weight_t sign, workspace_t &ws) {
+
+    // contributions buffered before they are sorted and added to G2_tau
+    constexpr std::size_t max_contribs = 1 << 16;
+
+    bool diag_block    = (m.b1.idx == m.b2.idx);
+    auto const &det1   = data.dets[m.b1.idx];
+    auto const &det2   = data.dets[m.b2.idx];
+    auto const &mesh   = std::get<0>(G2_tau_block.mesh().components());
+    int n_tau          = mesh.size();
+    double delta       = mesh.delta();
+    auto sh            = G2_tau_block.data().shape();
+    long n_orb         = long(sh[3]) * sh[4] * sh[5] * sh[6];
+    dcomplex *g        = G2_tau_block.data().data_start();
+
+    // the entries of the two dets (the batch is filled before the parallel region, see accumulate_grouped)
+    auto const &batch = data.det_batch();
+    long begin1 = batch.start[m.b1.idx], end1 = batch.start[m.b1.idx + 1];
+    long begin2 = batch.start[m.b2.idx], end2 = batch.start[m.b2.idx + 1];
+
+    // Bins and flips of the times get_op(0), ..., get_op(n_op - 1) relative to get_ref(0), ..., get_ref(n_ref - 1)
+    auto relative = [n_tau, delta](relative_bins_t &r, int n_ref, auto get_ref, int n_op, auto get_op) {
+      r.n = n_op;
+      r.bins.resize(n_ref * n_op);
+      r.flips.resize(n_ref * n_op);
+      for (int a = 0; a < n_ref; ++a) {
+        time_pt const &ref = get_ref(a);
+        for (int b = 0; b < n_op; ++b) {
+          time_pt const &t = get_op(b);
+          // nearest mesh point, as closest_mesh_pt
+          r.bins[a * n_op + b]  = std::min(n_tau - 1, int(std::floor(double(t - ref) / delta + 0.5)));
+          r.flips[a * n_op + b] = (t < ref);
+        }
+      }
+    };
+    auto x_of = [](auto const &det) { return [&det](int i) -> time_pt { return det.get_x(i).first; }; };
+    auto y_of = [](auto const &det) { return [&det](int i) -> time_pt { return det.get_y(i).first; }; };
+
+    // Add the contributions to G2_tau, in the order of the first two times (counting sort)
+    auto flush = [&]() {
+      long n_buckets = long(n_tau) * n_tau, slab = n_tau * n_orb;
+      ws.bucket_start.assign(n_buckets + 1, 0);
+      for (auto const &c : ws.contribs) ++ws.bucket_start[c.first / slab + 1];
+      for (long b = 0; b < n_buckets; ++b) ws.bucket_start[b + 1] += ws.bucket_start[b];
+      ws.sorted.resize(ws.contribs.size());
+      for (auto const &c : ws.contribs) ws.sorted[ws.bucket_start[c.first / slab]++] = c;
+      for (auto const &c : ws.sorted) g[c.first] += c.second;
+      ws.contribs.clear();
+    };
+
+    // The product terms s * M(p, q) * M(r, ref) with the times (p - ref, q - ref, r - ref), q and ref the y operators (AABB),
+    // or s * M(p, ref) * M(r, q), with q and ref swapped (ABBA). In both cases ref runs over the outer loop.
+    auto accumulate_term = [&](bool abba, mc_weight_t s) {
+      // for the times relative to ref: rel[0] of p, rel[1] of q, rel[2] of r
+      int n1 = det1.size(), n2 = det2.size();
+      if (!abba) {
+        relative(ws.rel[0], n2, y_of(det2), n1, x_of(det1));
+        relative(ws.rel[1], n2, y_of(det2), n1, y_of(det1));
+        relative(ws.rel[2], n2, y_of(det2), n2, x_of(det2));
+      } else {
+        relative(ws.rel[0], n1, y_of(det1), n1, x_of(det1));
+        relative(ws.rel[1], n1, y_of(det1), n2, y_of(det2));
+        relative(ws.rel[2], n1, y_of(det1), n2, x_of(det2));
+      }
+      for (long k2 = begin2; k2 < end2; ++k2) {
+        for (long k1 = begin1; k1 < end1; ++k1) {
+          int y1 = batch.y_pos[k1], y2 = batch.y_pos[k2];
+          int ref = (abba ? y1 : y2), q = (abba ? y2 : y1);
+          int r0 = ref * ws.rel[0].n + batch.x_pos[k1], r1 = ref * ws.rel[1].n + q, r2 = ref * ws.rel[2].n + batch.x_pos[k2];
+          long bin       = (long(ws.rel[0].bins[r0]) * n_tau + ws.rel[1].bins[r1]) * n_tau + ws.rel[2].bins[r2];
+          bool flip      = ws.rel[0].flips[r0] ^ ws.rel[1].flips[r1] ^ ws.rel[2].flips[r2];
+          int y1_orb = batch.y[k1].second, y2_orb = batch.y[k2].second;
+          int q_orb      = (abba ? y2_orb : y1_orb), ref_orb = (abba ? y1_orb : y2_orb);
+          long orb       = ((long(batch.x[k1].second) * sh[4] + q_orb) * sh[5] + batch.x[k2].second) * sh[6] + ref_orb;
+          ws.contribs.emplace_back(bin * n_orb + orb, (flip ? -s : s) * batch.M[k1] * batch.M[k2]);
+        }
+        if (ws.contribs.size() >= max_contribs) flush();
+      }
+      flush();
+    };
+
+    if (order == block_order::AABB || diag_block) accumulate_term(false, +sign);
+    if (order == block_order::ABBA || diag_block) accumulate_term(true, -sign);
   }
 
   void measure_G2_tau::collect_results(triqs::mpi::communicator const &comm) {
 
     average_sign = mpi_all_reduce(average_sign, comm);
-    G2_tau       = mpi_all_reduce(G2_tau, comm);
+    mpi_reduce_block2_gf(G2_tau, comm, make_reduction_mode(G2_measures.params.measure_G2_reduction), std::size_t(G2_measures.params.mpi_reduction_chunk_mb) << 20);
 
     // Rescale sampled Green's function
     double beta = data.config.beta();
@@ -21,6 +21,8 @@
 #pragma once
 
 #include <triqs/gfs.hpp>
+#include <utility>
+#include <vector>
 
 #include "../qmc_data.hpp"
 #include "util.hpp"
@@ -44,6 +46,26 @@ namespace triqs_cthyb {
     mc_weight_t average_sign;
     block_order order;
     G2_measures_t G2_measures;
+    bool grouped;
+
+    // For each reference operator, the mesh bin of the time of each operator relative to it,
+    // and 1 if that time is before the reference (sign flip of the beta-antiperiodicity), 0 otherwise
+    struct relative_bins_t {
+      int n = 0;
+      std::vector<int> bins;
+      std::vector<unsigned char> flips;
+    };
+
+    // Work arrays of accumulate_grouped, by thread
+    struct workspace_t {
+      relative_bins_t rel[3];
+      std::vector<std::pair<long, mc_weight_t>> contribs, sorted;
+      std::vector<long> bucket_start;
+    };
+    std::vector<workspace_t> workspaces = std::vector<workspace_t>(1);
+
+    void accumulate_grouped(mc_weight_t sign);
+    void accumulate_block_pair(G2_measure_t const &m, G2_tau_t::g_t::view_type &G2_tau_block, mc_weight_t sign, workspace_t &ws);
   };
 
 } // namespace triqs_cthyb
@@ -0,0 +1,70 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "./G_iw_nfft.hpp"
+#include "../timeline.hpp"
+
+namespace triqs_cthyb {
+
+  using namespace triqs::gfs;
+  using triqs::experimental::make_nfft_mesh_dim;
+  using triqs::experimental::nfft_mesh_dim_t;
+
+  measure_G_iw_nfft::measure_G_iw_nfft(std::optional<G_iw_t> &G_iw_opt, qmc_data const &data, int n_iw, gf_struct_t const &gf_struct)
+     : data(data), average_sign(0) {
+    G_iw_opt = block_gf<imfreq>({data.config.beta(), Fermion, n_iw}, gf_struct);
+    G_iw.rebind(*G_iw_opt);
+    G_iw() = 0.0;
+
+    for (auto &G_iw_block : G_iw) {
+      auto sh = G_iw_block.target_shape();
+      G_nfft.emplace_back(std::array<nfft_mesh_dim_t, 1>{make_nfft_mesh_dim(G_iw_block.mesh())}, long(sh[0]) * sh[1], G_iw_block.data().data_start());
+    }
+  }
+
+  void measure_G_iw_nfft::accumulate(mc_weight_t s) {
+    s *= data.atomic_reweighting;
+    average_sign += s;
+
+    auto const &batch = data.det_batch();
+    for (auto block_idx : range(G_iw.size())) {
+      int n_cols = G_iw[block_idx].target_shape()[1];
+      auto &nfft = G_nfft[block_idx];
+      // No sign fix needed for dtau < 0: exp(i nu dtau) is beta-antiperiodic, as G
+      for (long k = batch.start[block_idx]; k < batch.start[block_idx + 1]; ++k)
+        nfft.push_back({batch.t_y[k] - batch.t_x[k]}, batch.y[k].second * n_cols + batch.x[k].second, std::complex<double>(s * batch.M[k]));
+    }
+  }
+
+  void measure_G_iw_nfft::collect_results(triqs::mpi::communicator const &c) {
+
+    {
+      timeline::span _("G_iw_nfft flush");
+      for (auto &nfft : G_nfft) nfft.flush();
+    }
+
+    G_iw         = mpi_all_reduce(G_iw, c);
+    average_sign = mpi_all_reduce(average_sign, c);
+
+    for (auto &G_iw_block : G_iw) G_iw_block /= -real(average_sign) * G_iw_block.mesh().domain().beta;
+  }
+
+} // namespace triqs_cthyb
@@ -0,0 +1,50 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+
+#include <triqs/gfs.hpp>
+#include <triqs/experimental/nfft_batch.hpp>
+
+#include "../qmc_data.hpp"
+
+namespace triqs_cthyb {
+
+  using namespace triqs::gfs;
+  using triqs::experimental::nfft_batch_t;
+
+  // Measure Matsubara Green's function (all blocks), without binning in imaginary time.
+  // The elements of the inverse hybridization matrix are transformed with an adjoint NFFT in each block.
+  // The NFFT being linear, the grids accumulate over the configurations and are transformed once, in collect_results.
+  class measure_G_iw_nfft {
+
+    public:
+    measure_G_iw_nfft(std::optional<G_iw_t> &G_iw_opt, qmc_data const &data, int n_iw, gf_struct_t const &gf_struct);
+    void accumulate(mc_weight_t s);
+    void collect_results(triqs::mpi::communicator const &c);
+
+    private:
+    qmc_data const &data;
+    mc_weight_t average_sign;
+    G_iw_t::view_type G_iw;
+    std::vector<nfft_batch_t<1>> G_nfft; // by block, one function per matrix element
+  };
+
+} // namespace triqs_cthyb
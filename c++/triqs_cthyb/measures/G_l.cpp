@@ -20,6 +20,7 @@
  ******************************************************************************/
 
 #include "G_l.hpp"
+#include <algorithm>
 
 namespace triqs_cthyb {
 
@@ -29,49 +30,93 @@ namespace triqs_cthyb {
     G_l_opt = block_gf<legendre>{{data.config.beta(), Fermion, static_cast<size_t>(n_l)}, gf_struct};
     G_l.rebind(*G_l_opt);
     G_l() = 0.0;
+    for (auto const &G_l_block : G_l) {
+      auto sh = G_l_block.target_shape();
+      G_l_acc.emplace_back(G_l_block.mesh().size() * sh[0] * sh[1], 0);
+    }
   }
 
   void measure_G_l::accumulate(mc_weight_t s) {
     s *= data.atomic_reweighting;
     average_sign += s;
 
-    double beta = data.config.beta();
-    auto Tn     = triqs::utility::legendre_generator();
+    double beta       = data.config.beta();
+    auto const &batch = data.det_batch();
 
     for (auto block_idx : range(G_l.size())) {
 
-      foreach (data.dets[block_idx], [this, s, block_idx, beta, &Tn](op_t const &x, op_t const &y, det_scalar_t M) {
-
-        double poly_arg = 2 * double(y.first - x.first) / beta - 1.0;
-        Tn.reset(poly_arg);
-
-        auto val = (y.first >= x.first ? s : -s) * M;
+      // Gather the arguments, values and matrix elements of all pairs of the block
+      int n_cols = G_l[block_idx].target_shape()[1];
+      long k0 = batch.start[block_idx], n = batch.size(block_idx);
+      args.resize(n);
+      vals.resize(n);
+      elements.resize(n);
+      for (long k = 0; k < n; ++k) {
+        args[k]     = 2 * batch.dtau[k0 + k] / beta - 1.0;
+        vals[k]     = s * batch.M_signed[k0 + k];
+        elements[k] = batch.y[k0 + k].second * n_cols + batch.x[k0 + k].second;
+      }
 
-        for (auto l : G_l[block_idx].mesh()) {
-          // Evaluate all polynomial orders
-          this->G_l[block_idx][l](y.second, x.second) += val * Tn.next();
+      // Legendre recurrence (l + 1) P_{l+1} = (2l + 1) x P_l - l P_{l-1}, for all pairs at once
+      int n_pairs = args.size(), n_l = G_l[block_idx].mesh().size();
+      long n_elements = G_l_acc[block_idx].size() / n_l;
+      p_prev.assign(n_pairs, 0);
+      p_cur.assign(n_pairs, 1);
+      mc_weight_t *acc = G_l_acc[block_idx].data();
+      double const *x  = args.data();
+      for (int l = 0; l < n_l; ++l, acc += n_elements) {
+        for (int k = 0; k < n_pairs; ++k) acc[elements[k]] += vals[k] * p_cur[k];
+        double a = (2 * l + 1) / double(l + 1), b = l / double(l + 1);
+        double *pp = p_prev.data(), *pc = p_cur.data();
+        for (int k = 0; k < n_pairs; ++k) {
+          double p_next = a * x[k] * pc[k] - b * pp[k];
+          pp[k]         = pc[k];
+          pc[k]         = p_next;
         }
-      })
-        ;
+      }
     } // for block_idx
   }
 
+  namespace {
+    // Normalization of the summed coefficients by the sum of the signs, with the basis overlap, and the discontinuity enforced
+    template <typename BlockGf> void normalize(BlockGf &G_l, mc_weight_t average_sign, double beta) {
+      for (auto &G_l_block : G_l) {
+        for (auto l : G_l_block.mesh()) {
+          /// Normalize polynomial coefficients with basis overlap
+          G_l_block[l] *= -(sqrt(2.0 * l + 1.0) / (real(average_sign) * beta));
+        }
+        matrix<double> id(G_l_block.target_shape());
+        id() = 1.0; // this creates an unit matrix
+        enforce_discontinuity(G_l_block, id);
+      }
+    }
+  } // namespace
+
   void measure_G_l::collect_results(triqs::mpi::communicator const &c) {
 
+    for (auto block_idx : range(G_l.size())) {
+      auto const &acc = G_l_acc[block_idx];
+      std::copy(acc.begin(), acc.end(), G_l[block_idx].data().data_start());
+    }
+
     average_sign = mpi_all_reduce(average_sign, c);
     G_l          = mpi_all_reduce(G_l, c);
+    normalize(G_l, average_sign, data.config.beta());
+  }
 
-    double beta = data.config.beta();
-
-    for (auto &G_l_block : G_l) {
-      for (auto l : G_l_block.mesh()) {
-        /// Normalize polynomial coefficients with basis overlap
-        G_l_block[l] *= -(sqrt(2.0 * l + 1.0) / (real(average_sign) * beta));
-      }
-      matrix<double> id(G_l_block.target_shape());
-      id() = 1.0; // this creates an unit matrix
-      enforce_discontinuity(G_l_block, id);
+  void measure_G_l::write_snapshot(triqs::mpi::communicator const &c, triqs::h5::group *g) const {
+    G_l_t G  = G_l;
+    auto sign = average_sign;
+    for (auto block_idx : range(G.size())) {
+      auto const &acc = G_l_acc[block_idx];
+      std::copy(acc.begin(), acc.end(), G[block_idx].data().data_start());
+      snapshot_reduce(G[block_idx].data().data_start(), acc.size(), c);
     }
+    snapshot_reduce(&sign, 1, c);
+    if (!g) return;
+    normalize(G, sign, data.config.beta());
+    h5_write(*g, "G_l", G);
+    h5_write(*g, "average_sign", sign);
   }
 
 } // namespace triqs_cthyb
@@ -20,8 +20,9 @@
  ******************************************************************************/
 #pragma once
 #include <triqs/gfs.hpp>
-#include <triqs/utility/legendre.hpp>
+#include <vector>
 #include "../qmc_data.hpp"
+#include "../snapshots.hpp"
 
 namespace triqs_cthyb {
 
@@ -34,11 +35,20 @@ namespace triqs_cthyb {
     measure_G_l(std::optional<G_l_t> &G_l_opt, qmc_data const &data, int n_l, gf_struct_t const &gf_struct);
     void accumulate(mc_weight_t s);
     void collect_results(triqs::mpi::communicator const &c);
+    void write_snapshot(triqs::mpi::communicator const &c, triqs::h5::group *g) const;
 
     private:
     qmc_data const &data;
     mc_weight_t average_sign;
     G_l_t::view_type G_l;
+
+    // Accumulated coefficients by block, contiguous in (l, i, j), added to G_l in collect_results
+    std::vector<std::vector<mc_weight_t>> G_l_acc;
+
+    // Work arrays of accumulate, by (x, y) pair of a block
+    std::vector<double> args, p_prev, p_cur;
+    std::vector<mc_weight_t> vals;
+    std::vector<int> elements;
   };
 
 } // namespace triqs_cthyb
@@ -36,38 +36,54 @@ namespace triqs_cthyb {
     s *= data.atomic_reweighting;
     average_sign += s;
 
+    // beta-periodicity is implicit in dtau, and the sign is in M_signed
+    auto const &batch = data.det_batch();
     for (auto block_idx : range(G_tau.size())) {
-      foreach (data.dets[block_idx], [this, s, block_idx](op_t const &x, op_t const &y, det_scalar_t M) {
-        // beta-periodicity is implicit in the argument, just fix the sign properly
-        auto val    = (y.first >= x.first ? s : -s) * M;
-        double dtau = double(y.first - x.first);
-        this->G_tau[block_idx][closest_mesh_pt(dtau)](y.second, x.second) += val;
-      })
-        ;
+      auto &G_block = G_tau[block_idx];
+      for (long k = batch.start[block_idx]; k < batch.start[block_idx + 1]; ++k)
+        G_block[closest_mesh_pt(batch.dtau[k])](batch.y[k].second, batch.x[k].second) += s * batch.M_signed[k];
     }
   }
 
-  void measure_G_tau::collect_results(triqs::mpi::communicator const &c) {
+  namespace {
+    // Normalization of the accumulated G_tau by the sum of the signs, with the 1/iw discontinuity enforced.
+    // warn: warns if the discontinuity deviates appreciably from -1
+    template <typename BlockGf> void normalize(BlockGf &G_tau, mc_weight_t average_sign, bool warn) {
+      for (auto &G_tau_block : G_tau) {
+        double beta = G_tau_block.mesh().domain().beta;
+        G_tau_block /= -real(average_sign) * beta * G_tau_block.mesh().delta();
 
-    G_tau        = mpi_all_reduce(G_tau, c);
-    average_sign = mpi_all_reduce(average_sign, c);
+        // Multiply first and last bins by 2 to account for full bins
+        int last = G_tau_block.mesh().size() - 1;
+        G_tau_block[0] *= 2;
+        G_tau_block[last] *= 2;
 
-    for (auto &G_tau_block : G_tau) {
-      double beta = G_tau_block.mesh().domain().beta;
-      G_tau_block /= -real(average_sign) * beta * G_tau_block.mesh().delta();
+        // Set 1/iw behaviour of tails in G_tau to avoid problems when taking FTs later
+        auto d = max_element(abs(G_tau_block[0] + G_tau_block[last] + 1));
+        if (d > 1e-2 && warn)
+          std::cerr << "WARNING: Tau discontinuity of G_tau deviates appreciably from -1\n     .... max_element |g(0) + g(beta) + 1| = "<<d<<"\n";
+
+        G_tau_block[last] = -1. - G_tau_block[0]; // Enforce 1/iw discontinuity (nb. matrix eq.)
+      }
+    }
+  } // namespace
 
-      // Multiply first and last bins by 2 to account for full bins
-      int last = G_tau_block.mesh().size() - 1;
-      G_tau_block[0] *= 2;
-      G_tau_block[last] *= 2;
+  void measure_G_tau::collect_results(triqs::mpi::communicator const &c) {
 
-      // Set 1/iw behaviour of tails in G_tau to avoid problems when taking FTs later
-      auto d= max_element(abs(G_tau_block[0] + G_tau_block[last] + 1));
-      if(d > 1e-2 && c.rank() == 0)
-	std::cerr << "WARNING: Tau discontinuity of G_tau deviates appreciably from -1\n     .... max_element |g(0) + g(beta) + 1| = "<<d<<"\n";
+    G_tau        = mpi_all_reduce(G_tau, c);
+    average_sign = mpi_all_reduce(average_sign, c);
+    normalize(G_tau, average_sign, c.rank() == 0);
+  }
 
-      G_tau_block[last] = -1. - G_tau_block[0]; // Enforce 1/iw discontinuity (nb. matrix eq.)
-    }
+  void measure_G_tau::write_snapshot(triqs::mpi::communicator const &c, triqs::h5::group *g) const {
+    G_tau_G_target_t G = G_tau;
+    auto sign          = average_sign;
+    for (auto &G_block : G) snapshot_reduce(G_block.data().data_start(), G_block.data().size(), c);
+    snapshot_reduce(&sign, 1, c);
+    if (!g) return;
+    normalize(G, sign, false);
+    h5_write(*g, "G_tau", G);
+    h5_write(*g, "average_sign", sign);
   }
 
 } // namespace triqs_cthyb
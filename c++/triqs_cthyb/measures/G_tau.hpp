@@ -23,6 +23,7 @@
 #include <triqs/gfs.hpp>
 
 #include "../qmc_data.hpp"
+#include "../snapshots.hpp"
 
 namespace triqs_cthyb {
 
@@ -35,6 +36,7 @@ namespace triqs_cthyb {
     measure_G_tau(std::optional<G_tau_G_target_t> &G_tau_opt, qmc_data const &data, int n_tau, gf_struct_t const &gf_struct);
     void accumulate(mc_weight_t s);
     void collect_results(triqs::mpi::communicator const &c);
+    void write_snapshot(triqs::mpi::communicator const &c, triqs::h5::group *g) const;
 
     private:
     qmc_data const &data;
@@ -21,6 +21,7 @@
  ******************************************************************************/
 
 #include <triqs/mc_tools.hpp>
+#include <algorithm>
 
 #include "./O_tau_ins.hpp"
 
@@ -29,11 +30,12 @@ namespace triqs_cthyb {
   using namespace triqs::gfs;
 
   measure_O_tau_ins::measure_O_tau_ins(std::optional<gf<imtime, scalar_valued>> &O_tau_opt, qmc_data const &data, int n_tau,
-                                       many_body_op_t const &op1, many_body_op_t const &op2, int min_ins, mc_tools::random_generator &rng)
-    : data(data), average_sign(0), op1(op1), op2(op2), min_ins(min_ins), rng(rng) {
+                                       many_body_op_t const &op1, many_body_op_t const &op2, int min_ins, bool sweep, mc_tools::random_generator &rng)
+    : data(data), average_sign(0), op1(op1), op2(op2), min_ins(min_ins), sweep(sweep), rng(rng) {
     O_tau_opt = gf<imtime, scalar_valued>{{data.config.beta(), Boson, n_tau}};
     O_tau.rebind(*O_tau_opt);
     O_tau() = 0.0;
+    for (auto const &tau : O_tau.mesh()) dtaus.push_back(double(tau));
 
     op1_d = data.imp_trace.attach_aux_operator(op1);
     op2_d = data.imp_trace.attach_aux_operator(op2);
@@ -45,11 +47,25 @@ namespace triqs_cthyb {
 
     int pto = 0;
     for (const auto &det : data.dets) pto += det.size();
-    int nsamples = pto * pto;
-    if( nsamples < min_ins ) nsamples = min_ins;
 
     mc_weight_t atomic_weight, atomic_reweighting;
     auto [bare_atomic_weight, bare_atomic_reweighting] = data.imp_trace.compute();
+
+    // For each of the random times of op1, op2 at all the points of the mesh.
+    // A point of the mesh stands for a bin of width dtau (half of it at the edges), so for (n_tau - 1) samples of the bins.
+    if (sweep) {
+      int n_points  = dtaus.size();
+      int n_samples = std::max({pto, 1, (min_ins + n_points - 1) / n_points});
+      auto prefactor = s / bare_atomic_weight / bare_atomic_reweighting / double(n_samples) / double(n_points - 1);
+      for (int i : range(n_samples)) {
+        data.imp_trace.compute_aux_pair_traces(op1_d, op2_d, data.tau_seg.get_random_pt(rng), dtaus, traces);
+        for (int j : range(n_points)) O_tau[j] += prefactor * traces[j] * ((j == 0) || (j == n_points - 1) ? 0.5 : 1.0);
+      }
+      return;
+    }
+
+    int nsamples = pto * pto;
+    if( nsamples < min_ins ) nsamples = min_ins;
     const auto prefactor = s / bare_atomic_weight / bare_atomic_reweighting / double(nsamples);
 
     for (int i : range(nsamples)) {
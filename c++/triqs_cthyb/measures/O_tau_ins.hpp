@@ -33,7 +33,7 @@ namespace triqs_cthyb {
   class measure_O_tau_ins {
 
     public:
-    measure_O_tau_ins(std::optional<gf<imtime, scalar_valued>> &O_tau_opt, qmc_data const &data, int n_tau, many_body_op_t const &op1, many_body_op_t const &op2, int min_ins, mc_tools::random_generator &rng);
+    measure_O_tau_ins(std::optional<gf<imtime, scalar_valued>> &O_tau_opt, qmc_data const &data, int n_tau, many_body_op_t const &op1, many_body_op_t const &op2, int min_ins, bool sweep, mc_tools::random_generator &rng);
     void accumulate(mc_weight_t s);
     void collect_results(triqs::mpi::communicator const &c);
 
@@ -44,8 +44,11 @@ namespace triqs_cthyb {
     many_body_op_t op1, op2;
     op_desc op1_d, op2_d;
     int min_ins;
+    bool sweep;                 // O_tau on the whole mesh for each time of op1
+    std::vector<double> dtaus;  // the points of the mesh
+    std::vector<h_scalar_t> traces;
     mc_tools::random_generator &rng;
-    
+
   };
 
 } // namespace triqs_cthyb
@@ -0,0 +1,82 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+
+#include "autocorrelation.hpp"
+#include <algorithm>
+
+namespace triqs_cthyb {
+
+  measure_autocorrelation::measure_autocorrelation(qmc_data const &data, autocorrelation_times_t &result, int n_l,
+                                                   std::vector<std::string> const &block_names)
+     : data(data), result(result), n_l(std::max(n_l, 0)) {
+    names = {"sign", "perturbation_order"};
+    for (auto const &b : block_names)
+      for (int l = 0; l < this->n_l; ++l) names.push_back("G_l/" + b + "/" + std::to_string(l));
+    series.resize(names.size());
+    g_l.resize(this->n_l);
+    result.clear();
+  }
+
+  void measure_autocorrelation::accumulate(mc_weight_t s) {
+    if (!started) {
+      start   = clock::now();
+      started = true;
+    }
+    s *= data.atomic_reweighting;
+    series[0] << std::real(s);
+    series[1] << data.config.size() / 2;
+
+    // Estimator of the Legendre coefficients of the trace of each block, up to their normalization
+    double beta = data.config.beta();
+    auto it     = series.begin() + 2;
+    auto const &batch = data.det_batch();
+    for (int b = 0; b < batch.n_blocks(); ++b) {
+      std::fill(g_l.begin(), g_l.end(), 0);
+      for (long k = batch.start[b]; k < batch.start[b + 1]; ++k) {
+        if (batch.x[k].second != batch.y[k].second) continue;
+        double t = 2 * batch.dtau[k] / beta - 1, p_prev = 0, p = 1;
+        double v = std::real(s * batch.M_signed[k]);
+        for (int l = 0; l < n_l; ++l) {
+          g_l[l] += v * p;
+          double p_next = ((2 * l + 1) * t * p - l * p_prev) / (l + 1);
+          p_prev        = p;
+          p             = p_next;
+        }
+      }
+      for (int l = 0; l < n_l; ++l) *it++ << g_l[l];
+    }
+  }
+
+  void measure_autocorrelation::collect_results(triqs::mpi::communicator const &c) {
+    double time = (started ? std::chrono::duration<double>(clock::now() - start).count() : 0);
+    if (c.size() > 1) MPI_Allreduce(MPI_IN_PLACE, &time, 1, MPI_DOUBLE, MPI_MAX, c.get());
+    result.clear();
+    for (size_t k = 0; k < series.size(); ++k) {
+      series[k].mpi_sum(c);
+      double tau = series[k].tau_int(), n_eff = series[k].n_values() / (1 + 2 * tau);
+      result[names[k] + "/tau_int"]       = tau;
+      result[names[k] + "/n_eff"]         = n_eff;
+      result[names[k] + "/n_eff_per_sec"] = (time > 0 ? n_eff / time : 0);
+    }
+    result["n_measures"] = series[0].n_values();
+  }
+
+} // namespace triqs_cthyb
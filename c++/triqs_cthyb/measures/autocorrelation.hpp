@@ -0,0 +1,100 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include "../qmc_data.hpp"
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace triqs_cthyb {
+
+  /// Integrated autocorrelation times, and effective numbers of samples, by "<observable>/<quantity>"
+  using autocorrelation_times_t = std::map<std::string, double>;
+
+  // Logarithmic binning of a time series: level l holds the sums over the means of the bins of 2^l successive values.
+  // The memory is fixed (max_levels), whatever the length of the series.
+  class log_binning {
+    public:
+    static constexpr int max_levels = 40;
+
+    void operator<<(double x) {
+      for (int l = 0; l < max_levels; ++l) {
+        sum[l] += x;
+        sum2[l] += x * x;
+        ++count[l];
+        if (!has_pending[l]) {
+          pending[l]     = x;
+          has_pending[l] = true;
+          return;
+        }
+        x              = (pending[l] + x) / 2;
+        has_pending[l] = false;
+      }
+    }
+
+    /// Sums over the processes, level by level
+    void mpi_sum(triqs::mpi::communicator const &c) {
+      if (c.size() == 1) return;
+      for (auto *v : {sum, sum2, count}) MPI_Allreduce(MPI_IN_PLACE, v, max_levels, MPI_DOUBLE, MPI_SUM, c.get());
+    }
+
+    /// Number of values
+    double n_values() const { return count[0]; }
+
+    /// Integrated autocorrelation time tau = (2^l var_l / var_0 - 1) / 2, in units of the step of the series,
+    /// at the deepest level l with at least min_bins bins. 0 for a constant series.
+    double tau_int(int min_bins = 32) const {
+      auto var = [this](int l) { return (count[l] > 1 ? (sum2[l] - sum[l] * sum[l] / count[l]) / (count[l] - 1) : 0); };
+      double var0 = var(0);
+      if (!(var0 > 0)) return 0;
+      int l = 0;
+      while (l + 1 < max_levels && count[l + 1] >= min_bins) ++l;
+      return std::max(0.0, (std::ldexp(var(l), l) / var0 - 1) / 2);
+    }
+
+    private:
+    double sum[max_levels] = {}, sum2[max_levels] = {}, count[max_levels] = {}, pending[max_levels] = {};
+    bool has_pending[max_levels] = {};
+  };
+
+  // Autocorrelation of the sign, of the perturbation order, and of the first Legendre coefficients of the trace of each block of G
+  struct measure_autocorrelation {
+
+    public:
+    measure_autocorrelation(qmc_data const &data, autocorrelation_times_t &result, int n_l, std::vector<std::string> const &block_names);
+    void accumulate(mc_weight_t s);
+    void collect_results(triqs::mpi::communicator const &c);
+
+    private:
+    using clock = std::chrono::steady_clock;
+    qmc_data const &data;
+    autocorrelation_times_t &result;
+    int n_l;
+    std::vector<std::string> names; // sign, perturbation_order, then G_l/<block>/<l>, by block and l
+    std::vector<log_binning> series;
+    std::vector<double> g_l;
+    clock::time_point start;
+    bool started = false;
+  };
+
+} // namespace triqs_cthyb
@@ -20,6 +20,8 @@
  ******************************************************************************/
 #pragma once
 #include "../qmc_data.hpp"
+#include "../snapshots.hpp"
+#include <utility>
 
 namespace triqs_cthyb {
 
@@ -28,8 +30,10 @@ namespace triqs_cthyb {
     qmc_data const &data;
     mc_weight_t &average_sign;
     mc_weight_t sign, z;
+    std::pair<mc_weight_t, mc_weight_t> *totals; // if not null, the sums of the sign and of the weight, after collect_results
 
-    measure_average_sign(qmc_data const &data, mc_weight_t &average_sign) : data(data), average_sign(average_sign) {
+    measure_average_sign(qmc_data const &data, mc_weight_t &average_sign, std::pair<mc_weight_t, mc_weight_t> *totals = nullptr)
+       : data(data), average_sign(average_sign), totals(totals) {
       average_sign = 1.0;
       z            = 0;
       sign         = 0;
@@ -48,6 +52,13 @@ namespace triqs_cthyb {
       z            = mpi_all_reduce(z, c);
       sign         = mpi_all_reduce(sign, c);
       average_sign = sign / z;
+      if (totals) *totals = {sign, z};
+    }
+
+    void write_snapshot(triqs::mpi::communicator const &c, triqs::h5::group *g) const {
+      mc_weight_t x[2] = {sign, z};
+      snapshot_reduce(x, 2, c);
+      if (g) h5_write(*g, "average_sign", x[0] / x[1]);
     }
   };
 }
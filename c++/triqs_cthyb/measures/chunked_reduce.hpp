@@ -0,0 +1,90 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include <triqs/mpi/base.hpp>
+#include <triqs/utility/exceptions.hpp>
+#include <algorithm>
+#include <complex>
+#include <cstddef>
+#include <deque>
+#include <string>
+
+namespace triqs_cthyb {
+
+  /// How the large measurement containers are summed over the MPI processes
+  // all:     mpi_all_reduce of the whole container (a temporary as large as the container on every process)
+  // chunked: in-place all-reduce, in chunks
+  // root:    in-place reduce to rank 0, in chunks. The other processes are left with their partial sums.
+  enum class reduction_mode { all, chunked, root };
+
+  inline reduction_mode make_reduction_mode(std::string const &s) {
+    if (s == "all") return reduction_mode::all;
+    if (s == "chunked") return reduction_mode::chunked;
+    if (s == "root") return reduction_mode::root;
+    TRIQS_RUNTIME_ERROR << "Unknown reduction mode " << s << " (expected all, chunked or root)";
+  }
+
+  namespace detail {
+    inline MPI_Datatype mpi_type(double const *) { return MPI_DOUBLE; }
+    inline MPI_Datatype mpi_type(std::complex<double> const *) { return MPI_CXX_DOUBLE_COMPLEX; }
+  } // namespace detail
+
+  /// In-place sum over comm of the n elements at p, by chunks of chunk_bytes, to rank 0 only if root_only.
+  // At most max_pending non-blocking reductions are in flight, so that successive chunks overlap.
+  template <typename T>
+  void mpi_reduce_in_chunks(T *p, std::size_t n, triqs::mpi::communicator const &comm, bool root_only, std::size_t chunk_bytes,
+                            int max_pending = 4) {
+    if (comm.size() == 1) return;
+    std::size_t chunk = std::max(std::size_t{1}, chunk_bytes / sizeof(T));
+    bool is_root      = (comm.rank() == 0);
+    std::deque<MPI_Request> pending;
+    for (std::size_t start = 0; start < n; start += chunk) {
+      int count = int(std::min(chunk, n - start));
+      MPI_Request r;
+      if (!root_only)
+        MPI_Iallreduce(MPI_IN_PLACE, p + start, count, detail::mpi_type(p), MPI_SUM, comm.get(), &r);
+      else if (is_root)
+        MPI_Ireduce(MPI_IN_PLACE, p + start, count, detail::mpi_type(p), MPI_SUM, 0, comm.get(), &r);
+      else
+        MPI_Ireduce(p + start, nullptr, count, detail::mpi_type(p), MPI_SUM, 0, comm.get(), &r);
+      pending.push_back(r);
+      if (int(pending.size()) >= max_pending) {
+        MPI_Wait(&pending.front(), MPI_STATUS_IGNORE);
+        pending.pop_front();
+      }
+    }
+    for (auto &r : pending) MPI_Wait(&r, MPI_STATUS_IGNORE);
+  }
+
+  /// Sum over comm of the blocks of a block2_gf (or view), according to mode
+  template <typename G2> void mpi_reduce_block2_gf(G2 &g, triqs::mpi::communicator const &comm, reduction_mode mode, std::size_t chunk_bytes) {
+    if (mode == reduction_mode::all) {
+      g = mpi_all_reduce(g, comm);
+      return;
+    }
+    for (int i = 0; i < g.size1(); ++i)
+      for (int j = 0; j < g.size2(); ++j) {
+        auto d = g(i, j).data();
+        mpi_reduce_in_chunks(d.data_start(), d.size(), comm, mode == reduction_mode::root, chunk_bytes);
+      }
+  }
+
+} // namespace triqs_cthyb
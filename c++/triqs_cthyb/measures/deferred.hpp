@@ -0,0 +1,95 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include "../qmc_data.hpp"
+#include <triqs/mpi/base.hpp>
+#include <triqs/utility/exceptions.hpp>
+#include <memory>
+
+namespace triqs_cthyb {
+
+  // A measure accumulated once per configuration, with the sum of the signs of the cycles spent in it (defer_measures).
+  //
+  // For a measure linear in the sign, sum_n s_n f(C) = (sum_n s_n) f(C): the cycles which see the same configuration
+  // (no qmc_data::flush_deferred_measures in between) only add their sign to a pending sum. The measure is accumulated with that sum just before
+  // the configuration changes (qmc_data::flush_deferred_measures, called by move_flushing_measures at the acceptance of a move,
+  // and by clear_configuration and load_configuration), before a snapshot, and at collect_results.
+  // At the acceptance of a move, the trace holds the proposed configuration: only the measures which read the configuration,
+  // the dets and the weights of qmc_data (not the trace, nor the random generator) can be deferred.
+  template <typename Measure> class measure_deferred {
+
+    struct state_t {
+      Measure measure;
+      qmc_data const &data;
+      mc_weight_t pending = 0;
+      long n_pending = 0, n_flushes = -1; // n_flushes of data at the first pending cycle
+
+      void flush() {
+        if (n_pending == 0) return;
+        measure.accumulate(pending);
+        pending   = 0;
+        n_pending = 0;
+      }
+    };
+    std::shared_ptr<state_t> st;
+
+    public:
+    measure_deferred(Measure m, qmc_data &data) : st(std::make_shared<state_t>(state_t{std::move(m), data})) {
+      data.deferred_measures.push_back([st = st]() { st->flush(); });
+    }
+
+    void accumulate(mc_weight_t s) {
+      auto &x = *st;
+      if ((x.n_pending > 0) && (x.data.n_flushes != x.n_flushes))
+        TRIQS_RUNTIME_ERROR << "Deferred measure: the configuration has changed without the accumulation of the previous one";
+      x.n_flushes = x.data.n_flushes;
+      x.pending += s;
+      ++x.n_pending;
+    }
+
+    void collect_results(triqs::mpi::communicator const &c) {
+      st->flush();
+      st->measure.collect_results(c);
+    }
+
+    // between two cycles, with the configuration of the pending sum
+    void write_snapshot(triqs::mpi::communicator const &c, triqs::h5::group *g) {
+      st->flush();
+      st->measure.write_snapshot(c, g);
+    }
+  };
+
+  // A move which accumulates the deferred measures of its qmc_data before its acceptance changes the configuration
+  template <typename Move> class move_flushing_measures {
+    Move move;
+    qmc_data *data;
+
+    public:
+    move_flushing_measures(Move move, qmc_data &data) : move(std::move(move)), data(&data) {}
+    mc_weight_t attempt() { return move.attempt(); }
+    mc_weight_t accept() {
+      data->flush_deferred_measures();
+      return move.accept();
+    }
+    void reject() { move.reject(); }
+  };
+
+} // namespace triqs_cthyb
@@ -37,17 +37,16 @@ namespace triqs_cthyb {
   void measure_density_matrix::accumulate(mc_weight_t s) {
     // we assume here that we are in "Norm" mode, i.e. qmc weight is norm, not trace
 
-    // We need to recompute since the density_matrix in the trace is changed at each computatation,
-    // in particular at the last failed attempt.
-    // So we need to compute it, without any Yee threshold.
-    data.imp_trace.compute();
+    // The density_matrix in the trace is changed at each computation, in particular at the last failed attempt.
+    // The trace keeps that of the accepted configuration, recomputed (without any Yee threshold) only when it has changed.
+    auto const &dm = data.imp_trace.get_accepted_density_matrix();
     z += s * data.atomic_reweighting;
     s /= data.atomic_weight; // accumulate matrix / norm since weight is norm * det
 
     // Careful: there is no reweighting factor here!
     int size = block_dm.size();
     for (int i = 0; i < size; ++i)
-      if (data.imp_trace.get_density_matrix()[i].is_valid) { block_dm[i] += s * data.imp_trace.get_density_matrix()[i].mat; }
+      if (dm[i].is_valid) { block_dm[i] += s * dm[i].mat; }
   }
 
   // ---------------------------------------------
@@ -68,4 +67,14 @@ namespace triqs_cthyb {
       std::cerr << "Warning :: Trace of the density matrix is " << std::setprecision(13) << tr << std::setprecision(6) << " instead of 1"
                 << std::endl;
   }
+
+  void measure_density_matrix::write_snapshot(triqs::mpi::communicator const &c, triqs::h5::group *g) const {
+    auto dm = block_dm;
+    auto zz = z;
+    for (auto &b : dm) snapshot_reduce(b.data_start(), b.size1() * b.size2(), c);
+    snapshot_reduce(&zz, 1, c);
+    if (!g) return;
+    auto gr = g->create_group("density_matrix");
+    for (int i = 0; i < int(dm.size()); ++i) h5_write(gr, std::to_string(i), matrix_t(dm[i] / real(zz)));
+  }
 }
@@ -20,6 +20,7 @@
  ******************************************************************************/
 #pragma once
 #include "../qmc_data.hpp"
+#include "../snapshots.hpp"
 
 namespace triqs_cthyb {
 
@@ -31,5 +32,6 @@ namespace triqs_cthyb {
     measure_density_matrix(qmc_data const &data, std::vector<matrix_t> &density_matrix);
     void accumulate(mc_weight_t s);
     void collect_results(triqs::mpi::communicator const &c);
+    void write_snapshot(triqs::mpi::communicator const &c, triqs::h5::group *g) const;
   };
 }
@@ -0,0 +1,83 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include "../config.hpp"
+#include <triqs/mpi/base.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+namespace triqs_cthyb {
+
+  // A measure accumulated only every interval cycles.
+  //
+  // The measures normalize by their own accumulated sign, so that skipping cycles does not bias them.
+  // With interval = 0 (adaptive), the measure is accumulated at every cycle during the first n_calibration_cycles,
+  // then every n cycles, with n the ratio of the time of one accumulation to the time of one cycle of the
+  // Markov chain: the time spent in the measure is then about the time spent in the moves.
+  template <typename Measure> class measure_every_n_cycles {
+
+    static constexpr long n_calibration_cycles = 100;
+    using clock                                = std::chrono::steady_clock;
+
+    Measure measure;
+    std::string name;
+    int interval;
+    bool adaptive, report;
+    long n_cycles = 0, n_accumulated = 0;
+    double accumulate_time = 0, chain_time = 0; // in seconds
+    clock::time_point last;
+
+    static double seconds(clock::duration d) { return std::chrono::duration<double>(d).count(); }
+
+    public:
+    measure_every_n_cycles(Measure measure, std::string name, int interval, bool report)
+       : measure(std::move(measure)), name(std::move(name)), interval(std::max(interval, 1)), adaptive(interval <= 0), report(report) {}
+
+    void accumulate(mc_weight_t s) {
+      auto start = clock::now();
+      if (adaptive && n_cycles > 0) chain_time += seconds(start - last);
+      ++n_cycles;
+      if (n_cycles % interval == 0) {
+        measure.accumulate(s);
+        ++n_accumulated;
+        last = clock::now();
+        accumulate_time += seconds(last - start);
+      } else
+        last = start;
+      if (adaptive && n_cycles == n_calibration_cycles) {
+        double cycle_time = chain_time / (n_cycles - 1);
+        double ratio      = (cycle_time > 0 ? accumulate_time / n_accumulated / cycle_time : 1);
+        interval          = int(std::min(std::max(std::lround(ratio), 1l), 1000000l));
+        adaptive          = false;
+      }
+    }
+
+    void collect_results(triqs::mpi::communicator const &c) {
+      measure.collect_results(c);
+      if (report && c.rank() == 0)
+        std::cout << name << ": accumulated every " << interval << " cycle(s), " << n_accumulated << " times on rank 0" << std::endl;
+    }
+  };
+
+} // namespace triqs_cthyb
@@ -22,6 +22,7 @@
 #pragma once
 
 #include "../types.hpp"
+#include <set>
 
 namespace triqs_cthyb {
 
@@ -55,6 +56,13 @@ namespace triqs_cthyb {
 
     const std::vector<G2_measure_t> &operator()() { return measures; }
 
+    /// The names of the measured pairs of blocks, the only ones allocated in the containers
+    std::set<std::pair<std::string, std::string>> block_pairs() const {
+      std::set<std::pair<std::string, std::string>> r;
+      for (auto const &m : measures) r.emplace(m.b1.name, m.b2.name);
+      return r;
+    }
+
     /// the constructor mangles the parameters, especially params.measure_G2_blocks
     /// and populates the std::vector<g4_measure_t> measures
     G2_measures_t(const G_tau_t &_Delta_tau, const gf_struct_t &gf_struct, const solve_parameters_t &params) : gf_struct(gf_struct), params(params) {
@@ -52,6 +52,8 @@ namespace triqs_cthyb {
     std::cerr << "* Attempt for move_insert_c_c_cdag_cdag (blocks " << block_index1 << ", " << block_index2 << ")" << std::endl;
 #endif
 
+    det_tried = false;
+
     // Pick up the value of alpha and choose the operators
     auto rs1 = rng(block_size1), rs2 = rng(block_size1), rs3 = rng(block_size2), rs4 = rng(block_size2);
     op1 = op_desc{block_index1, rs1, true, data.linindex[std::make_pair(block_index1, rs1)]};
@@ -97,28 +99,18 @@ namespace triqs_cthyb {
       return 0;
     }
 
+    // A structural zero of the trace is rejected before any work on the determinant
+    if (!data.imp_trace.is_structurally_nonzero()) return 0;
+
     // Computation of det ratio
-    auto &det1    = data.dets[block_index1];
-    auto &det2    = data.dets[block_index2];
-    int det1_size = det1.size();
-    int det2_size = det2.size();
+    auto &det1 = data.dets[block_index1];
+    auto &det2 = data.dets[block_index2];
     det_scalar_t det_ratio;
 
     // Find the position for insertion in the determinant
     // NB : the determinant stores the C in decreasing time order.
-    int num_c_dag1, num_c1, num_c_dag2, num_c2;
-    for (num_c_dag1 = 0; num_c_dag1 < det1_size; ++num_c_dag1) {
-      if (det1.get_x(num_c_dag1).first < tau1) break;
-    }
-    for (num_c1 = 0; num_c1 < det1_size; ++num_c1) {
-      if (det1.get_y(num_c1).first < tau2) break;
-    }
-    for (num_c_dag2 = 0; num_c_dag2 < det2_size; ++num_c_dag2) {
-      if (det2.get_x(num_c_dag2).first < tau3) break;
-    }
-    for (num_c2 = 0; num_c2 < det2_size; ++num_c2) {
-      if (det2.get_y(num_c2).first < tau4) break;
-    }
+    int num_c_dag1 = det_position_x(det1, tau1), num_c1 = det_position_y(det1, tau2);
+    int num_c_dag2 = det_position_x(det2, tau3), num_c2 = det_position_y(det2, tau4);
 
     // Insert in the det. Returns the ratio of dets (Cf det_manip doc).
     if (block_index1 == block_index2) {
@@ -140,6 +132,7 @@ namespace triqs_cthyb {
       auto det_ratio2 = det2.try_insert(num_c_dag2, num_c2, {tau3, op3.inner_index}, {tau4, op4.inner_index});
       det_ratio       = det_ratio1 * det_ratio2;
     }
+    det_tried = true;
 
     // proposition probability
     mc_weight_t t_ratio;
@@ -201,12 +194,13 @@ namespace triqs_cthyb {
 
     // insert in the determinant
     if (block_index1 == block_index2) {
-      data.dets[block_index1].complete_operation();
+      data.complete_det_operation(block_index1);
     } else {
-      data.dets[block_index1].complete_operation();
-      data.dets[block_index2].complete_operation();
+      data.complete_det_operation(block_index1);
+      data.complete_det_operation(block_index2);
     }
-    data.update_sign();
+    data.update_sign({{tau1, op1.block_index, op1.dagger}, {tau2, op2.block_index, op2.dagger}, {tau3, op3.block_index, op3.dagger},
+                      {tau4, op4.block_index, op4.dagger}});
 
     data.atomic_weight      = new_atomic_weight;
     data.atomic_reweighting = new_atomic_reweighting;
@@ -232,11 +226,9 @@ namespace triqs_cthyb {
 
     config.finalize();
     data.imp_trace.cancel_insert();
-    if (block_index1 == block_index2) {
-      data.dets[block_index1].reject_last_try();
-    } else {
+    if (det_tried) {
       data.dets[block_index1].reject_last_try();
-      data.dets[block_index2].reject_last_try();
+      if (block_index2 != block_index1) data.dets[block_index2].reject_last_try();
     }
 
 #ifdef EXT_DEBUG
@@ -52,6 +52,8 @@ namespace triqs_cthyb {
     std::cerr << "* Attempt for move_remove_c_c_cdag_cdag (blocks " << block_index1 << ", " << block_index2 << ")" << std::endl;
 #endif
 
+    det_tried = false;
+
     auto &det1 = data.dets[block_index1];
     auto &det2 = data.dets[block_index2];
     det_scalar_t det_ratio;
@@ -91,6 +93,9 @@ namespace triqs_cthyb {
       *histo_proposed2 << dtau2;
     }
 
+    // A structural zero of the trace is rejected before any work on the determinant
+    if (!data.imp_trace.is_structurally_nonzero()) return 0;
+
     if (block_index1 == block_index2) {
       det_ratio = det1.try_remove2(num_c_dag1, num_c_dag2, num_c1, num_c2);
     } else { // block_index1 != block_index2
@@ -98,6 +103,7 @@ namespace triqs_cthyb {
       auto det_ratio2 = det2.try_remove(num_c_dag2, num_c2);
       det_ratio       = det_ratio1 * det_ratio2;
     }
+    det_tried = true;
 
     // proposition probability
     mc_weight_t t_ratio;
@@ -157,12 +163,12 @@ namespace triqs_cthyb {
 
     // remove from the determinants
     if (block_index1 == block_index2) {
-      data.dets[block_index1].complete_operation();
+      data.complete_det_operation(block_index1);
     } else {
-      data.dets[block_index1].complete_operation();
-      data.dets[block_index2].complete_operation();
+      data.complete_det_operation(block_index1);
+      data.complete_det_operation(block_index2);
     }
-    data.update_sign();
+    data.update_sign({{tau1, block_index1, false}, {tau2, block_index1, true}, {tau3, block_index2, false}, {tau4, block_index2, true}});
 
     data.atomic_weight      = new_atomic_weight;
     data.atomic_reweighting = new_atomic_reweighting;
@@ -187,11 +193,9 @@ namespace triqs_cthyb {
     config.finalize();
     data.imp_trace.cancel_delete();
     // remove from the determinants
-    if (block_index1 == block_index2) {
-      data.dets[block_index1].reject_last_try();
-    } else {
+    if (det_tried) {
       data.dets[block_index1].reject_last_try();
-      data.dets[block_index2].reject_last_try();
+      if (block_index2 != block_index1) data.dets[block_index2].reject_last_try();
     }
 
 #ifdef EXT_DEBUG
@@ -20,9 +20,60 @@
  ******************************************************************************/
 
 #include "./global.hpp"
+#include <triqs/arrays/linalg/det_and_inverse.hpp>
 
 namespace triqs_cthyb {
 
+  // The ratio is det(M')/det(M), with M' = (f(x_i, y_j)) and M the matrix of det.
+  // When M' has the size of M and differs from it by a few rows R and columns C (the operators which are substituted
+  // in the same block), M' = M + U V^T with U = [e_R, dC] and V^T = [dR; e_C^T], and the ratio is det(1 + V^T M^-1 U)
+  // (matrix determinant lemma): O(n^2 (|R| + |C|)), with the product M^-1 U as a single gemm. Otherwise, the
+  // determinant of M' by an LU decomposition, which is still about three times cheaper than the inverse of M'.
+  det_scalar_t det_ratio_of_refill(det_type const &det, qmc_data::delta_block_adaptor const &f, std::vector<det_type::x_type> const &x,
+                                   std::vector<det_type::y_type> const &y) {
+    int n = x.size(), n_old = det.size();
+
+    std::vector<int> rows, cols;
+    if (n == n_old) {
+      for (int i = 0; i < n; ++i)
+        if (!(x[i] == det.get_x(i))) rows.push_back(i);
+      for (int j = 0; j < n; ++j)
+        if (!(y[j] == det.get_y(j))) cols.push_back(j);
+    }
+    int n_r = rows.size(), n_c = cols.size(), m = n_r + n_c;
+
+    // The low-rank form pays off for a few changes only
+    if (n != n_old || 3 * m > n) {
+      if (n == 0) return 1 / det.determinant();
+      matrix<det_scalar_t> new_mat(n, n);
+      for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) new_mat(i, j) = f(x[i], y[j]);
+      return determinant(new_mat) / det.determinant();
+    }
+    if (m == 0) return 1;
+
+    // dR: the new rows minus the old ones, on the old columns. dC: the new columns minus the old ones, on the new rows.
+    // Their sum on the substituted entries (R, C) is then f(x_i, y_j) - M_ij, counted once.
+    matrix<det_scalar_t> U(n, m), VT(m, n);
+    U()  = 0;
+    VT() = 0;
+    for (int r = 0; r < n_r; ++r) {
+      int i   = rows[r];
+      U(i, r) = 1;
+      for (int j = 0; j < n; ++j) VT(r, j) = f(x[i], det.get_y(j)) - f(det.get_x(i), det.get_y(j));
+    }
+    for (int c = 0; c < n_c; ++c) {
+      int j          = cols[c];
+      VT(n_r + c, j) = 1;
+      for (int i = 0; i < n; ++i) U(i, n_r + c) = f(x[i], y[j]) - f(x[i], det.get_y(j));
+    }
+
+    matrix<det_scalar_t> W = det.inverse_matrix() * U; // M^-1 U
+    matrix<det_scalar_t> S = VT * W;
+    for (int k = 0; k < m; ++k) S(k, k) += 1;
+    return determinant(S);
+  }
+
   move_global::move_global(std::string const &name, indices_map_t const &substitution_map, qmc_data &data, mc_tools::random_generator &rng)
      : name(name),
        data(data),
@@ -119,11 +170,11 @@ namespace triqs_cthyb {
       if (x[block_index].size() != y[block_index].size()) return 0;
     }
 
-    // Try refill determinants
+    // Ratios of the determinants. The dets are only refilled (with the O(n^3) inversion) if the move is accepted.
     mc_weight_t det_ratio = 1;
     for (auto block_index : affected_blocks) {
-      auto &det                   = data.dets[block_index];
-      mc_weight_t block_det_ratio = det.try_refill(x[block_index], y[block_index]);
+      qmc_data::delta_block_adaptor f(data.delta_tables[block_index]);
+      mc_weight_t block_det_ratio = det_ratio_of_refill(data.dets[block_index], f, x[block_index], y[block_index]);
       if (block_det_ratio == .0) {
 #ifdef EXT_DEBUG
         std::cerr << "block_det_ratio[" << block_index << "] = 0" << std::endl;
@@ -170,7 +221,10 @@ namespace triqs_cthyb {
     for (auto const &o : updated_ops) data.config.replace(o.first, o.second);
     config.finalize();
 
-    for (auto block_index : affected_blocks) data.dets[block_index].complete_operation();
+    for (auto block_index : affected_blocks) {
+      data.dets[block_index].try_refill(x[block_index], y[block_index]);
+      data.complete_det_operation(block_index);
+    }
 
     data.update_sign();
     data.atomic_weight      = new_atomic_weight;
@@ -191,7 +245,7 @@ namespace triqs_cthyb {
 
     config.finalize();
     data.imp_trace.cancel_replace();
-    for (auto block_index : affected_blocks) data.dets[block_index].reject_last_try();
+    // the dets are only refilled by accept: they hold no try to reject
 
 #ifdef EXT_DEBUG
     std::cerr << "* Move move_global '" << name << "' rejected" << std::endl;
@@ -31,6 +31,11 @@
 
 namespace triqs_cthyb {
 
+  // Ratio det(M')/det(M) of the matrix M' = (f(x_i, y_j)) to the matrix M of det, without changing det.
+  // For a few substituted rows and columns, by the matrix determinant lemma.
+  det_scalar_t det_ratio_of_refill(det_type const &det, qmc_data::delta_block_adaptor const &f, std::vector<det_type::x_type> const &x,
+                                   std::vector<det_type::y_type> const &y);
+
   class move_global {
 
     std::string name;
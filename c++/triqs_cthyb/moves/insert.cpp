@@ -29,15 +29,39 @@ namespace triqs_cthyb {
     return &(new_histo.first->second);
   }
 
+  insertion_candidate_t draw_insertion_candidate(qmc_data &data, mc_tools::random_generator &rng, int block_index, int block_size) {
+    insertion_candidate_t c;
+    auto rs1 = rng(block_size), rs2 = rng(block_size);
+    c.op1    = op_desc{block_index, rs1, true, data.linindex[std::make_pair(block_index, rs1)]};
+    c.op2    = op_desc{block_index, rs2, false, data.linindex[std::make_pair(block_index, rs2)]};
+    c.tau1   = data.tau_seg.get_random_pt(rng);
+    c.tau2   = data.tau_seg.get_random_pt(rng);
+    return c;
+  }
+
+  double insertion_candidate_weight(qmc_data &data, insertion_candidate_t const &c) {
+    double w = 0;
+    try {
+      data.imp_trace.try_insert(c.tau1, c.op1);
+      data.imp_trace.try_insert(c.tau2, c.op2);
+      w = data.imp_trace.compute_energy_bound();
+    } catch (rbt_insert_error const &) {} // an operator is already sitting there: as the move, weight 0
+    data.imp_trace.cancel_shift();
+    return w;
+  }
+
   move_insert_c_cdag::move_insert_c_cdag(int block_index, int block_size, std::string const &block_name, qmc_data &data,
-                                         mc_tools::random_generator &rng, histo_map_t *histos)
+                                         mc_tools::random_generator &rng, histo_map_t *histos, int n_tries)
      : data(data),
        config(data.config),
        rng(rng),
        block_index(block_index),
        block_size(block_size),
        histo_proposed(add_histo("insert_length_proposed_" + block_name, histos)),
-       histo_accepted(add_histo("insert_length_accepted_" + block_name, histos)) {}
+       histo_accepted(add_histo("insert_length_accepted_" + block_name, histos)),
+       n_tries(n_tries),
+       candidates(n_tries),
+       candidate_weights(n_tries) {}
 
   mc_weight_t move_insert_c_cdag::attempt() {
 
@@ -47,14 +71,45 @@ namespace triqs_cthyb {
     std::cerr << "* Attempt for move_insert_c_cdag (block " << block_index << ")" << std::endl;
 #endif
 
-    // Pick up the value of alpha and choose the operators
-    auto rs1 = rng(block_size), rs2 = rng(block_size);
-    op1 = op_desc{block_index, rs1, true, data.linindex[std::make_pair(block_index, rs1)]};
-    op2 = op_desc{block_index, rs2, false, data.linindex[std::make_pair(block_index, rs2)]};
-
-    // Choice of times for insertion. Find the time as double and them put them on the grid.
-    tau1 = data.tau_seg.get_random_pt(rng);
-    tau2 = data.tau_seg.get_random_pt(rng);
+    det_tried = false;
+
+    // ratio of the probabilities to choose the pair, in the multiple-try scheme
+    double mtm_ratio = 1;
+
+    if (n_tries == 1) {
+      // Pick up the value of alpha and choose the operators
+      auto rs1 = rng(block_size), rs2 = rng(block_size);
+      op1 = op_desc{block_index, rs1, true, data.linindex[std::make_pair(block_index, rs1)]};
+      op2 = op_desc{block_index, rs2, false, data.linindex[std::make_pair(block_index, rs2)]};
+
+      // Choice of times for insertion. Find the time as double and them put them on the grid.
+      tau1 = data.tau_seg.get_random_pt(rng);
+      tau2 = data.tau_seg.get_random_pt(rng);
+    } else {
+      // Multiple-try: the candidate j is chosen with probability w_j / W, W = sum of the weights.
+      // The ratio W / (n_tries * w_j) restores the detailed balance with move_remove_c_cdag,
+      // which draws n_tries - 1 candidates in the same way for the reverse move.
+      double W = 0;
+      for (int j = 0; j < n_tries; ++j) {
+        candidates[j]        = draw_insertion_candidate(data, rng, block_index, block_size);
+        candidate_weights[j] = insertion_candidate_weight(data, candidates[j]);
+        W += candidate_weights[j];
+      }
+      if (W == 0) return 0; // all candidates are structural zeros
+      double u = rng(W);
+      int k    = -1;
+      for (int j = 0; j < n_tries; ++j) {
+        if (candidate_weights[j] == 0) continue;
+        k = j;
+        if (u < candidate_weights[j]) break;
+        u -= candidate_weights[j];
+      }
+      mtm_ratio = W / (n_tries * candidate_weights[k]);
+      op1       = candidates[k].op1;
+      op2       = candidates[k].op2;
+      tau1      = candidates[k].tau1;
+      tau2      = candidates[k].tau2;
+    }
 
 #ifdef EXT_DEBUG
     std::cerr << "* Proposing to insert:" << std::endl;
@@ -79,25 +134,22 @@ namespace triqs_cthyb {
       return 0;
     }
 
+    // A structural zero of the trace is rejected before any work on the determinant
+    if (!data.imp_trace.is_structurally_nonzero()) return 0;
+
     // Computation of det ratio
-    auto &det    = data.dets[block_index];
-    int det_size = det.size();
+    auto &det = data.dets[block_index];
 
     // Find the position for insertion in the determinant
     // NB : the determinant stores the C in decreasing time order.
-    int num_c_dag, num_c;
-    for (num_c_dag = 0; num_c_dag < det_size; ++num_c_dag) {
-      if (det.get_x(num_c_dag).first < tau1) break;
-    }
-    for (num_c = 0; num_c < det_size; ++num_c) {
-      if (det.get_y(num_c).first < tau2) break;
-    }
+    int num_c_dag = det_position_x(det, tau1), num_c = det_position_y(det, tau2);
 
     // Insert in the det. Returns the ratio of dets (Cf det_manip doc).
     auto det_ratio = det.try_insert(num_c_dag, num_c, {tau1, op1.inner_index}, {tau2, op2.inner_index});
+    det_tried      = true;
 
     // proposition probability
-    mc_weight_t t_ratio = std::pow(block_size * config.beta() / double(det.size() + 1), 2);
+    mc_weight_t t_ratio = std::pow(block_size * config.beta() / double(det.size() + 1), 2) * mtm_ratio;
 
     // For quick abandon
     double random_number = rng.preview();
@@ -151,8 +203,8 @@ namespace triqs_cthyb {
     config.finalize();
 
     // insert in the determinant
-    data.dets[block_index].complete_operation();
-    data.update_sign();
+    data.complete_det_operation(block_index);
+    data.update_sign({{tau1, op1.block_index, op1.dagger}, {tau2, op2.block_index, op2.dagger}});
     data.atomic_weight      = new_atomic_weight;
     data.atomic_reweighting = new_atomic_reweighting;
     if (histo_accepted) *histo_accepted << dtau;
@@ -170,7 +222,7 @@ namespace triqs_cthyb {
 
     config.finalize();
     data.imp_trace.cancel_insert();
-    data.dets[block_index].reject_last_try();
+    if (det_tried) data.dets[block_index].reject_last_try();
 
 #ifdef EXT_DEBUG
     std::cerr << "* Move move_insert_c_cdag rejected" << std::endl;
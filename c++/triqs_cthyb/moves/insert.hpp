@@ -24,6 +24,19 @@
 
 namespace triqs_cthyb {
 
+  // A proposed insertion of C^dagger(tau1) C(tau2)
+  struct insertion_candidate_t {
+    time_pt tau1, tau2;
+    op_desc op1, op2;
+  };
+
+  // Draws the operators and times of an insertion in block_index, uniformly
+  insertion_candidate_t draw_insertion_candidate(qmc_data &data, mc_tools::random_generator &rng, int block_index, int block_size);
+
+  // Weight of a candidate in the multiple-try scheme: the energy bound of the trace with the pair inserted,
+  // on top of the nodes possibly flagged for deletion. The tree is restored with cancel_shift, which also clears the deletions.
+  double insertion_candidate_weight(qmc_data &data, insertion_candidate_t const &c);
+
   // Insertion of C, C^dagger operator
   class move_insert_c_cdag {
 
@@ -34,14 +47,20 @@ namespace triqs_cthyb {
     histogram *histo_proposed, *histo_accepted; // Analysis histograms
     double dtau;
     h_scalar_t new_atomic_weight, new_atomic_reweighting;
+    bool det_tried = false; // the dets hold a try of this attempt, to reject
     time_pt tau1, tau2;
     op_desc op1, op2;
 
+    // Multiple-try Metropolis: n_tries candidates, one of which is chosen with a probability proportional to its weight
+    int n_tries;
+    std::vector<insertion_candidate_t> candidates;
+    std::vector<double> candidate_weights;
+
     histogram *add_histo(std::string const &name, histo_map_t *histos);
 
     public:
     move_insert_c_cdag(int block_index, int block_size, std::string const &block_name, qmc_data &data, mc_tools::random_generator &rng,
-                       histo_map_t *histos);
+                       histo_map_t *histos, int n_tries = 1);
 
     mc_weight_t attempt();
     mc_weight_t accept();
@@ -0,0 +1,101 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include "../config.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+
+namespace triqs_cthyb {
+
+  // Number of attempts and acceptances of a move, and the time spent in it
+  struct move_statistics_t {
+    long n_attempted = 0, n_accepted = 0;
+    double time = 0;                                           // in seconds
+    double time_attempt = 0, time_accept = 0, time_reject = 0; // the parts of time
+
+    // accepted moves per second
+    double efficiency() const { return (time > 0 ? n_accepted / time : 0); }
+
+    move_statistics_t &operator+=(move_statistics_t const &s) {
+      n_attempted += s.n_attempted;
+      n_accepted += s.n_accepted;
+      time += s.time;
+      time_attempt += s.time_attempt;
+      time_accept += s.time_accept;
+      time_reject += s.time_reject;
+      return *this;
+    }
+  };
+
+  // A move recording its statistics in *stats, if stats is not null.
+  // The statistics are shared, since the move is copied into the move set.
+  template <typename Move> class move_with_statistics {
+
+    Move move;
+    std::shared_ptr<move_statistics_t> stats;
+    using clock = std::chrono::steady_clock;
+    clock::time_point start;
+
+    void stop(double &part) {
+      double t = std::chrono::duration<double>(clock::now() - start).count();
+      stats->time += t;
+      part += t;
+    }
+
+    public:
+    move_with_statistics(Move move, std::shared_ptr<move_statistics_t> stats) : move(std::move(move)), stats(std::move(stats)) {}
+
+    mc_weight_t attempt() {
+      if (!stats) return move.attempt();
+      ++stats->n_attempted;
+      start  = clock::now();
+      auto r = move.attempt();
+      stop(stats->time_attempt);
+      return r;
+    }
+
+    mc_weight_t accept() {
+      if (!stats) return move.accept();
+      ++stats->n_accepted;
+      start  = clock::now();
+      auto r = move.accept();
+      stop(stats->time_accept);
+      return r;
+    }
+
+    void reject() {
+      if (!stats) return move.reject();
+      start = clock::now();
+      move.reject();
+      stop(stats->time_reject);
+    }
+  };
+
+  // Factor on the weight of a move of efficiency eff, when the weighted mean efficiency of all moves is eff_mean.
+  // Moves with more accepted moves per second are proposed more often. The factor is bounded, to keep all moves (ergodicity).
+  inline double efficiency_factor(double eff, double eff_mean) {
+    if (!(eff_mean > 0)) return 1;
+    return std::min(std::max(std::sqrt(eff / eff_mean), 0.25), 4.0);
+  }
+
+} // namespace triqs_cthyb
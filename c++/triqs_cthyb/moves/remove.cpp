@@ -30,14 +30,15 @@ namespace triqs_cthyb {
   }
 
   move_remove_c_cdag::move_remove_c_cdag(int block_index, int block_size, std::string const &block_name, qmc_data &data, mc_tools::random_generator &rng,
-                     histo_map_t *histos)
+                     histo_map_t *histos, int n_tries)
      : data(data),
        config(data.config),
        rng(rng),
        block_index(block_index),
        block_size(block_size),
        histo_proposed(add_histo("remove_length_proposed_" + block_name, histos)),
-       histo_accepted(add_histo("remove_length_accepted_" + block_name, histos)) {}
+       histo_accepted(add_histo("remove_length_accepted_" + block_name, histos)),
+       n_tries(n_tries) {}
 
   mc_weight_t move_remove_c_cdag::attempt() {
 
@@ -47,6 +48,8 @@ namespace triqs_cthyb {
     std::cerr << "* Attempt for move_remove_c_cdag (block " << block_index << ")" << std::endl;
 #endif
 
+    det_tried = false;
+
     auto &det = data.dets[block_index];
 
     // Pick up a couple of C, Cdagger to remove at random
@@ -61,6 +64,20 @@ namespace triqs_cthyb {
     std::cerr << num_c << "-th C(" << block_index << ",...)" << std::endl;
 #endif
 
+    // Reverse of the multiple-try insertion: the current configuration is the chosen candidate, with weight w,
+    // among n_tries - 1 candidates drawn for insertion in the configuration without the pair. W = sum of the weights.
+    double mtm_ratio = 1;
+    if (n_tries > 1) {
+      double w = data.imp_trace.compute_energy_bound(), W = w;
+      if (w == 0) return 0;
+      for (int j = 0; j < n_tries - 1; ++j) {
+        data.imp_trace.try_delete(num_c, block_index, false);
+        data.imp_trace.try_delete(num_c_dag, block_index, true);
+        W += insertion_candidate_weight(data, draw_insertion_candidate(data, rng, block_index, block_size));
+      }
+      mtm_ratio = W / (n_tries * w);
+    }
+
     // now mark 2 nodes for deletion
     tau1 = data.imp_trace.try_delete(num_c, block_index, false);
     tau2 = data.imp_trace.try_delete(num_c_dag, block_index, true);
@@ -69,10 +86,14 @@ namespace triqs_cthyb {
     dtau = double(tau2 - tau1);
     if (histo_proposed) *histo_proposed << dtau;
 
+    // A structural zero of the trace is rejected before any work on the determinant
+    if (!data.imp_trace.is_structurally_nonzero()) return 0;
+
     auto det_ratio = det.try_remove(num_c_dag, num_c);
+    det_tried      = true;
 
     // proposition probability
-    auto t_ratio = std::pow(block_size * config.beta() / double(det_size), 2); // Size of the det before the try_delete!
+    auto t_ratio = std::pow(block_size * config.beta() / double(det_size), 2) * mtm_ratio; // Size of the det before the try_delete!
 
     // For quick abandon
     double random_number = rng.preview();
@@ -127,8 +148,8 @@ namespace triqs_cthyb {
     config.finalize();
 
     // remove from the determinants
-    data.dets[block_index].complete_operation();
-    data.update_sign();
+    data.complete_det_operation(block_index);
+    data.update_sign({{tau1, block_index, false}, {tau2, block_index, true}});
     data.atomic_weight      = new_atomic_weight;
     data.atomic_reweighting = new_atomic_reweighting;
     if (histo_accepted) *histo_accepted << dtau;
@@ -146,7 +167,7 @@ namespace triqs_cthyb {
 
     config.finalize();
     data.imp_trace.cancel_delete();
-    data.dets[block_index].reject_last_try();
+    if (det_tried) data.dets[block_index].reject_last_try();
 
 #ifdef EXT_DEBUG
     std::cerr << "* Move move_remove_c_cdag rejected" << std::endl;
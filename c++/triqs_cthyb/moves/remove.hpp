@@ -22,6 +22,7 @@
 #include <algorithm>
 #include <triqs/mc_tools.hpp>
 #include "../qmc_data.hpp"
+#include "./insert.hpp"
 
 namespace triqs_cthyb {
 
@@ -35,13 +36,15 @@ namespace triqs_cthyb {
     histogram *histo_proposed, *histo_accepted; // Analysis histograms
     double dtau;
     h_scalar_t new_atomic_weight, new_atomic_reweighting;
+    bool det_tried = false; // the dets hold a try of this attempt, to reject
     time_pt tau1, tau2;
+    int n_tries; // multiple-try scheme of move_insert_c_cdag
 
     histogram *add_histo(std::string const &name, histo_map_t *histos);
 
     public:
     move_remove_c_cdag(int block_index, int block_size, std::string const &block_name, qmc_data &data, mc_tools::random_generator &rng,
-                       histo_map_t *histos);
+                       histo_map_t *histos, int n_tries = 1);
 
     mc_weight_t attempt();
     mc_weight_t accept();
@@ -20,6 +20,7 @@
  ******************************************************************************/
 
 #include "./shift.hpp"
+#include <cmath>
 
 namespace triqs_cthyb {
 
@@ -29,13 +30,23 @@ namespace triqs_cthyb {
     return &(new_histo.first->second);
   }
 
-  move_shift_operator::move_shift_operator(qmc_data &data, mc_tools::random_generator &rng, histo_map_t *histos)
+  move_shift_operator::move_shift_operator(qmc_data &data, mc_tools::random_generator &rng, histo_map_t *histos,
+                                           std::shared_ptr<shift_window_t> window)
      : data(data),
        config(data.config),
        rng(rng),
        block_index(0),
        histo_proposed(add_histo("shift_length_proposed", histos)),
-       histo_accepted(add_histo("shift_length_accepted", histos)) {}
+       histo_accepted(add_histo("shift_length_accepted", histos)),
+       window(std::move(window)) {}
+
+  // Robbins-Monro update of the log of the half-width, towards the target acceptance rate
+  void move_shift_operator::update_window(bool accepted) {
+    if (!window_proposed || !window->adapt) return;
+    ++window->n_updates;
+    window->half_width *= std::exp(((accepted ? 1 : 0) - shift_window_t::target_acceptance) / std::sqrt(double(window->n_updates)));
+    window->half_width = std::min(std::max(window->half_width, 1e-3 * config.beta()), config.beta());
+  }
 
   mc_weight_t move_shift_operator::attempt() {
 
@@ -45,6 +56,9 @@ namespace triqs_cthyb {
     std::cerr << "* Attempt for move_shift_operator ";
 #endif
 
+    window_proposed = false;
+    window_ratio    = 1;
+
     // --- Choose an operator in configuration to shift at random
     // By choosing an *operator* in config directly, not bias based on det size introduced
     auto config_size = config.size();
@@ -58,11 +72,8 @@ namespace triqs_cthyb {
     const int op_pos_in_config = rng(config_size);
 
     // --- Find operator (and its characteristics) from the configuration
-    auto itconfig = config.begin();
-    for (int i = 0; i < op_pos_in_config; ++i, ++itconfig)
-      ; // Get to right position in config
-    tau_old        = (*itconfig).first;
-    op_old         = (*itconfig).second;
+    tau_old        = config[op_pos_in_config].first;
+    op_old         = config[op_pos_in_config].second;
     block_index    = op_old.block_index;
     auto is_dagger = op_old.dagger;
 
@@ -80,6 +91,9 @@ namespace triqs_cthyb {
     auto inner_new = rng(data.n_inner[block_index]);
     op_new         = op_desc{block_index, inner_new, is_dagger, data.linindex[std::make_pair(block_index, inner_new)]};
 
+    // A window narrower than beta: the new time is drawn uniformly in the window, cut by the neighbours
+    window_proposed = (window && (window->half_width < config.beta()));
+
     // --- Determine new time to shift the operator to.
     // The time must fall in the range between the closest operators on the left and
     // right belonging to the same block. First determine these.
@@ -94,12 +108,8 @@ namespace triqs_cthyb {
       // Find the c and c_dag operators at the right of op_old (at smaller times)
       // They could be the last entries (earliest times)
 
-      for (ic_dag = 0; ic_dag < det_size; ++ic_dag) { // c_dag
-        if (det.get_x(ic_dag).first < tau_old) break;
-      }
-      for (ic = 0; ic < det_size; ++ic) { // c
-        if (det.get_y(ic).first < tau_old) break;
-      }
+      ic_dag = det_position_x(det, tau_old); // c_dag
+      ic     = det_position_y(det, tau_old); // c
 
       op_pos_in_det = (is_dagger ? ic_dag : ic); // This finds the operator on the right
       --op_pos_in_det;                           // Rewind by one to find the operator
@@ -122,13 +132,27 @@ namespace triqs_cthyb {
       // Then deduce the closest one and put its distance to op_old in tL
       tL = ((tLdag - tau_old) > (tLnodag - tau_old) ? tLnodag : tLdag);
       // Choose new random time
-      tau_new = tR + data.tau_seg.get_random_pt(rng, tL - tR);
+      if (!window_proposed)
+        tau_new = tR + data.tau_seg.get_random_pt(rng, tL - tR);
+      else {
+        // positions measured from tR. The window is cut by the neighbours: its length depends on the position.
+        double L = double(tL - tR), a_old = double(tau_old - tR), h = window->half_width;
+        double lo = std::max(0.0, a_old - h), hi = std::min(L, a_old + h);
+        tau_new            = tR + data.tau_seg.make_time_pt(lo) + data.tau_seg.get_random_pt(rng, data.tau_seg.make_time_pt(hi - lo));
+        auto window_length = [&](double a) { return std::min(L, a + h) - std::max(0.0, a - h); };
+        window_ratio       = window_length(a_old) / window_length(double(tau_new - tR));
+      }
 
     } else { // det_size = 1
 
       op_pos_in_det = 0;
       // Choose new random time, can be anywhere between beta and 0
-      tau_new = data.tau_seg.get_random_pt(rng);
+      // On the circle, the window has the same length everywhere: the proposal is symmetric
+      double h = (window_proposed ? window->half_width : config.beta());
+      if (2 * h >= config.beta())
+        tau_new = data.tau_seg.get_random_pt(rng);
+      else
+        tau_new = tau_old - data.tau_seg.make_time_pt(h) + data.tau_seg.get_random_pt(rng, data.tau_seg.make_time_pt(2 * h));
     }
 
     // Record the length of the proposed shift
@@ -144,16 +168,12 @@ namespace triqs_cthyb {
 
     // --- Modify the tree
 
-    // Mark the operator at original time for deletion in the tree
-    data.imp_trace.try_delete(op_pos_in_det, block_index, is_dagger);
-
-    // Try to insert the new operator at shifted time in the tree
+    // Move the operator from its original time to the shifted time in the tree
     try {
-      data.imp_trace.try_insert(tau_new, op_new);
+      data.imp_trace.try_shift(op_pos_in_det, block_index, is_dagger, tau_new, op_new);
     } catch (rbt_insert_error const &) {
       std::cerr << "Insert error : recovering ... " << std::endl;
-      data.imp_trace.cancel_delete();
-      data.imp_trace.cancel_insert();
+      data.imp_trace.cancel_shift();
       std::cerr << "Insert error : recovered ... " << std::endl;
       return 0;
     }
@@ -177,7 +197,7 @@ namespace triqs_cthyb {
     // for quick abandon
     double random_number = rng.preview();
     if (random_number == 0.0) return 0;
-    double p_yee = std::abs(det_ratio / data.atomic_weight);
+    double p_yee = std::abs(window_ratio * det_ratio / data.atomic_weight);
 
     // --- Compute the atomic_weight ratio
     std::tie(new_atomic_weight, new_atomic_reweighting) = data.imp_trace.compute(p_yee, random_number);
@@ -193,7 +213,7 @@ namespace triqs_cthyb {
                           << new_atomic_weight / data.atomic_weight << " in config " << config.get_id();
 
     // --- Compute the weight
-    mc_weight_t p = atomic_weight_ratio * det_ratio;
+    mc_weight_t p = atomic_weight_ratio * det_ratio * window_ratio;
 
 #ifdef EXT_DEBUG
     std::cerr << "Trace ratio: " << atomic_weight_ratio << '\t';
@@ -207,6 +227,8 @@ namespace triqs_cthyb {
 
   mc_weight_t move_shift_operator::accept() {
 
+    update_window(true);
+
     // Update the tree
     data.imp_trace.confirm_shift();
 
@@ -216,8 +238,8 @@ namespace triqs_cthyb {
     config.finalize();
 
     // Update the determinant
-    data.dets[block_index].complete_operation();
-    data.update_sign();
+    data.complete_det_operation(block_index);
+    data.update_sign({{tau_old, op_old.block_index, op_old.dagger}, {tau_new, op_new.block_index, op_new.dagger}});
 
     data.atomic_weight      = new_atomic_weight;
     data.atomic_reweighting = new_atomic_reweighting;
@@ -237,6 +259,7 @@ namespace triqs_cthyb {
 
   void move_shift_operator::reject() {
 
+    update_window(false);
     config.finalize();
     data.imp_trace.cancel_shift();
     data.dets[block_index].reject_last_try();
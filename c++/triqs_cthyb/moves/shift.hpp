@@ -20,10 +20,20 @@
  ******************************************************************************/
 #pragma once
 #include <triqs/mc_tools.hpp>
+#include <memory>
 #include "../qmc_data.hpp"
 
 namespace triqs_cthyb {
 
+  // Half-width of the window around the old time in which the operator is shifted, shared by the copies of the move.
+  // If adapt, it is tuned during the warmup towards the target acceptance rate. It is frozen afterwards.
+  struct shift_window_t {
+    double half_width;
+    bool adapt     = false;
+    long n_updates = 0;
+    static constexpr double target_acceptance = 0.4;
+  };
+
   // Move a C or C^dagger operator to a different time
   class move_shift_operator {
 
@@ -38,11 +48,15 @@ namespace triqs_cthyb {
     using det_type = det_manip::det_manip<qmc_data::delta_block_adaptor>;
     det_type::RollDirection roll_direction;
     int block_index;
+    std::shared_ptr<shift_window_t> window; // nullptr: anywhere between the neighbours
+    bool window_proposed = false;           // was the last proposal restricted to the window?
+    double window_ratio  = 1;               // ratio of the proposal probabilities with the window
 
     histogram *add_histo(std::string const &name, histo_map_t *histos);
+    void update_window(bool accepted);
 
     public:
-    move_shift_operator(qmc_data &data, mc_tools::random_generator &rng, histo_map_t *histos);
+    move_shift_operator(qmc_data &data, mc_tools::random_generator &rng, histo_map_t *histos, std::shared_ptr<shift_window_t> window = {});
     mc_weight_t attempt();
     mc_weight_t accept();
     void reject();
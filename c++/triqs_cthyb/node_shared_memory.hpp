@@ -0,0 +1,70 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include <triqs/mpi/base.hpp>
+#include <triqs/utility/exceptions.hpp>
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+namespace triqs_cthyb {
+
+  /// An array of n elements, shared by the processes of comm running on the same node (MPI-3 shared memory window).
+  // The array is filled once per node, by fill() on the lowest rank of the node, and must only be read afterwards.
+  // Collective on comm. The window is freed with the last copy of the pointer: as MPI_Win_free is collective
+  // on the node, all processes must release their copies at the same point (e.g. at the end of solve).
+  template <typename T>
+  std::shared_ptr<T> make_node_shared_array(triqs::mpi::communicator const &comm, std::size_t n, std::function<void(T *)> const &fill) {
+
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(comm.get(), MPI_COMM_TYPE_SHARED, comm.rank(), MPI_INFO_NULL, &node_comm);
+    int node_rank;
+    MPI_Comm_rank(node_comm, &node_rank);
+
+    // The leader allocates the whole segment, the others map it
+    T *base = nullptr;
+    MPI_Win win;
+    MPI_Aint size = (node_rank == 0 ? MPI_Aint(n * sizeof(T)) : 0);
+    if (MPI_Win_allocate_shared(size, sizeof(T), MPI_INFO_NULL, node_comm, &base, &win) != MPI_SUCCESS) {
+      MPI_Comm_free(&node_comm);
+      TRIQS_RUNTIME_ERROR << "Allocation of " << n * sizeof(T) << " bytes of MPI shared memory failed";
+    }
+    if (node_rank != 0) {
+      MPI_Aint leader_size;
+      int disp_unit;
+      MPI_Win_shared_query(win, 0, &leader_size, &disp_unit, &base);
+    }
+
+    // Fill on the leader, then make the data visible to the node
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, win);
+    if (node_rank == 0) fill(base);
+    MPI_Win_sync(win);
+    MPI_Barrier(node_comm);
+    MPI_Win_sync(win);
+    MPI_Win_unlock_all(win);
+
+    return std::shared_ptr<T>(base, [win, node_comm](T *) mutable {
+      MPI_Win_free(&win);
+      MPI_Comm_free(&node_comm);
+    });
+  }
+
+} // namespace triqs_cthyb
@@ -82,26 +82,39 @@ namespace triqs_cthyb {
     h5_write(grp, "h_int", sp.h_int);
 
     h5_write(grp, "n_cycles", sp.n_cycles);
+    h5_write(grp, "balanced_accumulation", sp.balanced_accumulation);
+    h5_write(grp, "balanced_check_interval", sp.balanced_check_interval);
     h5_write(grp, "partition_method", sp.partition_method);
     h5_write(grp, "quantum_numbers", sp.quantum_numbers);
     h5_write(grp, "loc_n_min", sp.loc_n_min);
     h5_write(grp, "loc_n_max", sp.loc_n_max);
+    h5_write(grp, "atom_diag_cache_file", sp.atom_diag_cache_file);
 
     h5_write(grp, "length_cycle", sp.length_cycle);
     h5_write(grp, "n_warmup_cycles", sp.n_warmup_cycles);
+    h5_write(grp, "warm_start", sp.warm_start);
+    h5_write(grp, "n_warmup_cycles_warm_start", sp.n_warmup_cycles_warm_start);
+    h5_write(grp, "configuration_file", sp.configuration_file);
     h5_write(grp, "random_seed", sp.random_seed);
+    h5_write(grp, "n_walkers", sp.n_walkers);
+    h5_write(grp, "walker_placement", sp.walker_placement);
+    h5_write(grp, "max_memory", sp.max_memory);
     h5_write(grp, "random_name", sp.random_name);
     h5_write(grp, "max_time", sp.max_time);
     h5_write(grp, "verbosity", sp.verbosity);
 
     h5_write(grp, "move_shift", sp.move_shift);
     h5_write(grp, "move_double", sp.move_double);
+    h5_write(grp, "move_insert_n_tries", sp.move_insert_n_tries);
     h5_write(grp, "use_trace_estimator", sp.use_trace_estimator);
 
     h5_write(grp, "measure_G_tau", sp.measure_G_tau);
     h5_write(grp, "measure_G_l", sp.measure_G_l);
+    h5_write(grp, "measure_G_iw_nfft", sp.measure_G_iw_nfft);
+    h5_write(grp, "measure_G_iw_nfft_n_iw", sp.measure_G_iw_nfft_n_iw);
     h5_write(grp, "measure_O_tau", sp.measure_O_tau);
     h5_write(grp, "measure_O_tau_min_ins", sp.measure_O_tau_min_ins);
+    h5_write(grp, "measure_O_tau_sweep", sp.measure_O_tau_sweep);
     h5_write(grp, "measure_G2_tau", sp.measure_G2_tau);
     h5_write(grp, "measure_G2_iw", sp.measure_G2_iw);
     h5_write(grp, "measure_G2_iw_nfft", sp.measure_G2_iw_nfft);
@@ -120,18 +133,44 @@ namespace triqs_cthyb {
     h5_write(grp, "measure_G2_n_l", sp.measure_G2_n_l);
 
     h5_write(grp, "measure_G2_iwll_nfft_buf_size", sp.measure_G2_iwll_nfft_buf_size);
+    h5_write(grp, "measure_G2_iw_gemm", sp.measure_G2_iw_gemm);
+    h5_write(grp, "measure_G2_iw_conj_symmetry", sp.measure_G2_iw_conj_symmetry);
+    h5_write(grp, "measure_G2_tau_grouped", sp.measure_G2_tau_grouped);
+    h5_write(grp, "measure_G2_every_n_cycles", sp.measure_G2_every_n_cycles);
+    h5_write(grp, "measure_G2_async_threads", sp.measure_G2_async_threads);
+    h5_write(grp, "measure_G2_reduction", sp.measure_G2_reduction);
+    h5_write(grp, "mpi_reduction_chunk_mb", sp.mpi_reduction_chunk_mb);
+    h5_write(grp, "measure_G2_stream_file", sp.measure_G2_stream_file);
+    h5_write(grp, "measure_G2_stream_deflate", sp.measure_G2_stream_deflate);
     h5_write(grp, "nfft_buf_sizes", sp.nfft_buf_sizes);
+    h5_write(grp, "nfft_fftw_wisdom_file", sp.nfft_fftw_wisdom_file);
+    h5_write(grp, "nfft_fftw_planner", sp.nfft_fftw_planner);
 
     h5_write(grp, "measure_pert_order", sp.measure_pert_order);
+    h5_write(grp, "measure_autocorrelation", sp.measure_autocorrelation);
+    h5_write(grp, "measure_autocorrelation_n_l", sp.measure_autocorrelation_n_l);
     h5_write(grp, "measure_density_matrix", sp.measure_density_matrix);
+    h5_write(grp, "defer_measures", sp.defer_measures);
     h5_write(grp, "use_norm_as_weight", sp.use_norm_as_weight);
     h5_write(grp, "performance_analysis", sp.performance_analysis);
+    h5_write(grp, "timeline_file", sp.timeline_file);
+    h5_write(grp, "timeline_sample_interval", sp.timeline_sample_interval);
+    h5_write(grp, "progress_file", sp.progress_file);
+    h5_write(grp, "progress_interval", sp.progress_interval);
+    h5_write(grp, "snapshot_file", sp.snapshot_file);
+    h5_write(grp, "snapshot_interval", sp.snapshot_interval);
+    h5_write(grp, "trace_parallel_blocks", sp.trace_parallel_blocks);
+    h5_write(grp, "trace_energy_cutoff", sp.trace_energy_cutoff);
+    h5_write(grp, "trace_prune_tolerance", sp.trace_prune_tolerance);
+    h5_write(grp, "trace_single_precision_tol", sp.trace_single_precision_tol);
+    h5_write(grp, "trace_single_min_block_dim", sp.trace_single_min_block_dim);
     h5_write(grp, "proposal_prob", sp.proposal_prob);
 
     //h5_write(grp, "move_global", sp.move_global);
     if( sp.move_global.size() != 0 )
       TRIQS_RUNTIME_ERROR << "Error serailizing: CTHYB solve_parameters, can not serialize the global moves data type.";
     h5_write(grp, "move_global_prob", sp.move_global_prob);
+    h5_write(grp, "adaptive_warmup", sp.adaptive_warmup);
 
     h5_write(grp, "imag_threshold", sp.imag_threshold);
 
@@ -139,7 +178,13 @@ namespace triqs_cthyb {
     h5_write(grp, "det_n_operations_before_check", sp.det_n_operations_before_check);
     h5_write(grp, "det_precision_warning", sp.det_precision_warning);
     h5_write(grp, "det_precision_error", sp.det_precision_error);
+    h5_write(grp, "det_adaptive_check", sp.det_adaptive_check);
     h5_write(grp, "det_singular_threshold", sp.det_singular_threshold);
+    h5_write(grp, "delta_interpolation", sp.delta_interpolation);
+    h5_write(grp, "delta_node_shared_memory", sp.delta_node_shared_memory);
+    h5_write(grp, "mpi_group_ranks", sp.mpi_group_ranks);
+    h5_write(grp, "replica_h_int_scalings", sp.replica_h_int_scalings);
+    h5_write(grp, "replica_swap_interval", sp.replica_swap_interval);
   }
 
   void h5_read(triqs::h5::group h5group, std::string name, solve_parameters_t &sp) {
@@ -147,26 +192,39 @@ namespace triqs_cthyb {
     h5_read(grp, "h_int", sp.h_int);
 
     h5_read(grp, "n_cycles", sp.n_cycles);
+    if (grp.has_key("balanced_accumulation")) h5_read(grp, "balanced_accumulation", sp.balanced_accumulation);
+    if (grp.has_key("balanced_check_interval")) h5_read(grp, "balanced_check_interval", sp.balanced_check_interval);
     h5_read(grp, "partition_method", sp.partition_method);
     h5_read(grp, "quantum_numbers", sp.quantum_numbers);
     h5_read(grp, "loc_n_min", sp.loc_n_min);
     h5_read(grp, "loc_n_max", sp.loc_n_max);
+    if (grp.has_key("atom_diag_cache_file")) h5_read(grp, "atom_diag_cache_file", sp.atom_diag_cache_file);
 
     h5_read(grp, "length_cycle", sp.length_cycle);
     h5_read(grp, "n_warmup_cycles", sp.n_warmup_cycles);
+    if (grp.has_key("warm_start")) h5_read(grp, "warm_start", sp.warm_start);
+    if (grp.has_key("n_warmup_cycles_warm_start")) h5_read(grp, "n_warmup_cycles_warm_start", sp.n_warmup_cycles_warm_start);
+    if (grp.has_key("configuration_file")) h5_read(grp, "configuration_file", sp.configuration_file);
     h5_read(grp, "random_seed", sp.random_seed);
+    if (grp.has_key("n_walkers")) h5_read(grp, "n_walkers", sp.n_walkers);
+    if (grp.has_key("walker_placement")) h5_read(grp, "walker_placement", sp.walker_placement);
+    if (grp.has_key("max_memory")) h5_read(grp, "max_memory", sp.max_memory);
     h5_read(grp, "random_name", sp.random_name);
     h5_read(grp, "max_time", sp.max_time);
     h5_read(grp, "verbosity", sp.verbosity);
 
     h5_read(grp, "move_shift", sp.move_shift);
     h5_read(grp, "move_double", sp.move_double);
+    if (grp.has_key("move_insert_n_tries")) h5_read(grp, "move_insert_n_tries", sp.move_insert_n_tries);
     h5_read(grp, "use_trace_estimator", sp.use_trace_estimator);
 
     h5_read(grp, "measure_G_tau", sp.measure_G_tau);
     h5_read(grp, "measure_G_l", sp.measure_G_l);
+    if (grp.has_key("measure_G_iw_nfft")) h5_read(grp, "measure_G_iw_nfft", sp.measure_G_iw_nfft);
+    if (grp.has_key("measure_G_iw_nfft_n_iw")) h5_read(grp, "measure_G_iw_nfft_n_iw", sp.measure_G_iw_nfft_n_iw);
     if( grp.has_key("measure_O_tau") ) h5_read(grp, "measure_O_tau", sp.measure_O_tau);
     h5_read(grp, "measure_O_tau_min_ins", sp.measure_O_tau_min_ins);
+    if (grp.has_key("measure_O_tau_sweep")) h5_read(grp, "measure_O_tau_sweep", sp.measure_O_tau_sweep);
     h5_read(grp, "measure_G2_tau", sp.measure_G2_tau);
     h5_read(grp, "measure_G2_iw", sp.measure_G2_iw);
     h5_read(grp, "measure_G2_iw_nfft", sp.measure_G2_iw_nfft);
@@ -185,18 +243,44 @@ namespace triqs_cthyb {
     h5_read(grp, "measure_G2_n_l", sp.measure_G2_n_l);
 
     h5_read(grp, "measure_G2_iwll_nfft_buf_size", sp.measure_G2_iwll_nfft_buf_size);
+    if (grp.has_key("measure_G2_iw_gemm")) h5_read(grp, "measure_G2_iw_gemm", sp.measure_G2_iw_gemm);
+    if (grp.has_key("measure_G2_iw_conj_symmetry")) h5_read(grp, "measure_G2_iw_conj_symmetry", sp.measure_G2_iw_conj_symmetry);
+    if (grp.has_key("measure_G2_tau_grouped")) h5_read(grp, "measure_G2_tau_grouped", sp.measure_G2_tau_grouped);
+    if (grp.has_key("measure_G2_every_n_cycles")) h5_read(grp, "measure_G2_every_n_cycles", sp.measure_G2_every_n_cycles);
+    if (grp.has_key("measure_G2_async_threads")) h5_read(grp, "measure_G2_async_threads", sp.measure_G2_async_threads);
+    if (grp.has_key("measure_G2_reduction")) h5_read(grp, "measure_G2_reduction", sp.measure_G2_reduction);
+    if (grp.has_key("mpi_reduction_chunk_mb")) h5_read(grp, "mpi_reduction_chunk_mb", sp.mpi_reduction_chunk_mb);
+    if (grp.has_key("measure_G2_stream_file")) h5_read(grp, "measure_G2_stream_file", sp.measure_G2_stream_file);
+    if (grp.has_key("measure_G2_stream_deflate")) h5_read(grp, "measure_G2_stream_deflate", sp.measure_G2_stream_deflate);
     h5_read(grp, "nfft_buf_sizes", sp.nfft_buf_sizes);
+    if (grp.has_key("nfft_fftw_wisdom_file")) h5_read(grp, "nfft_fftw_wisdom_file", sp.nfft_fftw_wisdom_file);
+    if (grp.has_key("nfft_fftw_planner")) h5_read(grp, "nfft_fftw_planner", sp.nfft_fftw_planner);
 
     h5_read(grp, "measure_pert_order", sp.measure_pert_order);
+    if (grp.has_key("measure_autocorrelation")) h5_read(grp, "measure_autocorrelation", sp.measure_autocorrelation);
+    if (grp.has_key("measure_autocorrelation_n_l")) h5_read(grp, "measure_autocorrelation_n_l", sp.measure_autocorrelation_n_l);
     h5_read(grp, "measure_density_matrix", sp.measure_density_matrix);
+    if (grp.has_key("defer_measures")) h5_read(grp, "defer_measures", sp.defer_measures);
     h5_read(grp, "use_norm_as_weight", sp.use_norm_as_weight);
     h5_read(grp, "performance_analysis", sp.performance_analysis);
+    if (grp.has_key("timeline_file")) h5_read(grp, "timeline_file", sp.timeline_file);
+    if (grp.has_key("timeline_sample_interval")) h5_read(grp, "timeline_sample_interval", sp.timeline_sample_interval);
+    if (grp.has_key("progress_file")) h5_read(grp, "progress_file", sp.progress_file);
+    if (grp.has_key("progress_interval")) h5_read(grp, "progress_interval", sp.progress_interval);
+    if (grp.has_key("snapshot_file")) h5_read(grp, "snapshot_file", sp.snapshot_file);
+    if (grp.has_key("snapshot_interval")) h5_read(grp, "snapshot_interval", sp.snapshot_interval);
+    if (grp.has_key("trace_parallel_blocks")) h5_read(grp, "trace_parallel_blocks", sp.trace_parallel_blocks);
+    if (grp.has_key("trace_energy_cutoff")) h5_read(grp, "trace_energy_cutoff", sp.trace_energy_cutoff);
+    if (grp.has_key("trace_prune_tolerance")) h5_read(grp, "trace_prune_tolerance", sp.trace_prune_tolerance);
+    if (grp.has_key("trace_single_precision_tol")) h5_read(grp, "trace_single_precision_tol", sp.trace_single_precision_tol);
+    if (grp.has_key("trace_single_min_block_dim")) h5_read(grp, "trace_single_min_block_dim", sp.trace_single_min_block_dim);
     h5_read(grp, "proposal_prob", sp.proposal_prob);
 
     //h5_read(grp, "move_global", sp.move_global);
     if( grp.has_key("move_global") )
       TRIQS_RUNTIME_ERROR << "Error reading: CTHYB solve_parameters, can not de-serialize the global moves data type.";
     h5_read(grp, "move_global_prob", sp.move_global_prob);
+    if (grp.has_key("adaptive_warmup")) h5_read(grp, "adaptive_warmup", sp.adaptive_warmup);
 
     h5_read(grp, "imag_threshold", sp.imag_threshold);
 
@@ -204,7 +288,13 @@ namespace triqs_cthyb {
     h5_read(grp, "det_n_operations_before_check", sp.det_n_operations_before_check);
     h5_read(grp, "det_precision_warning", sp.det_precision_warning);
     h5_read(grp, "det_precision_error", sp.det_precision_error);
+    if (grp.has_key("det_adaptive_check")) h5_read(grp, "det_adaptive_check", sp.det_adaptive_check);
     h5_read(grp, "det_singular_threshold", sp.det_singular_threshold);
+    if (grp.has_key("delta_interpolation")) h5_read(grp, "delta_interpolation", sp.delta_interpolation);
+    if (grp.has_key("delta_node_shared_memory")) h5_read(grp, "delta_node_shared_memory", sp.delta_node_shared_memory);
+    if (grp.has_key("mpi_group_ranks")) h5_read(grp, "mpi_group_ranks", sp.mpi_group_ranks);
+    if (grp.has_key("replica_h_int_scalings")) h5_read(grp, "replica_h_int_scalings", sp.replica_h_int_scalings);
+    if (grp.has_key("replica_swap_interval")) h5_read(grp, "replica_swap_interval", sp.replica_swap_interval);
   }
 
 } // namespace triqs_cthyb
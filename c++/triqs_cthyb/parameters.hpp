@@ -67,6 +67,12 @@ namespace triqs_cthyb {
     /// Number of QMC cycles
     int n_cycles;
 
+    /// Accumulate until all the processes together did n_cycles times their number: faster processes do more cycles, and all stop together
+    bool balanced_accumulation = false;
+
+    /// Number of cycles between two progress reports of a process, in the balanced accumulation
+    int balanced_check_interval = 100;
+
     /// Partition method
     /// type: str
     std::string partition_method = "autopartition";
@@ -84,6 +90,9 @@ namespace triqs_cthyb {
     /// default: INT_MAX
     int loc_n_max = INT_MAX;
 
+    /// If not empty, HDF5 file in which the diagonalization of the local Hamiltonian is kept, and reused while the local problem is unchanged
+    std::string atom_diag_cache_file = "";
+
     /// Length of a single QMC cycle
     /// default: 50
     int length_cycle = 50;
@@ -92,10 +101,28 @@ namespace triqs_cthyb {
     /// default: 5000
     int n_warmup_cycles = 5000;
 
+    /// Start from the final configuration of the previous solve (of this solver, or read from configuration_file), with the dets rebuilt for the new Delta
+    bool warm_start = false;
+
+    /// Number of cycles for thermalization after a successful warm start. -1: n_warmup_cycles
+    int n_warmup_cycles_warm_start = -1;
+
+    /// If not empty, each process writes its final configuration to <configuration_file>.<rank>.h5, and a warm start reads it from there
+    std::string configuration_file = "";
+
     /// Seed for random number generator
     /// default: 34788 + 928374 * MPI.rank
     int random_seed = 34788 + 928374 * triqs::mpi::communicator().rank();
 
+    /// Number of independent Markov chains run in threads by each process. They share the atomic problem and Delta; their results are combined before the MPI reduction.
+    int n_walkers = 1;
+
+    /// Threads of the walkers after the first: none, cores (pinned to cores spread over the NUMA nodes and the processes of a node, data built there) or numa (idem, h_diag per node)
+    std::string walker_placement = "none";
+
+    /// Upper bound of the estimated memory per process in MiB, checked before the allocations of solve (see estimate_memory). No limit if negative.
+    double max_memory = -1;
+
     /// Name of random number generator
     /// type: str
     std::string random_name = "";
@@ -114,6 +141,9 @@ namespace triqs_cthyb {
     /// Add double insertions as a move?
     bool move_double = true;
 
+    /// Number of candidate pairs drawn by the insertion of a c, c^dagger pair (multiple-try Metropolis, weighted by a bound of the trace). 1: a single candidate
+    int move_insert_n_tries = 1;
+
     /// Calculate the full trace or use an estimate?
     bool use_trace_estimator = false;
 
@@ -123,11 +153,20 @@ namespace triqs_cthyb {
     /// Measure G_l (Legendre)?
     bool measure_G_l = false;
 
+    /// Measure G(iw) directly from the configurations with NFFT, without binning in imaginary time?
+    bool measure_G_iw_nfft = false;
+
+    /// Number of positive Matsubara frequencies of the NFFT measurement of G(iw). 0: n_iw of the solver.
+    int measure_G_iw_nfft_n_iw = 0;
+
     /// Measure O_tau by insertion
     std::optional<std::pair<many_body_op_t, many_body_op_t>> measure_O_tau = std::optional<std::pair<many_body_op_t, many_body_op_t>>{};
 
     /// Minumum of operator insertions in: O_tau by insertion measure
     int measure_O_tau_min_ins = 10;
+
+    /// Evaluate O_tau on the whole tau mesh for each time of O1, from the partial products of the configuration, instead of inserting both operators at random times
+    bool measure_O_tau_sweep = false;
     
     /// Measure G^4(tau,tau',tau'') with three fermionic times.
     bool measure_G2_tau = false;
@@ -175,25 +214,99 @@ namespace triqs_cthyb {
     /// Number of Legendre coefficients for G^4(iomega,l,l') measurement.
     int measure_G2_n_l = 20;
 
-    /// NFFT buffer size for G^4(iomega,l,l') measurement.
+    /// Deprecated and ignored: the batched NFFT spreads the nodes on its grid without a buffer.
     int measure_G2_iwll_nfft_buf_size = 100;
 
-    /// NFFT buffer sizes for different blocks
-    /// default: 100 for every block
+    /// Accumulate the scattering matrix of the G^4(inu,inu',inu'') measurements (without NFFT) with matrix products. Faster for many frequencies and large expansion orders.
+    bool measure_G2_iw_gemm = false;
+
+    /// Accumulate G^4 in Matsubara frequencies only for a non-negative first frequency, the rest from G^4(-w) = conj(G^4(w)). Requires a real Delta(tau) and h_loc.
+    bool measure_G2_iw_conj_symmetry = false;
+
+    /// Accumulate G^4(tau,tau',tau'') from precomputed time bins, with contributions flushed in memory order and block pairs split across OpenMP threads.
+    bool measure_G2_tau_grouped = false;
+
+    /// Accumulate the G^4 measures every n cycles only. 0: adaptive, from the timings of the first cycles, so that measuring takes about as long as the moves.
+    int measure_G2_every_n_cycles = 1;
+
+    /// Number of threads accumulating the Matsubara G^4 measures from snapshots of the scattering matrices, while the Markov chain goes on. 0: in the Markov chain.
+    int measure_G2_async_threads = 0;
+
+    /// MPI reduction of the G2 containers: all (all-reduce), chunked (in-place all-reduce in chunks) or root (in-place reduce in chunks to rank 0 only)
+    std::string measure_G2_reduction = "all";
+
+    /// Size in MiB of the chunks of the chunked reductions of the G2 containers
+    int mpi_reduction_chunk_mb = 64;
+
+    /// If not empty, the G2 measures are written by rank 0 to this HDF5 file, in chunks, instead of being kept in the containers. Requires measure_G2_reduction = root
+    std::string measure_G2_stream_file = "";
+
+    /// Deflate (gzip) level 0-9 of the datasets of measure_G2_stream_file. 0: no compression
+    int measure_G2_stream_deflate = 0;
+
+    /// Deprecated and ignored: the batched NFFT spreads the nodes on its grid without a buffer.
     std::map<std::string, int> nfft_buf_sizes = (std::map<std::string, int>{});
 
+    /// File of FFTW wisdom for the NFFT measures, read before planning and written after it (by the first rank). Empty: no wisdom file.
+    std::string nfft_fftw_wisdom_file = "";
+
+    /// Planner of the FFTs of the NFFT measures: estimate, measure or patient. Costly plans are best kept in nfft_fftw_wisdom_file.
+    std::string nfft_fftw_planner = "estimate";
+
     /// Measure perturbation order?
     bool measure_pert_order = false;
 
+    /// Measure the integrated autocorrelation times of the sign, the perturbation order and the first G_l coefficients, by logarithmic binning?
+    bool measure_autocorrelation = false;
+
+    /// Number of Legendre coefficients of G_l (trace of each block) in measure_autocorrelation
+    int measure_autocorrelation_n_l = 4;
+
     /// Measure the reduced impurity density matrix?
     bool measure_density_matrix = false;
 
+    /// Accumulate G_tau, G_l, G_iw_nfft and the G2 measures once per configuration, with the sum of the signs of its cycles, instead of at every cycle
+    bool defer_measures = false;
+
     /// Use the norm of the density matrix in the weight if true, otherwise use Trace
     bool use_norm_as_weight = false;
 
     /// Analyse performance of trace computation with histograms (developers only)?
     bool performance_analysis = false;
 
+    /// If not empty, a timeline of the solve (phases, sampled moves, trace computations and measures) is written to <timeline_file>.<rank>.json, as Chrome trace events
+    std::string timeline_file = "";
+
+    /// Only one call in timeline_sample_interval of the moves, trace computations and accumulations is recorded in the timeline
+    int timeline_sample_interval = 100;
+
+    /// If not empty, the progress of each process is written every progress_interval seconds as JSON lines to <progress_file>.<rank>.jsonl ("-": stdout)
+    std::string progress_file = "";
+
+    /// Interval of the progress lines, in seconds
+    double progress_interval = 10.0;
+
+    /// If not empty, normalized snapshots of G_tau, G_l, the density matrix and the average sign are appended to this HDF5 file every snapshot_interval seconds
+    std::string snapshot_file = "";
+
+    /// Interval of the snapshots, in seconds
+    double snapshot_interval = 3600.0;
+
+    /// Number of leading blocks of the trace evaluated in parallel with OpenMP before the truncation (0 = serial)
+    int trace_parallel_blocks = 0;
+
+    /// Keep only the atomic eigenstates with beta*(E-E_0) <= trace_energy_cutoff in the trace (if > 0). Empty blocks are dropped
+    double trace_energy_cutoff = -1;
+
+    /// After the warmup, drop from the trace the atomic subspaces whose share of the bound of the trace at the root stayed below this tolerance (if > 0)
+    double trace_prune_tolerance = 0;
+
+    /// Store the cached partial products of the trace in single precision where their relative rounding error is below this tolerance (0: double). Needs trace_parallel_blocks <= 1
+    double trace_single_precision_tol = 0;
+
+    /// With trace_single_precision_tol: only the blocks of at least this dimension are cached in single precision
+    int trace_single_min_block_dim = 16;
+
     /// Operator insertion/removal probabilities for different blocks
     /// type: dict(str:float)
     /// default: {}
@@ -208,6 +321,9 @@ namespace triqs_cthyb {
     /// Overall probability of the global moves
     double move_global_prob = 0.05;
 
+    /// Tune the weights of the moves, the proposal probabilities of the blocks and the shift window during the warmup, for more accepted moves per second. Frozen afterwards
+    bool adaptive_warmup = false;
+
     /// Threshold below which imaginary components of Delta and h_loc are set to zero
     double imag_threshold = 1.e-15;
 
@@ -223,9 +339,27 @@ namespace triqs_cthyb {
     /// Threshold for determinant precision error
     double det_precision_error = 1.e-5;
 
+    /// Adapt the interval between the checks of M^-1 of each block to the deviations met at the checks, starting from det_n_operations_before_check
+    bool det_adaptive_check = false;
+
     /// Bound for the determinant matrix being singular, abs(det) > singular_threshold. If <0, it is !isnormal(abs(det))
     double det_singular_threshold = -1;
 
+    /// Evaluate Delta(tau) in the determinants by linear interpolation between mesh points, instead of taking the closest mesh point
+    bool delta_interpolation = false;
+
+    /// Store the tables of Delta(tau) once per node, in MPI-3 shared memory, instead of once per process. The diagonalization of h_loc and the operator matrices stay per process
+    bool delta_node_shared_memory = false;
+
+    /// Ranks in MPI_COMM_WORLD of the processes which do this solve, collectively, e.g. for concurrent problems (Solver.solve_batch). Empty: all
+    std::vector<int> mpi_group_ranks = std::vector<int>{};
+
+    /// Replica exchange: scalings of h_int of the replicas, run by consecutive processes (chains of this size). Only those at 1 measure. Empty: none
+    std::vector<double> replica_h_int_scalings = std::vector<double>{};
+
+    /// Replica exchange: cycles between two proposals of swaps of the configurations of neighbouring replicas
+    int replica_swap_interval = 10;
+
     solve_parameters_t() {}
 
     solve_parameters_t(many_body_op_t h_int, int n_cycles) : h_int(h_int), n_cycles(n_cycles) {}
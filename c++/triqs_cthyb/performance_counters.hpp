@@ -0,0 +1,98 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include "./config.hpp"
+#include <triqs/mpi/base.hpp>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace triqs_cthyb {
+
+  // The counters of the hot paths are compiled in with -DCTHYB_PERFORMANCE_COUNTERS (CMake option Performance_counters).
+  // Otherwise, the code recording them is discarded at compile time and the registry stays empty.
+#ifdef CTHYB_PERFORMANCE_COUNTERS
+  constexpr bool performance_counters_enabled = true;
+#else
+  constexpr bool performance_counters_enabled = false;
+#endif
+
+  /// Counters, and times in seconds, by hierarchical name, e.g. "moves/Shift one operator/attempts"
+  using performance_counters_t = std::map<std::string, double>;
+
+  // Counters of impurity_trace::compute
+  struct trace_counters_t {
+    long n_compute = 0, n_blocks = 0, n_gemm = 0, n_yee_exits = 0, n_single_stores = 0;
+    double flops = 0;
+
+    trace_counters_t &operator+=(trace_counters_t const &x) {
+      n_compute += x.n_compute;
+      n_blocks += x.n_blocks;
+      n_gemm += x.n_gemm;
+      n_yee_exits += x.n_yee_exits;
+      n_single_stores += x.n_single_stores;
+      flops += x.flops;
+      return *this;
+    }
+
+    void add_to(performance_counters_t &r, std::string const &prefix) const {
+      r[prefix + "/calls"] += n_compute;
+      r[prefix + "/blocks"] += n_blocks;
+      r[prefix + "/gemms"] += n_gemm;
+      r[prefix + "/flops"] += flops;
+      r[prefix + "/yee_exits"] += n_yee_exits;
+      r[prefix + "/single_precision_stores"] += n_single_stores;
+    }
+  };
+
+  // Sum over comm, name by name. Collective: all processes must have the same names, which only depend on the parameters.
+  inline performance_counters_t mpi_sum(performance_counters_t const &x, triqs::mpi::communicator const &comm) {
+    std::vector<double> v;
+    for (auto const &[name, value] : x) v.push_back(value);
+    if (comm.size() > 1) MPI_Allreduce(MPI_IN_PLACE, v.data(), v.size(), MPI_DOUBLE, MPI_SUM, comm.get());
+    performance_counters_t r;
+    int i = 0;
+    for (auto const &[name, value] : x) r[name] = v[i++];
+    return r;
+  }
+
+  // A measure, with the number and the time of its accumulations added to the counters at n and time
+  template <typename Measure> class measure_with_timer {
+
+    Measure measure;
+    double *n, *time;
+    using clock = std::chrono::steady_clock;
+
+    public:
+    measure_with_timer(Measure measure, double *n, double *time) : measure(std::move(measure)), n(n), time(time) {}
+
+    void accumulate(mc_weight_t s) {
+      auto start = clock::now();
+      measure.accumulate(s);
+      *time += std::chrono::duration<double>(clock::now() - start).count();
+      ++*n;
+    }
+
+    void collect_results(triqs::mpi::communicator const &c) { measure.collect_results(c); }
+  };
+
+} // namespace triqs_cthyb
@@ -0,0 +1,161 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include <triqs/mpi/base.hpp>
+#include <triqs/utility/exceptions.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Placement of the threads of the walkers (walker_placement) on the cores and the NUMA nodes of the process.
+// Linux only: elsewhere, the threads are not pinned and there is a single node.
+namespace triqs_cthyb {
+
+  enum class walker_placement_t {
+    none,  // the threads are placed by the system, and the data of the walkers is built by the main thread
+    cores, // each walker is pinned to a core, and its data is built by its own thread (first touch on its node)
+    numa   // idem, with a copy of the atomic data (h_diag) per NUMA node
+  };
+
+  inline walker_placement_t make_walker_placement(std::string const &s) {
+    if (s == "none") return walker_placement_t::none;
+    if (s == "cores") return walker_placement_t::cores;
+    if (s == "numa") return walker_placement_t::numa;
+    TRIQS_RUNTIME_ERROR << "walker_placement must be none, cores or numa, not " << s;
+  }
+
+  /// The cores the process may run on (its affinity mask), with their NUMA nodes, from /sys/devices/system/node
+  struct cpu_topology_t {
+    std::vector<int> cpus, nodes; // cpus[i] is on the node nodes[i] (numbered from 0, among the nodes of the process)
+    int n_nodes = 1;
+
+    // The cores in the order of the placement of the walkers: one core of each node in turn, so that the walkers
+    // and the memory bandwidth are spread over the nodes
+    std::vector<std::pair<int, int>> spread() const {
+      std::vector<std::pair<int, int>> r; // (cpu, node)
+      std::vector<std::vector<int>> by_node(n_nodes);
+      for (size_t i = 0; i < cpus.size(); ++i) by_node[nodes[i]].push_back(cpus[i]);
+      for (size_t k = 0; r.size() < cpus.size(); ++k)
+        for (int n = 0; n < n_nodes; ++n)
+          if (k < by_node[n].size()) r.emplace_back(by_node[n][k], n);
+      return r;
+    }
+  };
+
+  namespace detail {
+    // "0-3,8,10-11" -> 0 1 2 3 8 10 11
+    inline std::vector<int> parse_cpu_list(std::string const &s) {
+      std::vector<int> r;
+      std::stringstream ss(s);
+      std::string item;
+      while (std::getline(ss, item, ',')) {
+        if (item.empty() || item == "\n") continue;
+        auto dash = item.find('-');
+        int a = std::stoi(item.substr(0, dash)), b = (dash == std::string::npos ? a : std::stoi(item.substr(dash + 1)));
+        for (int c = a; c <= b; ++c) r.push_back(c);
+      }
+      return r;
+    }
+  } // namespace detail
+
+  inline cpu_topology_t cpu_topology() {
+    cpu_topology_t t;
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) != 0) return t;
+    std::vector<int> node_of_cpu(CPU_SETSIZE, 0);
+    int n_sys_nodes = 0;
+    for (int n = 0;; ++n) {
+      std::ifstream f("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+      if (!f) break;
+      std::string s;
+      std::getline(f, s);
+      for (int c : detail::parse_cpu_list(s))
+        if (c < CPU_SETSIZE) node_of_cpu[c] = n;
+      n_sys_nodes = n + 1;
+    }
+    // the nodes of the process only, numbered from 0
+    std::vector<int> renumber(std::max(n_sys_nodes, 1), -1);
+    t.n_nodes = 0;
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+      if (!CPU_ISSET(c, &mask)) continue;
+      int &n = renumber[node_of_cpu[c]];
+      if (n == -1) n = t.n_nodes++;
+      t.cpus.push_back(c);
+      t.nodes.push_back(n);
+    }
+    if (t.n_nodes == 0) t.n_nodes = 1;
+#endif
+    return t;
+  }
+
+  /// Pins the calling thread to the core cpu. Returns false if it could not be done.
+  inline bool pin_this_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    CPU_SET(cpu, &mask);
+    return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask) == 0;
+#else
+    return false;
+#endif
+  }
+
+  /// The first of the cores of spread() for the walkers of this process, among the processes of comm on its node.
+  // Processes with the same affinity mask (e.g. not bound by the MPI launcher) take consecutive ranges of n_walkers
+  // cores, by rank on the node; with disjoint masks, each starts at 0. Returns -1 if the masks of the node overlap
+  // without being the same: the walkers are then not pinned. Collective on comm.
+  inline int first_walker_core(triqs::mpi::communicator const &comm, cpu_topology_t const &t, int n_walkers) {
+    constexpr int n_bits = 1024; // cpus beyond are ignored in the comparison
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(comm.get(), MPI_COMM_TYPE_SHARED, comm.rank(), MPI_INFO_NULL, &node_comm);
+    int node_rank, node_size;
+    MPI_Comm_rank(node_comm, &node_rank);
+    MPI_Comm_size(node_comm, &node_size);
+    std::vector<char> mine(n_bits, 0), all(std::size_t(n_bits) * node_size);
+    for (int c : t.cpus)
+      if (c < n_bits) mine[c] = 1;
+    MPI_Allgather(mine.data(), n_bits, MPI_CHAR, all.data(), n_bits, MPI_CHAR, node_comm);
+    MPI_Comm_free(&node_comm);
+
+    int n_same = 0, same_before = 0;
+    for (int r = 0; r < node_size; ++r) {
+      char const *other = all.data() + std::size_t(r) * n_bits;
+      bool same = std::equal(mine.begin(), mine.end(), other), overlap = false;
+      for (int c = 0; c < n_bits; ++c) overlap = overlap || (mine[c] && other[c]);
+      if (overlap && !same) return -1;
+      if (same) {
+        ++n_same;
+        if (r < node_rank) ++same_before;
+      }
+    }
+    return (n_same > 1 ? same_before * n_walkers : 0);
+  }
+
+} // namespace triqs_cthyb
@@ -0,0 +1,172 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include "./qmc_data.hpp"
+#include <triqs/mpi/base.hpp>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace triqs_cthyb {
+
+  // A move, counting its acceptances at n_accepted
+  template <typename Move> class move_counting_accepts {
+    Move move;
+    long *n_accepted;
+
+    public:
+    move_counting_accepts(Move move, long *n_accepted) : move(std::move(move)), n_accepted(n_accepted) {}
+    mc_weight_t attempt() { return move.attempt(); }
+    mc_weight_t accept() {
+      ++*n_accepted;
+      return move.accept();
+    }
+    void reject() { move.reject(); }
+  };
+
+  /// Progress of the Markov chain of a process, written every interval seconds as one JSON line:
+  /// cycles/sec, accepted moves/sec, mean expansion order per block since the last line, and the estimated time to finish.
+  // callback() wraps the stop callback of mc_generic, which is called once per cycle. The summary of the whole run is
+  // written by write_summary, collectively, once the accumulation is over.
+  class progress_reporter {
+
+    using clock = std::chrono::steady_clock;
+
+    struct state_t {
+      std::unique_ptr<std::ofstream> file;
+      std::ostream *out = nullptr;
+      int rank          = 0;
+      double interval   = 10;
+      long n_warmup = 0, n_target = 0; // cycles of warmup before the accumulation in the same run, target of accumulation cycles
+      qmc_data const *data    = nullptr;
+      long const *n_accepted  = nullptr;
+      std::vector<std::string> block_names;
+
+      clock::time_point start, last;
+      long n_done = 0, n_done_at_last = 0, n_accepted_at_start = 0, n_accepted_at_last = 0;
+      std::vector<double> order_sums;
+      long n_order_samples = 0;
+      bool started         = false;
+    };
+    std::shared_ptr<state_t> st;
+
+    static double seconds(clock::duration d) { return std::chrono::duration<double>(d).count(); }
+
+    static std::string json_string(std::string const &s) {
+      std::string r = "\"";
+      for (char c : s) r += ((c == '"' || c == '\\') ? std::string("\\") + c : std::string(1, c));
+      return r + "\"";
+    }
+
+    void report(clock::time_point now) {
+      auto &s      = *st;
+      double dt    = seconds(now - s.last), t = seconds(now - s.start);
+      long n       = s.n_done - s.n_done_at_last;
+      double rate  = (dt > 0 ? n / dt : 0);
+      bool warmup  = (s.n_done <= s.n_warmup);
+      long n_left  = std::max(0l, s.n_warmup + s.n_target - s.n_done);
+      double r_all = (t > 0 ? s.n_done / t : 0);
+
+      std::ostringstream line;
+      line << "{\"rank\": " << s.rank << ", \"time\": " << t << ", \"phase\": \"" << (warmup ? "warmup" : "accumulation") << "\""
+           << ", \"cycles\": " << s.n_done << ", \"cycles_target\": " << s.n_warmup + s.n_target << ", \"cycles_per_sec\": " << rate
+           << ", \"accepted_per_sec\": " << (dt > 0 ? (*s.n_accepted - s.n_accepted_at_last) / dt : 0) << ", \"mean_order\": {";
+      for (size_t b = 0; b < s.block_names.size(); ++b)
+        line << (b ? ", " : "") << json_string(s.block_names[b]) << ": " << (s.n_order_samples ? s.order_sums[b] / s.n_order_samples : 0);
+      line << "}, \"eta\": " << (r_all > 0 ? n_left / r_all : -1) << "}\n";
+      *s.out << line.str() << std::flush;
+
+      s.last               = now;
+      s.n_done_at_last     = s.n_done;
+      s.n_accepted_at_last = *s.n_accepted;
+      std::fill(s.order_sums.begin(), s.order_sums.end(), 0);
+      s.n_order_samples = 0;
+    }
+
+    public:
+    /// No reporting if file is empty. file = "-" writes to stdout; otherwise to <file>.<rank>.jsonl
+    progress_reporter(std::string const &file, double interval, triqs::mpi::communicator const &comm, qmc_data const &data,
+                      long const *n_accepted, std::vector<std::string> block_names, long n_warmup, long n_target) {
+      if (file.empty()) return;
+      st       = std::make_shared<state_t>();
+      auto &s  = *st;
+      s.rank   = comm.rank();
+      if (file == "-")
+        s.out = &std::cout;
+      else {
+        s.file = std::make_unique<std::ofstream>(file + "." + std::to_string(s.rank) + ".jsonl");
+        s.out  = s.file.get();
+      }
+      s.interval    = interval;
+      s.n_warmup    = n_warmup;
+      s.n_target    = n_target;
+      s.data        = &data;
+      s.n_accepted  = n_accepted;
+      s.block_names = std::move(block_names);
+      s.order_sums.assign(s.block_names.size(), 0);
+    }
+
+    bool is_enabled() const { return bool(st); }
+
+    /// The stop callback stop, reporting the progress
+    std::function<bool()> callback(std::function<bool()> stop) const {
+      if (!st) return stop;
+      return [self = *this, stop = std::move(stop)]() mutable {
+        auto &s  = *self.st;
+        auto now = clock::now();
+        if (!s.started) {
+          s.start = s.last      = now;
+          s.n_accepted_at_start = s.n_accepted_at_last = *s.n_accepted;
+          s.started             = true;
+        }
+        ++s.n_done;
+        for (size_t b = 0; b < s.order_sums.size(); ++b) s.order_sums[b] += s.data->dets[b].size();
+        ++s.n_order_samples;
+        if (seconds(now - s.last) >= s.interval) self.report(now);
+        return stop();
+      };
+    }
+
+    /// The summary of the run, summed over comm (collective), written by rank 0
+    void write_summary(triqs::mpi::communicator const &comm) const {
+      if (!st) return;
+      auto &s         = *st;
+      double t        = (s.started ? seconds(clock::now() - s.start) : 0);
+      double rate     = (t > 0 ? s.n_done / t : 0);
+      double x[3]     = {double(s.n_done), (t > 0 ? (*s.n_accepted - s.n_accepted_at_start) / t : 0), rate}, sum[3];
+      double min_rate = rate, max_time = t;
+      MPI_Reduce(x, sum, 3, MPI_DOUBLE, MPI_SUM, 0, comm.get());
+      MPI_Reduce(&rate, &min_rate, 1, MPI_DOUBLE, MPI_MIN, 0, comm.get());
+      MPI_Reduce(&t, &max_time, 1, MPI_DOUBLE, MPI_MAX, 0, comm.get());
+      if (comm.rank() != 0) return;
+      *s.out << "{\"rank\": \"all\", \"n_ranks\": " << comm.size() << ", \"time\": " << max_time << ", \"cycles\": " << long(sum[0])
+             << ", \"cycles_per_sec\": " << sum[2] << ", \"accepted_per_sec\": " << sum[1] << ", \"slowest_rank_cycles_per_sec\": " << min_rate
+             << "}\n"
+             << std::flush;
+    }
+  };
+
+} // namespace triqs_cthyb
@@ -20,9 +20,16 @@
  ******************************************************************************/
 #pragma once
 #include "impurity_trace.hpp"
+#include "det_batch.hpp"
 #include <triqs/gfs.hpp>
 #include <triqs/det_manip.hpp>
 #include <triqs/utility/serialization.hpp>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <initializer_list>
+#include <limits>
+#include <memory>
 
 namespace triqs_cthyb {
   using namespace triqs::gfs;
@@ -39,49 +46,117 @@ namespace triqs_cthyb {
     atom_diag const &h_diag;                     // Diagonalization of the atomic problem
     mutable impurity_trace imp_trace;            // Calculator of the trace
     std::vector<int> n_inner;
-    block_gf<imtime, delta_target_t> delta; // Hybridization function
-
     /// This callable object adapts the Delta function for the call of the det.
     struct delta_block_adaptor {
-      gf<imtime, delta_target_t> delta_block; // make a copy. Needed in the real case anyway.
 
-      delta_block_adaptor(gf<imtime, delta_target_t> delta_block) : delta_block(std::move(delta_block)) {}
+      // For each (i,j), the values Delta_ij(tau_k) and, for the linear interpolation, the slopes Delta_ij(tau_k+1) - Delta_ij(tau_k),
+      // contiguous in k, at (i * n_orb + j) * n_tau. The slopes are nullptr when interpolation is off.
+      // The table is read-only, and shared by the copies of the adaptor (e.g. the dets of all the walkers).
+      struct table_t {
+        det_scalar_t const *values = nullptr, *slopes = nullptr;
+        int n_orb = 0, n_tau = 0;
+        double inv_dtau = 0;
+        std::shared_ptr<det_scalar_t> storage; // holds values and slopes
+      };
+      std::shared_ptr<table_t const> table;
+
+      // Allocates the storage for n elements and fills it with fill(), e.g. in memory local to the process or shared by a node
+      using allocator_t = std::function<std::shared_ptr<det_scalar_t>(std::size_t n, std::function<void(det_scalar_t *)> const &fill)>;
+
+      static std::shared_ptr<det_scalar_t> local_allocator(std::size_t n, std::function<void(det_scalar_t *)> const &fill) {
+        std::shared_ptr<det_scalar_t> r(new det_scalar_t[n], std::default_delete<det_scalar_t[]>());
+        fill(r.get());
+        return r;
+      }
+
+      // The table of a block of Delta
+      static std::shared_ptr<table_t const> make_table(gf<imtime, delta_target_t> const &delta_block, bool interpolate,
+                                                       allocator_t const &allocate = local_allocator) {
+        auto t        = std::make_shared<table_t>();
+        auto const &d = delta_block.data();
+        t->n_tau      = delta_block.mesh().size();
+        t->n_orb      = d.shape()[1];
+        t->inv_dtau   = (t->n_tau - 1) / delta_block.mesh().domain().beta;
+        int n_tau = t->n_tau, n_orb = t->n_orb;
+        std::size_t n = std::size_t(n_orb) * n_orb * n_tau;
+        t->storage    = allocate(interpolate ? 2 * n : n, [&](det_scalar_t *values) {
+          det_scalar_t *slopes = values + n;
+          for (int i = 0; i < n_orb; ++i)
+            for (int j = 0; j < n_orb; ++j) {
+              int p = (i * n_orb + j) * n_tau;
+              for (int k = 0; k < n_tau; ++k) values[p + k] = d(k, i, j);
+              if (!interpolate) continue;
+              for (int k = 0; k < n_tau - 1; ++k) slopes[p + k] = values[p + k + 1] - values[p + k];
+              slopes[p + n_tau - 1] = 0;
+            }
+        });
+        t->values = t->storage.get();
+        if (interpolate) t->slopes = t->values + n;
+        return t;
+      }
+
+      delta_block_adaptor(std::shared_ptr<table_t const> table) : table(std::move(table)) {}
       delta_block_adaptor(delta_block_adaptor const &) = default;
       delta_block_adaptor(delta_block_adaptor &&)      = default;
       delta_block_adaptor &operator=(delta_block_adaptor const &) = delete;
       delta_block_adaptor &operator=(delta_block_adaptor &&) = default;
 
       det_scalar_t operator()(std::pair<time_pt, int> const &x, std::pair<time_pt, int> const &y) const {
-        det_scalar_t res = delta_block[closest_mesh_pt(double(x.first - y.first))](x.second, y.second);
+        auto const &t = *table;
+        double s      = double(x.first - y.first) * t.inv_dtau;
+        int p         = (x.second * t.n_orb + y.second) * t.n_tau;
+        det_scalar_t res;
+        if (t.slopes == nullptr)
+          res = t.values[p + std::min(int(s + 0.5), t.n_tau - 1)]; // closest mesh point
+        else {
+          int k = std::min(int(s), t.n_tau - 2);
+          res   = t.values[p + k] + (s - k) * t.slopes[p + k];
+        }
         return (x.first >= y.first ? res : -res); // x,y first are time_pt, wrapping is automatic in the - operation, but need to
                                                   // compute the sign
       }
 
-      friend void swap(delta_block_adaptor &dba1, delta_block_adaptor &dba2) noexcept { swap(dba1.delta_block, dba2.delta_block); }
+      friend void swap(delta_block_adaptor &dba1, delta_block_adaptor &dba2) noexcept {
+        using std::swap;
+        swap(dba1.table, dba2.table);
+      }
     };
 
-    std::vector<det_manip::det_manip<delta_block_adaptor>> dets; // The determinants
+    using delta_tables_t = std::vector<std::shared_ptr<delta_block_adaptor::table_t const>>;
+    delta_tables_t delta_tables;                                 // Hybridization function, by block
+    std::vector<det_manip::det_manip<delta_block_adaptor>> dets;                     // The determinants
     int current_sign, old_sign;                                  // Permutation prefactor
     h_scalar_t atomic_weight;                                    // The current value of the trace or norm
     h_scalar_t atomic_reweighting;                               // The current value of the reweighting
 
-    // Construction
-    qmc_data(double beta, solve_parameters_t const &p, atom_diag const &h_diag, std::map<std::pair<int, int>, int> linindex,
-             block_gf_const_view<imtime> delta, std::vector<int> n_inner, histo_map_t *histo_map)
-       : config(beta),
-         tau_seg(beta),
-         h_diag(h_diag),
-         delta(map([](gf_const_view<imtime> d) { return real(d); }, delta)),
-         linindex(linindex),
-         imp_trace(beta, h_diag, histo_map, p.use_norm_as_weight, p.measure_density_matrix, p.performance_analysis),
-         current_sign(1),
-         old_sign(1),
-         n_inner(n_inner) {
-      std::tie(atomic_weight, atomic_reweighting) = imp_trace.compute();
-      dets.clear();
+    // Adaptive checks of M^-1 of a det (det_adaptive_check), in place of the checks at a fixed interval of det_manip
+    struct det_check_t {
+      long interval, initial_interval; // operations between two checks
+      long n_since_check = 0, n_checks = 0, n_regenerations = 0;
+    };
+    std::vector<det_check_t> det_checks; // by block, empty without the adaptive checks
+    double det_precision_warning, det_precision_error;
+
+    // The entries of the dets for the measures, gathered once per configuration (see det_batch_t)
+    inline det_batch_t const &det_batch() const;
+
+    // The pending accumulations of the deferred measures (measure_deferred), done before any change of the configuration.
+    // n_flushes counts them: the configuration is the same between two flushes. Unlike config.get_id(), it does not
+    // advance with the rejected moves.
+    std::vector<std::function<void()>> deferred_measures;
+    long n_flushes = 0;
+    void flush_deferred_measures() {
+      for (auto const &f : deferred_measures) f();
+      ++n_flushes;
+    }
+
+    // The tables of all the blocks of delta, with their storage obtained from allocate
+    static delta_tables_t make_delta_tables(block_gf_const_view<imtime> delta, solve_parameters_t const &p,
+                                            delta_block_adaptor::allocator_t const &allocate = delta_block_adaptor::local_allocator) {
+      delta_tables_t r;
       for (auto const &bl : range(delta.size())) {
 #ifdef HYBRIDISATION_IS_COMPLEX
-        dets.emplace_back(delta_block_adaptor(delta[bl]), p.det_init_size);
+        r.push_back(delta_block_adaptor::make_table(delta[bl], p.delta_interpolation, allocate));
 #else
         if (!is_gf_real(delta[bl], 1e-10)) {
           //TRIQS_RUNTIME_ERROR << "The Delta(tau) block number " << bl << " is not real in tau space";
@@ -91,27 +166,255 @@ namespace triqs_cthyb {
             std::cerr << "WARNING: Dissregarding the imaginary component in the calculation.\n";
           }
         }
-        dets.emplace_back(delta_block_adaptor(real(delta[bl])), p.det_init_size);
+        r.push_back(delta_block_adaptor::make_table(real(delta[bl]), p.delta_interpolation, allocate));
 #endif
-        dets.back().set_singular_threshold(p.det_singular_threshold);
-        dets.back().set_n_operations_before_check(p.det_n_operations_before_check);
-        dets.back().set_precision_warning(p.det_precision_warning);
-        dets.back().set_precision_error(p.det_precision_error);
       }
+      return r;
+    }
+
+    // Construction. The tables of Delta are made from delta, unless they are given (shared with another qmc_data, or another process).
+    qmc_data(double beta, solve_parameters_t const &p, atom_diag const &h_diag, std::map<std::pair<int, int>, int> linindex,
+             block_gf_const_view<imtime> delta, std::vector<int> n_inner, histo_map_t *histo_map, delta_tables_t delta_tables = {})
+       : config(beta),
+         tau_seg(beta),
+         linindex(linindex),
+         h_diag(h_diag),
+         imp_trace(beta, h_diag, histo_map, p),
+         n_inner(n_inner),
+         delta_tables(std::move(delta_tables)),
+         current_sign(1),
+         old_sign(1),
+         det_precision_warning(p.det_precision_warning),
+         det_precision_error(p.det_precision_error) {
+      std::tie(atomic_weight, atomic_reweighting) = imp_trace.compute();
+      if (this->delta_tables.empty()) this->delta_tables = make_delta_tables(delta, p);
+      dets.clear();
+      for (auto const &bl : range(delta.size())) {
+        dets.emplace_back(delta_block_adaptor(this->delta_tables[bl]), p.det_init_size);
+        set_det_parameters(dets.back(), p);
+      }
+      if (p.det_adaptive_check) {
+        long n = std::max(p.det_n_operations_before_check, 1);
+        det_checks.assign(dets.size(), det_check_t{n, n});
+      }
+    }
+
+    // Start from the operators of r, usually the final configuration of a previous run, on the empty configuration:
+    // the operators are inserted in the trace and the configuration, and the dets are rebuilt with the current Delta.
+    // Returns false if r does not fit the problem, or if the weight of the configuration is not positive
+    // (the sign of the Monte Carlo starts at 1): the qmc_data is then left in an unspecified state, and must be discarded.
+    bool load_configuration(configuration_record_t const &r, solve_parameters_t const &p) {
+      flush_deferred_measures();
+      int n_blocks = dets.size();
+      configuration::flat_oplist_t ops;
+      if (!ops_from_record(r, ops)) return false;
+
+      std::vector<std::vector<std::pair<time_pt, int>>> x(n_blocks), y(n_blocks); // c^dagger and c of each block, in decreasing time order
+      for (auto const &[tau, op] : ops) (op.dagger ? x : y)[op.block_index].emplace_back(tau, op.inner_index);
+      for (int b = 0; b < n_blocks; ++b)
+        if (x[b].size() != y[b].size()) return false;
+
+      // Insert in the trace two operators at a time, as the insertion moves
+      for (int k = 0; k < int(ops.size()); k += 2) {
+        imp_trace.try_insert(ops[k].first, ops[k].second);
+        imp_trace.try_insert(ops[k + 1].first, ops[k + 1].second);
+        imp_trace.compute();
+        imp_trace.confirm_insert();
+      }
+      for (auto const &[tau, op] : ops) config.insert(tau, op);
+      config.finalize();
+      std::tie(atomic_weight, atomic_reweighting) = imp_trace.compute();
+
+      dets.clear();
+      for (int b = 0; b < n_blocks; ++b) {
+        dets.emplace_back(delta_block_adaptor(delta_tables[b]), x[b], y[b]);
+        set_det_parameters(dets.back(), p);
+      }
+      update_sign();
+      old_sign = current_sign;
+
+      return has_positive_weight();
+    }
+
+    // Weight of the configuration in the Monte Carlo: sign, trace (or norm) and determinants
+    mc_weight_t weight() const {
+      mc_weight_t w = current_sign * atomic_weight;
+      for (auto const &d : dets) w *= d.determinant();
+      return w;
+    }
+
+    // Is the weight of the configuration real and positive? The sign of a Monte Carlo run starts at 1: it must start there.
+    bool has_positive_weight() const {
+      mc_weight_t w = weight();
+      return (std::real(w) > 0) && (std::abs(std::imag(w)) <= 1e-10 * std::abs(w));
+    }
+
+    // Back to the empty configuration if the weight is not positive, e.g. before a new Monte Carlo run continues
+    // the configuration of another one (separate warmup). Returns true if the walker was restarted.
+    bool restart_if_not_positive(solve_parameters_t const &p) {
+      if (has_positive_weight()) return false;
+      configuration_record_t empty;
+      empty.beta = config.beta();
+      clear_configuration();
+      load_configuration(empty, p);
+      return true;
+    }
+
+    // Drops from the trace the atomic subspaces below tolerance (impurity_trace::prune_blocks), and recomputes the weight,
+    // which may no longer be positive (restart_if_not_positive). Returns the estimate of the relative error on the trace.
+    double prune_trace_blocks(double tolerance) {
+      flush_deferred_measures();
+      double error                                = imp_trace.prune_blocks(tolerance);
+      std::tie(atomic_weight, atomic_reweighting) = imp_trace.compute();
+      update_sign();
+      old_sign = current_sign;
+      return error;
+    }
+
+    // Back to the empty configuration, e.g. before a load_configuration. The operators are removed from the trace
+    // as pairs c^dagger c of a block.
+    void clear_configuration() {
+      flush_deferred_measures();
+      for (int b = 0; b < int(dets.size()); ++b)
+        for (int k = 0; k < int(dets[b].size()); ++k) {
+          imp_trace.try_delete(0, b, true);
+          imp_trace.try_delete(0, b, false);
+          imp_trace.compute();
+          imp_trace.confirm_delete();
+        }
+      config.clear();
+      config.finalize();
+    }
+
+    // The operators of r, in decreasing time order, with their times on the grid of time_pt.
+    // Returns false if r does not fit the problem: beta, block and inner indices, distinct times.
+    bool ops_from_record(configuration_record_t const &r, configuration::flat_oplist_t &ops) const {
+      double beta = config.beta();
+      if (std::abs(r.beta - beta) > 1e-12 * beta) return false;
+      ops.clear();
+      double u_max = std::nextafter(1.0, 0.0), n_max = double(std::numeric_limits<uint64_t>::max());
+      for (int k = 0; k < r.size(); ++k) {
+        int b = r.block[k], i = r.inner[k];
+        if ((b < 0) || (b >= int(dets.size())) || (i < 0) || (i >= n_inner[b])) return false;
+        time_pt tau(uint64_t(std::min(std::max(r.tau[k] / beta, 0.0), u_max) * n_max), beta);
+        if (!ops.empty() && !(tau < ops.back().first)) return false; // the times must be distinct
+        ops.emplace_back(tau, op_desc{b, i, bool(r.dagger[k]), linindex.at(std::make_pair(b, i))});
+      }
+      return true;
     }
 
     qmc_data(qmc_data const &) = delete; // Member imp_trace is not copyable
     qmc_data &operator=(qmc_data const &) = delete;
 
+    // Full recount of the sign, from the configuration
     void update_sign() {
+      old_sign     = current_sign;
+      order_parity = compute_order_parity();
+      current_sign = sign_from_parities();
+    }
+
+    // An operator inserted in or removed from the configuration
+    struct changed_op_t {
+      time_pt tau;
+      int block_index;
+      bool dagger;
+    };
+
+    // Incremental update of the sign, after the insertion or removal of changed_ops (for a shift, the old and the new operator).
+    // Must be called once the move is confirmed in imp_trace, whose subtree counts give the ranks of the operators in O(log N).
+    void update_sign(std::initializer_list<changed_op_t> changed_ops) {
+      old_sign = current_sign;
+      int s    = 0;
+      for (auto const &z : changed_ops) s += n_pairs_with_others(z);
+      // the pairs among the changed operators, in decreasing time order
+      std::vector<changed_op_t> ops(changed_ops);
+      std::sort(ops.begin(), ops.end(), [](changed_op_t const &x, changed_op_t const &y) { return x.tau > y.tau; });
+      for (int i = 0; i < int(ops.size()); ++i)
+        for (int j = i + 1; j < int(ops.size()); ++j) s += pair_count(ops[i].block_index, ops[i].dagger, ops[j].block_index, ops[j].dagger);
+      order_parity = (order_parity + s) % 2;
+#ifdef EXT_DEBUG
+      if (order_parity != compute_order_parity()) TRIQS_RUNTIME_ERROR << "qmc_data: incremental update of the sign failed";
+#endif
+      current_sign = sign_from_parities();
+    }
+
+    // Completes the operation tried on the det of block b, and checks it from time to time (with the adaptive checks)
+    void complete_det_operation(int b) {
+      dets[b].complete_operation();
+      if (!det_checks.empty() && (++det_checks[b].n_since_check >= det_checks[b].interval)) check_det(b);
+    }
+
+    // Deviation max |M M^-1 - 1| of the det of block b, from a gemm. It is regenerated unless the deviation is negligible.
+    // The interval doubles (up to 100 times its initial value) while the deviations stay below 1e-3 of det_precision_warning,
+    // and is halved when they are above 1e-1 of it.
+    void check_det(int b) {
+      auto &det       = dets[b];
+      auto &c         = det_checks[b];
+      c.n_since_check = 0;
+      ++c.n_checks;
+      int n = det.size();
+      if (n == 0) return;
+      delta_block_adaptor f(delta_tables[b]);
+      matrix<det_scalar_t> m(n, n);
+      for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) m(i, j) = f(det.get_x(i), det.get_y(j));
+      matrix<det_scalar_t> r = m * det.inverse_matrix();
+      double dev             = 0;
+      for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) dev = std::max(dev, std::abs(r(i, j) - det_scalar_t(i == j)));
+
+      if (dev > det_precision_error)
+        TRIQS_RUNTIME_ERROR << "Deviation of M^-1 of the det of block " << b << " above det_precision_error: " << dev;
+      if (dev > det_precision_warning)
+        std::cerr << "WARNING: deviation of M^-1 of the det of block " << b << " above det_precision_warning: " << dev << std::endl;
+      if (dev > 1e-3 * det_precision_warning) {
+        det.regenerate();
+        ++c.n_regenerations;
+      }
 
+      if (dev < 1e-3 * det_precision_warning)
+        c.interval = std::min(2 * c.interval, 100 * c.initial_interval);
+      else if (dev > 1e-1 * det_precision_warning)
+        c.interval = std::max(c.interval / 2, 1l);
+    }
+
+    private:
+    static void set_det_parameters(det_manip::det_manip<delta_block_adaptor> &det, solve_parameters_t const &p) {
+      det.set_singular_threshold(p.det_singular_threshold);
+      // with the adaptive checks, det_manip does not check by itself
+      det.set_n_operations_before_check(p.det_adaptive_check ? std::numeric_limits<int>::max() : p.det_n_operations_before_check);
+      det.set_precision_warning(p.det_precision_warning);
+      det.set_precision_error(p.det_precision_error);
+    }
+
+    mutable det_batch_t batch; // filled by det_batch
+
+    int order_parity = 0; // parity of the permutation to bring the configuration to d^_1 ... d_1 d^_2 ... d_2 ... (see below)
+
+    // Contribution of the operators x then y (x at the larger time) to the permutation:
+    // 1 if y has to be moved to the left of x to sort the operators by block, then daggers first.
+    static int pair_count(int block_x, bool dagger_x, int block_y, bool dagger_y) {
+      return (block_x > block_y) || ((block_x == block_y) && !dagger_x && dagger_y);
+    }
+
+    // Sum of pair_count over the pairs of z with the other operators of the configuration
+    int n_pairs_with_others(changed_op_t const &z) const {
+      int s = 0;
+      for (int b = 0; b < int(dets.size()); ++b) {
+        for (bool d : {false, true}) {
+          if (pair_count(b, d, z.block_index, z.dagger)) s += imp_trace.count_ops_later(z.tau, b, d);
+          if (pair_count(z.block_index, z.dagger, b, d)) s += imp_trace.count_ops_earlier(z.tau, b, d);
+        }
+      }
+      return s;
+    }
+
+    // Parity of the permutation bringing the configuration to d^_1 d^_1 d^_1 ... d_1 d_1 d_1   d^_2 d^_2 ... d_2 d_2   ...   d^_n .. d_n
+    int compute_order_parity() const {
       int s             = 0;
       size_t num_blocks = dets.size();
       std::vector<int> n_op_with_a_equal_to(num_blocks, 0), n_ndag_op_with_a_equal_to(num_blocks, 0);
 
-      // In this first part we compute the sign to bring the configuration to
-      // d^_1 d^_1 d^_1 ... d_1 d_1 d_1   d^_2 d^_2 ... d_2 d_2   ...   d^_n .. d_n
-
       // loop over the operators "op" in the trace (right to left)
       for (auto const &op : config) {
 
@@ -125,16 +428,18 @@ namespace triqs_cthyb {
         else
           n_ndag_op_with_a_equal_to[op.second.block_index]++;
       }
+      return s % 2;
+    }
 
-      // Now we compute the sign to bring the configuration to
-      // d_1 d^_1 d_1 d^_1 ... d_1 d^_1   ...   d_n d^_n ... d_n d^_n
-      for (int block_index = 0; block_index < num_blocks; block_index++) {
+    // Then the sign to bring the configuration to
+    // d_1 d^_1 d_1 d^_1 ... d_1 d^_1   ...   d_n d^_n ... d_n d^_n
+    int sign_from_parities() const {
+      int s = order_parity;
+      for (int block_index = 0; block_index < dets.size(); block_index++) {
         int n = dets[block_index].size();
         s += n * (n + 1) / 2;
       }
-
-      old_sign     = current_sign;
-      current_sign = (s % 2 == 0 ? 1 : -1);
+      return (s % 2 == 0 ? 1 : -1);
     }
   };
 
@@ -142,6 +447,41 @@ namespace triqs_cthyb {
 
   using det_type = det_manip::det_manip<qmc_data::delta_block_adaptor>;
 
+  // Position of an operator at tau in the det: the number of c^dagger (x), resp. c (y), at larger times.
+  // The det stores the operators in decreasing time order (cf check_det_sequence): binary search.
+  inline int det_position_x(det_type const &det, time_pt const &tau) {
+    int lo = 0, hi = det.size();
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (det.get_x(mid).first < tau)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    return lo;
+  }
+
+  inline int det_position_y(det_type const &det, time_pt const &tau) {
+    int lo = 0, hi = det.size();
+    while (lo < hi) {
+      int mid = (lo + hi) / 2;
+      if (det.get_y(mid).first < tau)
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+    return lo;
+  }
+
+  // Refilled when the configuration has changed since the last call: a single pass over the dets, shared by all the measures.
+  inline det_batch_t const &qmc_data::det_batch() const {
+    if (batch.config_id == config.get_id()) return batch;
+    batch.clear();
+    for (auto const &det : dets) batch.push_back_block(det);
+    batch.config_id = config.get_id();
+    return batch;
+  }
+
   // Print taus of operator sequence in dets
   inline void print_det_sequence(qmc_data const &data) {
     int i;
@@ -0,0 +1,184 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include "./qmc_data.hpp"
+#include <triqs/mc_tools.hpp>
+#include <triqs/mpi/base.hpp>
+#include <triqs/utility/exceptions.hpp>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace triqs_cthyb {
+
+  /// Replica exchange (parallel tempering) in the scaling of h_int (replica_h_int_scalings).
+  // The processes form chains of n = scalings.size() consecutive ranks, which run the replicas of scalings[0], ..., scalings[n-1].
+  // Every interval cycles, the neighbouring replicas of a chain propose to swap their configurations, the pairs (0,1), (2,3), ...
+  // and (1,2), (3,4), ... in turn. The dets do not depend on the scaling, and the weights w_a(C) of a replica a for the
+  // configuration C of the other one are computed by loading it (as for a warm start): the swap is accepted with the probability
+  // |w_a(C_b) w_b(C_a) / (w_a(C_a) w_b(C_b))|. A swap which changes the sign of the configuration of a replica is rejected
+  // (the condition is the same for the reverse swap, which keeps the detailed balance), as mc_generic only follows the sign
+  // through the moves. The processes must run the same cycles, in step: see the checks in solver_core::solve.
+  class replica_exchange {
+
+    struct state_t {
+      triqs::mpi::communicator comm;
+      qmc_data *data;
+      solve_parameters_t params;
+      mc_tools::random_generator *rng;
+      int replica, n_replicas, interval;
+      long n_cycles = 0, n_proposed = 0, n_accepted = 0;
+    };
+    std::shared_ptr<state_t> st;
+    double scaling = 1;
+
+    static bool is_positive(mc_weight_t r) { return (std::real(r) > 0) && (std::abs(std::imag(r)) <= 1e-10 * std::abs(r)); }
+
+    // The configuration record r, as beta, n, then the times, blocks, inner indices and daggers
+    static std::vector<double> pack(configuration_record_t const &r) {
+      std::vector<double> v{r.beta, double(r.size())};
+      v.insert(v.end(), r.tau.begin(), r.tau.end());
+      for (auto const *x : {&r.block, &r.inner, &r.dagger}) v.insert(v.end(), x->begin(), x->end());
+      return v;
+    }
+    static configuration_record_t unpack(std::vector<double> const &v) {
+      configuration_record_t r;
+      r.beta = v[0];
+      int n  = int(v[1]);
+      auto p = v.begin() + 2;
+      r.tau.assign(p, p + n);
+      for (auto *x : {&r.block, &r.inner, &r.dagger}) {
+        p += n;
+        for (int k = 0; k < n; ++k) x->push_back(int(p[k]));
+      }
+      return r;
+    }
+
+    void propose_swap(int partner) {
+      auto &s            = *st;
+      auto &data         = *s.data;
+      int other          = s.comm.rank() + (partner - s.replica);
+      auto mine          = make_configuration_record(data.config);
+      mc_weight_t w_mine = data.weight();
+
+      std::vector<double> v = pack(mine);
+      int n = v.size(), n_other;
+      MPI_Sendrecv(&n, 1, MPI_INT, other, 0, &n_other, 1, MPI_INT, other, 0, s.comm.get(), MPI_STATUS_IGNORE);
+      std::vector<double> v_other(n_other);
+      MPI_Sendrecv(v.data(), n, MPI_DOUBLE, other, 1, v_other.data(), n_other, MPI_DOUBLE, other, 1, s.comm.get(), MPI_STATUS_IGNORE);
+      auto theirs = unpack(v_other);
+
+      // The ratio w_mine(C_other) / w_mine(C_mine), with the configuration of the other replica loaded
+      configuration::flat_oplist_t ops;
+      if (!data.ops_from_record(theirs, ops)) TRIQS_RUNTIME_ERROR << "Replica exchange: the configuration of the replica " << partner << " does not fit";
+      data.clear_configuration();
+      data.load_configuration(theirs, s.params);
+      mc_weight_t r = data.weight() / w_mine;
+      double x[2]   = {std::abs(r), is_positive(r) ? 1. : 0.}, y[2];
+      MPI_Sendrecv(x, 2, MPI_DOUBLE, other, 2, y, 2, MPI_DOUBLE, other, 2, s.comm.get(), MPI_STATUS_IGNORE);
+
+      // The lower replica decides, and sends the decision to the upper one
+      int accepted = 0;
+      if (s.replica < partner) {
+        accepted = (x[1] > 0) && (y[1] > 0) && ((*s.rng)(1.0) < x[0] * y[0]);
+        MPI_Send(&accepted, 1, MPI_INT, other, 3, s.comm.get());
+      } else
+        MPI_Recv(&accepted, 1, MPI_INT, other, 3, s.comm.get(), MPI_STATUS_IGNORE);
+      ++s.n_proposed;
+      if (accepted) {
+        ++s.n_accepted;
+        return;
+      }
+      data.clear_configuration();
+      data.load_configuration(mine, s.params);
+    }
+
+    public:
+    /// No replica exchange if p.replica_h_int_scalings is empty. The walker is given later (set_walker).
+    replica_exchange(triqs::mpi::communicator const &comm, solve_parameters_t const &p) {
+      auto const &scalings = p.replica_h_int_scalings;
+      if (scalings.empty()) return;
+      int n = scalings.size();
+      if (comm.size() % n != 0)
+        TRIQS_RUNTIME_ERROR << "Replica exchange: the number of processes, " << comm.size() << ", is not a multiple of the number of replicas, " << n;
+      int n_targets = 0;
+      for (double x : scalings) {
+        if (!(x > 0)) TRIQS_RUNTIME_ERROR << "Replica exchange: the scalings of h_int must be positive";
+        if (x == 1) ++n_targets;
+      }
+      if (n_targets == 0) TRIQS_RUNTIME_ERROR << "Replica exchange: one of the scalings of h_int must be 1 (the replica which measures)";
+      st             = std::make_shared<state_t>();
+      st->comm       = comm;
+      st->params     = p;
+      st->replica    = comm.rank() % n;
+      st->n_replicas = n;
+      st->interval   = std::max(p.replica_swap_interval, 1);
+      scaling        = scalings[st->replica];
+    }
+
+    bool is_enabled() const { return bool(st); }
+
+    /// The scaling of h_int of the replica of this process
+    double h_int_scaling() const { return scaling; }
+
+    /// Does this replica measure (scaling 1)?
+    bool measures() const { return scaling == 1; }
+
+    /// The walker whose configurations are swapped, once it is built
+    void set_walker(qmc_data &data, mc_tools::random_generator &rng) {
+      if (!st) return;
+      st->data = &data;
+      st->rng  = &rng;
+    }
+
+    long n_proposed() const { return (st ? st->n_proposed : 0); }
+    long n_accepted() const { return (st ? st->n_accepted : 0); }
+
+    /// The stop callback stop, with the swaps (called once per cycle)
+    std::function<bool()> callback(std::function<bool()> stop) const {
+      if (!st) return stop;
+      return [self = *this, stop = std::move(stop)]() mutable {
+        auto &s = *self.st;
+        if (++s.n_cycles % s.interval == 0) {
+          long round  = s.n_cycles / s.interval;
+          int partner = ((s.replica % 2) == (round % 2) ? s.replica + 1 : s.replica - 1);
+          if ((partner >= 0) && (partner < s.n_replicas)) self.propose_swap(partner);
+        }
+        return stop();
+      };
+    }
+  };
+
+  // A measure which only accumulates on the replicas which measure (see replica_exchange)
+  template <typename Measure> class measure_on_replica {
+    Measure measure;
+    bool measures;
+
+    public:
+    measure_on_replica(Measure measure, bool measures) : measure(std::move(measure)), measures(measures) {}
+    void accumulate(mc_weight_t s) {
+      if (measures) measure.accumulate(s);
+    }
+    void collect_results(triqs::mpi::communicator const &c) { measure.collect_results(c); }
+  };
+
+} // namespace triqs_cthyb
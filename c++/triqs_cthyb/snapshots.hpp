@@ -0,0 +1,182 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include "./config.hpp"
+#include "./measures/chunked_reduce.hpp"
+#include <triqs/h5.hpp>
+#include <triqs/mpi/base.hpp>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace triqs_cthyb {
+
+  // Sum to rank 0 of the n elements at p (in place), by non-blocking reductions of chunks, for the snapshots
+  template <typename T> void snapshot_reduce(T *p, std::size_t n, triqs::mpi::communicator const &c) {
+    mpi_reduce_in_chunks(p, n, c, true, std::size_t(1) << 26);
+  }
+
+  /// Snapshots of the accumulators of the measures during the accumulation, appended to an HDF5 file by rank 0 in normalized form.
+  // The processes decide together when to take a snapshot: every check_interval cycles, each one reports whether snapshot_interval
+  // seconds have passed since the last snapshot, by a non-blocking all-reduce which overlaps with the next cycles. A reduction is
+  // only started once the previous one has completed: as all the processes see the same results, they all take the same snapshots,
+  // in the same order. Once its accumulation is over, a process keeps joining the reductions (finish) until all are over.
+  // The reductions and the snapshots use a duplicate of the communicator, so that they do not interfere with the other collectives.
+  class snapshot_manager {
+
+    public:
+    /// Writes the normalized snapshot of a measure: the accumulators are summed to rank 0, which writes them in g (nullptr elsewhere)
+    using writer_t = std::function<void(triqs::mpi::communicator const &c, triqs::h5::group *g)>;
+
+    private:
+    using clock = std::chrono::steady_clock;
+
+    struct state_t {
+      MPI_Comm comm = MPI_COMM_NULL;
+      std::string file_name;
+      double interval;
+      int check_interval;
+      long n_warmup; // cycles of warmup, without snapshot
+      std::vector<std::pair<std::string, writer_t>> writers;
+      clock::time_point start, last_snapshot;
+      long n_cycles = 0, n_cycles_at_last_report = 0;
+      int n_snapshots = 0;
+      double local[3] = {0, 0, 0}, global[3] = {0, 0, 0}; // snapshot requested, process done, cycles
+      MPI_Request request = MPI_REQUEST_NULL;
+      bool pending = false, done = false;
+
+      ~state_t() {
+        if (comm != MPI_COMM_NULL) MPI_Comm_free(&comm);
+      }
+    };
+    std::shared_ptr<state_t> st;
+
+    static double seconds(clock::duration d) { return std::chrono::duration<double>(d).count(); }
+
+    void start_report() {
+      auto &s    = *st;
+      s.local[0] = ((s.n_cycles > s.n_warmup) && (seconds(clock::now() - s.last_snapshot) >= s.interval) ? 1 : 0);
+      s.local[1] = (s.done ? 1 : 0);
+      s.local[2] = s.n_cycles;
+      MPI_Iallreduce(s.local, s.global, 3, MPI_DOUBLE, MPI_SUM, s.comm, &s.request);
+      s.pending                 = true;
+      s.n_cycles_at_last_report = s.n_cycles;
+    }
+
+    // The result of the last report has arrived: take the snapshot if requested
+    void process_report() {
+      auto &s   = *st;
+      s.pending = false;
+      if (s.global[0] > 0) take_snapshot(long(s.global[2]));
+    }
+
+    void take_snapshot(long n_cycles_total) {
+      auto &s = *st;
+      triqs::mpi::communicator c{s.comm};
+      std::unique_ptr<triqs::h5::file> f;
+      std::unique_ptr<triqs::h5::group> g;
+      if (c.rank() == 0) {
+        f = std::make_unique<triqs::h5::file>(s.file_name, s.n_snapshots == 0 ? H5F_ACC_TRUNC : H5F_ACC_RDWR);
+        g = std::make_unique<triqs::h5::group>(triqs::h5::group(*f).create_group("snapshot_" + std::to_string(s.n_snapshots)));
+        h5_write(*g, "time", seconds(clock::now() - s.start));
+        h5_write(*g, "n_cycles", n_cycles_total);
+      }
+      for (auto const &[name, w] : s.writers) {
+        std::unique_ptr<triqs::h5::group> gm;
+        if (g) gm = std::make_unique<triqs::h5::group>(g->create_group(name));
+        w(c, gm.get());
+      }
+      if (c.rank() == 0) {
+        triqs::h5::group root(*f);
+        h5_write(root, "n_snapshots", s.n_snapshots + 1);
+      }
+      ++s.n_snapshots;
+      s.last_snapshot = clock::now();
+    }
+
+    public:
+    /// No snapshot if file_name is empty. The first n_warmup cycles are the warmup, without snapshot.
+    snapshot_manager(triqs::mpi::communicator const &comm, std::string const &file_name, double interval, int check_interval, long n_warmup) {
+      if (file_name.empty()) return;
+      st = std::make_shared<state_t>();
+      MPI_Comm_dup(comm.get(), &st->comm);
+      st->file_name      = file_name;
+      st->interval       = interval;
+      st->check_interval = std::max(check_interval, 1);
+      st->n_warmup       = n_warmup;
+      st->start = st->last_snapshot = clock::now();
+    }
+
+    bool is_enabled() const { return bool(st); }
+
+    /// Registers the writer of the snapshots of a measure, in the group name of each snapshot
+    void add(std::string const &name, writer_t writer) {
+      if (st) st->writers.emplace_back(name, std::move(writer));
+    }
+
+    /// The stop callback stop, with the reports of the snapshots (called once per cycle)
+    std::function<bool()> callback(std::function<bool()> stop) const {
+      if (!st) return stop;
+      return [self = *this, stop = std::move(stop)]() mutable {
+        auto &s = *self.st;
+        ++s.n_cycles;
+        if (s.pending) {
+          int completed = 0;
+          MPI_Test(&s.request, &completed, MPI_STATUS_IGNORE);
+          if (completed) self.process_report();
+        }
+        if (!s.pending && (s.n_cycles - s.n_cycles_at_last_report >= s.check_interval)) self.start_report();
+        return stop();
+      };
+    }
+
+    /// To be called by all processes once their accumulation is over: joins the reports (and snapshots) of the other processes,
+    /// until all of them are over
+    void finish() {
+      if (!st) return;
+      auto &s = *st;
+      s.done  = true;
+      while (true) {
+        if (!s.pending) start_report();
+        MPI_Wait(&s.request, MPI_STATUS_IGNORE);
+        process_report();
+        if (s.global[1] == triqs::mpi::communicator{s.comm}.size()) break;
+      }
+    }
+  };
+
+  // A measure, with its snapshots registered in a snapshot_manager. The measure is shared with the registered writer,
+  // as mc_generic moves the measures it is given.
+  template <typename Measure> class measure_with_snapshots {
+    std::shared_ptr<Measure> measure;
+
+    public:
+    measure_with_snapshots(Measure m, snapshot_manager &snapshots, std::string const &name) : measure(std::make_shared<Measure>(std::move(m))) {
+      snapshots.add(name, [m = measure](triqs::mpi::communicator const &c, triqs::h5::group *g) { m->write_snapshot(c, g); });
+    }
+    void accumulate(mc_weight_t s) { measure->accumulate(s); }
+    void collect_results(triqs::mpi::communicator const &c) { measure->collect_results(c); }
+  };
+
+} // namespace triqs_cthyb
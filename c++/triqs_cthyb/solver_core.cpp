@@ -22,12 +22,31 @@
  ******************************************************************************/
 #include "./solver_core.hpp"
 #include "./qmc_data.hpp"
+#include "./node_shared_memory.hpp"
+#include "./balanced_stop.hpp"
+#include "./timeline.hpp"
+#include "./progress.hpp"
+#include "./snapshots.hpp"
+#include "./replica_exchange.hpp"
+#include "./placement.hpp"
 
 #include <triqs/utility/callbacks.hpp>
 #include <triqs/utility/exceptions.hpp>
 #include <triqs/gfs.hpp>
 #include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <exception>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <thread>
 #include <triqs/utility/variant.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 #include "./moves/insert.hpp"
 #include "./moves/remove.hpp"
@@ -35,19 +54,26 @@
 #include "./moves/double_remove.hpp"
 #include "./moves/shift.hpp"
 #include "./moves/global.hpp"
+#include "./moves/move_statistics.hpp"
 #include "./measures/G_tau.hpp"
 #include "./measures/G_l.hpp"
+#include "./measures/G_iw_nfft.hpp"
 #include "./measures/O_tau_ins.hpp"
 #include "./measures/perturbation_hist.hpp"
 #include "./measures/density_matrix.hpp"
 #include "./measures/average_sign.hpp"
+#include "./measures/autocorrelation.hpp"
+#include "./measures/deferred.hpp"
 #ifdef CTHYB_G2_NFFT
 #include "./measures/G2_tau.hpp"
 #include "./measures/G2_iw.hpp"
 #include "./measures/G2_iw_nfft.hpp"
 #include "./measures/G2_iwll.hpp"
+#include "./measures/measure_interval.hpp"
 #endif
 #include "./measures/util.hpp"
+#include "./measures/chunked_reduce.hpp"
+#include "./measures/G2_stream.hpp"
 
 namespace triqs_cthyb {
 
@@ -77,6 +103,30 @@ namespace triqs_cthyb {
     solve_parameters = solve_parameters_;
     solve_parameters_t params(solve_parameters_);
 
+    // With mpi_group_ranks, the solve is done on a communicator of these processes only (MPI_Comm_create_group is only
+    // collective over them), so that other groups can solve other problems at the same time. _comm is restored on exit.
+    struct group_comm_t {
+      triqs::mpi::communicator &comm, world;
+      MPI_Comm group = MPI_COMM_NULL;
+      ~group_comm_t() {
+        comm = world;
+        if (group != MPI_COMM_NULL) MPI_Comm_free(&group);
+      }
+    } group_comm{_comm, _comm};
+    if (!params.mpi_group_ranks.empty()) {
+      MPI_Group world_group, group;
+      int rank_in_group;
+      MPI_Comm_group(group_comm.world.get(), &world_group);
+      MPI_Group_incl(world_group, params.mpi_group_ranks.size(), params.mpi_group_ranks.data(), &group);
+      MPI_Group_rank(group, &rank_in_group);
+      if (rank_in_group != MPI_UNDEFINED) MPI_Comm_create_group(group_comm.world.get(), group, 0, &group_comm.group);
+      MPI_Group_free(&group);
+      MPI_Group_free(&world_group);
+      if (rank_in_group == MPI_UNDEFINED)
+        TRIQS_RUNTIME_ERROR << "solve: the process of rank " << group_comm.world.rank() << " is not in mpi_group_ranks";
+      _comm = triqs::mpi::communicator{group_comm.group};
+    }
+
     // Merge constr_params and solve_params
     //params_t params(constr_parameters, solve_parameters);
 
@@ -87,6 +137,19 @@ namespace triqs_cthyb {
                    " ║ ╠╦╝║║═╬╗╚═╗  │   │ ├─┤└┬┘├┴┐\n"
                    " ╩ ╩╚═╩╚═╝╚╚═╝  └─┘ ┴ ┴ ┴ ┴ └─┘\n\n";
 
+    // The timeline of this solve, by phase, written at its end if timeline_file is given
+    auto &tl = timeline::instance();
+    if (!params.timeline_file.empty())
+      tl.start(params.timeline_sample_interval);
+    else
+      tl.stop();
+    std::optional<timeline::span> phase;
+    auto write_timeline = [&] {
+      phase.reset();
+      if (tl.is_enabled()) tl.stop_and_write(params.timeline_file + "." + std::to_string(_comm.rank()) + ".json", _comm.rank());
+    };
+    phase.emplace("Delta and h_loc");
+
     // determine basis of operators to use
     fundamental_operator_set fops;
     for (auto const &bl : gf_struct) {
@@ -136,7 +199,12 @@ namespace triqs_cthyb {
 
     // ==== Compute h_loc ====
 
-    _h_loc = params.h_int;
+    // With replica_h_int_scalings, the process runs the replica of its scaling of h_int
+    replica_exchange replicas(_comm, params);
+    _h_loc = (replicas.h_int_scaling() == 1 ? params.h_int : replicas.h_int_scaling() * params.h_int);
+    // the processes of the replicas have different h_loc, while atom_diag_cache_file holds one diagonalization for all
+    if (replicas.is_enabled() && !params.atom_diag_cache_file.empty())
+      TRIQS_RUNTIME_ERROR << "replica_h_int_scalings is incompatible with atom_diag_cache_file";
 
     // Do I have imaginary components in my local Hamiltonian?
     auto max_imag = 0.0;
@@ -193,29 +261,77 @@ namespace triqs_cthyb {
     _performance_analysis.clear();
     histo_map_t *histo_map = params.performance_analysis ? &_performance_analysis : nullptr;
 
-    // Determine block structure
-    if (params.partition_method == "autopartition") {
-      if (params.verbosity >= 2)
-        std::cout << "Using autopartition algorithm to partition the local Hilbert space"
-                  << std::endl;
-      if (params.loc_n_min == 0 && params.loc_n_max == INT_MAX)
-        h_diag = {_h_loc, fops};
-      else {
+    phase.emplace("diagonalization of h_loc");
+
+    // The diagonalization of the local problem is only redone when the problem changes: it is identified by
+    // a canonical description of h_loc (round-trip precision), the partition method and its parameters, and the block structure.
+    // It is kept in memory by the solver, and in atom_diag_cache_file if given.
+    std::ostringstream h_diag_key_os;
+    h_diag_key_os << std::setprecision(17) << _h_loc << "|" << params.partition_method << "|" << params.loc_n_min << "|" << params.loc_n_max;
+    for (auto const &qn : params.quantum_numbers) h_diag_key_os << "|" << qn;
+    for (auto const &bl : gf_struct) h_diag_key_os << "|" << bl.first << ":" << bl.second.size();
+    std::string h_diag_key = h_diag_key_os.str();
+
+    // The decision is collective, as the diagonalization is followed by a barrier with atom_diag_cache_file:
+    // the key of the file is read and compared by the first process only.
+    int h_diag_cached = (h_diag_key == _h_diag_key);
+    MPI_Allreduce(MPI_IN_PLACE, &h_diag_cached, 1, MPI_INT, MPI_MIN, _comm.get());
+    if (!h_diag_cached && !params.atom_diag_cache_file.empty()) {
+      int file_matches = 0;
+      if ((_comm.rank() == 0) && std::ifstream(params.atom_diag_cache_file).good()) {
+        triqs::h5::file f(params.atom_diag_cache_file, H5F_ACC_RDONLY);
+        triqs::h5::group gr(f);
+        std::string key;
+        h5_read(gr, "key", key);
+        file_matches = (key == h_diag_key);
+      }
+      MPI_Bcast(&file_matches, 1, MPI_INT, 0, _comm.get());
+      if (file_matches) {
+        triqs::h5::file f(params.atom_diag_cache_file, H5F_ACC_RDONLY);
+        triqs::h5::group gr(f);
+        h5_read(gr, "atom_diag", h_diag);
+        h_diag_cached = true;
+      }
+    }
+
+    if (h_diag_cached) {
+      if (params.verbosity >= 2) std::cout << "Reusing the diagonalization of the local Hamiltonian" << std::endl;
+    } else {
+      // Determine block structure
+      if (params.partition_method == "autopartition") {
         if (params.verbosity >= 2)
-          std::cout << "Restricting the local Hilbert space to states with [" << params.loc_n_min
-                    << ";" << params.loc_n_max << "] particles" << std::endl;
-        h_diag = {_h_loc, fops, params.loc_n_min, params.loc_n_max};
+          std::cout << "Using autopartition algorithm to partition the local Hilbert space"
+                    << std::endl;
+        if (params.loc_n_min == 0 && params.loc_n_max == INT_MAX)
+          h_diag = {_h_loc, fops};
+        else {
+          if (params.verbosity >= 2)
+            std::cout << "Restricting the local Hilbert space to states with [" << params.loc_n_min
+                      << ";" << params.loc_n_max << "] particles" << std::endl;
+          h_diag = {_h_loc, fops, params.loc_n_min, params.loc_n_max};
+        }
+      } else if (params.partition_method == "quantum_numbers") {
+        if (params.quantum_numbers.empty()) TRIQS_RUNTIME_ERROR << "No quantum numbers provided.";
+        if (params.verbosity >= 2)
+          std::cout << "Using quantum numbers to partition the local Hilbert space" << std::endl;
+        h_diag = {_h_loc, fops, params.quantum_numbers};
+      } else if (params.partition_method == "none") { // give empty quantum numbers list
+        std::cout << "Not partitioning the local Hilbert space" << std::endl;
+        h_diag = {_h_loc, fops, std::vector<many_body_op_t>{}};
+      } else
+        TRIQS_RUNTIME_ERROR << "Partition method " << params.partition_method << " not recognised.";
+
+      if (!params.atom_diag_cache_file.empty()) {
+        _comm.barrier(); // all the processes are done reading the file
+        if (_comm.rank() == 0) {
+          triqs::h5::file f(params.atom_diag_cache_file, H5F_ACC_TRUNC);
+          triqs::h5::group gr(f);
+          h5_write(gr, "key", h_diag_key);
+          h5_write(gr, "atom_diag", h_diag);
+        }
       }
-    } else if (params.partition_method == "quantum_numbers") {
-      if (params.quantum_numbers.empty()) TRIQS_RUNTIME_ERROR << "No quantum numbers provided.";
-      if (params.verbosity >= 2)
-        std::cout << "Using quantum numbers to partition the local Hilbert space" << std::endl;
-      h_diag = {_h_loc, fops, params.quantum_numbers};
-    } else if (params.partition_method == "none") { // give empty quantum numbers list
-      std::cout << "Not partitioning the local Hilbert space" << std::endl;
-      h_diag = {_h_loc, fops, std::vector<many_body_op_t>{}};
-    } else
-      TRIQS_RUNTIME_ERROR << "Partition method " << params.partition_method << " not recognised.";
+    }
+    _h_diag_key = h_diag_key;
 
     // FIXME save h_loc to be able to rebuild h_diag in an analysis program.
     //if (_comm.rank() ==0) h5_write(h5::file("h_loc.h5",'w'), "h_loc", _h_loc, fops);
@@ -225,26 +341,139 @@ namespace triqs_cthyb {
 
     if (params.performance_analysis) std::ofstream("impurity_blocks.dat") << h_diag;
 
+    // Fail before the allocations if the estimated memory exceeds the budget
+    if (params.max_memory > 0) {
+      auto estimate   = estimate_memory(params);
+      double total_mb = estimate["total"] / (1 << 20);
+      if (total_mb > params.max_memory) {
+        std::vector<std::pair<double, std::string>> items;
+        for (auto const &[name, bytes] : estimate)
+          if (name != "total") items.emplace_back(bytes, name);
+        std::sort(items.rbegin(), items.rend());
+        std::ostringstream largest;
+        for (int i = 0; i < std::min<int>(3, items.size()); ++i) largest << " " << items[i].second << " (" << items[i].first / (1 << 20) << " MiB)";
+        TRIQS_RUNTIME_ERROR << "The estimated memory per process, " << total_mb << " MiB, exceeds max_memory = " << params.max_memory << " MiB.\n"
+                            << "Largest items:" << largest.str() << ".\n"
+                            << "Cheaper settings: fewer measure_G2_blocks or G2 frequencies, "
+                               "n_walkers = 1, delta_node_shared_memory = True.";
+      }
+    }
+
     // If one is interested only in the atomic problem
     if (params.n_warmup_cycles == 0 && params.n_cycles == 0) {
       if (params.measure_density_matrix) _density_matrix = atomic_density_matrix(h_diag, beta);
+      write_timeline();
       return;
     }
 
     // Initialise Monte Carlo quantities
-    qmc_data data(beta, params, h_diag, linindex, _Delta_tau, n_inner, histo_map);
-    auto qmc =
-       mc_tools::mc_generic<mc_weight_t>(params.random_name, params.random_seed, params.verbosity);
+    phase.emplace("setup of the Markov chain");
+    if (params.n_walkers < 1) TRIQS_RUNTIME_ERROR << "n_walkers must be >= 1";
+    // Whatever the verbosity: a value set by the user is dropped
+    if (_comm.rank() == 0) {
+      if (!params.nfft_buf_sizes.empty())
+        std::cerr << "WARNING: nfft_buf_sizes is deprecated and ignored: the batched NFFT needs no buffer" << std::endl;
+      if (params.measure_G2_iwll_nfft_buf_size != 100)
+        std::cerr << "WARNING: measure_G2_iwll_nfft_buf_size is deprecated and ignored: the batched NFFT needs no buffer" << std::endl;
+    }
+    auto G2_reduction = make_reduction_mode(params.measure_G2_reduction);
+    if (!params.measure_G2_stream_file.empty() && G2_reduction != reduction_mode::root)
+      TRIQS_RUNTIME_ERROR << "measure_G2_stream_file requires measure_G2_reduction = root";
+    _G2_stream_file.clear();
+    if (params.n_walkers > 1 && params.performance_analysis) TRIQS_RUNTIME_ERROR << "performance_analysis requires n_walkers = 1";
+    if (params.n_walkers > 1 && params.balanced_accumulation) TRIQS_RUNTIME_ERROR << "balanced_accumulation requires n_walkers = 1";
+    if (params.n_walkers > 1 && params.trace_prune_tolerance > 0) TRIQS_RUNTIME_ERROR << "trace_prune_tolerance requires n_walkers = 1";
+    if (params.trace_parallel_blocks > 1 && params.trace_single_precision_tol > 0)
+      TRIQS_RUNTIME_ERROR << "trace_single_precision_tol requires trace_parallel_blocks <= 1";
+    if (replicas.is_enabled()) {
+      // the processes of a chain must run the same cycles, in step
+      if (params.n_walkers > 1) TRIQS_RUNTIME_ERROR << "replica_h_int_scalings requires n_walkers = 1";
+      if (params.balanced_accumulation) TRIQS_RUNTIME_ERROR << "replica_h_int_scalings is incompatible with balanced_accumulation";
+      if (params.adaptive_warmup) TRIQS_RUNTIME_ERROR << "replica_h_int_scalings is incompatible with adaptive_warmup";
+      if (params.max_time >= 0) TRIQS_RUNTIME_ERROR << "replica_h_int_scalings requires max_time = -1";
+      if (params.measure_autocorrelation) TRIQS_RUNTIME_ERROR << "replica_h_int_scalings is incompatible with measure_autocorrelation";
+    }
+#ifdef SAVE_CONFIGS
+    // The problem, for the replay of the saved configurations (benchmark/cpp/cthyb_replay)
+    if (params.n_walkers > 1) TRIQS_RUNTIME_ERROR << "SAVE_CONFIGS requires n_walkers = 1";
+    {
+      triqs::h5::file f(configuration::configs_file_name(), H5F_ACC_TRUNC);
+      h5_write(f, "constr_parameters", constr_parameters);
+      h5_write(f, "solve_parameters", params);
+      h5_write(f, "h_diag", h_diag);
+      h5_write(f, "Delta_tau", _Delta_tau);
+    }
+#endif
+    // The tables of Delta, in memory shared by the processes of each node if requested
+    qmc_data::delta_tables_t delta_tables;
+    if (params.delta_node_shared_memory)
+      delta_tables = qmc_data::make_delta_tables(_Delta_tau, params, [this](std::size_t n, auto const &fill) {
+        return make_node_shared_array<det_scalar_t>(_comm, n, fill);
+      });
+
+    // Placement of the walkers after the first on the cores of the process, spread over its NUMA nodes, and shared with the
+    // processes of the node which run on the same cores. The main walker runs on the main thread, which is not pinned:
+    // it keeps the whole affinity of the process for its OpenMP threads. With a single walker, nothing is placed.
+    auto placement = make_walker_placement(params.walker_placement);
+    if (params.n_walkers == 1) placement = walker_placement_t::none;
+    auto topology     = cpu_topology();
+    auto walker_cores = topology.spread(); // (cpu, node)
+    int first_core    = 0;
+    if (placement != walker_placement_t::none) {
+      first_core = first_walker_core(_comm, topology, params.n_walkers);
+      if (first_core < 0) {
+        if (params.verbosity >= 2)
+          std::cerr << "WARNING: the cores of rank " << _comm.rank() << " overlap with those of other processes of its node: walkers not pinned" << std::endl;
+        placement = walker_placement_t::none;
+      }
+    }
+    if (walker_cores.empty()) placement = walker_placement_t::none;
+    auto core_of = [&walker_cores, &first_core](int w) { return walker_cores[(first_core + w) % walker_cores.size()]; };
+    if ((placement != walker_placement_t::none) && (int(walker_cores.size()) < first_core + params.n_walkers) && (params.verbosity >= 2))
+      std::cerr << "WARNING: " << params.n_walkers << " walkers from core " << first_core << " of " << walker_cores.size() << ", on rank "
+                << _comm.rank() << std::endl;
+    // f, on a thread of the core of the walker w (sequentially): the memory it allocates is first touched on the node of the walker
+    auto on_walker_core = [&](int w, auto const &f) {
+      if (placement == walker_placement_t::none) return f();
+      std::exception_ptr error;
+      std::thread([&] {
+        try {
+          pin_this_thread(core_of(w).first);
+          f();
+        } catch (...) { error = std::current_exception(); }
+      }).join();
+      if (error) std::rethrow_exception(error);
+    };
+
+    auto data_ptr = std::make_unique<qmc_data>(beta, params, h_diag, linindex, _Delta_tau, n_inner, histo_map, delta_tables);
+
+    // Warm start from the last configuration of this process, found in configuration_file or kept from the previous solve
+    std::string configuration_file = (params.configuration_file.empty() ? "" : params.configuration_file + "." + std::to_string(_comm.rank()) + ".h5");
+    bool warm_started = false;
+    if (params.warm_start) {
+      configuration_record_t record = _last_configuration;
+      if (!configuration_file.empty() && std::ifstream(configuration_file).good()) {
+        triqs::h5::file f(configuration_file, H5F_ACC_RDONLY);
+        h5_read(triqs::h5::group(f), "configuration", record);
+      }
+      if (record.size() > 0) {
+        warm_started = data_ptr->load_configuration(record, params);
+        if (!warm_started) {
+          if (params.verbosity >= 2) std::cout << "Warm start: the previous configuration does not fit, starting from the empty one" << std::endl;
+          data_ptr = std::make_unique<qmc_data>(beta, params, h_diag, linindex, _Delta_tau, n_inner, histo_map, delta_tables);
+        } else if (params.verbosity >= 3)
+          std::cout << "Warm start from a configuration of " << record.size() << " operators" << std::endl;
+      }
+    }
+    int n_warmup_cycles = ((warm_started && params.n_warmup_cycles_warm_start >= 0) ? params.n_warmup_cycles_warm_start : params.n_warmup_cycles);
+    qmc_data &data = *data_ptr;
+    using qmc_type = mc_tools::mc_generic<mc_weight_t>;
 
     // --------------------------------------------------------------------------
     // Moves
     // --------------------------------------------------------------------------
 
-    using move_set_type = mc_tools::move_set<mc_weight_t>;
-    move_set_type inserts(qmc.get_rng());
-    move_set_type removes(qmc.get_rng());
-    move_set_type double_inserts(qmc.get_rng());
-    move_set_type double_removes(qmc.get_rng());
+    if (params.move_insert_n_tries < 1) TRIQS_RUNTIME_ERROR << "move_insert_n_tries must be >= 1";
 
     auto &delta_names  = _Delta_tau.block_names();
     auto get_prob_prop = [&params](std::string const &block_name) {
@@ -252,49 +481,232 @@ namespace triqs_cthyb {
       return (f != params.proposal_prob.end() ? f->second : 1.0);
     };
 
-    for (size_t block = 0; block < _Delta_tau.size(); ++block) {
-      int block_size         = _Delta_tau[block].data().shape()[1];
-      auto const &block_name = delta_names[block];
-      double prop_prob       = get_prob_prop(block_name);
-      inserts.add(move_insert_c_cdag(block, block_size, block_name, data, qmc.get_rng(), histo_map),
-                  "Insert Delta_" + block_name, prop_prob);
-      removes.add(move_remove_c_cdag(block, block_size, block_name, data, qmc.get_rng(), histo_map),
-                  "Remove Delta_" + block_name, prop_prob);
+    // Weights of the moves. A move and its reverse must have the same weight.
+    struct move_weights_t {
+      std::vector<double> block; // proposal probability of the insertions/removals in each block
+      double pairs = 1, double_pairs = 1, shift = 1, global = 1;
+    } weights;
+    for (size_t block = 0; block < _Delta_tau.size(); ++block) weights.block.push_back(get_prob_prop(delta_names[block]));
+    weights.global = params.move_global_prob;
+    auto shift_window = std::make_shared<shift_window_t>(shift_window_t{beta});
+
+    // Performance counters of a walker, only recorded with performance_counters_enabled
+    struct walker_counters_t {
+      std::map<std::string, std::shared_ptr<move_statistics_t>> moves; // by name of the move
+      performance_counters_t measures;                                 // "measures/<name>/accumulations" and ".../time"
+      long n_accepted = 0;                                             // accepted moves, for the progress lines
+    };
+
+    // Statistics of the moves during the warmup, with the same grouping as the weights (nullptr: not recorded)
+    struct move_stats_t {
+      std::vector<std::shared_ptr<move_statistics_t>> block;
+      std::shared_ptr<move_statistics_t> double_pairs, shift, global;
+    };
+
+    auto add_moves = [&](qmc_type &qmc, qmc_data &data, move_stats_t const &stats, walker_counters_t &counters) {
+      using move_set_type = mc_tools::move_set<mc_weight_t>;
+      move_set_type inserts(qmc.get_rng());
+      move_set_type removes(qmc.get_rng());
+      move_set_type double_inserts(qmc.get_rng());
+      move_set_type double_removes(qmc.get_rng());
+      // the move with the statistics s, and counted under its name. The deferred measures are accumulated before its acceptance.
+      auto with_stats = [&counters, &data](auto move, std::shared_ptr<move_statistics_t> const &s, std::string const &name) {
+        using stats_t = move_with_statistics<decltype(move)>;
+        auto m        = move_counting_accepts<stats_t>(stats_t(std::move(move), s), &counters.n_accepted);
+        if constexpr (performance_counters_enabled) {
+          auto &c = counters.moves[name];
+          if (!c) c = std::make_shared<move_statistics_t>();
+          using counted_t = move_with_statistics<decltype(m)>;
+          using timed_t   = move_in_timeline<counted_t>;
+          return move_flushing_measures<timed_t>(timed_t(counted_t(std::move(m), c), name), data);
+        } else {
+          using timed_t = move_in_timeline<decltype(m)>;
+          return move_flushing_measures<timed_t>(timed_t(std::move(m), name), data);
+        }
+      };
+      auto block_stats = [&stats](size_t block) { return (stats.block.empty() ? nullptr : stats.block[block]); };
+
+      for (size_t block = 0; block < _Delta_tau.size(); ++block) {
+        int block_size         = _Delta_tau[block].data().shape()[1];
+        auto const &block_name = delta_names[block];
+        double prop_prob       = weights.block[block];
+        inserts.add(with_stats(move_insert_c_cdag(block, block_size, block_name, data, qmc.get_rng(), histo_map, params.move_insert_n_tries),
+                               block_stats(block), "Insert Delta_" + block_name),
+                    "Insert Delta_" + block_name, prop_prob);
+        removes.add(with_stats(move_remove_c_cdag(block, block_size, block_name, data, qmc.get_rng(), histo_map, params.move_insert_n_tries),
+                               block_stats(block), "Remove Delta_" + block_name),
+                    "Remove Delta_" + block_name, prop_prob);
+        if (params.move_double) {
+          for (size_t block2 = 0; block2 < _Delta_tau.size(); ++block2) {
+            int block_size2         = _Delta_tau[block2].data().shape()[1];
+            auto const &block_name2 = delta_names[block2];
+            double prop_prob2       = weights.block[block2];
+            double_inserts.add(
+               with_stats(move_insert_c_c_cdag_cdag(block, block2, block_size, block_size2, block_name,
+                                                    block_name2, data, qmc.get_rng(), histo_map),
+                          stats.double_pairs, "Insert Delta_" + block_name + "_" + block_name2),
+               "Insert Delta_" + block_name + "_" + block_name2, prop_prob * prop_prob2);
+            double_removes.add(
+               with_stats(move_remove_c_c_cdag_cdag(block, block2, block_size, block_size2, block_name,
+                                                    block_name2, data, qmc.get_rng(), histo_map),
+                          stats.double_pairs, "Remove Delta_" + block_name + "_" + block_name2),
+               "Remove Delta_" + block_name + "_" + block_name2, prop_prob * prop_prob2);
+          }
+        }
+      }
+
+      qmc.add_move(std::move(inserts), "Insert two operators", weights.pairs);
+      qmc.add_move(std::move(removes), "Remove two operators", weights.pairs);
       if (params.move_double) {
-        for (size_t block2 = 0; block2 < _Delta_tau.size(); ++block2) {
-          int block_size2         = _Delta_tau[block2].data().shape()[1];
-          auto const &block_name2 = delta_names[block2];
-          double prop_prob2       = get_prob_prop(block_name2);
-          double_inserts.add(
-             move_insert_c_c_cdag_cdag(block, block2, block_size, block_size2, block_name,
-                                       block_name2, data, qmc.get_rng(), histo_map),
-             "Insert Delta_" + block_name + "_" + block_name2, prop_prob * prop_prob2);
-          double_removes.add(
-             move_remove_c_c_cdag_cdag(block, block2, block_size, block_size2, block_name,
-                                       block_name2, data, qmc.get_rng(), histo_map),
-             "Remove Delta_" + block_name + "_" + block_name2, prop_prob * prop_prob2);
+        qmc.add_move(std::move(double_inserts), "Insert four operators", weights.double_pairs);
+        qmc.add_move(std::move(double_removes), "Remove four operators", weights.double_pairs);
+      }
+
+      if (params.move_shift)
+        qmc.add_move(with_stats(move_shift_operator(data, qmc.get_rng(), histo_map, (params.adaptive_warmup ? shift_window : nullptr)), stats.shift, "Shift one operator"),
+                     "Shift one operator", weights.shift);
+
+      if (params.move_global.size()) {
+        move_set_type global(qmc.get_rng());
+        for (auto const &mv : params.move_global) {
+          auto const &name          = mv.first;
+          auto const &substitutions = mv.second;
+          global.add(with_stats(move_global(name, substitutions, data, qmc.get_rng()), stats.global, name), name, 1.0);
         }
+        qmc.add_move(std::move(global), "Global moves", weights.global);
       }
-    }
+    };
+
+    auto stop_callback = triqs::utility::clock_callback(params.max_time);
+    int random_seed    = params.random_seed;
+
+    // Adaptive warmup: the warmup runs on its own, with the moves recording their statistics.
+    // The weights are then tuned for the accumulation, and frozen, which keeps the detailed balance.
+    // Pruning of the trace: the warmup runs on its own, with the trace recording the weights of the atomic subspaces.
+    // Those below trace_prune_tolerance are then dropped for the accumulation.
+    bool adaptive_warmup = params.adaptive_warmup && (n_warmup_cycles > 0);
+    bool prune_trace     = (params.trace_prune_tolerance > 0) && (n_warmup_cycles > 0);
+    bool separate_warmup = adaptive_warmup || prune_trace;
+    // The accumulation runs on another mc_generic, whose sign starts at 1: if the weight of the configuration left by the
+    // warmup (or by the pruning) is not positive, the walker restarts from the empty configuration, and warms up again.
+    bool rewarm = false;
+    walker_counters_t counters;
+    move_stats_t stats;
+    _trace_pruning_error = 0;
+    if (separate_warmup) {
+      if (adaptive_warmup) {
+        auto new_stats = [] { return std::make_shared<move_statistics_t>(); };
+        for (size_t block = 0; block < _Delta_tau.size(); ++block) stats.block.push_back(new_stats());
+        stats.double_pairs  = new_stats();
+        stats.shift         = new_stats();
+        stats.global        = new_stats();
+        shift_window->adapt = true;
+      }
+      data.imp_trace.record_block_weights = prune_trace;
+
+      phase.emplace(adaptive_warmup ? "adaptive warmup" : "warmup");
+      {
+        auto qmc_warmup = qmc_type(params.random_name, random_seed, params.verbosity);
+        add_moves(qmc_warmup, data, stats, counters);
+        qmc_warmup.warmup(n_warmup_cycles, params.length_cycle, stop_callback);
+        random_seed = qmc_warmup.get_rng()(std::numeric_limits<int>::max()); // a new stream for the accumulation
+      }
+      shift_window->adapt                 = false;
+      data.imp_trace.record_block_weights = false;
 
-    qmc.add_move(std::move(inserts), "Insert two operators", 1.0);
-    qmc.add_move(std::move(removes), "Remove two operators", 1.0);
-    if (params.move_double) {
-      qmc.add_move(std::move(double_inserts), "Insert four operators", 1.0);
-      qmc.add_move(std::move(double_removes), "Remove four operators", 1.0);
+      if (prune_trace) {
+        int n_blocks_before  = data.imp_trace.n_blocks_kept();
+        _trace_pruning_error = data.prune_trace_blocks(params.trace_prune_tolerance);
+        if (params.verbosity >= 2)
+          std::cout << "Pruning of the trace: keeping " << data.imp_trace.n_blocks_kept() << " of " << n_blocks_before
+                    << " subspaces on rank " << _comm.rank() << ", estimated relative error " << _trace_pruning_error << std::endl;
+        MPI_Allreduce(MPI_IN_PLACE, &_trace_pruning_error, 1, MPI_DOUBLE, MPI_MAX, _comm.get());
+      }
+      rewarm = data.restart_if_not_positive(params);
+      if (rewarm && (params.verbosity >= 2))
+        std::cout << "Weight not positive after the warmup on rank " << _comm.rank() << ": warming up again from the empty configuration"
+                  << std::endl;
+      phase.emplace("setup of the Markov chain");
     }
 
-    if (params.move_shift)
-      qmc.add_move(move_shift_operator(data, qmc.get_rng(), histo_map), "Shift one operator", 1.0);
+    if (adaptive_warmup) {
+      // Efficiencies of the groups of moves, compared to their weighted mean
+      move_statistics_t pairs;
+      for (auto const &s : stats.block) pairs += *s;
+      double w_sum = 0, eff_sum = 0;
+      auto add = [&](double w, move_statistics_t const &s) {
+        if (s.n_attempted == 0) return;
+        w_sum += w;
+        eff_sum += w * s.efficiency();
+      };
+      add(2 * weights.pairs, pairs);
+      if (params.move_double) add(2 * weights.double_pairs, *stats.double_pairs);
+      if (params.move_shift) add(weights.shift, *stats.shift);
+      if (params.move_global.size()) add(weights.global, *stats.global);
+      double eff_mean = (w_sum > 0 ? eff_sum / w_sum : 0);
+      auto tune       = [eff_mean](double &w, move_statistics_t const &s) {
+        if (s.n_attempted > 0) w *= efficiency_factor(s.efficiency(), eff_mean);
+      };
+      tune(weights.pairs, pairs);
+      tune(weights.double_pairs, *stats.double_pairs);
+      tune(weights.shift, *stats.shift);
+      tune(weights.global, *stats.global);
 
-    if (params.move_global.size()) {
-      move_set_type global(qmc.get_rng());
-      for (auto const &mv : params.move_global) {
-        auto const &name          = mv.first;
-        auto const &substitutions = mv.second;
-        global.add(move_global(name, substitutions, data, qmc.get_rng()), name, 1.0);
+      // the blocks, compared to the mean of the insertions/removals
+      double block_eff_mean = pairs.efficiency();
+      for (size_t block = 0; block < _Delta_tau.size(); ++block)
+        if (stats.block[block]->n_attempted > 0) weights.block[block] *= efficiency_factor(stats.block[block]->efficiency(), block_eff_mean);
+
+      if (params.verbosity >= 2) {
+        std::cout << "Adaptive warmup: move weights " << weights.pairs << " (insert/remove two operators)";
+        if (params.move_double) std::cout << ", " << weights.double_pairs << " (insert/remove four operators)";
+        if (params.move_shift) std::cout << ", " << weights.shift << " (shift)";
+        if (params.move_global.size()) std::cout << ", " << weights.global << " (global)";
+        std::cout << "\nAdaptive warmup: proposal probabilities of the blocks";
+        for (size_t block = 0; block < _Delta_tau.size(); ++block) std::cout << " " << delta_names[block] << ": " << weights.block[block];
+        if (params.move_shift) std::cout << "\nAdaptive warmup: half-width of the shift window " << shift_window->half_width;
+        std::cout << std::endl;
       }
-      qmc.add_move(std::move(global), "Global moves", params.move_global_prob);
+    }
+
+    auto qmc = qmc_type(params.random_name, random_seed, params.verbosity);
+    add_moves(qmc, data, {}, counters);
+    replicas.set_walker(data, qmc.get_rng());
+
+    // The other walkers: independent Markov chains sharing h_diag and the tables of Delta, seeded from the first one.
+    // The first walker fills the containers and results of the solver, the others their own ones.
+    // With walker_placement, the data of a walker is built on its core, and with numa, on a copy of h_diag made on its node
+    // (except on the node of the main walker).
+    struct walker_t {
+      std::unique_ptr<qmc_data> data;
+      std::unique_ptr<qmc_type> qmc;
+      container_set_t containers;
+      histo_map_t pert_order;
+      histogram pert_order_total;
+      std::vector<matrix_t> density_matrix;
+      mc_weight_t average_sign;
+      std::pair<mc_weight_t, mc_weight_t> sign_totals;
+      int solve_status = 0;
+      std::exception_ptr error;
+      walker_counters_t counters;
+    };
+    std::vector<std::unique_ptr<atom_diag>> h_diag_copies(topology.n_nodes); // by node, outliving the walkers
+    std::vector<std::unique_ptr<walker_t>> walkers;
+    for (int w = 1; w < params.n_walkers; ++w) {
+      int seed = qmc.get_rng()(std::numeric_limits<int>::max());
+      auto walker = std::make_unique<walker_t>();
+      on_walker_core(w, [&] {
+        atom_diag const *hd = &h_diag;
+        int node            = core_of(w).second;
+        if ((placement == walker_placement_t::numa) && (node != core_of(0).second)) {
+          if (!h_diag_copies[node]) h_diag_copies[node] = std::make_unique<atom_diag>(h_diag);
+          hd = h_diag_copies[node].get();
+        }
+        walker->data = std::make_unique<qmc_data>(beta, params, *hd, linindex, _Delta_tau, n_inner, histo_map, data.delta_tables);
+        walker->qmc  = std::make_unique<qmc_type>(params.random_name, seed, 0);
+        add_moves(*walker->qmc, *walker->data, {}, walker->counters);
+      });
+      walkers.push_back(std::move(walker));
     }
 
     // --------------------------------------------------------------------------
@@ -304,110 +716,418 @@ namespace triqs_cthyb {
     // --------------------------------------------------------------------------
     // Two-particle correlators
 
+    // FFTW plans of the NFFT measures, made while the measures are constructed
+    auto &nfft_plans = triqs::experimental::nfft_plan_pool::instance();
+    nfft_plans.set_planner(params.nfft_fftw_planner);
+    if (!params.nfft_fftw_wisdom_file.empty() && !nfft_plans.import_wisdom(params.nfft_fftw_wisdom_file) && params.verbosity >= 2 && _comm.rank() == 0)
+      std::cout << "No FFTW wisdom read from " << params.nfft_fftw_wisdom_file << std::endl;
+
     G2_measures_t G2_measures(_Delta_tau, gf_struct, params);
 
+    // The measures of a walker, into the given containers and results
+    auto add_measures = [&](qmc_type &qmc, qmc_data &data, container_set_t &cs, histo_map_t &pert_order, histogram &pert_order_total,
+                            std::vector<matrix_t> &density_matrix, mc_weight_t &average_sign, std::pair<mc_weight_t, mc_weight_t> *sign_totals,
+                            walker_counters_t &counters, autocorrelation_times_t *autocorrelation_times, snapshot_manager *snapshots) {
+
+      // the measure, in the timeline, and with the number and the time of its accumulations counted under its name
+      auto add_counted_measure = [&](auto &&measure, std::string const &name) {
+        using measure_t = std::decay_t<decltype(measure)>;
+        if constexpr (performance_counters_enabled) {
+          using counted_t = measure_with_timer<measure_t>;
+          qmc.add_measure(measure_in_timeline<counted_t>{counted_t{std::move(measure), &counters.measures["measures/" + name + "/accumulations"],
+                                                                   &counters.measures["measures/" + name + "/time"]},
+                                                         name},
+                          name);
+        } else
+          qmc.add_measure(measure_in_timeline<measure_t>{std::move(measure), name}, name);
+      };
+      // with the replica exchange, the measures only accumulate on the replicas of h_int itself
+      auto add_measure = [&](auto &&measure, std::string const &name) {
+        using measure_t = std::decay_t<decltype(measure)>;
+        if (replicas.is_enabled())
+          add_counted_measure(measure_on_replica<measure_t>{std::move(measure), replicas.measures()}, name);
+        else
+          add_counted_measure(std::move(measure), name);
+      };
+      // the measure, deferred with defer_measures, then given to add (see measure_deferred: the measure must be linear in the sign,
+      // and only read the configuration, the dets and the weights)
+      auto deferred = [&](auto &&measure, auto &&add) {
+        using measure_t = std::decay_t<decltype(measure)>;
+        if (params.defer_measures)
+          add(measure_deferred<measure_t>{std::move(measure), data});
+        else
+          add(std::move(measure));
+      };
+      auto add_deferred_measure = [&](auto &&measure, std::string const &name) {
+        deferred(std::move(measure), [&](auto &&m) { add_measure(std::move(m), name); });
+      };
+      // the measure, with its snapshots in the group snapshot_name if they are taken
+      auto add_measure_with_snapshots = [&](auto &&measure, std::string const &name, std::string const &snapshot_name) {
+        using measure_t = std::decay_t<decltype(measure)>;
+        if (snapshots && snapshots->is_enabled())
+          add_measure(measure_with_snapshots<measure_t>{std::move(measure), *snapshots, snapshot_name}, name);
+        else
+          add_measure(std::move(measure), name);
+      };
+      auto add_deferred_measure_with_snapshots = [&](auto &&measure, std::string const &name, std::string const &snapshot_name) {
+        deferred(std::move(measure), [&](auto &&m) { add_measure_with_snapshots(std::move(m), name, snapshot_name); });
+      };
+
 #ifdef CTHYB_G2_NFFT
-    // Imaginary-time binning
-    if (params.measure_G2_tau)
-      qmc.add_measure(measure_G2_tau{G2_tau, data, G2_measures},
-                      "G2_tau imaginary-time measurement");
-
-    // NFFT Matsubara frequency measures
-
-    if (params.measure_G2_iw_nfft)
-      qmc.add_measure(measure_G2_iw_nfft<G2_channel::AllFermionic>{G2_iw_nfft, data, G2_measures},
-                      "G2_iw nfft fermionic measurement");
-    if (params.measure_G2_iw_pp_nfft)
-      qmc.add_measure(measure_G2_iw_nfft<G2_channel::PP>{G2_iw_pp_nfft, data, G2_measures},
-                      "G2_iw_pp nfft particle-particle measurement");
-    if (params.measure_G2_iw_ph_nfft)
-      qmc.add_measure(measure_G2_iw_nfft<G2_channel::PH>{G2_iw_ph_nfft, data, G2_measures},
-                      "G2_iw_ph nfft particle-hole measurement");
-
-    // Direct Matsubara frequency measurement
-
-    if (params.measure_G2_iw)
-      qmc.add_measure(measure_G2_iw<G2_channel::AllFermionic>{G2_iw, data, G2_measures},
-                      "G2_iw fermionic measurement");
-    if (params.measure_G2_iw_pp)
-      qmc.add_measure(measure_G2_iw<G2_channel::PP>{G2_iw_pp, data, G2_measures},
-                      "G2_iw_pp particle-particle measurement");
-    if (params.measure_G2_iw_ph)
-      qmc.add_measure(measure_G2_iw<G2_channel::PH>{G2_iw_ph, data, G2_measures},
-                      "G2_iw_ph particle-hole measurement");
-
-    // Legendre mixed basis measurements
-    if (params.measure_G2_iwll_pp)
-      qmc.add_measure(measure_G2_iwll<G2_channel::PP>{G2_iwll_pp, data, G2_measures},
-                      "G2_iwll_pp Legendre particle-particle measurement");
-    if (params.measure_G2_iwll_ph)
-      qmc.add_measure(measure_G2_iwll<G2_channel::PH>{G2_iwll_ph, data, G2_measures},
-                      "G2_iwll_ph Legendre particle-hole measurement");
+      // The G2 measures are accumulated every measure_G2_every_n_cycles cycles (and deferred within the cycles they are accumulated)
+      auto add_G2_measure = [&](auto &&measure, std::string const &name) {
+        deferred(std::move(measure), [&](auto &&m) {
+          using measure_t = std::decay_t<decltype(m)>;
+          if (params.measure_G2_every_n_cycles == 1)
+            add_measure(std::move(m), name);
+          else
+            add_measure(measure_every_n_cycles<measure_t>{std::move(m), name, params.measure_G2_every_n_cycles, params.verbosity >= 2}, name);
+        });
+      };
+
+      // Imaginary-time binning
+      if (params.measure_G2_tau)
+        add_G2_measure(measure_G2_tau{cs.G2_tau, data, G2_measures},
+                       "G2_tau imaginary-time measurement");
+
+      // NFFT Matsubara frequency measures
+
+      if (params.measure_G2_iw_nfft)
+        add_G2_measure(measure_G2_iw_nfft<G2_channel::AllFermionic>{cs.G2_iw_nfft, data, G2_measures},
+                       "G2_iw nfft fermionic measurement");
+      if (params.measure_G2_iw_pp_nfft)
+        add_G2_measure(measure_G2_iw_nfft<G2_channel::PP>{cs.G2_iw_pp_nfft, data, G2_measures},
+                       "G2_iw_pp nfft particle-particle measurement");
+      if (params.measure_G2_iw_ph_nfft)
+        add_G2_measure(measure_G2_iw_nfft<G2_channel::PH>{cs.G2_iw_ph_nfft, data, G2_measures},
+                       "G2_iw_ph nfft particle-hole measurement");
+
+      // Direct Matsubara frequency measurement
+
+      if (params.measure_G2_iw)
+        add_G2_measure(measure_G2_iw<G2_channel::AllFermionic>{cs.G2_iw, data, G2_measures},
+                       "G2_iw fermionic measurement");
+      if (params.measure_G2_iw_pp)
+        add_G2_measure(measure_G2_iw<G2_channel::PP>{cs.G2_iw_pp, data, G2_measures},
+                       "G2_iw_pp particle-particle measurement");
+      if (params.measure_G2_iw_ph)
+        add_G2_measure(measure_G2_iw<G2_channel::PH>{cs.G2_iw_ph, data, G2_measures},
+                       "G2_iw_ph particle-hole measurement");
+
+      // Legendre mixed basis measurements
+      if (params.measure_G2_iwll_pp)
+        add_G2_measure(measure_G2_iwll<G2_channel::PP>{cs.G2_iwll_pp, data, G2_measures},
+                       "G2_iwll_pp Legendre particle-particle measurement");
+      if (params.measure_G2_iwll_ph)
+        add_G2_measure(measure_G2_iwll<G2_channel::PH>{cs.G2_iwll_ph, data, G2_measures},
+                       "G2_iwll_ph Legendre particle-hole measurement");
 #endif
 
-    // --------------------------------------------------------------------------
-    // Single-particle correlators
-
-    if (params.measure_O_tau) {
-
-      const auto &[O1, O2] = *params.measure_O_tau;
-      auto comm_0          = O1 * O2 - O2 * O1;
-      auto comm_1          = O1 * _h_loc - _h_loc * O1;
-      auto comm_2          = O2 * _h_loc - _h_loc * O2;
-
-      if (!comm_0.is_zero() || !comm_1.is_zero() || !comm_2.is_zero()) {
-        if (params.verbosity >= 2) {
-          TRIQS_RUNTIME_ERROR << "Error: measure_O_tau, supplied operators does not commute with "
-                                 "the local Hamiltonian.\n"
-                              << "[O1, O2] = " << comm_0 << "\n"
-                              << "[O1, H_loc] = " << comm_1 << "\n"
-                              << "[O2, H_loc] = " << comm_2 << "\n";
+      // --------------------------------------------------------------------------
+      // Single-particle correlators
+
+      if (params.measure_O_tau) {
+
+        const auto &[O1, O2] = *params.measure_O_tau;
+        auto comm_0          = O1 * O2 - O2 * O1;
+        auto comm_1          = O1 * _h_loc - _h_loc * O1;
+        auto comm_2          = O2 * _h_loc - _h_loc * O2;
+
+        if (!comm_0.is_zero() || !comm_1.is_zero() || !comm_2.is_zero()) {
+          if (params.verbosity >= 2) {
+            TRIQS_RUNTIME_ERROR << "Error: measure_O_tau, supplied operators does not commute with "
+                                   "the local Hamiltonian.\n"
+                                << "[O1, O2] = " << comm_0 << "\n"
+                                << "[O1, H_loc] = " << comm_1 << "\n"
+                                << "[O2, H_loc] = " << comm_2 << "\n";
+          }
         }
+        add_measure(
+           measure_O_tau_ins{cs.O_tau, data, n_tau, O1, O2, params.measure_O_tau_min_ins, params.measure_O_tau_sweep, qmc.get_rng()},
+           "O_tau insertion measure");
       }
-      qmc.add_measure(
-         measure_O_tau_ins{O_tau, data, n_tau, O1, O2, params.measure_O_tau_min_ins, qmc.get_rng()},
-         "O_tau insertion measure");
-    }
 
-    if (params.measure_G_tau) {
-      G_tau = block_gf<imtime>{{beta, Fermion, n_tau}, gf_struct};
-      qmc.add_measure(measure_G_tau{G_tau_accum, data, n_tau, gf_struct}, "G_tau measure");
-    }
+      if (params.measure_G_tau) {
+        cs.G_tau = block_gf<imtime>{{beta, Fermion, n_tau}, gf_struct};
+        add_deferred_measure_with_snapshots(measure_G_tau{cs.G_tau_accum, data, n_tau, gf_struct}, "G_tau measure", "G_tau");
+      }
 
-    if (params.measure_G_l) qmc.add_measure(measure_G_l{G_l, data, n_l, gf_struct}, "G_l measure");
+      if (params.measure_G_l) add_deferred_measure_with_snapshots(measure_G_l{cs.G_l, data, n_l, gf_struct}, "G_l measure", "G_l");
 
-    // Other measurements
-    if (params.measure_pert_order) {
-      auto &g_names = _Delta_tau.block_names();
-      for (size_t block = 0; block < _Delta_tau.size(); ++block) {
-        auto const &block_name = g_names[block];
-        qmc.add_measure(measure_perturbation_hist(block, data, _pert_order[block_name]),
-                        "Perturbation order (" + block_name + ")");
+      if (params.measure_G_iw_nfft)
+        add_deferred_measure(measure_G_iw_nfft{cs.G_iw_nfft, data, params.measure_G_iw_nfft_n_iw > 0 ? params.measure_G_iw_nfft_n_iw : n_iw, gf_struct},
+                             "G_iw nfft measure");
+
+      // Other measurements
+      if (params.measure_pert_order) {
+        auto &g_names = _Delta_tau.block_names();
+        for (size_t block = 0; block < _Delta_tau.size(); ++block) {
+          auto const &block_name = g_names[block];
+          add_measure(measure_perturbation_hist(block, data, pert_order[block_name]),
+                          "Perturbation order (" + block_name + ")");
+        }
+        add_measure(measure_perturbation_hist_total(data, pert_order_total),
+                        "Perturbation order");
       }
-      qmc.add_measure(measure_perturbation_hist_total(data, _pert_order_total),
-                      "Perturbation order");
-    }
-    if (params.measure_density_matrix) {
-      if (!params.use_norm_as_weight)
-        TRIQS_RUNTIME_ERROR << "To measure the density_matrix of atomic states, you need to set "
-                               "use_norm_as_weight to True, i.e. to reweight the QMC";
-      qmc.add_measure(measure_density_matrix{data, _density_matrix},
-                      "Density Matrix for local static observable");
+      if (params.measure_density_matrix) {
+        if (!params.use_norm_as_weight)
+          TRIQS_RUNTIME_ERROR << "To measure the density_matrix of atomic states, you need to set "
+                                 "use_norm_as_weight to True, i.e. to reweight the QMC";
+        add_measure_with_snapshots(measure_density_matrix{data, density_matrix}, "Density Matrix for local static observable",
+                                   "density_matrix");
+      }
+
+      add_measure_with_snapshots(measure_average_sign{data, average_sign, sign_totals}, "Average sign", "average_sign");
+
+      if (params.measure_autocorrelation && autocorrelation_times)
+        add_measure(measure_autocorrelation{data, *autocorrelation_times, params.measure_autocorrelation_n_l,
+                                            std::vector<std::string>(delta_names.begin(), delta_names.end())},
+                    "Autocorrelation");
+    };
+
+    std::pair<mc_weight_t, mc_weight_t> sign_totals;
+    // The autocorrelation is measured, and the snapshots are taken, on the walker of the main thread only.
+    // The snapshots are not taken during the warmup, where there is nothing accumulated.
+    _autocorrelation_times.clear();
+    long n_main_warmup = (((separate_warmup && !rewarm) || params.balanced_accumulation) ? 0 : n_warmup_cycles);
+    snapshot_manager snapshots(_comm, params.snapshot_file, params.snapshot_interval, 10, n_main_warmup);
+    add_measures(qmc, data, container_set(), _pert_order, _pert_order_total, _density_matrix, _average_sign, &sign_totals, counters,
+                 &_autocorrelation_times, &snapshots);
+    for (int i = 0; i < int(walkers.size()); ++i) { // the accumulators of the walker on its core
+      auto *w = walkers[i].get();
+      on_walker_core(i + 1, [&] {
+        add_measures(*w->qmc, *w->data, w->containers, w->pert_order, w->pert_order_total, w->density_matrix, w->average_sign, &w->sign_totals,
+                     w->counters, nullptr, nullptr);
+      });
     }
 
-    qmc.add_measure(measure_average_sign{data, _average_sign}, "Average sign");
+    if (!params.nfft_fftw_wisdom_file.empty() && _comm.rank() == 0) nfft_plans.export_wisdom(params.nfft_fftw_wisdom_file);
 
     // --------------------------------------------------------------------------
 
     // Run! The empty (starting) configuration has sign = 1
-    _solve_status =
-       qmc.warmup_and_accumulate(params.n_warmup_cycles, params.n_cycles, params.length_cycle,
-                                 triqs::utility::clock_callback(params.max_time));
+    phase.emplace((separate_warmup && !rewarm) ? "accumulation" : "warmup and accumulation");
+    // The other walkers run in threads, each with its own warmup.
+    std::vector<std::thread> threads;
+    // The progress of the walker of this thread. For the balanced accumulation, the warmup is not reported.
+    progress_reporter progress(params.progress_file, params.progress_interval, _comm, data, &counters.n_accepted,
+                               std::vector<std::string>(delta_names.begin(), delta_names.end()), n_main_warmup, params.n_cycles);
+    // The stop callback of the main walker, with the progress lines, the snapshots and the swaps of the replicas
+    auto main_callback = [&](std::function<bool()> stop) {
+      return progress.callback(snapshots.callback(replicas.callback(std::move(stop))));
+    };
+    for (int i = 0; i < int(walkers.size()); ++i)
+      threads.emplace_back([&params, &stop_callback, w = walkers[i].get(), cpu = (placement == walker_placement_t::none ? -1 : core_of(i + 1).first)] {
+        if (cpu >= 0) {
+          pin_this_thread(cpu);
+#ifdef _OPENMP
+          omp_set_num_threads(1); // its OpenMP threads would share its core
+#endif
+        }
+        try {
+          // the full warmup, not n_warmup_cycles: only the main walker is warm started, the others start from the empty configuration
+          w->solve_status = w->qmc->warmup_and_accumulate(params.n_warmup_cycles, params.n_cycles, params.length_cycle, stop_callback);
+        } catch (...) { w->error = std::current_exception(); }
+      });
+    std::exception_ptr error;
+    try {
+      if (params.balanced_accumulation) {
+        // The processes accumulate until they did n_cycles * size cycles together
+        if (!separate_warmup || rewarm) qmc.warmup(n_warmup_cycles, params.length_cycle, stop_callback);
+        balanced_stop_callback balanced_stop{_comm, long(params.n_cycles) * _comm.size(), params.balanced_check_interval, stop_callback};
+        _solve_status = qmc.accumulate(std::numeric_limits<int>::max(), params.length_cycle, main_callback(balanced_stop));
+        if (balanced_stop.target_reached()) _solve_status = 0;
+        if (params.verbosity >= 2)
+          std::cout << "Balanced accumulation: " << balanced_stop.n_cycles_done() << " cycles on rank " << _comm.rank() << std::endl;
+      } else if (separate_warmup && !rewarm)
+        _solve_status = qmc.accumulate(params.n_cycles, params.length_cycle, main_callback(stop_callback));
+      else
+        _solve_status = qmc.warmup_and_accumulate(n_warmup_cycles, params.n_cycles, params.length_cycle, main_callback(stop_callback));
+    } catch (...) { error = std::current_exception(); }
+    for (auto &t : threads) t.join();
+    if (error) std::rethrow_exception(error);
+    for (auto &w : walkers)
+      if (w->error) std::rethrow_exception(w->error);
+    snapshots.finish();
+    progress.write_summary(_comm);
+    if (replicas.is_enabled() && params.verbosity >= 2)
+      std::cout << "Replica exchange: " << replicas.n_accepted() << " of " << replicas.n_proposed() << " swaps accepted on rank " << _comm.rank()
+                << " (h_int scaled by " << replicas.h_int_scaling() << ")" << std::endl;
+
+    // The final configuration, for a warm start of the next solve
+    _last_configuration = make_configuration_record(data.config);
+    if (!configuration_file.empty()) {
+      triqs::h5::file f(configuration_file, H5F_ACC_TRUNC);
+      h5_write(triqs::h5::group(f), "configuration", _last_configuration);
+    }
+
+    phase.emplace("collection of the results");
+
+    // The performance counters of all walkers, summed over the processes
+    if constexpr (performance_counters_enabled) {
+      performance_counters_t r;
+      auto add_walker = [&r, &delta_names](walker_counters_t const &c, qmc_data const &d) {
+        for (auto const &[name, s] : c.moves) {
+          auto prefix = "moves/" + name;
+          r[prefix + "/attempts"] += s->n_attempted;
+          r[prefix + "/accepts"] += s->n_accepted;
+          r[prefix + "/time_attempt"] += s->time_attempt;
+          r[prefix + "/time_accept"] += s->time_accept;
+          r[prefix + "/time_reject"] += s->time_reject;
+        }
+        for (auto const &[name, x] : c.measures) r[name] += x;
+        d.imp_trace.get_counters().add_to(r, "trace/compute");
+        // the intervals of the adaptive checks of the dets at the end, summed over the walkers
+        for (size_t b = 0; b < d.det_checks.size(); ++b) {
+          auto const &dc = d.det_checks[b];
+          auto prefix    = "dets/" + delta_names[b];
+          r[prefix + "/walkers"] += 1;
+          r[prefix + "/check_interval"] += dc.interval;
+          r[prefix + "/checks"] += dc.n_checks;
+          r[prefix + "/regenerations"] += dc.n_regenerations;
+        }
+      };
+      add_walker(counters, data);
+      for (auto &w : walkers) add_walker(w->counters, *w->data);
+      if (replicas.is_enabled()) {
+        r["replica_exchange/proposed"] += replicas.n_proposed();
+        r["replica_exchange/accepted"] += replicas.n_accepted();
+      }
+      _performance_counters = mpi_sum(r, _comm);
+    }
+
+    // The walkers are reduced in the same order on all processes
     qmc.collect_results(_comm);
+    for (auto &w : walkers) w->qmc->collect_results(_comm);
+
+    // Combine the results of the walkers, weighted by their sums of the sign (of the weight for the density matrix, as it is normalized)
+    if (!walkers.empty()) {
+      auto [sign_total, z_total] = sign_totals;
+      for (auto &w : walkers) {
+        double ws = real(w->sign_totals.first), wz = real(w->sign_totals.second);
+        double s0 = real(sign_total), z0 = real(z_total);
+        combine(container_set(), w->containers, s0 / (s0 + ws), ws / (s0 + ws));
+        for (size_t b = 0; b < _density_matrix.size(); ++b) _density_matrix[b] = (z0 * _density_matrix[b] + wz * w->density_matrix[b]) / (z0 + wz);
+        if (params.measure_pert_order) {
+          for (auto &[name, h] : _pert_order) h = h + w->pert_order[name];
+          _pert_order_total = _pert_order_total + w->pert_order_total;
+        }
+        sign_total += w->sign_totals.first;
+        z_total += w->sign_totals.second;
+        _solve_status = std::max(_solve_status, w->solve_status);
+      }
+      _average_sign = sign_total / z_total;
+    }
+
+    // With a reduction to the root only, the G2 containers of the other processes hold partial sums: drop them
+    if (G2_reduction == reduction_mode::root && _comm.rank() != 0) {
+      G2_tau.reset();
+      G2_iw.reset();
+      G2_iw_nfft.reset();
+      G2_iw_pp.reset();
+      G2_iw_pp_nfft.reset();
+      G2_iw_ph.reset();
+      G2_iw_ph_nfft.reset();
+      G2_iwll_pp.reset();
+      G2_iwll_ph.reset();
+    }
+
+    // The G2 measures to file, by the root, one chunk at a time
+    if (!params.measure_G2_stream_file.empty()) {
+      timeline::span _("G2 stream");
+      std::unique_ptr<triqs::h5::file> f;
+      if (_comm.rank() == 0) f = std::make_unique<triqs::h5::file>(params.measure_G2_stream_file, H5F_ACC_TRUNC);
+      auto chunk_bytes = std::size_t(params.mpi_reduction_chunk_mb) << 20;
+      int deflate      = params.measure_G2_stream_deflate;
+      stream_G2(G2_tau, f.get(), "G2_tau", chunk_bytes, deflate);
+      stream_G2(G2_iw, f.get(), "G2_iw", chunk_bytes, deflate);
+      stream_G2(G2_iw_nfft, f.get(), "G2_iw_nfft", chunk_bytes, deflate);
+      stream_G2(G2_iw_pp, f.get(), "G2_iw_pp", chunk_bytes, deflate);
+      stream_G2(G2_iw_pp_nfft, f.get(), "G2_iw_pp_nfft", chunk_bytes, deflate);
+      stream_G2(G2_iw_ph, f.get(), "G2_iw_ph", chunk_bytes, deflate);
+      stream_G2(G2_iw_ph_nfft, f.get(), "G2_iw_ph_nfft", chunk_bytes, deflate);
+      stream_G2(G2_iwll_pp, f.get(), "G2_iwll_pp", chunk_bytes, deflate);
+      stream_G2(G2_iwll_ph, f.get(), "G2_iwll_ph", chunk_bytes, deflate);
+      _G2_stream_file = params.measure_G2_stream_file;
+    }
 
     if (params.verbosity >= 2) std::cout << "Average sign: " << _average_sign << std::endl;
 
     // Copy local (real or complex) G_tau back to complex G_tau
     if (G_tau && G_tau_accum) *G_tau = *G_tau_accum;
+
+    write_timeline();
+  }
+
+  // -------------------------------------------------------------------------------------------
+
+  std::map<std::string, double> solver_core::estimate_memory(solve_parameters_t const &params) const {
+
+    std::map<std::string, double> r;
+    auto add = [&r](std::string const &name, double bytes) {
+      if (bytes > 0) r[name] += bytes;
+    };
+    constexpr double c16 = sizeof(dcomplex);
+    int n_walkers        = std::max(params.n_walkers, 1);
+
+    std::vector<double> block_size;
+    for (auto const &bl : gf_struct) block_size.push_back(bl.second.size());
+    double sum_n2 = 0;
+    for (auto n : block_size) sum_n2 += n * n;
+
+    // Single-particle containers, for each walker
+    if (params.measure_G_tau) add("G_tau", n_walkers * n_tau * sum_n2 * (c16 + sizeof(det_scalar_t)));
+    if (params.measure_G_l) add("G_l", n_walkers * n_l * sum_n2 * (c16 + sizeof(mc_weight_t)));
+    if (params.measure_G_iw_nfft) {
+      int n_iw_nfft = (params.measure_G_iw_nfft_n_iw > 0 ? params.measure_G_iw_nfft_n_iw : n_iw);
+      add("G_iw_nfft", n_walkers * n_iw_nfft * sum_n2 * c16 * 5); // the container and the oversampled grid of the NFFT
+    }
+
+    // Two-particle containers, for each walker: the measured pairs of blocks, the scattering matrices M, and the NFFT grids
+#ifdef CTHYB_G2_NFFT
+    double sum_pairs = 0; // number of orbital components of the measured pairs of blocks
+    for (size_t b1 = 0; b1 < gf_struct.size(); ++b1)
+      for (size_t b2 = 0; b2 < gf_struct.size(); ++b2)
+        if (params.measure_G2_blocks.empty() || params.measure_G2_blocks.count({gf_struct[b1].first, gf_struct[b2].first}))
+          sum_pairs += block_size[b1] * block_size[b1] * block_size[b2] * block_size[b2];
+    double n_f = 2 * params.measure_G2_n_fermionic, n_b = 2 * params.measure_G2_n_bosonic - 1;
+    double n_l2 = params.measure_G2_n_l, n_tau2 = params.measure_G2_n_tau;
+    double n_async = std::max(params.measure_G2_async_threads, 0);
+
+    // G2 with three frequency points of size n_points, with M of size n_M, and its copies for the asynchronous accumulation
+    auto add_G2_iw = [&](std::string const &name, bool measured, double n_points, double n_M, bool nfft) {
+      if (!measured) return;
+      add(name, n_walkers * (1 + n_async) * n_points * sum_pairs * c16);
+      add(name + " M", n_walkers * (1 + 2 * n_async) * n_M * sum_n2 * c16);
+      if (nfft) add(name + " NFFT grids", n_walkers * 4 * n_M * sum_n2 * c16);
+    };
+    add_G2_iw("G2_iw", params.measure_G2_iw, n_f * n_f * n_f, 3 * n_f * n_f, false);
+    add_G2_iw("G2_iw_nfft", params.measure_G2_iw_nfft, n_f * n_f * n_f, 3 * n_f * n_f, true);
+    double n_M_boson = (n_f + n_b + 1) * (n_f + n_b + 1);
+    add_G2_iw("G2_iw_pp", params.measure_G2_iw_pp, n_b * n_f * n_f, n_M_boson, false);
+    add_G2_iw("G2_iw_pp_nfft", params.measure_G2_iw_pp_nfft, n_b * n_f * n_f, n_M_boson, true);
+    add_G2_iw("G2_iw_ph", params.measure_G2_iw_ph, n_b * n_f * n_f, n_M_boson, false);
+    add_G2_iw("G2_iw_ph_nfft", params.measure_G2_iw_ph_nfft, n_b * n_f * n_f, n_M_boson, true);
+    if (params.measure_G2_tau) add("G2_tau", n_walkers * n_tau2 * n_tau2 * n_tau2 * sum_pairs * c16);
+    if (params.measure_G2_iwll_pp) add("G2_iwll_pp", n_walkers * 2 * n_b * n_l2 * n_l2 * sum_pairs * c16); // the container and the NFFT buffers
+    if (params.measure_G2_iwll_ph) add("G2_iwll_ph", n_walkers * 2 * n_b * n_l2 * n_l2 * sum_pairs * c16);
+#endif
+
+    // Work data of each walker, for an expansion order of det_init_size per block
+    double order = params.det_init_size;
+    add("dets", n_walkers * 3 * order * order * block_size.size() * sizeof(det_scalar_t)); // the inverse matrix and its workspaces
+    add("Delta tables", n_tau * sum_n2 * sizeof(det_scalar_t) * (params.delta_interpolation ? 2 : 1) * (params.delta_node_shared_memory ? 0 : 1));
+    if (h_diag.n_subspaces() > 0) { // the diagonalization of the last solve
+      double sum_dim2 = 0;
+      for (int sp = 0; sp < h_diag.n_subspaces(); ++sp) sum_dim2 += double(h_diag.get_subspace_dim(sp)) * h_diag.get_subspace_dim(sp);
+      double n_nodes = 2 * order * block_size.size();
+      add("impurity trace cache", n_walkers * n_nodes * sum_dim2 * sizeof(h_scalar_t));
+    }
+
+    double total = 0;
+    for (auto const &[name, bytes] : r) total += bytes;
+    r["total"] = total;
+    return r;
   }
+
 } // namespace triqs_cthyb
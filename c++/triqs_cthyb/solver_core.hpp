@@ -31,6 +31,9 @@
 #include "types.hpp"
 #include "container_set.hpp"
 #include "parameters.hpp"
+#include "configuration.hpp"
+#include "performance_counters.hpp"
+#include "measures/autocorrelation.hpp"
 
 namespace triqs_cthyb {
 
@@ -48,8 +51,14 @@ namespace triqs_cthyb {
     std::vector<matrix_t> _density_matrix; // density matrix, when used in Norm mode
     triqs::mpi::communicator _comm;        // define the communicator, here MPI_COMM_WORLD
     histo_map_t _performance_analysis;     // Histograms used for performance analysis
+    performance_counters_t _performance_counters; // Counters of the hot paths of the last solve, summed over the processes
+    autocorrelation_times_t _autocorrelation_times; // Autocorrelation times of the last solve, with measure_autocorrelation
+    std::string _G2_stream_file;           // File of the G2 measures of the last solve, with measure_G2_stream_file
+    double _trace_pruning_error = 0;       // Estimated relative error of the pruning of the trace in the last solve, with trace_prune_tolerance
     mc_weight_t _average_sign;             // average sign of the QMC
     int _solve_status;                     // Status of the solve upon exit: 0 for clean termination, > 0 otherwise.
+    configuration_record_t _last_configuration; // Final configuration of the last solve on this process, for a warm start
+    std::string _h_diag_key;               // Description of the local problem diagonalized in h_diag (empty: none)
 
     // Single-particle Green's function containers
     G_iw_t _G0_iw;      // Non-interacting Matsubara Green's function
@@ -90,6 +99,15 @@ namespace triqs_cthyb {
     CPP2PY_ARG_AS_DICT
     void solve(solve_parameters_t const &p);
 
+    /**
+     * Estimated memory per process, in bytes, of the containers and work data of solve(p), by item, and their "total".
+     * Nothing is allocated. The cache of the trace is only estimated once the local Hamiltonian has been diagonalized (by a solve).
+     *
+     * @param p Set of parameters for the CTHYB calculation
+     */
+    CPP2PY_ARG_AS_DICT
+    std::map<std::string, double> estimate_memory(solve_parameters_t const &p) const;
+
     /// The local Hamiltonian of the problem: :math:`H_{loc}` used in the last call to ``solve()``.
     many_body_op_t const &h_loc() const { return _h_loc; }
 
@@ -122,6 +140,34 @@ namespace triqs_cthyb {
     /// Accumulated density matrix.
     std::vector<matrix_t> const &density_matrix() const { return _density_matrix; }
 
+    /// Views of the blocks of the accumulated density matrix, on the memory of the solver (no copy).
+    std::vector<matrix_view<h_scalar_t>> density_matrix_view() {
+      std::vector<matrix_view<h_scalar_t>> r;
+      for (auto &m : _density_matrix) r.emplace_back(m);
+      return r;
+    }
+
+    // The accumulated containers, as views on the memory of the solver, which the Python objects share (no copy),
+    // or nothing if they are not measured. A copy must be made explicitly to keep them beyond the next solve.
+    template <typename G> static std::optional<typename G::view_type> view_of(std::optional<G> &g) {
+      if (!g) return {};
+      return typename G::view_type{*g};
+    }
+    std::optional<G_tau_t::view_type> get_G_tau() { return view_of(G_tau); }
+    std::optional<G_tau_G_target_t::view_type> get_G_tau_accum() { return view_of(G_tau_accum); }
+    std::optional<G_l_t::view_type> get_G_l() { return view_of(G_l); }
+    std::optional<G_iw_t::view_type> get_G_iw_nfft() { return view_of(G_iw_nfft); }
+    std::optional<gf<imtime, scalar_valued>::view_type> get_O_tau() { return view_of(O_tau); }
+    std::optional<G2_tau_t::view_type> get_G2_tau() { return view_of(G2_tau); }
+    std::optional<G2_iw_t::view_type> get_G2_iw() { return view_of(G2_iw); }
+    std::optional<G2_iw_t::view_type> get_G2_iw_nfft() { return view_of(G2_iw_nfft); }
+    std::optional<G2_iw_t::view_type> get_G2_iw_pp() { return view_of(G2_iw_pp); }
+    std::optional<G2_iw_t::view_type> get_G2_iw_pp_nfft() { return view_of(G2_iw_pp_nfft); }
+    std::optional<G2_iw_t::view_type> get_G2_iw_ph() { return view_of(G2_iw_ph); }
+    std::optional<G2_iw_t::view_type> get_G2_iw_ph_nfft() { return view_of(G2_iw_ph_nfft); }
+    std::optional<G2_iwll_t::view_type> get_G2_iwll_pp() { return view_of(G2_iwll_pp); }
+    std::optional<G2_iwll_t::view_type> get_G2_iwll_ph() { return view_of(G2_iwll_ph); }
+
     /// Diagonalization of :math:`H_{loc}`.
     atom_diag const &h_loc_diagonalization() const { return h_diag; }
 
@@ -134,6 +180,22 @@ namespace triqs_cthyb {
     /// Histograms related to the performance analysis.
     histo_map_t const &get_performance_analysis() const { return _performance_analysis; }
 
+    /// Counters and timers (in seconds) of the moves, the trace and the measures in the last solve, summed over the processes.
+    /// Empty unless cthyb is compiled with the Performance_counters option.
+    performance_counters_t const &get_performance_counters() const { return _performance_counters; }
+
+    /// Integrated autocorrelation times (in measurements), effective numbers of samples and effective samples per second
+    /// of the sign, the perturbation order and the first G_l coefficients, as "<observable>/tau_int" etc. Set with measure_autocorrelation.
+    autocorrelation_times_t const &get_autocorrelation_times() const { return _autocorrelation_times; }
+
+    /// HDF5 file of the G2 measures of the last solve, written with measure_G2_stream_file (empty otherwise).
+    /// The G2 containers are then empty.
+    std::string const &get_G2_stream_file() const { return _G2_stream_file; }
+
+    /// Sum of the largest shares of the bound of the trace of the atomic subspaces dropped after the warmup (trace_prune_tolerance).
+    /// An estimate of the relative error on the trace, the largest over the processes. 0 without pruning.
+    double trace_pruning_error() const { return _trace_pruning_error; }
+
     /// Monte Carlo average sign.
     mc_weight_t average_sign() const { return _average_sign; }
 
@@ -0,0 +1,168 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include "./config.hpp"
+#include <triqs/mpi/base.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace triqs_cthyb {
+
+  /// Timeline of a solve: spans of the phases, moves, trace computations and measures, written as Chrome trace events (Perfetto).
+  // One per process. The frequent spans (moves, trace, accumulations) are sampled: only one call in sample_interval is recorded,
+  // for each place of the code which counts its calls. The phases and the collections of the results are always recorded.
+  class timeline {
+
+    using clock = std::chrono::steady_clock;
+
+    struct event_t {
+      std::string name;
+      double start, duration; // in microseconds, from start()
+      int thread;
+    };
+
+    std::atomic<bool> enabled{false};
+    int sample_interval = 1;
+    clock::time_point origin;
+    std::mutex mutex;
+    std::vector<event_t> events;
+    long n_dropped                   = 0;
+    static constexpr long max_events = 1000000; // bounds the memory of a long run
+    std::atomic<int> n_threads{0};
+
+    static double microseconds(clock::duration d) { return std::chrono::duration<double, std::micro>(d).count(); }
+
+    // a small number for the calling thread, in the order of the first event
+    int thread_index() {
+      thread_local int index = n_threads++;
+      return index;
+    }
+
+    void record(std::string name, clock::time_point start, clock::time_point end) {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (long(events.size()) >= max_events) {
+        ++n_dropped;
+        return;
+      }
+      events.push_back({std::move(name), microseconds(start - origin), microseconds(end - start), thread_index()});
+    }
+
+    public:
+    static timeline &instance() {
+      static timeline t;
+      return t;
+    }
+
+    bool is_enabled() const { return enabled; }
+
+    /// Starts a new timeline, with one call in sample_interval of the sampled spans recorded
+    void start(int interval) {
+      std::lock_guard<std::mutex> lock(mutex);
+      events.clear();
+      n_dropped       = 0;
+      sample_interval = std::max(interval, 1);
+      origin          = clock::now();
+      enabled         = true;
+    }
+
+    /// Stops the recording, without writing the events
+    void stop() { enabled = false; }
+
+    /// Stops the recording, and writes the events to file, with the rank of the process as pid
+    void stop_and_write(std::string const &file, int rank) {
+      enabled = false;
+      std::lock_guard<std::mutex> lock(mutex);
+      std::ofstream out(file);
+      out << "{\"traceEvents\":[\n";
+      for (size_t i = 0; i < events.size(); ++i) {
+        auto const &e = events[i];
+        out << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"ts\":" << e.start << ",\"dur\":" << e.duration << ",\"pid\":" << rank
+            << ",\"tid\":" << e.thread << "}" << (i + 1 < events.size() ? ",\n" : "\n");
+      }
+      out << "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"sample_interval\":" << sample_interval << ",\"dropped_events\":" << n_dropped
+          << "}}\n";
+      events.clear();
+    }
+
+    /// A span, recorded at its destruction. The name is only copied if the span is recorded.
+    /// With a counter of the calls (n_calls != nullptr), the span is sampled.
+    class span {
+      timeline *t = nullptr;
+      char const *name;
+      clock::time_point start;
+
+      public:
+      span(char const *name, long *n_calls = nullptr) : name(name) {
+        auto &tl = instance();
+        if (!tl.enabled) return;
+        if (n_calls && ((*n_calls)++ % tl.sample_interval != 0)) return;
+        t     = &tl;
+        start = clock::now();
+      }
+      span(span const &) = delete;
+      span &operator=(span const &) = delete;
+      ~span() {
+        if (t) t->record(name, start, clock::now());
+      }
+    };
+  };
+
+  // A move, with its attempts in the timeline (sampled)
+  template <typename Move> class move_in_timeline {
+    Move move;
+    std::string name;
+    long n_calls = 0;
+
+    public:
+    move_in_timeline(Move move, std::string name) : move(std::move(move)), name("attempt " + name) {}
+    mc_weight_t attempt() {
+      timeline::span _(name.c_str(), &n_calls);
+      return move.attempt();
+    }
+    mc_weight_t accept() { return move.accept(); }
+    void reject() { move.reject(); }
+  };
+
+  // A measure, with its accumulations (sampled) and the collection of its results in the timeline
+  template <typename Measure> class measure_in_timeline {
+    Measure measure;
+    std::string accumulate_name, collect_name;
+    long n_calls = 0;
+
+    public:
+    measure_in_timeline(Measure measure, std::string const &name)
+       : measure(std::move(measure)), accumulate_name("accumulate " + name), collect_name("collect_results " + name) {}
+    void accumulate(mc_weight_t s) {
+      timeline::span _(accumulate_name.c_str(), &n_calls);
+      measure.accumulate(s);
+    }
+    void collect_results(triqs::mpi::communicator const &c) {
+      timeline::span _(collect_name.c_str());
+      measure.collect_results(c);
+    }
+  };
+
+} // namespace triqs_cthyb
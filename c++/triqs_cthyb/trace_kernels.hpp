@@ -0,0 +1,286 @@
+/*******************************************************************************
+ *
+ * TRIQS: a Toolbox for Research in Interacting Quantum Systems
+ *
+ * Copyright (C) 2026, The TRIQS cthyb contributors
+ *
+ * TRIQS is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 3 of the License, or (at your option) any later
+ * version.
+ *
+ * TRIQS is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * TRIQS. If not, see <http://www.gnu.org/licenses/>.
+ *
+ ******************************************************************************/
+#pragma once
+#include <triqs/arrays/blas_lapack/gemm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+// Kernels on raw, row-major, contiguous matrices used in the computation of the trace.
+// Destinations never alias sources, unless stated otherwise.
+namespace triqs_cthyb::kernels {
+
+  // Allocator of cache line aligned arrays, e.g. std::vector<double, aligned_allocator<double>>
+  template <typename T> struct aligned_allocator {
+    using value_type                 = T;
+    static constexpr std::size_t alignment = 64;
+    aligned_allocator()              = default;
+    template <typename U> aligned_allocator(aligned_allocator<U> const &) {}
+    T *allocate(std::size_t n) { return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t{alignment})); }
+    void deallocate(T *p, std::size_t) { ::operator delete(p, std::align_val_t{alignment}); }
+    template <typename U> bool operator==(aligned_allocator<U> const &) const { return true; }
+    template <typename U> bool operator!=(aligned_allocator<U> const &) const { return false; }
+  };
+
+  // e[i] <- scale * exp(-dtau * x[i]), for x[i] >= 0 and dtau >= 0.
+  // The loop is branch free and made of plain arithmetic, so that the compiler vectorizes it,
+  // which it does not do for std::exp. Relative error of a few ulp; results below exp(-708) are flushed to 0.
+  inline void exp_neg_scaled(double *e, double const *x, double dtau, double scale, int n) {
+    constexpr double log2e = 1.4426950408889634, ln2_hi = 6.93147180369123816490e-01, ln2_lo = 1.90821492927058770002e-10;
+    constexpr double magic = 6755399441055744.0; // 1.5 * 2^52: adding it rounds to an integer, which ends up in the low bits
+    std::int64_t magic_bits;
+    std::memcpy(&magic_bits, &magic, sizeof(double));
+    for (int i = 0; i < n; ++i) {
+      double a        = -dtau * x[i];
+      bool underflow  = (a < -708.0);
+      a               = (underflow ? -708.0 : a);
+      double t        = a * log2e + magic;
+      double k        = t - magic;                        // exp(a) = 2^k * exp(r)
+      double r        = (a - k * ln2_hi) - k * ln2_lo;    // |r| <= ln2/2
+      double p        = 1.0 / 6227020800.0;               // Taylor series to order 13, truncation error < 1e-17
+      p               = p * r + 1.0 / 479001600.0;
+      p               = p * r + 1.0 / 39916800.0;
+      p               = p * r + 1.0 / 3628800.0;
+      p               = p * r + 1.0 / 362880.0;
+      p               = p * r + 1.0 / 40320.0;
+      p               = p * r + 1.0 / 5040.0;
+      p               = p * r + 1.0 / 720.0;
+      p               = p * r + 1.0 / 120.0;
+      p               = p * r + 1.0 / 24.0;
+      p               = p * r + 1.0 / 6.0;
+      p               = p * r + 0.5;
+      p               = p * r + 1.0;
+      p               = p * r + 1.0;
+      std::int64_t t_bits;
+      std::memcpy(&t_bits, &t, sizeof(double));
+      std::int64_t two_k_bits = (t_bits - magic_bits + 1023) << 52; // the double 2^k
+      double two_k;
+      std::memcpy(&two_k, &two_k_bits, sizeof(double));
+      e[i] = (underflow ? 0.0 : scale * p * two_k);
+    }
+  }
+
+  // dst <- diag(e) * src, src of size n1 x n2. dst may be src.
+  template <typename T> void scale_rows(T *dst, T const *src, double const *e, int n1, int n2) {
+    for (int i = 0; i < n1; ++i) {
+      T *d = dst + i * n2;
+      T const *s = src + i * n2;
+      for (int j = 0; j < n2; ++j) d[j] = s[j] * e[i];
+    }
+  }
+
+  // dst <- src * diag(e), src of size n1 x n2. dst may be src.
+  template <typename T> void scale_cols(T *dst, T const *src, double const *e, int n1, int n2) {
+    for (int i = 0; i < n1; ++i) {
+      T *d = dst + i * n2;
+      T const *s = src + i * n2;
+      for (int j = 0; j < n2; ++j) d[j] = s[j] * e[j];
+    }
+  }
+
+  // C <- A * B, with A of size m x k, B of size k x n
+  template <typename T> void gemm(T *C, T const *A, T const *B, int m, int k, int n) {
+    if ((m == 1) || (k == 1) || (n == 1)) { // degenerate shapes: not worth a BLAS call
+      for (int i = 0; i < m; ++i) {
+        T *c = C + i * n;
+        for (int j = 0; j < n; ++j) c[j] = 0;
+        for (int l = 0; l < k; ++l) {
+          T a = A[i * k + l];
+          T const *b = B + l * n;
+          for (int j = 0; j < n; ++j) c[j] += a * b[j];
+        }
+      }
+      return;
+    }
+    // BLAS is column-major: a row-major matrix is seen as its transpose, so compute C^T = B^T * A^T
+    T alpha = 1, beta = 0;
+    triqs::arrays::blas::f77::gemm('N', 'N', n, m, k, alpha, B, n, A, k, beta, C, n);
+  }
+
+  // C <- A * B as gemm, for B and C with a number of columns N known at compile time.
+  // For small N, a row of C stays in registers and the inner loop is fully unrolled.
+  template <int N, typename T> void gemm_fixed_cols(T *C, T const *A, T const *B, int m, int k, int) {
+    for (int i = 0; i < m; ++i) {
+      T c[N] = {};
+      T const *a = A + i * k;
+      for (int l = 0; l < k; ++l) {
+        T const *b = B + l * N;
+        for (int j = 0; j < N; ++j) c[j] += a[l] * b[j];
+      }
+      for (int j = 0; j < N; ++j) C[i * N + j] = c[j];
+    }
+  }
+
+  template <typename T> using gemm_kernel_t = void (*)(T *, T const *, T const *, int, int, int);
+
+  // The gemm kernel for products with n columns: fixed size up to 4, BLAS beyond.
+  // From 5 columns on, an optimized BLAS is already faster than the unrolled loops.
+  template <typename T> gemm_kernel_t<T> select_gemm(int n) {
+    switch (n) {
+      case 1: return gemm_fixed_cols<1, T>;
+      case 2: return gemm_fixed_cols<2, T>;
+      case 3: return gemm_fixed_cols<3, T>;
+      case 4: return gemm_fixed_cols<4, T>;
+      default: return gemm<T>;
+    }
+  }
+
+  // Compressed sparse row storage of an operator block.
+  // In occupation number bases, the blocks of c and c^dagger have at most one non-zero element per column.
+  template <typename T> struct csr_matrix {
+    int n_rows = 0, n_cols = 0;
+    std::vector<int> row_start = {0}, cols;
+    std::vector<T> vals;
+    bool prefer_sparse = true; // are the sparse kernels cheaper than dense ones for this matrix?
+
+    csr_matrix() = default;
+
+    // from a dense row-major matrix
+    csr_matrix(T const *dense, int n_rows, int n_cols) : n_rows(n_rows), n_cols(n_cols) {
+      for (int i = 0; i < n_rows; ++i) {
+        for (int j = 0; j < n_cols; ++j)
+          if (dense[i * n_cols + j] != T(0)) {
+            cols.push_back(j);
+            vals.push_back(dense[i * n_cols + j]);
+          }
+        row_start.push_back(cols.size());
+      }
+      // dense BLAS wins for matrices with a significant filling, except for tiny ones
+      prefer_sparse = (4 * vals.size() <= std::size_t(n_rows) * n_cols) || (n_rows * n_cols <= 16);
+    }
+  };
+
+  // C <- Op * diag(e) * B, B of size Op.n_cols x n. e == nullptr stands for the identity.
+  template <typename T> void csr_gemm(T *C, csr_matrix<T> const &op, double const *e, T const *B, int n) {
+    for (int i = 0; i < op.n_rows; ++i) {
+      T *c = C + i * n;
+      for (int j = 0; j < n; ++j) c[j] = 0;
+      for (int p = op.row_start[i]; p < op.row_start[i + 1]; ++p) {
+        int k      = op.cols[p];
+        T a        = (e ? op.vals[p] * e[k] : op.vals[p]);
+        T const *b = B + k * n;
+        for (int j = 0; j < n; ++j) c[j] += a * b[j];
+      }
+    }
+  }
+
+  // C <- A * diag(e) * Op, A of size m x Op.n_rows
+  template <typename T> void gemm_csr(T *C, T const *A, double const *e, csr_matrix<T> const &op, int m) {
+    int n = op.n_cols, kmax = op.n_rows;
+    for (int i = 0; i < m; ++i) {
+      T *c = C + i * n;
+      for (int j = 0; j < n; ++j) c[j] = 0;
+      for (int k = 0; k < kmax; ++k) {
+        T a = A[i * kmax + k] * e[k];
+        for (int p = op.row_start[k]; p < op.row_start[k + 1]; ++p) c[op.cols[p]] += a * op.vals[p];
+      }
+    }
+  }
+
+  // dst <- identity of size n x n
+  template <typename T> void set_identity(T *dst, int n) {
+    for (int i = 0; i < n * n; ++i) dst[i] = 0;
+    for (int i = 0; i < n; ++i) dst[i * n + i] = 1;
+  }
+
+  // Frobenius norm of n elements
+  template <typename T> double frobenius_norm(T const *a, int n) {
+    double r = 0;
+    for (int i = 0; i < n; ++i) {
+      double x = std::abs(a[i]);
+      r += x * x;
+    }
+    return std::sqrt(r);
+  }
+
+  // An upper bound of the spectral norm of the n_rows x n_cols matrix a: min(Frobenius norm, sqrt(|a|_1 |a|_inf)).
+  // O(n_rows * n_cols), for the matrices computed in the cache.
+  template <typename T> double spectral_norm_bound(T const *a, int n_rows, int n_cols) {
+    std::vector<double> col_sums(n_cols, 0);
+    double max_row = 0, frob = 0;
+    for (int i = 0; i < n_rows; ++i) {
+      double row = 0;
+      for (int j = 0; j < n_cols; ++j) {
+        double x = std::abs(a[i * n_cols + j]);
+        row += x;
+        col_sums[j] += x;
+        frob += x * x;
+      }
+      max_row = std::max(max_row, row);
+    }
+    double max_col = 0;
+    for (double c : col_sums) max_col = std::max(max_col, c);
+    return std::min(std::sqrt(frob), std::sqrt(max_row * max_col));
+  }
+
+  // A sharp upper bound of the spectral norm of the n_rows x n_cols matrix a, for the operator blocks (computed once):
+  // |a|_2^2 = lambda_max(B) with B = a^dagger a, and lambda_max(B) <= |B^(2^k)|_inf^(2^-k), which tends to lambda_max(B) as k grows.
+  // B is rescaled by its norm at each squaring, only the logarithms of the scales are kept.
+  template <typename T> double sharp_spectral_norm_bound(T const *a, int n_rows, int n_cols, int n_squarings = 6) {
+    auto conj_ = [](T x) {
+      if constexpr (std::is_floating_point_v<T>)
+        return x;
+      else
+        return std::conj(x);
+    };
+    int n = n_cols;
+    std::vector<T> B(std::size_t(n) * n, T(0)), B2(B.size());
+    for (int k = 0; k < n_rows; ++k)
+      for (int i = 0; i < n; ++i) {
+        T x = conj_(a[k * n + i]);
+        for (int j = 0; j < n; ++j) B[i * n + j] += x * a[k * n + j];
+      }
+    auto inf_norm = [n](std::vector<T> const &M) {
+      double r = 0;
+      for (int i = 0; i < n; ++i) {
+        double row = 0;
+        for (int j = 0; j < n; ++j) row += std::abs(M[i * n + j]);
+        r = std::max(r, row);
+      }
+      return r;
+    };
+    // log of the bound of lambda_max(B) after k squarings: (log |B^(2^k)|_inf) / 2^k, with B^(2^k) = scale * (rescaled B)
+    double log_scale = 0, best = std::log(inf_norm(B)), weight = 1;
+    for (int k = 1; (k <= n_squarings) && std::isfinite(best); ++k) {
+      double s = inf_norm(B);
+      if (s == 0) return 0;
+      for (auto &x : B) x /= s;
+      log_scale = 2 * (log_scale + std::log(s));
+      weight /= 2;
+      for (int i = 0; i < n; ++i)
+        for (int j = 0; j < n; ++j) {
+          T r = 0;
+          for (int l = 0; l < n; ++l) r += B[i * n + l] * B[l * n + j];
+          B2[i * n + j] = r;
+        }
+      B.swap(B2);
+      best = std::min(best, weight * (log_scale + std::log(inf_norm(B))));
+    }
+    // a relative safety margin for the rounding errors
+    return std::min(std::exp(0.5 * best) * (1 + 1e-10), frobenius_norm(a, n_rows * n_cols));
+  }
+
+} // namespace triqs_cthyb::kernels
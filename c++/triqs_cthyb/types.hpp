@@ -32,6 +32,7 @@
 
 #include "config.hpp"
 #include <triqs/utility/variant.hpp>
+#include <set>
 
 namespace triqs_cthyb {
 
@@ -86,9 +87,11 @@ namespace triqs {
   namespace gfs {
 
     /// Function template for block2_gf initialization
+    /// Only the given pairs of blocks (all if empty) are allocated, the others are placeholders of empty target space.
     template <typename Var_t>
     block2_gf<Var_t, tensor_valued<4>> make_block2_gf(gf_mesh<Var_t> const &m, triqs::hilbert_space::gf_struct_t const &gf_struct,
-                                                      triqs_cthyb::block_order order = triqs_cthyb::block_order::AABB) {
+                                                      triqs_cthyb::block_order order                                = triqs_cthyb::block_order::AABB,
+                                                      std::set<std::pair<std::string, std::string>> const &block_pairs = {}) {
 
       std::vector<std::vector<gf<Var_t, tensor_valued<4>>>> gf_vecvec;
       std::vector<std::string> block_names;
@@ -105,6 +108,10 @@ namespace triqs {
           int bl2_size = bl2.second.size();
           std::vector<std::string> indices2;
           for (auto const &var : bl2.second) visit([&indices2](auto &&arg) { indices2.push_back(std::to_string(arg)); }, var);
+          if (!block_pairs.empty() && !block_pairs.count({bname, bl2.first})) {
+            gf_vec.emplace_back(m, make_shape(0, 0, 0, 0), std::vector<std::vector<std::string>>(4));
+            continue;
+          }
           auto I = std::vector<std::vector<std::string>>{indices1, indices1, indices2, indices2};
           switch (order) {
             case triqs_cthyb::block_order::AABB: gf_vec.emplace_back(m, make_shape(bl1_size, bl1_size, bl2_size, bl2_size), I); break;
@@ -23,9 +23,9 @@ r"""
 DOC
 
 """
-from solver import Solver
+from solver import Solver, solve_batch
 from solver_core import SolverCore
 from util import estimate_nfft_buf_size
 
-__all__ = ['Solver', 'SolverCore',
+__all__ = ['Solver', 'SolverCore', 'solve_batch',
            'estimate_nfft_buf_size']
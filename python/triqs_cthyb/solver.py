@@ -24,11 +24,41 @@ from solver_core  import SolverCore
 from pytriqs.gf import *
 import pytriqs.utility.mpi as mpi
 import numpy as np
+import inspect
+
+# The real-valued solver, with the complex build of cthyb and the option Real_variant
+try:
+    from solver_core_real import SolverCore as SolverCoreReal
+except ImportError:
+    SolverCoreReal = None
 
 from tail_fit import tail_fit as cthyb_tail_fit
 
+def _is_real_problem(G0_iw, h_int, imag_threshold):
+    """
+    Is the problem real: are Delta(tau) and h_loc real, up to imag_threshold?
+    G0(tau) is real iff G0(-i\omega_n) = G0(i\omega_n)^*, in which case its high-frequency part (Delta_infty) is real too.
+    """
+    for monomial, coef in h_int:
+        if abs(np.imag(coef)) > imag_threshold: return False
+    for name, g in G0_iw:
+        d = g.data
+        if np.max(np.abs(d[::-1] - d.conj())) > imag_threshold: return False
+    return True
+
 class Solver(SolverCore):
 
+    # The results of the core solver: read from _results_from when it is set, i.e. from the real-valued solver
+    # when it did the last solve, or from the results of a batch solved by other processes
+    _core_results = frozenset(n for n, v in inspect.getmembers(SolverCore)
+                              if inspect.isdatadescriptor(v) and not n.startswith('_') and n != 'G0_iw')
+
+    def __getattribute__(self, name):
+        if name in Solver._core_results:
+            real_core = object.__getattribute__(self, '__dict__').get('_results_from')
+            if real_core is not None: return getattr(real_core, name)
+        return SolverCore.__getattribute__(self, name)
+
     def __init__(self, beta, gf_struct, n_iw=1025, n_tau=10001, n_l=30):
         """
         Initialise the solver.
@@ -65,11 +95,27 @@ class Solver(SolverCore):
         self.gf_struct = gf_struct
         self.n_iw = n_iw
         self.n_tau = n_tau
+        self._constr_parameters = dict(beta=beta, gf_struct=gf_struct, n_iw=n_iw, n_tau=n_tau, n_l=n_l)
+        self._real_core = None
+        self._results_from = None
+
+    # The results of the last solve which solve_batch sends to the other processes
+    _batch_result_names = ['G_tau', 'G_tau_accum', 'G_l', 'G_iw_nfft', 'O_tau', 'G2_tau', 'G2_iw', 'G2_iw_nfft', 'G2_iw_pp', 'G2_iw_pp_nfft',
+                           'G2_iw_ph', 'G2_iw_ph_nfft', 'G2_iwll_pp', 'G2_iwll_ph', 'Delta_tau', 'density_matrix', 'average_sign',
+                           'solve_status', 'last_solve_parameters', 'autocorrelation_times', 'performance_counters', 'G2_stream_file']
+    # Set by the post-processing of solve
+    _batch_post_proc_names = ['G_iw', 'G_iw_raw', 'Sigma_iw', 'Sigma_iw_raw']
+
+    def _batch_results(self):
+        r = dict((n, getattr(self, n)) for n in Solver._batch_result_names if hasattr(SolverCore, n))
+        p = dict((n, self.__dict__[n]) for n in Solver._batch_post_proc_names if n in self.__dict__)
+        return r, p
 
     def solve(self, **params_kw):
         """
         Solve the impurity problem.
         If ``measure_g_tau`` (default = ``True``), ``G_iw`` and ``Sigma_iw`` will be calculated and their tails fitted.
+        Without ``measure_G_tau``, they are obtained from ``G_iw_nfft`` if it is measured on the mesh of ``G0_iw``.
         In addition to the solver parameters, parameters to control the tail fitting can be provided.
 
         Parameters
@@ -90,6 +136,10 @@ class Solver(SolverCore):
                     Index of ``iw`` from which to start fitting.
         fit_max_n : integer, optional, default = ``n_iw``
                     Index of ``iw`` to fit until.
+        use_real_variant : boolean, optional, default = ``True``
+                           With a complex build which includes the real-valued solver (option ``Real_variant``),
+                           solve with the real-valued solver if ``Delta(tau)`` and ``h_int`` are real (up to ``imag_threshold``).
+                           Its results are then those of the Solver.
         """
 
         # -- Deprecation checks for measure parameters
@@ -126,20 +176,40 @@ class Solver(SolverCore):
             fit_max_moment = params_kw.pop("fit_max_moment", None)
             fit_known_moments = params_kw.pop("fit_known_moments", None)
 
-        # Call the core solver's solve routine
-        solve_status = SolverCore.solve(self, **params_kw)
+        # Call the core solver's solve routine, the real-valued one if possible.
+        # The decision only depends on G0_iw and h_int, which are the same on all processes.
+        use_real_variant = params_kw.pop("use_real_variant", True)
+        self._results_from = None
+        if use_real_variant and SolverCoreReal is not None and "h_int" in params_kw and \
+           _is_real_problem(self.G0_iw, params_kw["h_int"], params_kw.get("imag_threshold", 1.e-15)):
+            if self._real_core is None:
+                self._real_core = SolverCoreReal(**self._constr_parameters)
+            self._real_core.G0_iw << self.G0_iw
+            solve_status = self._real_core.solve(**params_kw)
+            self._results_from = self._real_core
+        else:
+            solve_status = SolverCore.solve(self, **params_kw)
 
         # Post-processing:
-        # (only supported for G_tau, to permit compatibility with dft_tools)
-        if perform_post_proc and (self.last_solve_parameters["measure_G_tau"] == True):
-            # Fourier transform G_tau to obtain G_iw
-            for name, g in self.G_tau:
-                bl_size = g.target_shape[0]
-                known_moments = np.zeros((4, bl_size, bl_size), dtype=np.complex)
-                for i in range(bl_size):
-                    known_moments[1,i,i] = 1
+        # (only supported for G_tau, to permit compatibility with dft_tools,
+        # and for G_iw_nfft measured on the mesh of G0_iw)
+        post_proc_G_tau = perform_post_proc and (self.last_solve_parameters["measure_G_tau"] == True)
+        post_proc_G_iw_nfft = perform_post_proc and not post_proc_G_tau and \
+            (self.last_solve_parameters["measure_G_iw_nfft"] == True) and \
+            (self.last_solve_parameters["measure_G_iw_nfft_n_iw"] in (0, self.n_iw))
+        if post_proc_G_tau or post_proc_G_iw_nfft:
+            if post_proc_G_tau:
+                # Fourier transform G_tau to obtain G_iw
+                for name, g in self.G_tau:
+                    bl_size = g.target_shape[0]
+                    known_moments = np.zeros((4, bl_size, bl_size), dtype=np.complex)
+                    for i in range(bl_size):
+                        known_moments[1,i,i] = 1
 
-                self.G_iw[name].set_from_fourier(g, known_moments)
+                    self.G_iw[name].set_from_fourier(g, known_moments)
+            else:
+                # G_iw is measured directly
+                self.G_iw << self.G_iw_nfft
 
             self.G_iw_raw = self.G_iw.copy()
 
@@ -171,3 +241,80 @@ class Solver(SolverCore):
                 self.Sigma_iw = dyson(G0_iw=self.G0_iw, G_iw=self.G_iw)
 
         return solve_status
+
+class _BatchResults(object):
+    """The results of a problem of solve_batch, solved by the processes of another group"""
+
+    def __init__(self, results):
+        self.__dict__.update(results)
+
+    def __getattr__(self, name):
+        raise AttributeError("%s of this problem of solve_batch is only available on the processes which solved it" % name)
+
+def _batch_groups(costs, n_ranks):
+    """
+    Ranks of the processes which solve each problem: the processes go one by one to the problem with the largest cost
+    per process, so that the largest of them is minimal. With more problems than processes, each problem is solved by
+    one process, the problems going one by one, by decreasing cost, to the least loaded process.
+    """
+    n = len(costs)
+    if n >= n_ranks:
+        load = [0.] * n_ranks
+        groups = [None] * n
+        for k in sorted(range(n), key=lambda k: -costs[k]):
+            r = min(range(n_ranks), key=lambda r: load[r])
+            load[r] += costs[k]
+            groups[k] = [r]
+        return groups
+    sizes = [1] * n
+    for i in range(n_ranks - n):
+        k = max(range(n), key=lambda k: costs[k] / float(sizes[k]))
+        sizes[k] += 1
+    starts = np.cumsum([0] + sizes)
+    return [range(starts[k], starts[k + 1]) for k in range(n)]
+
+def _estimated_cost(solver, params):
+    """Estimated cost of a solve: its number of moves, times beta (for the expansion order), times the dimension of the Fock space"""
+    n_orbitals = sum(len(indices) for name, indices in solver.gf_struct)
+    n_moves = (params.get('n_warmup_cycles', 5000) + params['n_cycles']) * params.get('length_cycle', 50)
+    return float(n_moves) * solver._constr_parameters['beta'] * 2**n_orbitals
+
+def solve_batch(solvers, params, costs=None):
+    """
+    Solve independent impurity problems concurrently, instead of one after the other with all the processes.
+    The processes (of MPI_COMM_WORLD) are split into groups, of sizes proportional to the estimated costs of the problems,
+    and each group solves its problem (see the parameter ``mpi_group_ranks``). The results are then sent to all the processes,
+    except the histograms, ``h_loc`` and ``h_loc_diagonalization``, which are only on the processes of the group.
+    As the processes of a group only know the rank of the process in the group, the files written by the solves
+    (``progress_file``, ``timeline_file``, etc.) must be different for each problem.
+
+    Parameters
+    ----------
+    solvers : list of Solver
+              The solvers of the problems, with their ``G0_iw`` set on all processes.
+    params : list of dict
+             The parameters of ``Solver.solve`` for each problem.
+    costs : list of float, optional
+            Estimated costs of the problems, by default (n_warmup_cycles + n_cycles) * length_cycle * beta * 2^(number of orbitals).
+
+    Returns
+    -------
+    The list of the solve statuses.
+    """
+    if len(solvers) != len(params):
+        raise ValueError("solve_batch: there must be one dict of parameters per solver")
+    if costs is None:
+        costs = [_estimated_cost(s, p) for s, p in zip(solvers, params)]
+    groups = _batch_groups(costs, mpi.size)
+
+    for s, p, g in zip(solvers, params, groups):
+        if mpi.rank in g:
+            s.solve(mpi_group_ranks=list(g), **p)
+
+    for s, g in zip(solvers, groups):
+        results, post_proc = mpi.bcast(s._batch_results() if mpi.rank == g[0] else None, root=g[0])
+        if mpi.rank not in g:
+            s._results_from = _BatchResults(results)
+            s.__dict__.update(post_proc)
+
+    return [s.solve_status for s in solvers]
@@ -42,70 +42,61 @@ c = class_(
         hdf5 = True,
 )
 
-c.add_member(c_name = "G_tau",
-             c_type = "std::optional<G_tau_t>",
-             read_only= True,
-             doc = """Single-particle Green\'s function :math:`G(\\tau)` in imaginary time.""")
+c.add_property(name = "G_tau",
+               getter = cfunction("std::optional<G_tau_t::view_type> get_G_tau ()"),
+               doc = """Single-particle Green\'s function :math:`G(\\tau)` in imaginary time.\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
-c.add_member(c_name = "G_tau_accum",
-             c_type = "std::optional<G_tau_G_target_t>",
-             read_only= True,
-             doc = """Intermediate Green\'s function to accumulate g(tau), either real or complex""")
+c.add_property(name = "G_tau_accum",
+               getter = cfunction("std::optional<G_tau_G_target_t::view_type> get_G_tau_accum ()"),
+               doc = """Intermediate Green\'s function to accumulate g(tau), either real or complex\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
-c.add_member(c_name = "G_l",
-             c_type = "std::optional<G_l_t>",
-             read_only= True,
-             doc = """Single-particle Green\'s function :math:`G_l` in Legendre polynomial representation.""")
+c.add_property(name = "G_l",
+               getter = cfunction("std::optional<G_l_t::view_type> get_G_l ()"),
+               doc = """Single-particle Green\'s function :math:`G_l` in Legendre polynomial representation.\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
-c.add_member(c_name = "O_tau",
-             c_type = "std::optional<gf<imtime, scalar_valued> >",
-             read_only= True,
-             doc = """General operator Green\'s function :math:`O(\\tau)` in imaginary time.""")
+c.add_property(name = "G_iw_nfft",
+               getter = cfunction("std::optional<G_iw_t::view_type> get_G_iw_nfft ()"),
+               doc = """Single-particle Green\'s function :math:`G(i\\omega_n)` in Matsubara frequencies, measured with NFFT.\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
-c.add_member(c_name = "G2_tau",
-             c_type = "std::optional<G2_tau_t>",
-             read_only= True,
-             doc = """Two-particle Green\'s function :math:`G^{(2)}(\\tau_1,\\tau_2,\\tau_3)` (three Fermionic imaginary times)""")
+c.add_property(name = "O_tau",
+               getter = cfunction("std::optional<gf<imtime, scalar_valued>::view_type> get_O_tau ()"),
+               doc = """General operator Green\'s function :math:`O(\\tau)` in imaginary time.\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
-c.add_member(c_name = "G2_iw",
-             c_type = "std::optional<G2_iw_t>",
-             read_only= True,
-             doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\nu,i\\nu\',i\\nu\'\')` (three Fermionic frequencies)""")
+c.add_property(name = "G2_tau",
+               getter = cfunction("std::optional<G2_tau_t::view_type> get_G2_tau ()"),
+               doc = """Two-particle Green\'s function :math:`G^{(2)}(\\tau_1,\\tau_2,\\tau_3)` (three Fermionic imaginary times)\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
-c.add_member(c_name = "G2_iw_nfft",
-             c_type = "std::optional<G2_iw_t>",
-             read_only= True,
-             doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\nu,i\\nu\',i\\nu\'\')` (three Fermionic frequencies)""")
+c.add_property(name = "G2_iw",
+               getter = cfunction("std::optional<G2_iw_t::view_type> get_G2_iw ()"),
+               doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\nu,i\\nu\',i\\nu\'\')` (three Fermionic frequencies)\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
-c.add_member(c_name = "G2_iw_pp",
-             c_type = "std::optional<G2_iw_t>",
-             read_only= True,
-             doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\omega,i\\nu,i\\nu\')` in the pp-channel (one bosonic matsubara and two fermionic)""")
+c.add_property(name = "G2_iw_nfft",
+               getter = cfunction("std::optional<G2_iw_t::view_type> get_G2_iw_nfft ()"),
+               doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\nu,i\\nu\',i\\nu\'\')` (three Fermionic frequencies)\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
-c.add_member(c_name = "G2_iw_pp_nfft",
-             c_type = "std::optional<G2_iw_t>",
-             read_only= True,
-             doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\omega,i\\nu,i\\nu\')` in the pp-channel (one bosonic matsubara and two fermionic)""")
+c.add_property(name = "G2_iw_pp",
+               getter = cfunction("std::optional<G2_iw_t::view_type> get_G2_iw_pp ()"),
+               doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\omega,i\\nu,i\\nu\')` in the pp-channel (one bosonic matsubara and two fermionic)\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
-c.add_member(c_name = "G2_iw_ph",
-             c_type = "std::optional<G2_iw_t>",
-             read_only= True,
-             doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\omega,i\\nu,i\\nu\')` in the ph-channel (one bosonic matsubara and two fermionic)""")
+c.add_property(name = "G2_iw_pp_nfft",
+               getter = cfunction("std::optional<G2_iw_t::view_type> get_G2_iw_pp_nfft ()"),
+               doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\omega,i\\nu,i\\nu\')` in the pp-channel (one bosonic matsubara and two fermionic)\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
-c.add_member(c_name = "G2_iw_ph_nfft",
-             c_type = "std::optional<G2_iw_t>",
-             read_only= True,
-             doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\omega,i\\nu,i\\nu\')` in the ph-channel (one bosonic matsubara and two fermionic)""")
+c.add_property(name = "G2_iw_ph",
+               getter = cfunction("std::optional<G2_iw_t::view_type> get_G2_iw_ph ()"),
+               doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\omega,i\\nu,i\\nu\')` in the ph-channel (one bosonic matsubara and two fermionic)\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
-c.add_member(c_name = "G2_iwll_pp",
-             c_type = "std::optional<G2_iwll_t>",
-             read_only= True,
-             doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\omega,l,l\')` in the pp-channel (one bosonic matsubara and two legendre)""")
+c.add_property(name = "G2_iw_ph_nfft",
+               getter = cfunction("std::optional<G2_iw_t::view_type> get_G2_iw_ph_nfft ()"),
+               doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\omega,i\\nu,i\\nu\')` in the ph-channel (one bosonic matsubara and two fermionic)\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
-c.add_member(c_name = "G2_iwll_ph",
-             c_type = "std::optional<G2_iwll_t>",
-             read_only= True,
-             doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\omega,l,l\')` in the ph-channel (one bosonic matsubara and two legendre)""")
+c.add_property(name = "G2_iwll_pp",
+               getter = cfunction("std::optional<G2_iwll_t::view_type> get_G2_iwll_pp ()"),
+               doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\omega,l,l\')` in the pp-channel (one bosonic matsubara and two legendre)\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
+
+c.add_property(name = "G2_iwll_ph",
+               getter = cfunction("std::optional<G2_iwll_t::view_type> get_G2_iwll_ph ()"),
+               doc = """Two-particle Green\'s function :math:`G^{(2)}(i\\omega,l,l\')` in the ph-channel (one bosonic matsubara and two legendre)\n View on the memory of the solver (no copy): use ``copy()`` to keep it beyond the next solve.""")
 
 c.add_member(c_name = "constr_parameters",
              c_type = "triqs_cthyb::constr_parameters_t",
@@ -142,6 +133,10 @@ c.add_method("""void solve (**triqs_cthyb::solve_parameters_t)""",
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | n_cycles                      | int                                                       |                                                           | Number of QMC cycles                                                                                                                                                            |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| balanced_accumulation         | bool                                                      | false                                                     | Accumulate until all the processes together did n_cycles times their number: faster processes do more cycles, and all stop together                                             |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| balanced_check_interval       | int                                                       | 100                                                       | Number of cycles between two progress reports of a process, in the balanced accumulation                                                                                        |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | partition_method              | std::string                                               | "autopartition"                                           | Partition method\n     type: str                                                                                                                                                |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | quantum_numbers               | std::vector<many_body_op_t>                               | std::vector<many_body_op_t>{}                             | Quantum numbers\n     type: list(Operator)\n     default: []                                                                                                                    |
@@ -150,12 +145,26 @@ c.add_method("""void solve (**triqs_cthyb::solve_parameters_t)""",
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | loc_n_max                     | int                                                       | INT_MAX                                                   | Restrict local Hilbert space to states with at most this number of particles\n     default: INT_MAX                                                                             |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| atom_diag_cache_file          | std::string                                               | ""                                                        | If not empty, HDF5 file in which the diagonalization of the local Hamiltonian is kept, and reused while the local problem is unchanged                                          |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | length_cycle                  | int                                                       | 50                                                        | Length of a single QMC cycle\n     default: 50                                                                                                                                  |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | n_warmup_cycles               | int                                                       | 5000                                                      | Number of cycles for thermalization\n     default: 5000                                                                                                                         |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| warm_start                    | bool                                                      | false                                                     | Start from the final configuration of the previous solve (of this solver, or read from configuration_file), with the dets rebuilt for the new Delta                             |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| n_warmup_cycles_warm_start    | int                                                       | -1                                                        | Number of cycles for thermalization after a successful warm start. -1: n_warmup_cycles                                                                                          |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| configuration_file            | std::string                                               | ""                                                        | If not empty, each process writes its final configuration to <configuration_file>.<rank>.h5, and a warm start reads it from there                                               |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | random_seed                   | int                                                       | 34788+928374*triqs::mpi::communicator().rank()            | Seed for random number generator\n     default: 34788 + 928374 * MPI.rank                                                                                                       |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| n_walkers                     | int                                                       | 1                                                         | Number of independent Markov chains run in threads by each process. They share the atomic problem and Delta; their results are combined before the MPI reduction.               |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| walker_placement              | std::string                                               | "none"                                                    | Threads of the walkers after the first: none, cores (pinned to cores spread over the NUMA nodes and the processes of a node, data built there) or numa (idem, h_diag per node)  |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| max_memory                    | double                                                    | -1                                                        | Upper bound of the estimated memory per process in MiB, checked before the allocations of solve (see estimate_memory). No limit if negative.                                    |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | random_name                   | std::string                                               | ""                                                        | Name of random number generator\n     type: str                                                                                                                                 |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | max_time                      | int                                                       | -1                                                        | Maximum runtime in seconds, use -1 to set infinite\n     default: -1 = infinite                                                                                                 |
@@ -166,16 +175,24 @@ c.add_method("""void solve (**triqs_cthyb::solve_parameters_t)""",
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | move_double                   | bool                                                      | false                                                     | Add double insertions as a move?                                                                                                                                                |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| move_insert_n_tries           | int                                                       | 1                                                         | Number of candidate pairs drawn by the insertion of a c, c^dagger pair (multiple-try Metropolis, weighted by a bound of the trace). 1: a single candidate                       |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | use_trace_estimator           | bool                                                      | false                                                     | Calculate the full trace or use an estimate?                                                                                                                                    |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | measure_G_tau                 | bool                                                      | true                                                      | Measure G(tau)?                                                                                                                                                                 |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | measure_G_l                   | bool                                                      | false                                                     | Measure G_l (Legendre)?                                                                                                                                                         |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| measure_G_iw_nfft             | bool                                                      | false                                                     | Measure G(iw) directly from the configurations with NFFT, without binning in imaginary time?                                                                                    |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| measure_G_iw_nfft_n_iw        | int                                                       | 0                                                         | Number of positive Matsubara frequencies of the NFFT measurement of G(iw). 0: n_iw of the solver.                                                                               |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | measure_O_tau                 | std::optional<std::pair<many_body_op_t, many_body_op_t> > | std::optional<std::pair<many_body_op_t,many_body_op_t>>{} | Measure O_tau by insertion                                                                                                                                                      |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | measure_O_tau_min_ins         | int                                                       | 10                                                        | Minumum of operator insertions in: O_tau by insertion measure                                                                                                                   |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| measure_O_tau_sweep           | bool                                                      | false                                                     | Evaluate O_tau on the whole tau mesh for each time of O1, from the partial products of the configuration, instead of inserting both operators at random times                   |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | measure_G2_tau                | bool                                                      | false                                                     | Measure G^4(tau,tau\',tau\'\') with three fermionic times.                                                                                                                      |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | measure_G2_iw                 | bool                                                      | false                                                     | Measure G^4(inu,inu\',inu\'\') with three fermionic frequencies.                                                                                                                |
@@ -206,24 +223,76 @@ c.add_method("""void solve (**triqs_cthyb::solve_parameters_t)""",
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | measure_G2_n_l                | int                                                       | 20                                                        | Number of Legendre coefficients for G^4(iomega,l,l\') measurement.                                                                                                              |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
-| measure_G2_iwll_nfft_buf_size | int                                                       | 100                                                       | NFFT buffer size for G^4(iomega,l,l\') measurement.                                                                                                                             |
+| measure_G2_iwll_nfft_buf_size | int                                                       | 100                                                       | Deprecated and ignored: the batched NFFT spreads the nodes on its grid without a buffer.                                                                                        |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| measure_G2_iw_gemm            | bool                                                      | false                                                     | Accumulate the scattering matrix of the G^4(inu,inu',inu'') measurements (without NFFT) with matrix products. Faster for many frequencies and large expansion orders.           |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| measure_G2_iw_conj_symmetry   | bool                                                      | false                                                     | Accumulate G^4 in Matsubara frequencies only for a non-negative first frequency, the rest from G^4(-w) = conj(G^4(w)). Requires a real Delta(tau) and h_loc.                    |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| measure_G2_tau_grouped        | bool                                                      | false                                                     | Accumulate G^4(tau,tau',tau'') from precomputed time bins, with contributions flushed in memory order and block pairs split across OpenMP threads.                              |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| measure_G2_every_n_cycles     | int                                                       | 1                                                         | Accumulate the G^4 measures every n cycles only. 0: adaptive, from the timings of the first cycles, so that measuring takes about as long as the moves.                         |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| measure_G2_async_threads      | int                                                       | 0                                                         | Number of threads accumulating the Matsubara G^4 measures from snapshots of the scattering matrices, while the Markov chain goes on. 0: in the Markov chain.                    |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| measure_G2_reduction          | std::string                                               | "all"                                                     | MPI reduction of the G2 containers: all (all-reduce), chunked (in-place all-reduce in chunks) or root (in-place reduce in chunks to rank 0 only)                                |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| mpi_reduction_chunk_mb        | int                                                       | 64                                                        | Size in MiB of the chunks of the chunked reductions of the G2 containers                                                                                                        |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| measure_G2_stream_file        | std::string                                               | ""                                                        | If not empty, the G2 measures are written by rank 0 to this HDF5 file, in chunks, instead of being kept in the containers. Requires measure_G2_reduction = root                 |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
-| nfft_buf_sizes                | std::map<std::string, int>                                | (std::map<std::string,int>{})                             | NFFT buffer sizes for different blocks\n     default: 100 for every block                                                                                                       |
+| measure_G2_stream_deflate     | int                                                       | 0                                                         | Deflate (gzip) level 0-9 of the datasets of measure_G2_stream_file. 0: no compression                                                                                           |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| nfft_buf_sizes                | std::map<std::string, int>                                | (std::map<std::string,int>{})                             | Deprecated and ignored: the batched NFFT spreads the nodes on its grid without a buffer.                                                                                        |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| nfft_fftw_wisdom_file         | std::string                                               | ""                                                        | File of FFTW wisdom for the NFFT measures, read before planning and written after it (by the first rank). Empty: no wisdom file.                                         |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| nfft_fftw_planner             | std::string                                               | "estimate"                                                | Planner of the FFTs of the NFFT measures: estimate, measure or patient. Costly plans are best kept in nfft_fftw_wisdom_file.                                             |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | measure_pert_order            | bool                                                      | false                                                     | Measure perturbation order?                                                                                                                                                     |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| measure_autocorrelation       | bool                                                      | false                                                     | Measure the integrated autocorrelation times of the sign, the perturbation order and the first G_l coefficients, by logarithmic binning?                                        |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| measure_autocorrelation_n_l   | int                                                       | 4                                                         | Number of Legendre coefficients of G_l (trace of each block) in measure_autocorrelation                                                                                         |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | measure_density_matrix        | bool                                                      | false                                                     | Measure the reduced impurity density matrix?                                                                                                                                    |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| defer_measures                | bool                                                      | false                                                     | Accumulate G_tau, G_l, G_iw_nfft and the G2 measures once per configuration, with the sum of the signs of its cycles, instead of at every cycle                                 |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | use_norm_as_weight            | bool                                                      | false                                                     | Use the norm of the density matrix in the weight if true, otherwise use Trace                                                                                                   |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | performance_analysis          | bool                                                      | false                                                     | Analyse performance of trace computation with histograms (developers only)?                                                                                                     |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| timeline_file                 | std::string                                               | ""                                                        | If not empty, a timeline of the solve (phases, sampled moves, trace computations and measures) is written to <timeline_file>.<rank>.json, as Chrome trace events                |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| timeline_sample_interval      | int                                                       | 100                                                       | Only one call in timeline_sample_interval of the moves, trace computations and accumulations is recorded in the timeline                                                        |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| progress_file                 | std::string                                               | ""                                                        | If not empty, the progress of each process is written every progress_interval seconds as JSON lines to <progress_file>.<rank>.jsonl ("-": stdout)                               |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| progress_interval             | double                                                    | 10.0                                                      | Interval of the progress lines, in seconds                                                                                                                                      |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| snapshot_file                 | std::string                                               | ""                                                        | If not empty, normalized snapshots of G_tau, G_l, the density matrix and the average sign are appended to this HDF5 file every snapshot_interval seconds                        |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| snapshot_interval             | double                                                    | 3600.0                                                    | Interval of the snapshots, in seconds                                                                                                                                           |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| trace_parallel_blocks         | int                                                       | 0                                                         | Number of leading blocks of the trace evaluated in parallel with OpenMP before the truncation (0 = serial)                                                                      |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| trace_energy_cutoff           | double                                                    | -1                                                        | Keep only the atomic eigenstates with beta*(E-E_0) <= trace_energy_cutoff in the trace (if > 0). Empty blocks are dropped                                                       |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| trace_prune_tolerance         | double                                                    | 0                                                         | After the warmup, drop from the trace the atomic subspaces whose share of the bound of the trace at the root stayed below this tolerance (if > 0)                               |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| trace_single_precision_tol    | double                                                    | 0                                                         | Store the cached partial products of the trace in single precision where their relative rounding error is below this tolerance (0: double). Needs trace_parallel_blocks <= 1    |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| trace_single_min_block_dim    | int                                                       | 16                                                        | With trace_single_precision_tol: only the blocks of at least this dimension are cached in single precision                                                                      |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | proposal_prob                 | std::map<std::string, double>                             | (std::map<std::string,double>{})                          | Operator insertion/removal probabilities for different blocks\n     type: dict(str:float)\n     default: {}                                                                     |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | move_global                   | std::map<std::string, indices_map_t>                      | (std::map<std::string,indices_map_t>{})                   | List of global moves (with their names).\n     Each move is specified with an index substitution dictionary.\n     type: dict(str : dict(indices : indices))\n     default: {}  |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | move_global_prob              | double                                                    | 0.05                                                      | Overall probability of the global moves                                                                                                                                         |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| adaptive_warmup               | bool                                                      | false                                                     | Tune the weights of the moves, the proposal probabilities of the blocks and the shift window during the warmup, for more accepted moves per second. Frozen afterwards           |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | imag_threshold                | double                                                    | 1.e-15                                                    | Threshold below which imaginary components of Delta and h_loc are set to zero                                                                                                   |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | det_init_size                 | int                                                       | 100                                                       | The maximum size of the determinant matrix before a resize                                                                                                                      |
@@ -234,10 +303,25 @@ c.add_method("""void solve (**triqs_cthyb::solve_parameters_t)""",
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | det_precision_error           | double                                                    | 1.e-5                                                     | Threshold for determinant precision error                                                                                                                                       |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| det_adaptive_check            | bool                                                      | false                                                     | Adapt the interval between the checks of M^-1 of each block to the deviations met at the checks, starting from det_n_operations_before_check                                    |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 | det_singular_threshold        | double                                                    | -1                                                        | Bound for the determinant matrix being singular, abs(det) > singular_threshold. If <0, it is !isnormal(abs(det))                                                                |
 +-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| delta_interpolation           | bool                                                      | false                                                     | Evaluate Delta(tau) in the determinants by linear interpolation between mesh points, instead of taking the closest mesh point                                                   |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| delta_node_shared_memory      | bool                                                      | false                                                     | Store the tables of Delta(tau) once per node, in MPI-3 shared memory, instead of once per process. The diagonalization of h_loc and the operator matrices stay per process      |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| mpi_group_ranks               | std::vector<int>                                          | std::vector<int>{}                                        | Ranks in MPI_COMM_WORLD of the processes which do this solve, collectively, e.g. for concurrent problems (Solver.solve_batch). Empty: all                                       |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| replica_h_int_scalings        | std::vector<double>                                       | std::vector<double>{}                                     | Replica exchange: scalings of h_int of the replicas, run by consecutive processes (chains of this size). Only those at 1 measure. Empty: none                                   |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
+| replica_swap_interval         | int                                                       | 10                                                        | Replica exchange: cycles between two proposals of swaps of the configurations of neighbouring replicas                                                                          |
++-------------------------------+-----------------------------------------------------------+-----------------------------------------------------------+---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------+
 """)
 
+c.add_method("""std::map<std::string,double> estimate_memory (**triqs_cthyb::solve_parameters_t)""",
+             doc = """Estimated memory per process, in bytes, of the containers and work data of solve(p), by item, and their \"total\".\n Nothing is allocated. The cache of the trace is only estimated once the local Hamiltonian has been diagonalized (by a solve).\n\n :param p: Set of parameters for the CTHYB calculation""")
+
 c.add_property(name = "h_loc",
                getter = cfunction("triqs_cthyb::many_body_op_t h_loc ()"),
                doc = """The local Hamiltonian of the problem: :math:`H_{loc}` used in the last call to ``solve()``.""")
@@ -263,8 +347,8 @@ c.add_property(name = "G0_iw",
                doc = """:math:`G_0(i\\omega)` in imaginary frequencies.""")
 
 c.add_property(name = "density_matrix",
-               getter = cfunction("std::vector<matrix_t> density_matrix ()"),
-               doc = """Accumulated density matrix.""")
+               getter = cfunction("std::vector<matrix_view<triqs_cthyb::h_scalar_t>> density_matrix_view ()"),
+               doc = """Accumulated density matrix.\n Views on the memory of the solver (no copy): use ``copy()`` to keep them beyond the next solve.""")
 
 c.add_property(name = "h_loc_diagonalization",
                getter = cfunction("triqs_cthyb::atom_diag h_loc_diagonalization ()"),
@@ -282,6 +366,22 @@ c.add_property(name = "performance_analysis",
                getter = cfunction("triqs_cthyb::histo_map_t get_performance_analysis ()"),
                doc = """Histograms related to the performance analysis.""")
 
+c.add_property(name = "performance_counters",
+               getter = cfunction("triqs_cthyb::performance_counters_t get_performance_counters ()"),
+               doc = """Counters and timers (in seconds) of the moves, the trace and the measures in the last solve, summed over the processes.\n Empty unless cthyb is compiled with the Performance_counters option.""")
+
+c.add_property(name = "autocorrelation_times",
+               getter = cfunction("triqs_cthyb::autocorrelation_times_t get_autocorrelation_times ()"),
+               doc = """Integrated autocorrelation times (in measurements), effective numbers of samples and effective samples per second\n of the sign, the perturbation order and the first G_l coefficients, as "<observable>/tau_int" etc. Set with measure_autocorrelation.""")
+
+c.add_property(name = "G2_stream_file",
+               getter = cfunction("std::string get_G2_stream_file ()"),
+               doc = """HDF5 file of the G2 measures of the last solve, written with measure_G2_stream_file (empty otherwise).\n The G2 containers are then empty.""")
+
+c.add_property(name = "trace_pruning_error",
+               getter = cfunction("double trace_pruning_error ()"),
+               doc = """Sum of the largest shares of the bound of the trace of the atomic subspaces dropped after the warmup (trace_prune_tolerance).\n An estimate of the relative error on the trace, the largest over the processes. 0 without pruning.""")
+
 c.add_property(name = "average_sign",
                getter = cfunction("triqs_cthyb::mc_weight_t average_sign ()"),
                doc = """Monte Carlo average sign.""")
@@ -308,6 +408,16 @@ c.add_member(c_name = "n_cycles",
              initializer = """  """,
              doc = """Number of QMC cycles""")
 
+c.add_member(c_name = "balanced_accumulation",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Accumulate until all the processes together did n_cycles times their number: faster processes do more cycles, and all stop together""")
+
+c.add_member(c_name = "balanced_check_interval",
+             c_type = "int",
+             initializer = """ 100 """,
+             doc = """Number of cycles between two progress reports of a process, in the balanced accumulation""")
+
 c.add_member(c_name = "partition_method",
              c_type = "std::string",
              initializer = """ "autopartition" """,
@@ -328,6 +438,11 @@ c.add_member(c_name = "loc_n_max",
              initializer = """ INT_MAX """,
              doc = """Restrict local Hilbert space to states with at most this number of particles\n     default: INT_MAX""")
 
+c.add_member(c_name = "atom_diag_cache_file",
+             c_type = "std::string",
+             initializer = """ "" """,
+             doc = """If not empty, HDF5 file in which the diagonalization of the local Hamiltonian is kept, and reused while the local problem is unchanged""")
+
 c.add_member(c_name = "length_cycle",
              c_type = "int",
              initializer = """ 50 """,
@@ -338,11 +453,41 @@ c.add_member(c_name = "n_warmup_cycles",
              initializer = """ 5000 """,
              doc = """Number of cycles for thermalization\n     default: 5000""")
 
+c.add_member(c_name = "warm_start",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Start from the final configuration of the previous solve (of this solver, or read from configuration_file), with the dets rebuilt for the new Delta""")
+
+c.add_member(c_name = "n_warmup_cycles_warm_start",
+             c_type = "int",
+             initializer = """ -1 """,
+             doc = """Number of cycles for thermalization after a successful warm start. -1: n_warmup_cycles""")
+
+c.add_member(c_name = "configuration_file",
+             c_type = "std::string",
+             initializer = """ "" """,
+             doc = """If not empty, each process writes its final configuration to <configuration_file>.<rank>.h5, and a warm start reads it from there""")
+
 c.add_member(c_name = "random_seed",
              c_type = "int",
              initializer = """ 34788+928374*triqs::mpi::communicator().rank() """,
              doc = """Seed for random number generator\n     default: 34788 + 928374 * MPI.rank""")
 
+c.add_member(c_name = "n_walkers",
+             c_type = "int",
+             initializer = """ 1 """,
+             doc = """Number of independent Markov chains run in threads by each process. They share the atomic problem and Delta; their results are combined before the MPI reduction.""")
+
+c.add_member(c_name = "walker_placement",
+             c_type = "std::string",
+             initializer = """ "none" """,
+             doc = """Threads of the walkers after the first: none, cores (pinned to cores spread over the NUMA nodes and the processes of a node, data built there) or numa (idem, h_diag per node)""")
+
+c.add_member(c_name = "max_memory",
+             c_type = "double",
+             initializer = """ -1 """,
+             doc = """Upper bound of the estimated memory per process in MiB, checked before the allocations of solve (see estimate_memory). No limit if negative.""")
+
 c.add_member(c_name = "random_name",
              c_type = "std::string",
              initializer = """ "" """,
@@ -368,6 +513,11 @@ c.add_member(c_name = "move_double",
              initializer = """ false """,
              doc = """Add double insertions as a move?""")
 
+c.add_member(c_name = "move_insert_n_tries",
+             c_type = "int",
+             initializer = """ 1 """,
+             doc = """Number of candidate pairs drawn by the insertion of a c, c^dagger pair (multiple-try Metropolis, weighted by a bound of the trace). 1: a single candidate""")
+
 c.add_member(c_name = "use_trace_estimator",
              c_type = "bool",
              initializer = """ false """,
@@ -383,6 +533,16 @@ c.add_member(c_name = "measure_G_l",
              initializer = """ false """,
              doc = """Measure G_l (Legendre)?""")
 
+c.add_member(c_name = "measure_G_iw_nfft",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Measure G(iw) directly from the configurations with NFFT, without binning in imaginary time?""")
+
+c.add_member(c_name = "measure_G_iw_nfft_n_iw",
+             c_type = "int",
+             initializer = """ 0 """,
+             doc = """Number of positive Matsubara frequencies of the NFFT measurement of G(iw). 0: n_iw of the solver.""")
+
 c.add_member(c_name = "measure_O_tau",
              c_type = "std::optional<std::pair<many_body_op_t, many_body_op_t> >",
              initializer = """ std::optional<std::pair<many_body_op_t,many_body_op_t>>{} """,
@@ -393,6 +553,11 @@ c.add_member(c_name = "measure_O_tau_min_ins",
              initializer = """ 10 """,
              doc = """Minumum of operator insertions in: O_tau by insertion measure""")
 
+c.add_member(c_name = "measure_O_tau_sweep",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Evaluate O_tau on the whole tau mesh for each time of O1, from the partial products of the configuration, instead of inserting both operators at random times""")
+
 c.add_member(c_name = "measure_G2_tau",
              c_type = "bool",
              initializer = """ false """,
@@ -471,23 +636,93 @@ c.add_member(c_name = "measure_G2_n_l",
 c.add_member(c_name = "measure_G2_iwll_nfft_buf_size",
              c_type = "int",
              initializer = """ 100 """,
-             doc = """NFFT buffer size for G^4(iomega,l,l\') measurement.""")
+             doc = """Deprecated and ignored: the batched NFFT spreads the nodes on its grid without a buffer.""")
+
+c.add_member(c_name = "measure_G2_iw_gemm",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Accumulate the scattering matrix of the G^4(inu,inu',inu'') measurements (without NFFT) with matrix products. Faster for many frequencies and large expansion orders.""")
+
+c.add_member(c_name = "measure_G2_iw_conj_symmetry",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Accumulate G^4 in Matsubara frequencies only for a non-negative first frequency, the rest from G^4(-w) = conj(G^4(w)). Requires a real Delta(tau) and h_loc.""")
+
+c.add_member(c_name = "measure_G2_tau_grouped",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Accumulate G^4(tau,tau',tau'') from precomputed time bins, with contributions flushed in memory order and block pairs split across OpenMP threads.""")
+
+c.add_member(c_name = "measure_G2_every_n_cycles",
+             c_type = "int",
+             initializer = """ 1 """,
+             doc = """Accumulate the G^4 measures every n cycles only. 0: adaptive, from the timings of the first cycles, so that measuring takes about as long as the moves.""")
+
+c.add_member(c_name = "measure_G2_async_threads",
+             c_type = "int",
+             initializer = """ 0 """,
+             doc = """Number of threads accumulating the Matsubara G^4 measures from snapshots of the scattering matrices, while the Markov chain goes on. 0: in the Markov chain.""")
+
+c.add_member(c_name = "measure_G2_reduction",
+             c_type = "std::string",
+             initializer = """ "all" """,
+             doc = """MPI reduction of the G2 containers: all (all-reduce), chunked (in-place all-reduce in chunks) or root (in-place reduce in chunks to rank 0 only)""")
+
+c.add_member(c_name = "mpi_reduction_chunk_mb",
+             c_type = "int",
+             initializer = """ 64 """,
+             doc = """Size in MiB of the chunks of the chunked reductions of the G2 containers""")
+
+c.add_member(c_name = "measure_G2_stream_file",
+             c_type = "std::string",
+             initializer = """ "" """,
+             doc = """If not empty, the G2 measures are written by rank 0 to this HDF5 file, in chunks, instead of being kept in the containers. Requires measure_G2_reduction = root""")
+
+c.add_member(c_name = "measure_G2_stream_deflate",
+             c_type = "int",
+             initializer = """ 0 """,
+             doc = """Deflate (gzip) level 0-9 of the datasets of measure_G2_stream_file. 0: no compression""")
 
 c.add_member(c_name = "nfft_buf_sizes",
              c_type = "std::map<std::string, int>",
              initializer = """ (std::map<std::string,int>{}) """,
-             doc = """NFFT buffer sizes for different blocks\n     default: 100 for every block""")
+             doc = """Deprecated and ignored: the batched NFFT spreads the nodes on its grid without a buffer.""")
+
+c.add_member(c_name = "nfft_fftw_wisdom_file",
+             c_type = "std::string",
+             initializer = """ "" """,
+             doc = """File of FFTW wisdom for the NFFT measures, read before planning and written after it (by the first rank). Empty: no wisdom file.""")
+
+c.add_member(c_name = "nfft_fftw_planner",
+             c_type = "std::string",
+             initializer = """ "estimate" """,
+             doc = """Planner of the FFTs of the NFFT measures: estimate, measure or patient. Costly plans are best kept in nfft_fftw_wisdom_file.""")
 
 c.add_member(c_name = "measure_pert_order",
              c_type = "bool",
              initializer = """ false """,
              doc = """Measure perturbation order?""")
 
+c.add_member(c_name = "measure_autocorrelation",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Measure the integrated autocorrelation times of the sign, the perturbation order and the first G_l coefficients, by logarithmic binning?""")
+
+c.add_member(c_name = "measure_autocorrelation_n_l",
+             c_type = "int",
+             initializer = """ 4 """,
+             doc = """Number of Legendre coefficients of G_l (trace of each block) in measure_autocorrelation""")
+
 c.add_member(c_name = "measure_density_matrix",
              c_type = "bool",
              initializer = """ false """,
              doc = """Measure the reduced impurity density matrix?""")
 
+c.add_member(c_name = "defer_measures",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Accumulate G_tau, G_l, G_iw_nfft and the G2 measures once per configuration, with the sum of the signs of its cycles, instead of at every cycle""")
+
 c.add_member(c_name = "use_norm_as_weight",
              c_type = "bool",
              initializer = """ false """,
@@ -498,6 +733,61 @@ c.add_member(c_name = "performance_analysis",
              initializer = """ false """,
              doc = """Analyse performance of trace computation with histograms (developers only)?""")
 
+c.add_member(c_name = "timeline_file",
+             c_type = "std::string",
+             initializer = """ "" """,
+             doc = """If not empty, a timeline of the solve (phases, sampled moves, trace computations and measures) is written to <timeline_file>.<rank>.json, as Chrome trace events""")
+
+c.add_member(c_name = "timeline_sample_interval",
+             c_type = "int",
+             initializer = """ 100 """,
+             doc = """Only one call in timeline_sample_interval of the moves, trace computations and accumulations is recorded in the timeline""")
+
+c.add_member(c_name = "progress_file",
+             c_type = "std::string",
+             initializer = """ "" """,
+             doc = """If not empty, the progress of each process is written every progress_interval seconds as JSON lines to <progress_file>.<rank>.jsonl ("-": stdout)""")
+
+c.add_member(c_name = "progress_interval",
+             c_type = "double",
+             initializer = """ 10.0 """,
+             doc = """Interval of the progress lines, in seconds""")
+
+c.add_member(c_name = "snapshot_file",
+             c_type = "std::string",
+             initializer = """ "" """,
+             doc = """If not empty, normalized snapshots of G_tau, G_l, the density matrix and the average sign are appended to this HDF5 file every snapshot_interval seconds""")
+
+c.add_member(c_name = "snapshot_interval",
+             c_type = "double",
+             initializer = """ 3600.0 """,
+             doc = """Interval of the snapshots, in seconds""")
+
+c.add_member(c_name = "trace_parallel_blocks",
+             c_type = "int",
+             initializer = """ 0 """,
+             doc = """Number of leading blocks of the trace evaluated in parallel with OpenMP before the truncation (0 = serial)""")
+
+c.add_member(c_name = "trace_energy_cutoff",
+             c_type = "double",
+             initializer = """ -1 """,
+             doc = """Keep only the atomic eigenstates with beta*(E-E_0) <= trace_energy_cutoff in the trace (if > 0). Empty blocks are dropped""")
+
+c.add_member(c_name = "trace_prune_tolerance",
+             c_type = "double",
+             initializer = """ 0 """,
+             doc = """After the warmup, drop from the trace the atomic subspaces whose share of the bound of the trace at the root stayed below this tolerance (if > 0)""")
+
+c.add_member(c_name = "trace_single_precision_tol",
+             c_type = "double",
+             initializer = """ 0 """,
+             doc = """Store the cached partial products of the trace in single precision where their relative rounding error is below this tolerance (0: double). Needs trace_parallel_blocks <= 1""")
+
+c.add_member(c_name = "trace_single_min_block_dim",
+             c_type = "int",
+             initializer = """ 16 """,
+             doc = """With trace_single_precision_tol: only the blocks of at least this dimension are cached in single precision""")
+
 c.add_member(c_name = "proposal_prob",
              c_type = "std::map<std::string, double>",
              initializer = """ (std::map<std::string,double>{}) """,
@@ -513,6 +803,11 @@ c.add_member(c_name = "move_global_prob",
              initializer = """ 0.05 """,
              doc = """Overall probability of the global moves""")
 
+c.add_member(c_name = "adaptive_warmup",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Tune the weights of the moves, the proposal probabilities of the blocks and the shift window during the warmup, for more accepted moves per second. Frozen afterwards""")
+
 c.add_member(c_name = "imag_threshold",
              c_type = "double",
              initializer = """ 1.e-15 """,
@@ -538,11 +833,41 @@ c.add_member(c_name = "det_precision_error",
              initializer = """ 1.e-5 """,
              doc = """Threshold for determinant precision error""")
 
+c.add_member(c_name = "det_adaptive_check",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Adapt the interval between the checks of M^-1 of each block to the deviations met at the checks, starting from det_n_operations_before_check""")
+
 c.add_member(c_name = "det_singular_threshold",
              c_type = "double",
              initializer = """ -1 """,
              doc = """Bound for the determinant matrix being singular, abs(det) > singular_threshold. If <0, it is !isnormal(abs(det))""")
 
+c.add_member(c_name = "delta_interpolation",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Evaluate Delta(tau) in the determinants by linear interpolation between mesh points, instead of taking the closest mesh point""")
+
+c.add_member(c_name = "delta_node_shared_memory",
+             c_type = "bool",
+             initializer = """ false """,
+             doc = """Store the tables of Delta(tau) once per node, in MPI-3 shared memory, instead of once per process. The diagonalization of h_loc and the operator matrices stay per process""")
+
+c.add_member(c_name = "mpi_group_ranks",
+             c_type = "std::vector<int>",
+             initializer = """ std::vector<int>{} """,
+             doc = """Ranks in MPI_COMM_WORLD of the processes which do this solve, collectively, e.g. for concurrent problems (Solver.solve_batch). Empty: all""")
+
+c.add_member(c_name = "replica_h_int_scalings",
+             c_type = "std::vector<double>",
+             initializer = """ std::vector<double>{} """,
+             doc = """Replica exchange: scalings of h_int of the replicas, run by consecutive processes (chains of this size). Only those at 1 measure. Empty: none""")
+
+c.add_member(c_name = "replica_swap_interval",
+             c_type = "int",
+             initializer = """ 10 """,
+             doc = """Replica exchange: cycles between two proposals of swaps of the configurations of neighbouring replicas""")
+
 module.add_converter(c)
 
 # Converter for constr_parameters_t
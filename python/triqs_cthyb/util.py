@@ -31,6 +31,9 @@ def block_size_from_gf_struct(block_name, gf_struct):
     return block_size
     
 def estimate_nfft_buf_size(gf_struct, pert_order_histograms):
+    r"""
+    Deprecated: the solver ignores nfft_buf_sizes since its NFFT spreads the nodes without a buffer.
+    """
     buf_sizes = {}
     for bn, idxs in gf_struct:
         if not bn in pert_order_histograms:
@@ -41,3 +44,40 @@ def estimate_nfft_buf_size(gf_struct, pert_order_histograms):
             buf_sizes[bn] = int(max(ceil((max_order * max_order) / (block_size * block_size)), 1))
 
     return buf_sizes
+
+class G2_stream_block:
+    r"""
+    One block of a G2 measure in a file written with measure_G2_stream_file.
+    The data is only read when sliced, e.g. ``block[0]`` for the first frequency.
+    """
+    def __init__(self, group):
+        self.group = group
+        self.dataset = group['data']
+
+    @property
+    def shape(self):
+        return self.dataset.shape[:-1]
+
+    def __getitem__(self, key):
+        if not isinstance(key, tuple): key = (key,)
+        d = self.dataset[key + (Ellipsis, slice(None))]
+        return d[..., 0] + 1j * d[..., 1]
+
+class G2_stream:
+    r"""
+    The G2 measures of a solve written with measure_G2_stream_file (see SolverCore.G2_stream_file),
+    as lazily loaded blocks: ``G2_stream(S.G2_stream_file)['G2_iw', 'up', 'dn'][0]``.
+    """
+    def __init__(self, file_name):
+        import h5py
+        self.file = h5py.File(file_name, 'r')
+
+    def keys(self):
+        return [(m, b1, b2) for m in self.file for b1 in self.file[m] for b2 in self.file[m][b1]]
+
+    def __getitem__(self, key):
+        measure, b1, b2 = key
+        return G2_stream_block(self.file[measure][b1][b2])
+
+    def close(self):
+        self.file.close()
@@ -0,0 +1,73 @@
+#include <triqs_cthyb/qmc_data.hpp>
+#include <triqs/test_tools/arrays.hpp>
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+using namespace triqs_cthyb;
+using namespace triqs::gfs;
+using triqs::utility::time_pt;
+
+// The entries of a det_batch_t, against the loops over the dets of the measures: foreach for the elements of M,
+// and det_position_x and det_position_y for the positions of the operators
+TEST(DetBatch, AgainstForeach) {
+
+  double beta = 10.0;
+  int n_orb   = 2;
+  std::mt19937 rng(2468);
+  std::uniform_real_distribution<double> u(0, 1);
+  std::uniform_int_distribution<std::uint64_t> ticks;
+
+  gf<imtime, delta_target_t> delta{{beta, Fermion, 201}, {n_orb, n_orb}};
+  for (int k = 0; k < delta.mesh().size(); ++k)
+    for (int i = 0; i < n_orb; ++i)
+      for (int j = 0; j < n_orb; ++j) delta.data()(k, i, j) = 2 * u(rng) - 1;
+  qmc_data::delta_block_adaptor f(qmc_data::delta_block_adaptor::make_table(delta, true));
+
+  // Operators at random times, in decreasing time order
+  auto random_ops = [&](int n) {
+    std::vector<std::uint64_t> t(n);
+    for (auto &k : t) k = ticks(rng);
+    std::sort(t.rbegin(), t.rend());
+    std::vector<det_type::x_type> ops;
+    for (auto k : t) ops.emplace_back(time_pt(k, beta), int(u(rng) * n_orb));
+    return ops;
+  };
+
+  std::vector<det_type> dets;
+  for (int n : {5, 0, 9}) dets.emplace_back(f, random_ops(n), random_ops(n));
+  // an insertion and a removal, so that the storage of the det is no longer in time order
+  for (auto &det : dets) {
+    if (det.size() < 2) continue;
+    auto x = random_ops(1)[0], y = random_ops(1)[0];
+    det.try_insert(det_position_x(det, x.first), det_position_y(det, y.first), x, y);
+    det.complete_operation();
+    det.try_remove(1, 0);
+    det.complete_operation();
+  }
+
+  det_batch_t batch;
+  batch.clear();
+  for (auto const &det : dets) batch.push_back_block(det);
+  ASSERT_EQ(batch.n_blocks(), int(dets.size()));
+
+  for (int b = 0; b < int(dets.size()); ++b) {
+    auto const &det = dets[b];
+    ASSERT_EQ(batch.size(b), long(det.size()) * det.size());
+    std::map<std::pair<time_pt, time_pt>, det_scalar_t> ref;
+    foreach (det, [&](op_t const &x, op_t const &y, det_scalar_t M) { ref[{x.first, y.first}] = M; });
+    for (long k = batch.start[b]; k < batch.start[b + 1]; ++k) {
+      auto it = ref.find({batch.x[k].first, batch.y[k].first});
+      ASSERT_TRUE(it != ref.end());
+      EXPECT_EQ(batch.M[k], it->second);
+      EXPECT_EQ(batch.x_pos[k], det_position_x(det, batch.x[k].first) - 1);
+      EXPECT_EQ(batch.y_pos[k], det_position_y(det, batch.y[k].first) - 1);
+      EXPECT_EQ(batch.M_signed[k], (batch.y[k].first >= batch.x[k].first ? batch.M[k] : -batch.M[k]));
+      ref.erase(it);
+    }
+    EXPECT_TRUE(ref.empty());
+  }
+}
+
+MAKE_MAIN;
@@ -0,0 +1,81 @@
+#include <triqs/test_tools/gfs.hpp>
+
+#include <triqs/atom_diag/atom_diag.hpp>
+#include <triqs/hilbert_space/fundamental_operator_set.hpp> // gf_struct_t
+using gf_struct_t = triqs::hilbert_space::gf_struct_t;
+
+using namespace triqs::hilbert_space;
+using namespace triqs::operators;
+
+#include <triqs_cthyb/types.hpp>
+#include <triqs_cthyb/impurity_trace.hpp>
+#include <triqs_cthyb/configuration.hpp> // for op_desc
+
+using triqs_cthyb::op_desc;
+
+// -----------------------------------------------------------------------------
+// The sweep of measure_O_tau (compute_aux_pair_traces) against the insertion of both auxiliary operators in the tree,
+// as for the random insertions, on a fixed configuration. op2 lands in every segment between the operators, and past beta.
+TEST(impurity_trace, compute_aux_pair_traces) {
+
+  gf_struct_t gf_struct{{"up", {0}}, {"dn", {0}}};
+  fundamental_operator_set fops(gf_struct);
+
+  double U  = 1.0;
+  double mu = 0.3 * U;
+
+  many_body_operator_real H;
+  H += -mu * (n("up", 0) + n("dn", 0)) + U * n("up", 0) * n("dn", 0);
+
+  auto ad = triqs::atom_diag::atom_diag<triqs_cthyb::is_h_scalar_complex>(H, fops);
+
+  double beta = 1.0;
+  triqs_cthyb::time_segment tau_seg(beta);
+  triqs_cthyb::impurity_trace imp_trace(beta, ad, nullptr);
+
+  auto make_op = [&](int block_index, bool dagger) {
+    return op_desc{block_index, 0, dagger, fops[{std::string(block_index == 0 ? "up" : "dn"), 0}]};
+  };
+
+  // up c^dagger at 0.8, dn c^dagger at 0.6, up c at 0.4, dn c at 0.2
+  imp_trace.try_insert(tau_seg.make_time_pt(0.8), make_op(0, true));
+  imp_trace.try_insert(tau_seg.make_time_pt(0.6), make_op(1, true));
+  imp_trace.try_insert(tau_seg.make_time_pt(0.4), make_op(0, false));
+  imp_trace.try_insert(tau_seg.make_time_pt(0.2), make_op(1, false));
+  imp_trace.compute();
+  imp_trace.confirm_insert();
+
+  // Diagonal and block changing pairs
+  std::vector<std::pair<many_body_operator_real, many_body_operator_real>> pairs = {
+     {n("up", 0), n("dn", 0)},
+     {c_dag("up", 0) * c("dn", 0), c_dag("dn", 0) * c("up", 0)},
+  };
+
+  // op2 at 0.35, 0.5, 0.75, 0.9, 0.05 and 0.15
+  double tau1               = 0.3;
+  std::vector<double> dtaus = {0.05, 0.2, 0.45, 0.6, 0.75, 0.85};
+
+  for (auto const &p : pairs) {
+    auto op1_d = imp_trace.attach_aux_operator(p.first);
+    auto op2_d = imp_trace.attach_aux_operator(p.second);
+
+    std::vector<triqs_cthyb::h_scalar_t> traces;
+    imp_trace.compute_aux_pair_traces(op1_d, op2_d, tau_seg.make_time_pt(tau1), dtaus, traces);
+    ASSERT_EQ(traces.size(), dtaus.size());
+
+    bool non_zero = false;
+    for (int j = 0; j < int(dtaus.size()); ++j) {
+      imp_trace.try_insert(tau_seg.make_time_pt(tau1), op1_d);
+      imp_trace.try_insert(tau_seg.make_time_pt(std::fmod(tau1 + dtaus[j], beta)), op2_d);
+      auto w = imp_trace.compute();
+      imp_trace.cancel_insert();
+
+      auto reference = w.first * w.second;
+      EXPECT_NEAR(std::abs(traces[j] - reference), 0, 1e-12 * std::max(1.0, std::abs(reference)));
+      non_zero = non_zero || (std::abs(reference) > 1e-6);
+    }
+    EXPECT_TRUE(non_zero);
+  }
+}
+
+MAKE_MAIN;
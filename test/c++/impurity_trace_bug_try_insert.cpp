@@ -102,4 +102,50 @@ TEST(impurity_trace, try_insert_cancel_bug) {
   }
 }
 
+// -----------------------------------------------------------------------------
+// The first insertion of a move collides with a node of a populated tree: cancel_insert must leave the tree unchanged
+TEST(impurity_trace, try_insert_cancel_first_collision) {
+
+  gf_struct_t gf_struct{{"up", {0}}, {"dn", {0}}};
+  fundamental_operator_set fops(gf_struct);
+  auto linindex = make_linear_index(gf_struct, fops);
+
+  double U  = 1.0;
+  double mu = 0.5 * U;
+
+  many_body_operator_real H;
+  H += -mu * (n("up", 0) + n("dn", 0)) + U * n("up", 0) * n("dn", 0);
+
+  auto ad = triqs::atom_diag::atom_diag<triqs_cthyb::is_h_scalar_complex>(H, fops);
+
+  double beta = 1.0;
+  triqs_cthyb::impurity_trace imp_trace(beta, ad, nullptr);
+
+  auto op1 = triqs_cthyb::op_desc{0, 0, true, linindex[std::make_pair(0, 0)]};
+  auto op2 = triqs_cthyb::op_desc{0, 0, false, linindex[std::make_pair(0, 0)]};
+
+  triqs_cthyb::time_segment tau_seg(beta);
+  auto tau1 = tau_seg.make_time_pt(0.7);
+  auto tau2 = tau_seg.make_time_pt(0.3);
+
+  // A tree of two operators
+  imp_trace.try_insert(tau1, op1);
+  imp_trace.try_insert(tau2, op2);
+  imp_trace.compute();
+  imp_trace.confirm_insert();
+  auto root   = imp_trace.tree.get_root();
+  auto weight = imp_trace.compute();
+
+  // A move whose first insertion falls on an existing time
+  EXPECT_THROW(imp_trace.try_insert(tau1, op2), rbt_insert_error);
+  imp_trace.cancel_insert();
+
+  EXPECT_EQ(imp_trace.tree_size, 2);
+  EXPECT_EQ(imp_trace.tree.size(), 2);
+  EXPECT_EQ(imp_trace.tree.get_root(), root);
+  auto weight_after = imp_trace.compute();
+  EXPECT_EQ(weight_after.first, weight.first);
+  EXPECT_EQ(weight_after.second, weight.second);
+}
+
 MAKE_MAIN;
@@ -0,0 +1,88 @@
+#include <triqs/test_tools/gfs.hpp>
+
+#include <triqs/atom_diag/atom_diag.hpp>
+#include <triqs/hilbert_space/fundamental_operator_set.hpp> // gf_struct_t
+using gf_struct_t = triqs::hilbert_space::gf_struct_t;
+
+using namespace triqs::hilbert_space;
+using namespace triqs::operators;
+
+#include <triqs_cthyb/types.hpp>
+#include <triqs_cthyb/impurity_trace.hpp>
+#include <triqs_cthyb/configuration.hpp> // for op_desc
+
+#include <cmath>
+
+using triqs_cthyb::op_desc;
+
+// -----------------------------------------------------------------------------
+// The pruning of the subspaces (prune_blocks) for the Hubbard atom, with E = 0, -1, -1, 2 for |0>, |up>, |dn>, |up,dn> and beta = 10.
+// The relative bounds of the blocks at the root are recorded for two configurations:
+//  - A: up c at 9 and up c^dagger at 1. |0> goes through |up> (bound e^{8}), |dn> through |up,dn> (e^{-14}).
+//  - B: up c^dagger at 2 and up c at 1. |up> goes through |0> (bound e^{9}), |up,dn> through |dn> (e^{-17}).
+// |up,dn> is dropped for a tolerance between its relative bound 1 / (e^{26} + 1) and the one of |dn>, 1 / (e^{22} + 1).
+// The blocks are one dimensional, so that their bounds are their contributions: the trace of B changes by the estimated error.
+TEST(impurity_trace, prune_blocks) {
+
+  gf_struct_t gf_struct{{"up", {0}}, {"dn", {0}}};
+  fundamental_operator_set fops(gf_struct);
+
+  double U  = 4.0;
+  double mu = 1.0;
+
+  many_body_operator_real H;
+  H += -mu * (n("up", 0) + n("dn", 0)) + U * n("up", 0) * n("dn", 0);
+
+  auto ad = triqs::atom_diag::atom_diag<triqs_cthyb::is_h_scalar_complex>(H, fops);
+
+  double beta = 10.0;
+  triqs_cthyb::time_segment tau_seg(beta);
+
+  auto make_op = [&](int block_index, bool dagger) {
+    return op_desc{block_index, 0, dagger, fops[{std::string(block_index == 0 ? "up" : "dn"), 0}]};
+  };
+
+  // The weight of B and the estimated error of the pruning of the blocks recorded with A and B, with the number of blocks kept
+  auto prune = [&](double tolerance) {
+    triqs_cthyb::impurity_trace imp_trace(beta, ad, nullptr);
+    imp_trace.record_block_weights = true;
+
+    imp_trace.try_insert(tau_seg.make_time_pt(9.0), make_op(0, false));
+    imp_trace.try_insert(tau_seg.make_time_pt(1.0), make_op(0, true));
+    imp_trace.compute();
+    imp_trace.cancel_insert();
+
+    imp_trace.try_insert(tau_seg.make_time_pt(2.0), make_op(0, true));
+    imp_trace.try_insert(tau_seg.make_time_pt(1.0), make_op(0, false));
+    auto w = imp_trace.compute().first;
+    imp_trace.confirm_insert();
+
+    double error  = imp_trace.prune_blocks(tolerance);
+    auto w_pruned = imp_trace.compute().first;
+    EXPECT_EQ(imp_trace.n_blocks, 4);
+    return std::make_tuple(w, w_pruned, error, imp_trace.n_blocks_kept());
+  };
+
+  double error_up_dn = 1 / (std::exp(26.0) + 1);
+  double error_dn    = 1 / (std::exp(22.0) + 1);
+
+  // Below the relative bound of |up,dn>: nothing is dropped
+  {
+    auto [w, w_pruned, error, n_kept] = prune(0.5 * error_up_dn);
+    EXPECT_EQ(error, 0);
+    EXPECT_EQ(n_kept, 4);
+    EXPECT_NEAR(std::abs(w_pruned - w), 0, 1e-14 * std::abs(w));
+  }
+
+  // Between those of |up,dn> and |dn>: |up,dn> is dropped, and B loses its contribution
+  {
+    double tolerance                  = std::sqrt(error_up_dn * error_dn);
+    auto [w, w_pruned, error, n_kept] = prune(tolerance);
+    EXPECT_EQ(n_kept, 3);
+    EXPECT_NEAR(error, error_up_dn, 1e-8 * error_up_dn);
+    EXPECT_LT(error, tolerance);
+    EXPECT_NEAR(std::abs(w_pruned - w), error * std::abs(w), 1e-14 * std::abs(w));
+  }
+}
+
+MAKE_MAIN;
@@ -0,0 +1,98 @@
+#include <triqs/test_tools/gfs.hpp>
+
+#include <triqs/atom_diag/atom_diag.hpp>
+#include <triqs/hilbert_space/fundamental_operator_set.hpp> // gf_struct_t
+using gf_struct_t = triqs::hilbert_space::gf_struct_t;
+
+using namespace triqs::hilbert_space;
+using namespace triqs::operators;
+
+#include <triqs_cthyb/types.hpp>
+#include <triqs_cthyb/impurity_trace.hpp>
+#include <triqs_cthyb/configuration.hpp> // for op_desc
+
+#include <algorithm>
+#include <functional>
+
+using triqs_cthyb::op_desc;
+using triqs_cthyb::time_pt;
+
+// -----------------------------------------------------------------------------
+// try_shift, in place or not, against try_delete + try_insert, for shifts to earlier and later times,
+// over an operator of the other block or not. The confirmed tree must stay ordered, with a consistent cache.
+TEST(impurity_trace, try_shift) {
+
+  gf_struct_t gf_struct{{"up", {0}}, {"dn", {0}}};
+  fundamental_operator_set fops(gf_struct);
+
+  double U  = 1.0;
+  double mu = 0.3 * U;
+
+  many_body_operator_real H;
+  H += -mu * (n("up", 0) + n("dn", 0)) + U * n("up", 0) * n("dn", 0);
+
+  auto ad = triqs::atom_diag::atom_diag<triqs_cthyb::is_h_scalar_complex>(H, fops);
+
+  double beta = 1.0;
+  triqs_cthyb::time_segment tau_seg(beta);
+
+  auto make_op = [&](int block_index, bool dagger) {
+    return op_desc{block_index, 0, dagger, fops[{std::string(block_index == 0 ? "up" : "dn"), 0}]};
+  };
+
+  // Operator to shift (block, dagger) and its new time
+  struct shift_t {
+    int block_index;
+    bool dagger;
+    double tau;
+  };
+  std::vector<shift_t> shifts = {
+     {0, true, 0.5},  // earlier, over the dn c^dagger
+     {0, true, 0.7},  // earlier, in place
+     {1, false, 0.3}, // later, in place
+     {1, false, 0.5}, // later, over the up c
+     {0, false, 0.1}, // earlier, over the dn c
+     {1, true, 0.9},  // later, over the up c^dagger
+  };
+
+  for (auto const &s : shifts) {
+
+    // up c^dagger at 0.8, dn c^dagger at 0.6, up c at 0.4, dn c at 0.2
+    triqs_cthyb::impurity_trace imp_trace(beta, ad, nullptr);
+    imp_trace.try_insert(tau_seg.make_time_pt(0.8), make_op(0, true));
+    imp_trace.try_insert(tau_seg.make_time_pt(0.6), make_op(1, true));
+    imp_trace.try_insert(tau_seg.make_time_pt(0.4), make_op(0, false));
+    imp_trace.try_insert(tau_seg.make_time_pt(0.2), make_op(1, false));
+    imp_trace.compute();
+    imp_trace.confirm_insert();
+
+    auto tau = tau_seg.make_time_pt(s.tau);
+    auto op  = make_op(s.block_index, s.dagger);
+
+    // Reference
+    imp_trace.try_delete(0, s.block_index, s.dagger);
+    imp_trace.try_insert(tau, op);
+    auto reference = imp_trace.compute();
+    imp_trace.cancel_shift();
+
+    auto tau_old = imp_trace.try_shift(0, s.block_index, s.dagger, tau, op);
+    auto w       = imp_trace.compute();
+    double tol   = 1e-12 * std::max(1.0, std::abs(reference.first));
+    EXPECT_NEAR(std::abs(w.first - reference.first), 0, tol);
+    imp_trace.confirm_shift();
+
+    // The keys of the tree, latest first
+    std::vector<time_pt> keys;
+    foreach (imp_trace.tree, [&](auto n) { keys.push_back(n->key); });
+    EXPECT_EQ(imp_trace.tree.size(), 4);
+    EXPECT_EQ(int(keys.size()), 4);
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end(), std::greater<time_pt>{}));
+    EXPECT_TRUE(std::find(keys.begin(), keys.end(), tau) != keys.end());
+    EXPECT_TRUE(std::find(keys.begin(), keys.end(), tau_old) == keys.end());
+
+    foreach_subtree_first(imp_trace.tree, [&](auto n) { imp_trace.check_cache_integrity_one_node(n, false); });
+    EXPECT_NEAR(std::abs(imp_trace.compute().first - reference.first), 0, tol);
+  }
+}
+
+MAKE_MAIN;
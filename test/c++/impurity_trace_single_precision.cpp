@@ -0,0 +1,82 @@
+#include <triqs/test_tools/gfs.hpp>
+
+#include <triqs/atom_diag/atom_diag.hpp>
+#include <triqs/hilbert_space/fundamental_operator_set.hpp> // gf_struct_t
+using gf_struct_t = triqs::hilbert_space::gf_struct_t;
+
+using namespace triqs::hilbert_space;
+using namespace triqs::operators;
+
+#include <triqs_cthyb/types.hpp>
+#include <triqs_cthyb/impurity_trace.hpp>
+#include <triqs_cthyb/configuration.hpp> // for op_desc
+
+using triqs_cthyb::op_desc;
+
+// -----------------------------------------------------------------------------
+// The single precision storage of the cache (trace_single_precision_tol) against the double precision trace, on a fixed configuration,
+// with the cached subtrees read back in a trial insertion. Each matrix stored in single precision has a rounding error below tol,
+// relative to the largest bound of the blocks of its node: the traces agree within n_single_matrices * tol, relative to the trace.
+TEST(impurity_trace, single_precision) {
+
+  // Two orbitals with a hopping: the blocks of (N_up, N_dn) have dimension up to 4
+  gf_struct_t gf_struct{{"up", {0, 1}}, {"dn", {0, 1}}};
+  fundamental_operator_set fops(gf_struct);
+
+  double U  = 2.0;
+  double mu = 0.5 * U;
+  double t  = 0.4;
+
+  many_body_operator_real H;
+  for (int a : {0, 1}) H += -mu * (n("up", a) + n("dn", a)) + U * n("up", a) * n("dn", a);
+  for (auto s : {"up", "dn"}) H += t * (c_dag(s, 0) * c(s, 1) + c_dag(s, 1) * c(s, 0));
+
+  auto ad = triqs::atom_diag::atom_diag<triqs_cthyb::is_h_scalar_complex>(H, fops);
+
+  double beta = 5.0;
+  double tol  = 1e-3;
+  triqs_cthyb::time_segment tau_seg(beta);
+
+  auto make_op = [&](int block_index, int a, bool dagger) {
+    return op_desc{block_index, a, dagger, fops[{std::string(block_index == 0 ? "up" : "dn"), a}]};
+  };
+
+  // The weight of the configuration, and of the trial insertion of a pair of dn operators, with the cache of the configuration
+  auto weights = [&](triqs_cthyb::impurity_trace &imp_trace) {
+    imp_trace.try_insert(tau_seg.make_time_pt(4.5), make_op(0, 0, true));
+    imp_trace.try_insert(tau_seg.make_time_pt(3.5), make_op(1, 0, true));
+    imp_trace.try_insert(tau_seg.make_time_pt(2.5), make_op(0, 1, false));
+    imp_trace.try_insert(tau_seg.make_time_pt(1.5), make_op(1, 1, false));
+    imp_trace.try_insert(tau_seg.make_time_pt(1.0), make_op(0, 1, true));
+    imp_trace.try_insert(tau_seg.make_time_pt(0.5), make_op(0, 0, false));
+    imp_trace.compute();
+    imp_trace.confirm_insert();
+    auto w = imp_trace.compute().first;
+
+    imp_trace.try_insert(tau_seg.make_time_pt(4.0), make_op(1, 1, true));
+    imp_trace.try_insert(tau_seg.make_time_pt(3.0), make_op(1, 0, false));
+    auto w_trial = imp_trace.compute().first;
+    imp_trace.cancel_insert();
+    return std::make_pair(w, w_trial);
+  };
+
+  triqs_cthyb::solve_parameters_t p;
+  p.verbosity = 0;
+  triqs_cthyb::impurity_trace imp_trace(beta, ad, nullptr, p);
+  auto w = weights(imp_trace);
+  EXPECT_EQ(imp_trace.n_single_matrices(), 0);
+
+  p.trace_single_precision_tol = tol;
+  p.trace_single_min_block_dim = 2;
+  triqs_cthyb::impurity_trace imp_trace_single(beta, ad, nullptr, p);
+  auto w_single = weights(imp_trace_single);
+  int n_single  = imp_trace_single.n_single_matrices();
+  EXPECT_GT(n_single, 0);
+
+  EXPECT_GT(std::abs(w.first), 1e-6);
+  EXPECT_GT(std::abs(w.second), 1e-6);
+  EXPECT_NEAR(std::abs(w_single.first - w.first), 0, n_single * tol * std::abs(w.first));
+  EXPECT_NEAR(std::abs(w_single.second - w.second), 0, n_single * tol * std::abs(w.second));
+}
+
+MAKE_MAIN;
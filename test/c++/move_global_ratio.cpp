@@ -0,0 +1,55 @@
+#include <triqs_cthyb/moves/global.hpp>
+#include <triqs/test_tools/arrays.hpp>
+
+#include <algorithm>
+#include <random>
+
+using namespace triqs_cthyb;
+using namespace triqs::gfs;
+using triqs::utility::time_pt;
+
+// The ratio of the low-rank update of the global moves, against try_refill of the det, on random substitutions
+// of the inner indices of a few rows and columns (low-rank form) or of many of them (full determinant)
+TEST(MoveGlobal, RatioOfRefill) {
+
+  double beta = 10.0;
+  int n_orb = 3, n = 12;
+  std::mt19937 rng(4321);
+  std::uniform_real_distribution<double> u(0, 1);
+
+  gf<imtime, delta_target_t> delta{{beta, Fermion, 201}, {n_orb, n_orb}};
+  for (int k = 0; k < delta.mesh().size(); ++k)
+    for (int i = 0; i < n_orb; ++i)
+      for (int j = 0; j < n_orb; ++j) delta.data()(k, i, j) = 2 * u(rng) - 1;
+  qmc_data::delta_block_adaptor f(qmc_data::delta_block_adaptor::make_table(delta, true));
+
+  // Operators at random times, in decreasing time order
+  auto random_ops = [&]() {
+    std::uniform_int_distribution<std::uint64_t> ticks;
+    std::vector<std::uint64_t> t(n);
+    for (auto &k : t) k = ticks(rng);
+    std::sort(t.rbegin(), t.rend());
+    std::vector<det_type::x_type> ops;
+    for (auto k : t) ops.emplace_back(time_pt(k, beta), int(u(rng) * n_orb));
+    return ops;
+  };
+  auto x = random_ops();
+  auto y = random_ops();
+  det_type det(f, x, y);
+
+  for (int n_subst : {1, 2, 3, 4, 8, 12}) {
+    for (int trial = 0; trial < 20; ++trial) {
+      auto x2 = x, y2 = y;
+      for (int k = 0; k < n_subst; ++k) {
+        auto &op = (k % 2 == 0 ? x2 : y2)[int(u(rng) * n)];
+        op.second = (op.second + 1 + int(u(rng) * (n_orb - 1))) % n_orb;
+      }
+      auto ratio     = det_ratio_of_refill(det, f, x2, y2);
+      auto reference = det.try_refill(x2, y2);
+      det.reject_last_try();
+      EXPECT_NEAR(std::abs(ratio - reference), 0, 1e-10 * std::max(1.0, std::abs(reference)));
+    }
+  }
+}
+
+MAKE_MAIN;
@@ -0,0 +1,64 @@
+#include <triqs/experimental/nfft_batch.hpp>
+#include <triqs/test_tools/arrays.hpp>
+
+#include <random>
+
+using namespace triqs::experimental;
+using dcomplex = std::complex<double>;
+
+// Matsubara frequency of the data index d of the mesh dimension
+double omega(nfft_mesh_dim_t const &dim, long d) { return (2 * (d + dim.first_index) + (dim.fermion ? 1 : 0)) * M_PI / dim.beta; }
+
+// The batched NFFT of random points, against the direct sum over the points, for Rank 1 and 2
+template <int Rank> void check_against_direct_sum(std::array<nfft_mesh_dim_t, Rank> const &dims, long n_functions, int n_points) {
+
+  long n_freq = 1;
+  for (auto const &dim : dims) n_freq *= dim.size;
+  std::vector<dcomplex> out(n_freq * n_functions, 0), direct(n_freq * n_functions, 0);
+
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<double> u(0, 1);
+  std::vector<std::array<double, Rank>> taus;
+  std::vector<std::vector<dcomplex>> values;
+  for (int j = 0; j < n_points; ++j) {
+    std::array<double, Rank> tau;
+    for (int r = 0; r < Rank; ++r) tau[r] = (2 * u(rng) - 1) * dims[r].beta; // in (-beta, beta), as the differences of times
+    std::vector<dcomplex> f(n_functions);
+    for (auto &x : f) x = {2 * u(rng) - 1, 2 * u(rng) - 1};
+    taus.push_back(tau);
+    values.push_back(f);
+  }
+
+  // Two series of points, with a flush after each, the second one with one function at a time
+  nfft_batch_t<Rank> batch(dims, n_functions, out.data());
+  for (int j = 0; j < n_points / 2; ++j) batch.push_back(taus[j], 0, 1, values[j].data(), n_functions);
+  batch.flush();
+  for (int j = n_points / 2; j < n_points; ++j)
+    for (long c = 0; c < n_functions; ++c) batch.push_back(taus[j], c, values[j][c]);
+  batch.flush();
+
+  double norm = 0;
+  for (int j = 0; j < n_points; ++j)
+    for (long c = 0; c < n_functions; ++c) norm += std::abs(values[j][c]);
+  for (long i = 0; i < n_freq; ++i) {
+    std::array<long, Rank> d;
+    if constexpr (Rank == 1)
+      d = {i};
+    else
+      d = {i / dims[1].size, i % dims[1].size};
+    for (int j = 0; j < n_points; ++j) {
+      double phase = 0;
+      for (int r = 0; r < Rank; ++r) phase += omega(dims[r], d[r]) * taus[j][r];
+      for (long c = 0; c < n_functions; ++c) direct[i * n_functions + c] += values[j][c] * std::polar(1.0, phase);
+    }
+  }
+  for (long k = 0; k < n_freq * n_functions; ++k) EXPECT_NEAR(std::abs(out[k] - direct[k]) / norm, 0, 1e-9);
+}
+
+TEST(NfftBatch, Fermion) { check_against_direct_sum<1>({nfft_mesh_dim_t{10.0, true, -30, 60}}, 3, 200); }
+
+TEST(NfftBatch, Boson) { check_against_direct_sum<1>({nfft_mesh_dim_t{5.0, false, -7, 15}}, 2, 150); }
+
+TEST(NfftBatch, BosonFermion) { check_against_direct_sum<2>({nfft_mesh_dim_t{10.0, false, -4, 9}, nfft_mesh_dim_t{10.0, true, -10, 20}}, 4, 100); }
+
+MAKE_MAIN;
@@ -0,0 +1,35 @@
+import numpy as np
+import pytriqs.utility.mpi as mpi
+from pytriqs.gf import *
+from pytriqs.operators import *
+
+from triqs_cthyb import *
+
+# The direct NFFT measurement of G(iw) (measure_G_iw_nfft), against the Fourier transform of G_tau
+# accumulated on the same Markov chain. With a fine tau mesh the binning of G_tau is negligible
+# at the first Matsubara frequencies.
+
+beta = 10.0
+U = 2.0
+mu = 1.0
+V = 1.0
+epsilon = 1.3
+n_check = 10
+
+gf_struct = [['up',[0]], ['down',[0]]]
+H = U*n("up",0)*n("down",0)
+
+S = Solver(beta=beta, gf_struct=gf_struct, n_iw=100, n_tau=20001)
+for name, g0 in S.G0_iw:
+    g0 << inverse(iOmega_n + mu - V**2 * inverse(iOmega_n - epsilon) - V**2 * inverse(iOmega_n + epsilon))
+
+S.solve(h_int=H, max_time=-1, random_name="", random_seed=123 * mpi.rank + 567,
+        length_cycle=50, n_warmup_cycles=1000, n_cycles=20000,
+        measure_G_tau=True, measure_G_iw_nfft=True, perform_tail_fit=False)
+
+if mpi.is_master_node():
+    for name, g in S.G_iw_nfft:
+        n0 = len(g.mesh) / 2
+        nfft = g.data[n0:n0 + n_check]
+        fourier = S.G_iw_raw[name].data[n0:n0 + n_check]
+        assert np.max(np.abs(nfft - fourier)) < 1e-3, "G_iw_nfft differs from the Fourier transform of G_tau in block " + name
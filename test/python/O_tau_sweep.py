@@ -0,0 +1,55 @@
+"""
+Sampling of the density density correlator by operator insertion,
+with the sweep of op2 over the tau mesh (measure_O_tau_sweep).
+
+In the atomic limit (no hybridization) the configuration stays empty,
+so that each sweep is exact: O_tau is the exact <n_up(tau) n_do(0)>
+of the Hubbard atom at all tau, up to rounding. """
+
+# ----------------------------------------------------------------------
+
+import numpy as np
+
+# ----------------------------------------------------------------------
+
+from pytriqs.gf import *
+from pytriqs.operators import *
+import pytriqs.utility.mpi as mpi
+
+# ----------------------------------------------------------------------
+
+from triqs_cthyb import Solver
+
+# ----------------------------------------------------------------------
+if __name__ == '__main__':
+
+    beta = 2.1
+    U = 5.0
+    mu = 2.0
+
+    solv = Solver(
+        beta = beta,
+        gf_struct = [['up',[0]],['do',[0]]],
+        n_iw = 30,
+        n_tau = 2*30+1,
+        )
+
+    solv.G0_iw << inverse(iOmega_n + mu)
+
+    solv.solve(
+        h_int = U*n('up',0)*n('do',0),
+        random_seed = 123 * mpi.rank + 567,
+        length_cycle = 20,
+        n_warmup_cycles = 100,
+        n_cycles = 1000,
+        measure_O_tau = (n('up',0), n('do',0)),
+        measure_O_tau_sweep = True,
+        )
+
+    # n_up and n_do commute with h_loc: the correlator is the static <n_up n_do>
+    E = np.array([0., -mu, -mu, U - 2*mu])
+    w = np.exp(-beta * E)
+    exact = w[3] / np.sum(w)
+
+    if mpi.is_master_node():
+        assert np.max(np.abs(solv.O_tau.data - exact)) < 1e-10, "O_tau: the sweep differs from the exact atomic value"
@@ -0,0 +1,36 @@
+import pytriqs.utility.mpi as mpi
+from pytriqs.gf import *
+from pytriqs.operators import *
+from pytriqs.utility.comparison_tests import *
+
+from triqs_cthyb import *
+
+# The measures deferred to the changes of the configuration (defer_measures) accumulate the same
+# G_tau and G_l as the measures at every cycle, on the same Markov chain (same random numbers)
+
+beta = 10.0
+U = 2.0
+mu = 1.0
+V = 1.0
+epsilon = 1.3
+
+gf_struct = [['up',[0]], ['down',[0]]]
+H = U*n("up",0)*n("down",0)
+
+def run(defer):
+    S = Solver(beta=beta, gf_struct=gf_struct, n_iw=300, n_tau=1001, n_l=30)
+    for name, g0 in S.G0_iw:
+        g0 << inverse(iOmega_n + mu - V**2 * inverse(iOmega_n - epsilon) - V**2 * inverse(iOmega_n + epsilon))
+    # short cycles: many cycles see the same configuration, most of them after a rejected move
+    S.solve(h_int=H, max_time=-1, random_name="", random_seed=123 * mpi.rank + 567,
+            length_cycle=5, n_warmup_cycles=1000, n_cycles=20000,
+            measure_G_tau=True, measure_G_l=True, move_double=False, defer_measures=defer)
+    return S.G_tau.copy(), S.G_l.copy(), S.average_sign
+
+G_tau, G_l, sign = run(False)
+G_tau_deferred, G_l_deferred, sign_deferred = run(True)
+
+if mpi.is_master_node():
+    assert_block_gfs_are_close(G_tau, G_tau_deferred, precision=1e-10)
+    assert_block_gfs_are_close(G_l, G_l_deferred, precision=1e-10)
+    assert abs(sign - sign_deferred) < 1e-12
@@ -0,0 +1,31 @@
+import numpy as np
+import pytriqs.utility.mpi as mpi
+from pytriqs.gf import *
+from pytriqs.operators import *
+from triqs_cthyb import *
+from pytriqs.utility.comparison_tests import *
+
+# The adaptive interval between the checks of M^-1 (det_adaptive_check) only changes when the inverses are
+# recomputed from scratch: on the same Markov chain, the results agree with the checks at a fixed interval
+# up to the rounding errors. A single band is enough: the checks only see the det of each block
+
+beta = 10.0
+U = 2.0
+mu = 1.0
+V = 1.0
+epsilon = 2.3
+
+def run(adaptive):
+    S = Solver(beta=beta, gf_struct=[['up',[0]],['down',[0]]], n_iw=1025, n_tau=1001)
+    S.G0_iw << inverse(iOmega_n + mu - V**2 * (inverse(iOmega_n - epsilon) + inverse(iOmega_n + epsilon)))
+    S.solve(h_int=U*n('up',0)*n('down',0), max_time=-1, random_name="", random_seed=123 * mpi.rank + 567,
+            length_cycle=50, n_warmup_cycles=500, n_cycles=5000, move_double=False,
+            det_n_operations_before_check=10, det_adaptive_check=adaptive)
+    return S.G_tau.copy(), S.average_sign
+
+G_tau, sign = run(False)
+G_tau_adaptive, sign_adaptive = run(True)
+
+if mpi.is_master_node():
+    assert_block_gfs_are_close(G_tau, G_tau_adaptive, precision=1e-8)
+    assert abs(sign - sign_adaptive) < 1e-10
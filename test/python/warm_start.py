@@ -0,0 +1,40 @@
+import pytriqs.utility.mpi as mpi
+from pytriqs.gf import *
+from pytriqs.operators import *
+from pytriqs.utility.comparison_tests import *
+
+from triqs_cthyb import *
+
+# A warm start from the configuration kept by the solver, and one from the configuration written to
+# configuration_file, start the same Markov chain: with the same seed, they give the same results
+
+beta = 10.0
+U = 2.0
+mu = 1.0
+V = 1.0
+epsilon = 1.3
+
+gf_struct = [['up',[0]], ['down',[0]]]
+H = U*n("up",0)*n("down",0)
+
+def make_solver():
+    S = Solver(beta=beta, gf_struct=gf_struct, n_iw=300, n_tau=1001)
+    for name, g0 in S.G0_iw:
+        g0 << inverse(iOmega_n + mu - V**2 * inverse(iOmega_n - epsilon) - V**2 * inverse(iOmega_n + epsilon))
+    return S
+
+p = dict(h_int=H, max_time=-1, random_name="", length_cycle=50, n_warmup_cycles=1000, n_cycles=5000)
+
+# A first run, whose final configurations are kept by S and written to the files
+S = make_solver()
+S.solve(random_seed=123 * mpi.rank + 567, configuration_file="warm_start_test", **p)
+
+# No warmup after the warm starts, so that the results depend on the starting configuration
+p.update(random_seed=321 * mpi.rank + 765, warm_start=True, n_warmup_cycles_warm_start=0)
+S.solve(**p)
+S_file = make_solver()
+S_file.solve(configuration_file="warm_start_test", **p)
+
+if mpi.is_master_node():
+    assert_block_gfs_are_close(S.G_tau, S_file.G_tau, precision=1e-12)
+    assert abs(S.average_sign - S_file.average_sign) < 1e-12